@@ -290,9 +290,11 @@ def emulate(fname, path_emulate):
             #compare outputs
             if expected_out_no_spaces == actual_out_no_spaces:
                 results = 'CORRECT'
+                diff = None
             else:
                 results = 'INCORRECT'
-            return [error, results, expected_out, actual_out]
+                diff = state_diff(path_emulate, path_expected_out, path_actual_out)
+            return [error, results, expected_out, actual_out, diff]
 
 '''
 Function to actually execute assembler 
@@ -315,6 +317,23 @@ def execute_emulate(fname, path_emulate, path_bin, path_actual_out):
             else:
                 return e
 
+'''
+Function to find where the produced output differs from the expected one
+Runs statediff, built next to emulate, on the two outputs
+Returns its output as a list of lines, or None if it wasn't built or can't read them
+This function is called from emulate()
+'''
+def state_diff(path_emulate, path_expected_out, path_actual_out):
+    path_statediff = os.path.join(os.path.dirname(path_emulate), 'statediff')
+    if os.path.exists(path_statediff) == False:
+        return None
+    command = [path_statediff, path_expected_out, path_actual_out]
+    result = subprocess.run(command, capture_output=True, text=True)
+    #statediff exits with 1 if the states differ, and 2 if either can't be read
+    if result.returncode != 1:
+        return None
+    return result.stdout.splitlines()
+
 #function to read a file into a list
 def read_output(path):
     with open(path) as f:
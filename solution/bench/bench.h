@@ -0,0 +1,51 @@
+/**
+ * @file bench.h
+ * @brief What the benchmarks share: a clock, a random number generator,
+ * and a loop over the implementations of a `*_use_impl` function.
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "utils/clock.h"
+
+/// @brief The seed of every benchmark's random numbers, so each run sees the same ones.
+#define BENCH_SEED 0x9e3779b97f4a7c15
+
+/// @brief Steps the generator `*x` and returns its new state, of which the high bits are the most random.
+static inline
+uint64_t lcg_next(uint64_t *x) {
+    *x = *x * 6364136223846793005 + 1442695040888963407 ;
+    return *x ;
+}
+
+__attribute__((unused))
+static uint64_t bench_x = BENCH_SEED ;
+
+/// @brief The next 48 bits of the benchmark's own generator.
+static inline
+uint64_t next(void) {
+    return lcg_next(&bench_x) >> 16 ;
+}
+
+/// @brief The number of implementations of each `*_use_impl` function: a portable one, then a vector one.
+#define BENCH_N_IMPLS 2
+
+/// @brief The names of the implementations of those with a scalar fallback and an AVX2 one.
+__attribute__((unused))
+static const char *const impl_names[BENCH_N_IMPLS] = {"scalar", "avx2"} ;
+
+/**
+ * @brief Loops `impl` over the implementations `use_impl` takes, named in
+ * `names`, running the statement that follows under each the CPU can run,
+ * and printing, after `what`, those it can't.
+ */
+#define FOR_EACH_IMPL(impl, use_impl, names, what) \
+    for (int impl = 0; impl < BENCH_N_IMPLS; impl++) \
+        if (!use_impl(impl)) printf("%s %-6s: not supported by this CPU\n", what, names[impl]) ; else
+
+#endif
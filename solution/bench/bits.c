@@ -0,0 +1,124 @@
+/**
+ * @file bits.c
+ * @brief Checks the field helpers and PEXT/PDEP helpers against plain shifts and masks, and times them.
+ *
+ * `bits_at` is checked on every (high, low) field layout, and `set_bit_at`
+ * and `set_bits_at` on every bit and every shift, each against the shifts
+ * and masks they stand for, over 2^16 random words: all of the layouts,
+ * but only a sample of the words. `bits_extract` and `bits_deposit` are
+ * checked against each other, under each implementation the CPU can run,
+ * on the operand bits of every instruction table entry. Then `bits_at`,
+ * the `enc_instr` decoder built on it, and `bits_extract` are timed.
+ */
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "common/instr_table.h"
+#include "emulator/decoder/decode.h"
+#include "utils/bits.h"
+
+#define N_WORDS (1 << 16)
+#define N_CALLS 100000000
+#define N_DECODES 20000000
+#define N_EXTRACTS 10000000
+
+static word32_t words[N_WORDS] ;
+/// @brief Instances of random instruction table entries, for the decoder.
+static word32_t instrs[N_WORDS] ;
+
+/// @brief Where the timed `bits_at` calls are summed, so they aren't optimised away.
+uint64_t sink ;
+
+static const char *const bits_impl_names[] = {
+    [BITS_IMPL_PORTABLE] = "portable",
+    [BITS_IMPL_BMI2] = "bmi2",
+} ;
+
+/// @brief The number of results of the field helpers that differ from shifts and masks.
+static uint64_t check_fields(void) {
+    uint64_t bad = 0 ;
+    for (size_t k = 0; k < N_WORDS; k++) {
+        word32_t c = words[k], v = words[(k * 7 + 1) % N_WORDS] ;
+        for (int hi = 0; hi < 32; hi++) {
+            for (int lo = 0; lo <= hi; lo++) {
+                bad += bits_at(c, hi, lo) != ((c >> lo) & BIT_MASK(hi - lo + 1)) ;
+            }
+            word32_t d = c ;
+            set_bits_at(&d, hi, v) ;
+            bad += d != (c | (v << hi)) ;
+            for (int b = 0; b < 2; b++) {
+                d = c ;
+                set_bit_at(&d, hi, b) ;
+                bad += d != ((c & ~(1u << hi)) | ((word32_t) b << hi)) ;
+            }
+        }
+    }
+    return bad ;
+}
+
+/// @brief The number of results of the current `bits_extract` and `bits_deposit` that are wrong.
+static uint64_t check_ops(void) {
+    uint64_t bad = 0 ;
+    for (size_t k = 0; k < N_WORDS; k++) {
+        word32_t c = words[k], v = words[(k * 7 + 1) % N_WORDS] ;
+        for (size_t e = 0; e < INSTR_COUNT; e++) {
+            word32_t operands = ~instr_info[e].mask ;
+            bad += bits_deposit(bits_extract(c, operands), operands) != (c & operands) ;
+            bad += bits_extract(c, BIT_MASK(16) << 8) != ((c >> 8) & BIT_MASK(16)) ;
+            bad += bits_deposit(v, BIT_MASK(16) << 8) != ((v & BIT_MASK(16)) << 8) ;
+        }
+    }
+    return bad ;
+}
+
+int main(void) {
+    uint64_t x = BENCH_SEED ;
+    instr_t i ;
+    for (size_t k = 0; k < N_WORDS; k++) words[k] = lcg_next(&x) >> 32 ;
+    for (size_t k = 0; k < N_WORDS; ) {
+        lcg_next(&x) ;
+        const instr_info_t *e = &instr_info[(x >> 56) % INSTR_COUNT] ;
+        instrs[k] = e->value | ((x >> 16) & ~e->mask) ;
+        if (instr_decode(&i, instrs[k], 0)) k++ ;
+    }
+
+    uint64_t bad = check_fields() ;
+
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    uint64_t sum = 0 ;
+    for (uint64_t k = 0; k < N_CALLS; k++) {
+        sum += bits_at(words[k % N_WORDS], 20 + k % 8, k % 16) ;
+    }
+    double at_secs = seconds_since(&start) ;
+
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (uint64_t k = 0; k < N_DECODES; k++) {
+        sum += decode_word_enc(&i, instrs[k % N_WORDS], k * 4) ;
+    }
+    double dec_secs = seconds_since(&start) ;
+    sink = sum ;
+    printf("bits inline  : bits_at %.1f M calls/s, enc_instr decoder %.1f M decodes/s\n",
+        N_CALLS / at_secs / 1e6, N_DECODES / dec_secs / 1e6) ;
+
+    uint64_t sums[BENCH_N_IMPLS] = {0} ;
+    bool ran[BENCH_N_IMPLS] = {false} ;
+    FOR_EACH_IMPL(n, bits_use_impl, bits_impl_names, "bits") {
+        ran[n] = true ;
+        bad += check_ops() ;
+
+        clock_gettime(CLOCK_MONOTONIC, &start) ;
+        for (uint64_t k = 0; k < N_EXTRACTS; k++) {
+            sums[n] += bits_extract(words[k % N_WORDS], ~instr_info[k % INSTR_COUNT].mask) ;
+        }
+        double secs = seconds_since(&start) ;
+        printf("bits %-8s: bits_extract %.1f M calls/s\n", bits_impl_names[n], N_EXTRACTS / secs / 1e6) ;
+    }
+
+    if (bad || (ran[0] && ran[1] && sums[0] != sums[1])) {
+        fprintf(stderr, "bits: %lu results differ from shifts and masks\n", (unsigned long) bad) ;
+        return 1 ;
+    }
+    return 0 ;
+}
@@ -0,0 +1,15 @@
+// A compare-heavy loop: most flag results are overwritten unread.
+movz x3, #0x8, lsl #16
+loop:
+cmp x1, x2
+add x1, x1, #1
+cmp x1, #100
+b.lt small
+movz x1, #0
+small:
+cmn x2, x1
+add x2, x2, #3
+cmp x2, x1
+subs x3, x3, #1
+b.ne loop
+and x0, x0, x0
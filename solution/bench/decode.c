@@ -0,0 +1,73 @@
+/**
+ * @file decode.c
+ * @brief Decodes per second, through `enc_instr`, the instruction table and the memo.
+ *
+ * Decodes the same stream of words, made by filling the free bits of random
+ * instruction table entries, skipping those that don't decode, with
+ *  - `decode_word_enc`, the old decoder going through the bitfields of
+ *    `enc_instr` and `bits_at`,
+ *  - `instr_decode`, which looks the word's opcode bits up and decodes it
+ *    straight to an `instr_t`,
+ *  - `decode_word`, which after the first pass over the words finds each
+ *    of them in the decode memo.
+ */
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "common/instr_table.h"
+#include "emulator/decoder/decode.h"
+
+#define N_WORDS 4096
+#define N_DECODES 50000000
+
+static word32_t words[N_WORDS] ;
+
+int main(void) {
+    uint64_t x = BENCH_SEED ;
+    instr_t i ;
+    for (size_t k = 0; k < N_WORDS; ) {
+        lcg_next(&x) ;
+        const instr_info_t *e = &instr_info[(x >> 56) % INSTR_COUNT] ;
+        words[k] = e->value | ((x >> 16) & ~e->mask) ;
+        // Skip reserved fields, e.g. bitmask immediates of all ones
+        if (instr_decode(&i, words[k], 0)) k++ ;
+    }
+
+    struct timespec start ;
+    uint64_t sum = 0 ;
+
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (uint64_t n = 0; n < N_DECODES; n++) {
+        sum += decode_word_enc(&i, words[n % N_WORDS], n * 4) ;
+        sum += i.tp ;
+    }
+    double enc_secs = seconds_since(&start) ;
+    uint64_t enc_sum = sum ;
+
+    sum = 0 ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (uint64_t n = 0; n < N_DECODES; n++) {
+        sum += instr_decode(&i, words[n % N_WORDS], n * 4) ;
+        sum += i.tp ;
+    }
+    double table_secs = seconds_since(&start) ;
+    uint64_t table_sum = sum ;
+
+    sum = 0 ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (uint64_t n = 0; n < N_DECODES; n++) {
+        sum += decode_word(&i, words[n % N_WORDS], n * 4) ;
+        sum += i.tp ;
+    }
+    double memo_secs = seconds_since(&start) ;
+
+    if (table_sum != enc_sum || sum != enc_sum) {
+        fprintf(stderr, "decode: the decoders disagree\n") ;
+        return 1 ;
+    }
+    printf("enc_instr decoder: %.1f M decodes/s\n", N_DECODES / enc_secs / 1e6) ;
+    printf("table decoder:     %.1f M decodes/s (%.2fx)\n", N_DECODES / table_secs / 1e6, enc_secs / table_secs) ;
+    printf("decode memo:       %.1f M decodes/s (%.2fx)\n", N_DECODES / memo_secs / 1e6, enc_secs / memo_secs) ;
+    return 0 ;
+}
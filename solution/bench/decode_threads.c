@@ -0,0 +1,76 @@
+/**
+ * @file decode_threads.c
+ * @brief Decodes per second on 1 to `N_THREADS` threads at once.
+ *
+ * Each thread decodes the same stream of random words, valid or not, with
+ * `decode_word_enc` and `instr_decode`, which keep no state between calls
+ * and build their tables once, on whichever thread gets there first, and
+ * with `decode_word`, whose decode memo all the threads fill and read at
+ * once. Every thread must come to the same sums as a lone thread, and the
+ * rate should grow with the threads.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "common/instr_table.h"
+#include "emulator/decoder/decode.h"
+#include "emulator/decoder/decode_memo.h"
+
+#define N_THREADS 4
+#define N_DECODES 10000000
+
+typedef struct {
+    uint64_t enc_sum ;
+    uint64_t table_sum ;
+    uint64_t memo_sum ;
+}   sums_t ;
+
+/// @brief Sums the decodes into `arg` once done, the threads' sums sharing a cache line.
+static void *decode_stream(void *arg) {
+    sums_t sums = {0} ;
+    uint64_t x = BENCH_SEED ;
+    instr_t i ;
+    for (uint64_t n = 0; n < N_DECODES; n++) {
+        word32_t w = lcg_next(&x) >> 32 ;
+        if (decode_word_enc(&i, w, n * 4)) sums.enc_sum += 1 + i.tp ;
+        if (instr_decode(&i, w, n * 4)) sums.table_sum += 1 + i.tp ;
+        if (decode_word(&i, w, n * 4)) sums.memo_sum += 1 + i.tp ;
+    }
+    *(sums_t *) arg = sums ;
+    return NULL ;
+}
+
+int main(void) {
+    sums_t sums[N_THREADS] ;
+    pthread_t threads[N_THREADS] ;
+    double one_rate = 0 ;
+
+    for (int n_threads = 1; n_threads <= N_THREADS; n_threads *= 2) {
+        free_decode_memo() ;
+        struct timespec start ;
+        clock_gettime(CLOCK_MONOTONIC, &start) ;
+        for (int t = 0; t < n_threads; t++) {
+            sums[t] = (sums_t) {0} ;
+            if (pthread_create(&threads[t], NULL, decode_stream, &sums[t])) {
+                fprintf(stderr, "decode_threads: can't create a thread\n") ;
+                return 1 ;
+            }
+        }
+        for (int t = 0; t < n_threads; t++) pthread_join(threads[t], NULL) ;
+        double secs = seconds_since(&start) ;
+
+        for (int t = 0; t < n_threads; t++) {
+            if (sums[t].enc_sum != sums[0].enc_sum || sums[t].table_sum != sums[0].table_sum
+                || sums[t].memo_sum != sums[0].table_sum) {
+                fprintf(stderr, "decode_threads: thread %d disagrees with thread 0\n", t) ;
+                return 1 ;
+            }
+        }
+        double rate = 3.0 * N_DECODES * n_threads / secs / 1e6 ;
+        if (n_threads == 1) one_rate = rate ;
+        printf("%d thread%s: %.1f M decodes/s (%.2fx)\n", n_threads, n_threads == 1 ? " " : "s", rate, rate / one_rate) ;
+    }
+    return 0 ;
+}
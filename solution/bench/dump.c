@@ -0,0 +1,173 @@
+/**
+ * @file dump.c
+ * @brief Finding the non-zero words of memory for the final dump.
+ *
+ * Checks that each implementation of `dump_nonzero_words` the CPU can run
+ * finds the same words as a word-by-word scan, over pages from empty to
+ * full, and times them. Then times the dump of a 1 GiB memory of each
+ * backend with a few words stored, against scanning every page of it, and
+ * checks the dump of 2 MiB of non-zero words is byte for byte what a
+ * `fprintf` a line prints, timing both.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "emulator/dump.h"
+#include "emulator/alu.h"
+#include "emulator/loader.h"
+
+#define N_PAGES 256
+#define PAGE_WORDS (MEMORY_PAGE_BYTES / 4)
+#define N_SCANS 20
+#define MEMORY_SIZE ((size_t) 1 << 30)
+#define N_STORES 64
+#define FULL_SIZE (2 * 1024 * 1024)
+
+/// @brief Times the dump of a memory of `backend` with `N_STORES` words stored across it.
+static double time_dump(memory_backend_t backend, FILE *out) {
+    memory_config_t config = {.size = MEMORY_SIZE, .backend = backend} ;
+    cpu_t *cpu = init_cpu_config(&config) ;
+    for (size_t k = 0; k < N_STORES; k++) set_dword(cpu, k * (MEMORY_SIZE / N_STORES) + 8 * k, k + 1) ;
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    f_dump_mem(out, cpu, 0, 0, 0) ;
+    double secs = seconds_since(&start) ;
+    free_cpu(cpu) ;
+    return secs ;
+}
+
+/// @brief The dump of `cpu` as printed a line at a time, before `outbuf.h`.
+static void fprintf_dump(FILE *out, cpu_t *cpu) {
+    fprintf(out, "Registers:\n") ;
+    for (reg_e rn = R0; rn <= R30; rn++)
+        fprintf(out, "X%02d    = %016lx\n", rn, cpu->regs[rn]) ;
+    fprintf(out, "PC     = %016lx\n", cpu->pc) ;
+    fprintf(out, "PSTATE : %s%s%s%s\n", flag_n(&cpu->pstate) ? "N" : "-", flag_z(&cpu->pstate) ? "Z" : "-",
+            flag_c(&cpu->pstate) ? "C" : "-", flag_v(&cpu->pstate) ? "V" : "-") ;
+    fprintf(out, "Non-zero memory:\n") ;
+    memory_block_t *blocks[] = {cpu->memory->memory, cpu->memory->IO} ;
+    for (size_t k = 0; k < 2; k++) {
+        for (address_t i = blocks[k]->start; i < blocks[k]->start + blocks[k]->size; i += 4) {
+            uint32_t w = get_le_word_from_block(blocks[k], i) ;
+            if (w) fprintf(out, "0x%08lx : 0x%08x\n", i, w) ;
+        }
+    }
+}
+
+/// @brief The contents of `f`, of which there are `*len` bytes.
+static char *slurp(FILE *f, long *len) {
+    fflush(f) ;
+    *len = ftell(f) ;
+    char *s = malloc(*len) ;
+    rewind(f) ;
+    if (!s || fread(s, 1, *len, f) != (size_t) *len) return NULL ;
+    return s ;
+}
+
+/// @brief Compares the dump of a memory full of non-zero words with `fprintf_dump`'s.
+static bool check_full_dump(void) {
+    cpu_t *cpu = init_cpu(FULL_SIZE) ;
+    for (address_t i = 0; i < FULL_SIZE; i += 8) set_dword(cpu, i, i * 0x9e3779b97f4a7c15 | 1) ;
+    for (reg_e rn = R0; rn <= R30; rn++) cpu->regs[rn] = (uint64_t) rn << (2 * rn) ;
+    FILE *a = tmpfile() ;
+    FILE *b = tmpfile() ;
+    if (!a || !b) return false ;
+
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    fprintf_dump(a, cpu) ;
+    fflush(a) ;
+    double fprintf_secs = seconds_since(&start) ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    f_dump_cpu(b, cpu) ;
+    f_dump_mem(b, cpu, 0, 0, 0) ;
+    double outbuf_secs = seconds_since(&start) ;
+
+    // The stream's offset is stale after the writes to its descriptor
+    fseek(b, 0, SEEK_END) ;
+    long len_a, len_b ;
+    char *sa = slurp(a, &len_a) ;
+    char *sb = slurp(b, &len_b) ;
+    bool same = sa && sb && len_a == len_b && memcmp(sa, sb, len_a) == 0 ;
+    printf("dump of %ld bytes: fprintf %.1f ms, outbuf %.1f ms\n", len_a, fprintf_secs * 1e3, outbuf_secs * 1e3) ;
+    free(sa) ;
+    free(sb) ;
+    fclose(a) ;
+    fclose(b) ;
+    free_cpu(cpu) ;
+    return same ;
+}
+
+int main(void) {
+    static word32_t words[N_PAGES * PAGE_WORDS] ;
+    uint64_t x = BENCH_SEED ;
+    for (size_t p = 0; p < N_PAGES; p++) {
+        // One page in 256 non-zero words, through to every word non-zero
+        for (size_t k = 0; k < PAGE_WORDS; k++) {
+            lcg_next(&x) ;
+            words[p * PAGE_WORDS + k] = (x >> 56) < p ? (word32_t) (x >> 16) | 1 : 0 ;
+        }
+    }
+    // The words as stored, on a little-endian host
+    const uint8_t *bytes = (const uint8_t *) words ;
+
+    static uint16_t expected[N_PAGES][PAGE_WORDS] ;
+    static size_t n_expected[N_PAGES] ;
+    for (size_t p = 0; p < N_PAGES; p++) {
+        for (size_t k = 0; k < PAGE_WORDS; k++)
+            if (dump_le_word(bytes + 4 * (p * PAGE_WORDS + k))) expected[p][n_expected[p]++] = k ;
+    }
+
+    FOR_EACH_IMPL(n, dump_use_impl, impl_names, "scan") {
+        static uint16_t idx[PAGE_WORDS] ;
+        for (size_t p = 0; p < N_PAGES; p++) {
+            // An odd number of words, to take the tails too
+            size_t n_words = p % 2 ? PAGE_WORDS - 3 : PAGE_WORDS ;
+            size_t want = 0 ;
+            while (want < n_expected[p] && expected[p][want] < n_words) want++ ;
+            size_t got = dump_nonzero_words(bytes + p * MEMORY_PAGE_BYTES, n_words, idx) ;
+            if (got != want || memcmp(idx, expected[p], got * sizeof(uint16_t)) != 0) {
+                fprintf(stderr, "dump: %s finds the wrong words in page %zu\n", impl_names[n], p) ;
+                return 1 ;
+            }
+        }
+        struct timespec start ;
+        clock_gettime(CLOCK_MONOTONIC, &start) ;
+        size_t found = 0 ;
+        for (int r = 0; r < N_SCANS; r++) {
+            for (size_t p = 0; p < N_PAGES; p++)
+                found += dump_nonzero_words(bytes + p * MEMORY_PAGE_BYTES, PAGE_WORDS, idx) ;
+        }
+        double secs = seconds_since(&start) / N_SCANS ;
+        printf("scan %-6s: %.3f ms, %.0f M words/s (%zu found)\n",
+            impl_names[n], secs * 1e3, N_PAGES * PAGE_WORDS / secs / 1e6, found / N_SCANS) ;
+    }
+    dump_use_impl(DUMP_IMPL_AVX2) ;
+
+    FILE *out = fopen("/dev/null", "w") ;
+    if (!out) return 1 ;
+    printf("dump, heap: %.3f ms\n", time_dump(MEMORY_HEAP, out) * 1e3) ;
+    printf("dump, mmu:  %.3f ms\n", time_dump(MEMORY_MMU, out) * 1e3) ;
+
+    // What the dump would cost scanning every page, not just the dirty ones
+    memory_config_t config = {.size = MEMORY_SIZE, .backend = MEMORY_MMU} ;
+    cpu_t *cpu = init_cpu_config(&config) ;
+    static uint16_t idx[PAGE_WORDS] ;
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    size_t found = 0 ;
+    for (address_t page = 0; page < MEMORY_SIZE; page += MEMORY_PAGE_BYTES)
+        found += dump_nonzero_words(block_page(cpu->memory->memory, page), PAGE_WORDS, idx) ;
+    printf("every page, mmu: %.1f ms (%zu found)\n", seconds_since(&start) * 1e3, found) ;
+    free_cpu(cpu) ;
+    fclose(out) ;
+
+    if (!check_full_dump()) {
+        fprintf(stderr, "dump: the buffered dump differs from fprintf's\n") ;
+        return 1 ;
+    }
+    return 0 ;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file fingerprint.c
+ * @brief Fingerprinting the state of a 2 MiB memory, whole and incrementally.
+ *
+ * Checks that each implementation of the page hash the CPU can run agrees,
+ * then stores random words in batches, fingerprinting after each, and
+ * checks every fingerprint against that of a fresh cpu of the other memory
+ * backend holding the same words, and that zeroing a page restores the
+ * fingerprint of never having written it. Times the first fingerprint of
+ * a memory written all over, and those after a store.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "emulator/fingerprint.h"
+#include "emulator/loader.h"
+
+#define MEMORY_SIZE (2 * 1024 * 1024)
+#define N_PAGES 64
+#define PAGE_WORDS (MEMORY_PAGE_BYTES / 4)
+#define N_BATCHES 50
+#define BATCH 200
+#define N_REPEATS 1000
+
+static cpu_t *new_cpu(memory_backend_t backend) {
+    memory_config_t config = {.size = MEMORY_SIZE, .backend = backend} ;
+    return init_cpu_config(&config) ;
+}
+
+/// @brief A fresh cpu of `backend` holding the non-zero words of `cpu`.
+static cpu_t *copy_cpu(cpu_t *cpu, memory_backend_t backend) {
+    cpu_t *copy = new_cpu(backend) ;
+    state_t s ;
+    cpu_state(cpu, &s) ;
+    for (size_t k = 0; k < s.n_words; k++) store_le_word(copy->memory, s.addresses[k], s.words[k]) ;
+    state_free(&s) ;
+    return copy ;
+}
+
+static bool check_pages(void) {
+    static word32_t words[N_PAGES][PAGE_WORDS] ;
+    for (size_t p = 0; p < N_PAGES; p++)
+        for (size_t k = 0; k < PAGE_WORDS; k++) words[p][k] = next() % 4 ? next() : 0 ;
+    static uint64_t hashes[BENCH_N_IMPLS][N_PAGES][2] ;
+    bool ran[BENCH_N_IMPLS] = {false} ;
+    FOR_EACH_IMPL(n, fingerprint_use_impl, impl_names, "hash") {
+        ran[n] = true ;
+        // Odd numbers of words too, to take the tails
+        for (size_t p = 0; p < N_PAGES; p++)
+            fingerprint_page((const uint8_t *) words[p], PAGE_WORDS - p % 5, 4096 * p, hashes[n][p]) ;
+        struct timespec start ;
+        clock_gettime(CLOCK_MONOTONIC, &start) ;
+        uint64_t h[2] ;
+        for (int r = 0; r < N_REPEATS / 10; r++)
+            for (size_t p = 0; p < N_PAGES; p++) fingerprint_page((const uint8_t *) words[p], PAGE_WORDS, 0, h) ;
+        double secs = seconds_since(&start) / (N_REPEATS / 10) ;
+        printf("hash %-6s: %.0f MB/s\n", impl_names[n], N_PAGES * MEMORY_PAGE_BYTES / secs / 1e6) ;
+    }
+    fingerprint_use_impl(FINGERPRINT_IMPL_AVX2) ;
+    return !(ran[0] && ran[1]) || memcmp(hashes[0], hashes[1], sizeof(hashes[0])) == 0 ;
+}
+
+static bool check_incremental(memory_backend_t backend, memory_backend_t other) {
+    cpu_t *cpu = new_cpu(backend) ;
+    for (size_t b = 0; b < N_BATCHES; b++) {
+        for (size_t k = 0; k < BATCH; k++) {
+            // Mostly in a few pages, as programs store
+            address_t a = (next() % (b % 2 ? 16 * MEMORY_PAGE_BYTES : MEMORY_SIZE - 8)) & ~(address_t) 3 ;
+            // A load maps the page for the store to hit the TLB
+            if (k % 2) get_dword(cpu, a) ;
+            set_dword(cpu, a, next() % 3 ? next() : 0) ;
+        }
+        cpu_t *copy = copy_cpu(cpu, other) ;
+        bool same = fingerprint_equal(cpu_fingerprint(cpu), cpu_fingerprint(copy)) ;
+        free_cpu(copy) ;
+        if (!same) {
+            free_cpu(cpu) ;
+            return false ;
+        }
+    }
+    // Zeroing every page written to leaves the fingerprint of an empty memory
+    for (address_t a = 0; a < MEMORY_SIZE; a += 8) set_dword(cpu, a, 0) ;
+    cpu_t *empty = new_cpu(other) ;
+    bool same = fingerprint_equal(cpu_fingerprint(cpu), cpu_fingerprint(empty)) ;
+    free_cpu(empty) ;
+    free_cpu(cpu) ;
+    return same ;
+}
+
+int main(void) {
+    if (!check_pages()) {
+        fprintf(stderr, "fingerprint: the page hashes disagree\n") ;
+        return 1 ;
+    }
+    if (!check_incremental(MEMORY_HEAP, MEMORY_MMU) || !check_incremental(MEMORY_MMU, MEMORY_HEAP)) {
+        fprintf(stderr, "fingerprint: an incremental fingerprint differs from a fresh one\n") ;
+        return 1 ;
+    }
+
+    cpu_t *cpu = new_cpu(MEMORY_HEAP) ;
+    for (address_t a = 0; a < MEMORY_SIZE; a += 8) set_dword(cpu, a, next() | 1) ;
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    cpu_fingerprint(cpu) ;
+    double whole_secs = seconds_since(&start) ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (int r = 0; r < N_REPEATS; r++) {
+        set_dword(cpu, (next() % MEMORY_SIZE) & ~(address_t) 7, r) ;
+        cpu_fingerprint(cpu) ;
+    }
+    double store_secs = seconds_since(&start) / N_REPEATS ;
+    free_cpu(cpu) ;
+
+    printf("fingerprint of %d KiB written: %.3f ms\n", MEMORY_SIZE / 1024, whole_secs * 1e3) ;
+    printf("fingerprint after a store:    %.1f us\n", store_secs * 1e6) ;
+    return 0 ;
+}
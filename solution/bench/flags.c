@@ -0,0 +1,87 @@
+/**
+ * @file flags.c
+ * @brief Lazy against eager condition flags, on a compare-heavy sequence.
+ *
+ * Runs the same stream of `cmp`s, one in four followed by a `b.lt`, through
+ * the emulator's `alu_add`/`alu_cond`, which only record each comparison,
+ * and through a copy of the eager flag computation they replaced, which
+ * works out N, Z, C and V with 128-bit arithmetic on every `cmp`.
+ */
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "emulator/alu.h"
+
+#define N_OPS 50000000
+
+/// @brief The flags as they were stored before they were made lazy.
+typedef struct eager_pstate {
+    bool N :1 ;
+    bool Z :1 ;
+    bool C :1 ;
+    bool V :1 ;
+}   eager_pstate_t ;
+
+__attribute__((noinline))
+static uint64_t eager_subs(eager_pstate_t *ps, uint64_t op1, uint64_t op2) {
+    op2 = ~op2 ;
+    uint64_t carry = 1 ;
+    uint64_t result = op1 + op2 + carry ;
+    __uint128_t usum = (__uint128_t) op1 + (__uint128_t) op2 + ((__uint128_t)carry) ;
+    __int128_t sum = (__int128_t) ((signed) op1) + (__int128_t) ((signed) op2) + (__int128_t) ((signed) carry);
+    ps->N = result >> 63;
+    ps->Z = result == 0;
+    ps->C = usum >= ((__uint128_t) 1 << 64) ;
+    ps->V = sum >= ((__int128_t) 1 << 63) || sum < -((__int128_t) 1 << 63) ;
+    return result ;
+}
+
+__attribute__((noinline))
+static bool eager_lt(const eager_pstate_t *ps) {
+    return ps->N != ps->V ;
+}
+
+__attribute__((noinline))
+static uint64_t lazy_subs(pstate_t *ps, uint64_t op1, uint64_t op2) {
+    return alu_add(ps, OP_SUBS, op1, op2) ;
+}
+
+__attribute__((noinline))
+static bool lazy_lt(const pstate_t *ps) {
+    return alu_cond(ps, LT) ;
+}
+
+int main(void) {
+    struct timespec start ;
+    uint64_t x = BENCH_SEED, taken = 0 ;
+
+    eager_pstate_t eager = {0} ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (uint64_t i = 0; i < N_OPS; i++) {
+        lcg_next(&x) ;
+        eager_subs(&eager, x >> 32, x & 0xffffffff) ;
+        if (i % 4 == 3) taken += eager_lt(&eager) ;
+    }
+    double eager_secs = seconds_since(&start) ;
+    uint64_t eager_taken = taken ;
+
+    pstate_t lazy = { .op = FLAGS_NZCV } ;
+    x = BENCH_SEED ;
+    taken = 0 ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (uint64_t i = 0; i < N_OPS; i++) {
+        lcg_next(&x) ;
+        lazy_subs(&lazy, x >> 32, x & 0xffffffff) ;
+        if (i % 4 == 3) taken += lazy_lt(&lazy) ;
+    }
+    double lazy_secs = seconds_since(&start) ;
+
+    if (taken != eager_taken) {
+        fprintf(stderr, "flags: lazy and eager flags disagree\n") ;
+        return 1 ;
+    }
+    printf("eager flags: %.2f ns/cmp\n", eager_secs / N_OPS * 1e9) ;
+    printf("lazy flags:  %.2f ns/cmp (%.2fx)\n", lazy_secs / N_OPS * 1e9, eager_secs / lazy_secs) ;
+    return 0 ;
+}
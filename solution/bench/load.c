@@ -0,0 +1,90 @@
+/**
+ * @file load.c
+ * @brief Loading binaries that end part way through a word.
+ *
+ * Loads binaries of a memory's size plus 1 to 3 bytes, and of a word less
+ * plus 1 to 3, into a 4 KiB and a 2 MiB memory of each backend, checking
+ * that only their whole words are loaded, into no more pages than memory
+ * has, and the rest of memory is left zero. Then times the load of a 2 MiB
+ * binary.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "emulator/loader.h"
+
+#define N_REPEATS 100
+
+static const char *backend_names[] = {
+    [MEMORY_HEAP] = "heap",
+    [MEMORY_MMU] = "mmu",
+} ;
+
+/// @brief A file of `bytes` bytes, its words numbered from 1 and any bytes past the last 0xff.
+static FILE *binary(size_t bytes) {
+    FILE *f = tmpfile() ;
+    if (!f) return NULL ;
+    for (size_t k = 0; k < bytes / 4; k++) {
+        word32_t w = k + 1 ;
+        fwrite(&w, 4, 1, f) ;
+    }
+    for (size_t k = bytes / 4 * 4; k < bytes; k++) fputc(0xff, f) ;
+    rewind(f) ;
+    return f ;
+}
+
+/// @brief Loads a binary of `bytes` bytes into a memory of `size` bytes of `backend`, checking what it holds after.
+static bool check_load(memory_backend_t backend, size_t size, size_t bytes) {
+    FILE *f = binary(bytes) ;
+    if (!f) return false ;
+    memory_config_t config = {.size = size, .backend = backend} ;
+    cpu_t *cpu = init_cpu_config(&config) ;
+    size_t count = 0 ;
+    bool ok = load_bin(cpu->memory, f, &count) == LOAD_SUCCESS && count == bytes / 4 ;
+    fclose(f) ;
+    // No more pages of the binary than the memory has
+    memory_block_t *block = cpu->memory->memory ;
+    ok = ok && block->image_pages <= block->n_pages && block->n_touched <= block->n_pages ;
+
+    state_t s ;
+    cpu_state(cpu, &s) ;
+    ok = ok && s.n_words == bytes / 4 ;
+    for (size_t k = 0; ok && k < s.n_words; k++) ok = s.addresses[k] == 4 * k && s.words[k] == k + 1 ;
+    state_free(&s) ;
+    free_cpu(cpu) ;
+    if (!ok) fprintf(stderr, "load: a binary of %zu bytes in %zu bytes of %s memory loads wrong\n",
+                     bytes, size, backend_names[backend]) ;
+    return ok ;
+}
+
+int main(void) {
+    size_t sizes[] = {MEMORY_PAGE_BYTES, 2 * 1024 * 1024} ;
+    memory_backend_t backends[] = {MEMORY_HEAP, MEMORY_MMU} ;
+    for (size_t b = 0; b < 2; b++) {
+        for (size_t n = 0; n < 2; n++) {
+            for (size_t extra = 1; extra < 4; extra++) {
+                if (!check_load(backends[b], sizes[n], sizes[n] + extra)) return 1 ;
+                if (!check_load(backends[b], sizes[n], sizes[n] - 4 + extra)) return 1 ;
+            }
+        }
+    }
+
+    FILE *f = binary(sizes[1]) ;
+    if (!f) return 1 ;
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (int r = 0; r < N_REPEATS; r++) {
+        rewind(f) ;
+        cpu_t *cpu = init_cpu_config(&(memory_config_t) {.size = sizes[1], .backend = MEMORY_HEAP}) ;
+        size_t count = 0 ;
+        load_bin(cpu->memory, f, &count) ;
+        free_cpu(cpu) ;
+    }
+    double secs = seconds_since(&start) / N_REPEATS ;
+    fclose(f) ;
+    printf("load of a %zu KiB binary: %.1f us\n", sizes[1] / 1024, secs * 1e6) ;
+    return 0 ;
+}
@@ -0,0 +1,17 @@
+// A mask-heavy loop: each mask is a bitmask immediate, not a movz/movk
+// chain into a scratch register.
+movz x3, #0x10, lsl #16
+movz x1, #0x1234
+loop:
+eor x1, x1, #0x5555555555555555
+and x2, x1, #0xff00ff00ff00ff00
+orr x1, x2, #0x1
+and w4, w1, #0xfffffff0
+eor x1, x1, x4
+ands x5, x1, #0x8000000000000000
+b.eq clear
+orr x1, x1, #0x3
+clear:
+subs x3, x3, #1
+b.ne loop
+and x0, x0, x0
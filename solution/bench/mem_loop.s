@@ -0,0 +1,17 @@
+// A load/store-heavy loop: copies 512 double words a buffer further on,
+// adding one to each and summing them, over and over.
+movz x3, #0x800
+loop:
+movz x5, #0x1, lsl #16
+movz x6, #0x2, lsl #16
+movz x7, #0x200
+copy:
+ldr x8, [x5], #8
+add x9, x9, x8
+add x8, x8, #1
+str x8, [x6], #8
+subs x7, x7, #1
+b.ne copy
+subs x3, x3, #1
+b.ne loop
+and x0, x0, x0
@@ -0,0 +1,79 @@
+/**
+ * @file predecode.c
+ * @brief Classification and eager decoding of a 1M-word image.
+ *
+ * The image is 7/8 instances of random instruction table entries and 1/8
+ * random data. Classifies it with each implementation the CPU can run,
+ * checking that they agree, then times decoding every word on its first
+ * fetch, as the engines otherwise do, against `predecode_image`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "common/instr_table.h"
+#include "emulator/loader.h"
+#include "emulator/predecode.h"
+#include "emulator/decoder/decode_memo.h"
+
+#define N_WORDS (1 << 20)
+#define N_CLASSIFIES 20
+
+/// @brief A cpu with the image loaded, and nothing decoded.
+static cpu_t *load_words(const word32_t *words) {
+    cpu_t *cpu = init_cpu(4 * N_WORDS) ;
+    size_t count = 0 ;
+    // The words as loaded, on a little-endian host
+    load_image(cpu->memory, (const uint8_t *) words, 4 * N_WORDS, &count) ;
+    free_decode_memo() ;
+    return cpu ;
+}
+
+int main(void) {
+    static word32_t words[N_WORDS] ;
+    uint64_t x = BENCH_SEED ;
+    for (size_t k = 0; k < N_WORDS; k++) {
+        lcg_next(&x) ;
+        const instr_info_t *e = &instr_info[(x >> 56) % INSTR_COUNT] ;
+        words[k] = (x >> 53) % 8 == 0 ? (word32_t) (x >> 16) : e->value | ((x >> 16) & ~e->mask) ;
+    }
+
+    cpu_t *cpu = load_words(words) ;
+    // The words as loaded, on a little-endian host
+    const uint8_t *image = (const uint8_t *) words ;
+    static uint8_t classes[BENCH_N_IMPLS][N_WORDS] ;
+    bool ran[BENCH_N_IMPLS] = {false} ;
+    FOR_EACH_IMPL(n, predecode_use_impl, impl_names, "classify") {
+        ran[n] = true ;
+        struct timespec start ;
+        clock_gettime(CLOCK_MONOTONIC, &start) ;
+        for (int r = 0; r < N_CLASSIFIES; r++) predecode_classify(image, N_WORDS, classes[n]) ;
+        double secs = seconds_since(&start) / N_CLASSIFIES ;
+        printf("classify %-6s: %.3f ms, %.0f M words/s\n",
+            impl_names[n], secs * 1e3, N_WORDS / secs / 1e6) ;
+    }
+    if (ran[0] && ran[1] && memcmp(classes[0], classes[1], N_WORDS) != 0) {
+        fprintf(stderr, "predecode: the classifiers disagree\n") ;
+        return 1 ;
+    }
+    predecode_use_impl(PREDECODE_IMPL_AVX2) ;
+
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (size_t k = 0; k < N_WORDS; k++) fetch_cached(cpu, 4 * k) ;
+    double lazy_secs = seconds_since(&start) ;
+    free_cpu(cpu) ;
+
+    cpu = load_words(words) ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    predecode_image(cpu, N_WORDS) ;
+    double eager_secs = seconds_since(&start) ;
+    free_cpu(cpu) ;
+
+    printf("decode on first fetch: %.1f ms for %d words\n", lazy_secs * 1e3, N_WORDS) ;
+    printf("predecode_image:       %.1f ms (%.1f classifying), %zu words decoded\n",
+        eager_secs * 1e3, predecode_stats.classify_secs * 1e3, predecode_stats.decoded) ;
+    return 0 ;
+}
@@ -0,0 +1,21 @@
+// Self-modifying code: a loop whose first two words are overwritten by
+// code it reaches through `br`, which a recompiled object doesn't cover.
+// Its second pass must run the new `add x3, x3, #9`, leaving x3 = 0xa.
+movz x10, #2
+movz x6, #0x10
+movz x4, #0x24
+b loop
+loop:
+add x3, x3, #1
+subs x10, x10, #1
+b.eq done
+br x4
+done:
+and x0, x0, x0
+patch:
+ldr x5, new
+str x5, [x6]
+b loop
+new:
+.int 0x91002463
+.int 0xf100054a
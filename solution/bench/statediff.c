@@ -0,0 +1,180 @@
+/**
+ * @file statediff.c
+ * @brief Finding where two final states of 4 MiB of memory differ.
+ *
+ * Builds a state of a million words, and another from it with words
+ * changed, dropped and added, then checks that each implementation of the
+ * comparison the CPU can run finds the same differing words as a plain
+ * merge of the two, and times them. Then checks that the state read back
+ * from its text dump is the same, timing the read, and that read back from
+ * its binary record is, but not once its addresses are out of order or a
+ * word is zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "emulator/state.h"
+#include "utils/outbuf.h"
+
+#define N_WORDS (1024 * 1024)
+#define N_CHANGES 64
+#define N_REPEATS 20
+
+typedef struct diffs {
+    size_t n ;
+    address_t at[4 * N_CHANGES] ;
+    word32_t a[4 * N_CHANGES] ;
+    word32_t b[4 * N_CHANGES] ;
+}   diffs_t ;
+
+static void add_diff(void *ctx, address_t at, word32_t a, word32_t b) {
+    diffs_t *d = ctx ;
+    if (d->n == 4 * N_CHANGES) return ;
+    d->at[d->n] = at ;
+    d->a[d->n] = a ;
+    d->b[d->n] = b ;
+    d->n++ ;
+}
+
+/// @brief The differing words of `a` and `b`, a word at a time.
+static void merge_diff(const state_t *a, const state_t *b, diffs_t *d) {
+    size_t i = 0, j = 0 ;
+    while (i < a->n_words || j < b->n_words) {
+        if (j == b->n_words || (i < a->n_words && a->addresses[i] < b->addresses[j])) {
+            add_diff(d, a->addresses[i], a->words[i], 0) ;
+            i++ ;
+        } else if (i == a->n_words || b->addresses[j] < a->addresses[i]) {
+            add_diff(d, b->addresses[j], 0, b->words[j]) ;
+            j++ ;
+        } else {
+            if (a->words[i] != b->words[j]) add_diff(d, a->addresses[i], a->words[i], b->words[j]) ;
+            i++ ;
+            j++ ;
+        }
+    }
+}
+
+static void count_diff(void *ctx, address_t at, word32_t a, word32_t b) {
+    ++*(size_t *) ctx ;
+}
+
+/// @brief `a` with `N_CHANGES` words each changed, dropped and added, in `b`.
+static void mutate(const state_t *a, state_t *b) {
+    state_init(b) ;
+    for (size_t k = 0; k < a->n_words; k++) {
+        // A gap in the addresses of `a` to add a word in
+        if (k && a->addresses[k] - a->addresses[k - 1] > 4 && next() % (N_WORDS / N_CHANGES) == 0)
+            state_add_word(b, a->addresses[k] - 4, next() | 1) ;
+        uint64_t r = next() % (N_WORDS / N_CHANGES) ;
+        if (r == 0) continue ;
+        state_add_word(b, a->addresses[k], r == 1 ? a->words[k] ^ 0x100 : a->words[k]) ;
+    }
+}
+
+static bool check_diff(const state_t *a, const state_t *b) {
+    static diffs_t expected, found ;
+    expected.n = 0 ;
+    merge_diff(a, b, &expected) ;
+    FOR_EACH_IMPL(n, state_use_impl, impl_names, "diff") {
+        found.n = 0 ;
+        state_diff_words(a, b, add_diff, &found) ;
+        if (found.n != expected.n || memcmp(found.at, expected.at, found.n * sizeof(address_t)) != 0
+            || memcmp(found.a, expected.a, found.n * sizeof(word32_t)) != 0
+            || memcmp(found.b, expected.b, found.n * sizeof(word32_t)) != 0)
+            return false ;
+
+        struct timespec start ;
+        clock_gettime(CLOCK_MONOTONIC, &start) ;
+        size_t count = 0 ;
+        for (int r = 0; r < N_REPEATS; r++) state_diff_words(a, b, count_diff, &count) ;
+        double secs = seconds_since(&start) / N_REPEATS ;
+        printf("diff %-6s: %zu differing words of %zu found in %.3f ms\n",
+               impl_names[n], count / N_REPEATS, a->n_words, secs * 1e3) ;
+    }
+    return expected.n > 0 ;
+}
+
+/// @brief Checks that the text dump of `s` reads back as `s`.
+static bool check_text(const state_t *s) {
+    size_t cap = 64 * (STATE_N_REGS + 4) + 32 * s->n_words ;
+    char *text = malloc(cap) ;
+    size_t len = sprintf(text, "Registers:\n") ;
+    for (size_t r = 0; r < STATE_N_REGS; r++) len += sprintf(text + len, "X%02zu    = %016lx\n", r, s->regs[r]) ;
+    len += sprintf(text + len, "PC     = %016lx\nPSTATE : N-C-\nNon-zero memory:\n", s->pc) ;
+    for (size_t k = 0; k < s->n_words; k++)
+        len += sprintf(text + len, "0x%08lx : 0x%08x\n", s->addresses[k], s->words[k]) ;
+
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    state_t t ;
+    bool ok = state_read_text(text, len, &t) ;
+    double secs = seconds_since(&start) ;
+    printf("read %zu KiB of text dump in %.1f ms\n", len / 1024, secs * 1e3) ;
+    state_cmp_t cmp ;
+    ok = ok && t.nzcv == (STATE_N | STATE_C) && state_compare(s, &t, &cmp) ;
+    state_free(&t) ;
+    free(text) ;
+    return ok ;
+}
+
+/// @brief Checks that the binary record of `s` reads back as `s`, and is refused with its words out of order or zero.
+static bool check_bin(const state_t *s) {
+    FILE *f = tmpfile() ;
+    if (!f) return false ;
+    outbuf_t out ;
+    outbuf_init(&out, f, OUTBUF_CAPACITY) ;
+    state_write_bin(&out, s) ;
+    bool ok = outbuf_close(&out) ;
+    size_t len = ftell(f) ;
+    uint8_t *data = malloc(len) ;
+    rewind(f) ;
+    ok = ok && fread(data, 1, len, f) == len ;
+    fclose(f) ;
+
+    state_t t ;
+    state_cmp_t cmp ;
+    ok = ok && state_read_bin(data, len, &t) && state_compare(s, &t, &cmp) ;
+    state_free(&t) ;
+    // The last two addresses swapped, then the last word zero
+    uint8_t *addresses = data + STATE_HEADER_BYTES, *words = addresses + 8 * s->n_words ;
+    uint8_t last[8] ;
+    memcpy(last, addresses + 8 * (s->n_words - 1), 8) ;
+    memcpy(addresses + 8 * (s->n_words - 1), addresses + 8 * (s->n_words - 2), 8) ;
+    memcpy(addresses + 8 * (s->n_words - 2), last, 8) ;
+    ok = ok && !state_read_bin(data, len, &t) && t.n_words == 0 ;
+    memcpy(addresses + 8 * (s->n_words - 2), addresses + 8 * (s->n_words - 1), 8) ;
+    memcpy(addresses + 8 * (s->n_words - 1), last, 8) ;
+    memset(words + 4 * (s->n_words - 1), 0, 4) ;
+    ok = ok && !state_read_bin(data, len, &t) && t.n_words == 0 ;
+    free(data) ;
+    return ok ;
+}
+
+int main(void) {
+    state_t a, b ;
+    state_init(&a) ;
+    for (size_t r = 0; r < STATE_N_REGS; r++) a.regs[r] = next() ;
+    a.pc = 0x1000 ;
+    a.nzcv = STATE_N | STATE_C ;
+    // Mostly dense, as code and arrays are, with gaps
+    for (address_t at = 0; a.n_words < N_WORDS; at += 4)
+        if (next() % 8) state_add_word(&a, at, next() | 1) ;
+    mutate(&a, &b) ;
+
+    bool ok = check_diff(&a, &b) ;
+    if (!ok) fprintf(stderr, "statediff: the differing words found are wrong\n") ;
+    if (ok && !check_text(&a)) {
+        fprintf(stderr, "statediff: the state read from its text dump differs\n") ;
+        ok = false ;
+    }
+    if (ok && !check_bin(&a)) {
+        fprintf(stderr, "statediff: the state read from its binary record differs, or a bad record is read\n") ;
+        ok = false ;
+    }
+    state_free(&a) ;
+    state_free(&b) ;
+    return ok ? 0 : 1 ;
+}
@@ -0,0 +1,15 @@
+// Loads, adds and stores over an array: runs of uops no fixed fusion covers.
+movz x3, #0x8, lsl #16
+movz x4, #0x1000
+loop:
+ldr x1, [x4]
+add x1, x1, #3
+str x1, [x4]
+ldr x2, [x4, #8]
+add x2, x2, x1
+str x2, [x4, #8]
+madd x5, x1, x2, x5
+sub x3, x3, #1
+cmp x3, #0
+b.ne loop
+and x0, x0, x0
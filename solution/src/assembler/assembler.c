@@ -4,16 +4,15 @@
 #include "assembler/assembler.h"
 #include "assembler/parser/parse.h"
 #include "utils/log.h"
-#include "assembler/encoder.h"
-#include "assembler/worder.h"
+#include "common/instr_table.h"
+#include "utils/outbuf.h"
 
 int write_to_file (FILE *out, code_word *c) ;
 size_t label_pass(assembler_t *asmblr) ;
 instr_t line_to_instr(assembler_t *asmblr, char* line) ;
 int instr_listing(assembler_t *asmblr, size_t i) ;
 void instrs_listing(assembler_t *asmblr) ;
-void instrs_to_encs(assembler_t *asmblr) ;
-void encs_to_codes(assembler_t *asmblr) ;
+void instrs_to_codes(assembler_t *asmblr) ;
 int run_assembler(assembler_t *asmblr) ;
 void instr_pass(assembler_t *asmblr) ;
 int write_instr_listing(assembler_t *asmblr, instr_t instr, code_word c) ;
@@ -69,8 +68,8 @@ int assemble_listing(FILE *in, FILE *out, FILE *listing) {
 void assemble_all(assembler_t *asmblr) ;
 
 /**
- * @brief This assembler assembles all instructions to encodings, 
- * before converting to 32-bit words, and writing to file.
+ * @brief This assembler parses all instructions, 
+ * before encoding them to 32-bit words, and writing to file.
  * 
  * @param asmblr The assembler configuration.
  * @return int The assembly status.
@@ -92,16 +91,10 @@ int run_big_stage_asm(assembler_t *asmblr) {
     instr_pass(asmblr) ;
     free_parsing_tables() ;
 
-    // Instructions to their structured encodings
-    asmblr->enc_instrs = calloc(asmblr->instrs_size, sizeof(enc_instr)) ;
-    FAIL_IF_NULL(asmblr->enc_instrs, "enc_instrs array alloc failed") ;
-    instrs_to_encs(asmblr) ;
-
-
-    // Structured encodings to 32-bit words
+    // Instructions to 32-bit words
     asmblr->codes = calloc(asmblr->instrs_size, sizeof(word32_t)) ;
     FAIL_IF_NULL(asmblr->codes, "codes array alloc failed") ;
-    encs_to_codes(asmblr) ;
+    instrs_to_codes(asmblr) ;
 
     // Dump listing
     instrs_listing(asmblr) ;
@@ -211,8 +204,7 @@ void assemble_line(assembler_t *asmblr, char *line) {
 
     instr_t i = line_to_instr(asmblr, line) ;
 
-    enc_instr e = encode_instr(i) ;
-    word32_t c = to_word_enc(e) ;
+    word32_t c = instr_encode(i) ;
 
     write_to_file(asmblr->out, &c) ;
     if (asmblr->listing) write_instr_listing(asmblr, i, c) ;
@@ -247,21 +239,11 @@ void instr_pass(assembler_t *asmblr) {
         asmblr->curr_instr, asmblr->instrs_size) ;
 }
 
-/// @brief Convert each instruction in @c asmblr::instrs to an @c enc_instr, stored @c asmblr::enc_instrs
-void instrs_to_encs(assembler_t *asmblr) {
+/// @brief Encode each instruction in @c asmblr::instrs to a 32-bit word, stored in @c asmblr::codes
+void instrs_to_codes(assembler_t *asmblr) {
     loglvl(LOG_1, "Encoding pass ...\n") ;
     for (size_t i = 0; i < asmblr->instrs_size; i++) {
-        enc_instr e = encode_instr(asmblr->instrs[i]) ;
-        (asmblr->enc_instrs)[i] = e ;
-    }
-}
-
-/// @brief Convert each structured encoding to a 32-bit word. 
-void encs_to_codes(assembler_t *asmblr) {
-    loglvl(LOG_1, "word32_t pass ... \n") ;
-
-    for (size_t i = 0; i < asmblr->instrs_size; i++)  {
-        word32_t c = to_word_enc(asmblr->enc_instrs[i]) ;
+        word32_t c = instr_encode(asmblr->instrs[i]) ;
         asmblr->codes[i] = c ;
         write_to_file(asmblr->out, &c);
     }
@@ -281,6 +263,28 @@ void instrs_listing(assembler_t *asmblr) {
     
 }
 
+/**
+ * @brief Write the listing line of `instr`, encoded as `c` at `address`,
+ * to `listing`: as `"%4lx:\t%08x \t%s\n"` would, the numbers formatted by `outbuf.h`.
+ * 
+ * @return int The number of characters written, or -1 if the write failed.
+ */
+static
+int listing_line(FILE *listing, size_t address, instr_t instr, code_word c) {
+    char line[40] ;
+    char *p = fmt_hex_pad(line, address, 4) ;
+    p = FMT_LIT(p, ":\t") ;
+    p = fmt_hex(p, c, 8) ;
+    p = FMT_LIT(p, " \t") ;
+    size_t n = p - line ;
+    char *instr_s = show_instr(instr) ;
+    size_t len = strlen(instr_s) ;
+    bool ok = fwrite(line, 1, n, listing) == n && fwrite(instr_s, 1, len, listing) == len
+        && fputc('\n', listing) != EOF ;
+    free(instr_s) ;
+    return ok ? (int) (n + len + 1) : -1 ;
+}
+
 /**
  * @brief Write a single instruction to the listing file.
  * 
@@ -291,10 +295,7 @@ void instrs_listing(assembler_t *asmblr) {
  * @return int The write result status.
  */
 int write_instr_listing(assembler_t *asmblr, instr_t instr, code_word c) {
-    char *instr_s = show_instr(instr) ;
-    int res = fprintf(asmblr->listing, "%4lx:\t%08x \t%s\n", (asmblr->curr_instr * 4), c, instr_s) ;
-    free(instr_s) ;
-    return res ;
+    return listing_line(asmblr->listing, asmblr->curr_instr * 4, instr, c) ;
 }
 
 /**
@@ -305,12 +306,7 @@ int write_instr_listing(assembler_t *asmblr, instr_t instr, code_word c) {
  * @return int Write result status.
  */
 int instr_listing(assembler_t *asmblr, size_t i) {
-    instr_t instr = asmblr->instrs[i] ;
-    code_word c = asmblr->codes[i] ;
-    char *instr_s = show_instr(instr) ;
-    int res = fprintf(asmblr->listing, "%4lx:\t%08x \t%s\n", (i * 4), c, instr_s) ;
-    free(instr_s) ;
-    return res ;
+    return listing_line(asmblr->listing, i * 4, asmblr->instrs[i], asmblr->codes[i]) ;
 }
 
 /**
@@ -25,9 +25,7 @@ typedef struct assembler_t {
     size_t instrs_size ;
     /// Array of instructions already read from @c assembler_t::in
     instr_t *instrs ;
-    /// Array of structured encodings, encoded from @c assembler_t::instrs
-    enc_instr *enc_instrs ;
-    /// Array of 32-bit words encoded from @c assembler_t::enc_intrs
+    /// Array of 32-bit words encoded from @c assembler_t::instrs
     word32_t *codes ;
     /// Assembly @c .as source
     FILE *in ;
@@ -103,8 +103,8 @@ reg_t p_reg(prsr *p) {
     return res ;
 }
 
-/// @brief Parse a signed immediate
-imm p_imm(prsr *p) {
+/// @brief Parse a signed immediate, on 64 bits
+uint64_t p_imm64(prsr *p) {
     if (p->tok[0] == '#') p->tok++ ;
     uint64_t x;
     if (strlen(p->tok) >= 3 && p->tok[0] == '0' && tolower(p->tok[1]) == 'x') {
@@ -112,9 +112,13 @@ imm p_imm(prsr *p) {
     } else {
         sscanf(p->tok, "%ld", &x);
     }
-    imm res = x ;
     next_tok_p(p) ;
-    return res ;
+    return x ;
+}
+
+/// @brief Parse a signed immediate
+imm p_imm(prsr *p) {
+    return p_imm64(p) ;
 }
 
 /// @brief Parses a hash symbol followed by an immediate. 
@@ -184,9 +188,34 @@ bool is_one_of(char c, const char *cs) {
     return strchr(cs, c) != NULL ;
 }
 
-/// @brief Parse an operand of a data processing instruction
-op2_t p_dp_op2 (prsr *p) {
+/**
+ * @brief Parse the bitmask immediate operand of the logical operation
+ * `*op`, on 64 bits when `sf`. The negated operations have no immediate
+ * form, so are made the plain ones with the immediate inverted.
+ */
+op2_t p_bitmask(prsr *p, dp_op *op, bool sf) {
+    ASSERT_M(p->tok[0] == '#', "Expected #") ;
+    op2_t dest ;
+    dest.type = OP2_BITMASK ;
+    dest.bitmask.imm = p_imm64(p) ;
+    switch (*op) {
+        case OP_BIC: case OP_ORN: case OP_EON: case OP_BICS:
+            // In `dp_op`, each negated operation follows the plain one
+            *op -= 1 ;
+            dest.bitmask.imm = ~dest.bitmask.imm & (sf ? UINT64_MAX : UINT32_MAX) ;
+            break ;
+        default: break ;
+    }
+    return dest ;
+}
+
+/// @brief Parse an operand of the data processing operation `*op`, on 64 bits when `sf`
+op2_t p_dp_op2 (prsr *p, dp_op *op, bool sf) {
     op2_t dest;
+    switch (*op) {
+        case LOG_CASES: if (p->tok[0] == '#') return p_bitmask(p, op, sf) ; break ;
+        default: break ;
+    }
     if (is_one_of(p->tok[0], "=#")) {
         // Op2 is a (shifted) immediate
         dest.type   = OP2_IMM_SH;
@@ -218,7 +247,7 @@ void p_dp (instr_t *dest, prsr *p, dp_op *op_code) {
     
     dest->dp.rd = p_reg(p);
     dest->dp.rn = p_reg(p);
-    dest->dp.op2 = p_dp_op2(p);
+    dest->dp.op2 = p_dp_op2(p, &dest->dp.op_type, dest->dp.rd.extended);
 }
 
 /**
@@ -237,7 +266,7 @@ void p_dp_1 (instr_t *dest, prsr *p, dp_op *op_code, reg_t *reg, reg_t *rzr) {
     *reg = p_reg(p) ;
     *rzr = zero_reg(dest->dp.rn.extended) ;
 
-    dest->dp.op2 = p_dp_op2(p);
+    dest->dp.op2 = p_dp_op2(p, &dest->dp.op_type, reg->extended);
 }
 
 void p_dp_1_rd_zr(instr_t *dest, prsr *p, dp_op *op_code) {
@@ -104,8 +104,9 @@ void init_label_table() {
 
 char *show_label_binding(void *vlb) {
     label_binding *lb = (label_binding*) vlb ;
-    char *s = malloc(8 * sizeof(char)) ;
-    sprintf(s, "line %lu == 0x%lx", (lb->addr / 4), lb->addr) ;
+    size_t len = snprintf(NULL, 0, "line %lu == 0x%lx", (lb->addr / 4), lb->addr) + 1 ;
+    char *s = malloc(len * sizeof(char)) ;
+    snprintf(s, len, "line %lu == 0x%lx", (lb->addr / 4), lb->addr) ;
     return s ;
 }
 
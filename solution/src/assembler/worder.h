@@ -1,9 +0,0 @@
-#ifndef __WORDER_H
-#define __WORDER_H
-
-#include "common/word.h"
-#include "assembler/encoder.h"
-
-word32_t to_word_enc(enc_instr i) ;
-
-#endif
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include "wrapper/io.h"
+#include <inttypes.h>
 #include <string.h>
 
 #include "common/ast.h"
 #include "common/ast/reg.h"
+#include "common/instr_table.h"
 #include "utils/log.h"
 
 
@@ -53,6 +55,11 @@ void __catstr_op2_mul(char **dest, op2_mul mul) {
     append_to_dest(dest, "%s, %s", __str_reg(mul.rm), __str_reg(mul.ra)) ;
 }
 
+/// @brief Concatenate the string representation of a bitmask immediate to dest
+void __catstr_op2_bitmask(char **dest, op2_bitmask bitmask) {
+    append_to_dest(dest, "#0x%" PRIx64, bitmask.imm) ;
+}
+
 /// @brief Concatenate the string representation of a nop to dest
 void __catstr_instr_nop(char **dest) {
     append_to_dest(dest, "nop") ;
@@ -69,6 +76,7 @@ void __catstr_op2(char **dest, op2_t op2) {
         case OP2_IMM_SH: __catstr_op2_imm_sh(dest, op2.imm_sh) ; break ;
         case OP2_REG_SH: __catstr_op2_reg_sh(dest, op2.reg_sh) ; break ;
         case OP2_MUL:    __catstr_op2_mul(dest, op2.mul) ; break ;
+        case OP2_BITMASK: __catstr_op2_bitmask(dest, op2.bitmask) ; break ;
         default:
         log_exit_failure("Unknown op2 type %u", op2.type) ;
     }
@@ -76,26 +84,7 @@ void __catstr_op2(char **dest, op2_t op2) {
 
 /// @brief The string representation of a dp operation 
 const char *__str_dp_op(dp_op op) {
-    switch (op) {
-        case OP_ADD:  return "add" ;
-        case OP_ADDS: return "adds" ;
-        case OP_SUB:  return "sub" ;
-        case OP_SUBS: return "subs" ;
-        case OP_AND:  return "and" ;
-        case OP_BIC:  return "bic" ;
-        case OP_ORR:  return "orr" ;
-        case OP_ORN:  return "orn" ;
-        case OP_EOR:  return "eor" ;
-        case OP_EON:  return "eon" ;
-        case OP_ANDS: return "ands" ;
-        case OP_BICS: return "bics" ;
-        case OP_MOVN: return "movn" ;
-        case OP_MOVZ: return "movz" ;
-        case OP_MOVK: return "movk" ;
-        case OP_MADD: return "madd" ;
-        case OP_MSUB: return "msub" ;
-    }
-    log_exit_failure("Unknown dp_op %u", op) ;
+    return instr_dp_mnemonic(op) ;
 }
 
 
@@ -111,18 +100,25 @@ void __catstr_instr_dp(char **dest, instr_dp instr) {
 }
 
 const char *__str_cond(cond_e c) {
-    switch (c) {
-    case EQ: return "eq" ;
-    case NE: return "ne" ;
-    case GE: return "ge" ;
-    case LT: return "lt" ;
-    case GT: return "gt" ;
-    case LE: return "le" ;
-    case AL: return "al" ;
-    }
+    // All sixteen, not just those of `cond_e`: the decoder takes any, as in words of data
+    static const char *names[16] = {
+        "eq", "ne", "cs", "cc", "mi", "pl", "vs", "vc", "hi", "ls", "ge", "lt", "gt", "le", "al", "nv",
+    } ;
+    if ((unsigned) c < 16) return names[c] ;
     log_exit_failure("Unknown cond %u", c) ;
 }
 
+/**
+ * @brief Show a register of a decoded instruction. The decoder leaves a
+ * register 31 the emulator doesn't take, as the Rt of a load or the Rn of
+ * a `br`, as no register; it is shown as the zero register it encodes.
+ */
+static
+const char *__str_decoded_reg(reg_t r) {
+    if ((int) r.r == -1) return r.extended ? "xzr" : "wzr" ;
+    return __str_reg(r) ;
+}
+
 /// @brief concat branch instruction string to dest
 void __catstr_instr_b(char **dest, instr_b instr) {
     switch (instr.tp) {
@@ -135,7 +131,7 @@ void __catstr_instr_b(char **dest, instr_b instr) {
         append_to_dest(dest, "b.%s %lx <%s>", __str_cond(instr.cond), instr.address, instr.label) ;
         break ;
     case TP_BR:
-        append_to_dest(dest, "br %s", __str_reg(instr.rn)) ; 
+        append_to_dest(dest, "br %s", __str_decoded_reg(instr.rn)) ; 
         break ;
     }
 }
@@ -167,15 +163,10 @@ void __catstr_ls_imm(char **dest, i_ls_imm instr) {
 /// @param tp 
 /// @return 
 const char *__str_extend_e(ls_reg_extend_tp tp) {
-    char *res ;
-    switch (tp) {
-        // case E_LS_EXTEND_UXTW: return "uxtw" ;
-        case E_LS_EXTEND_LSL : return "lsl" ;
-        // case E_LS_EXTEND_SXTW: return "sxtw" ;
-        case E_LS_EXTEND_SXTX: return "sxtx" ;
-        default:
-        log_exit_failure("Unknown extend type %u", tp) ;
-    }
+    // All eight, not just those of `ls_reg_extend_tp`: the decoder takes any
+    static const char *names[8] = {"uxtb", "uxth", "uxtw", "lsl", "sxtb", "sxth", "sxtw", "sxtx"} ;
+    if ((unsigned) tp < 8) return names[tp] ;
+    log_exit_failure("Unknown extend type %u", tp) ;
 }
 
 /// @brief Show register extension
@@ -199,7 +190,7 @@ void __catstr_ls_lit(char **dest, i_ls_lit lit) {
 
 /// @brief Show a load/store instruction. 
 void __catstr_instr_ls(char **dest, instr_ls instr) {
-    append_to_dest(dest, "%s %s, ", __str_ls_op(instr.op), __str_reg(instr.rt)) ;
+    append_to_dest(dest, "%s %s, ", __str_ls_op(instr.op), __str_decoded_reg(instr.rt)) ;
 
     switch (instr.arg_tp) {
     case LS_IMM: __catstr_ls_imm(dest, instr.imm) ; break ;
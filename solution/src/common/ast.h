@@ -78,7 +78,7 @@ typedef uint32_t imm ;
 
 /// @brief The type of the 2nd operand of a data processing instruction.
 typedef enum {
-    OP2_IMM_SH, OP2_REG_SH, OP2_MUL
+    OP2_IMM_SH, OP2_REG_SH, OP2_MUL, OP2_BITMASK
 } op2_tp  ;
 
 /// @brief A (shifted) immediate 2nd operand
@@ -100,6 +100,11 @@ typedef struct op2_mul {
     reg_t ra ;
 }   op2_mul ;
 
+/// @brief A bitmask immediate 2nd operand of a logical instruction (see bitmask_imm.h)
+typedef struct op2_bitmask {
+    uint64_t imm ;
+}   op2_bitmask ;
+
 /**
  * @brief ADT for data processing 2nd operand.
  * 
@@ -112,6 +117,7 @@ typedef struct op2_t {
         op2_reg reg_sh ;
         op2_imm imm_sh ;
         op2_mul mul ;
+        op2_bitmask bitmask ;
     } ;
 }   op2_t ;
 
@@ -0,0 +1,93 @@
+#include <pthread.h>
+#include <stddef.h>
+
+#include "common/bitmask_imm.h"
+
+/// @brief log2 of the number of slots of the value to encoding hash, at most half full.
+#define BITMASK_IMM_INDEX_BITS 14
+
+/// @brief The 64-bit value of each encoding; 0, which no encoding has, where it is invalid.
+static uint64_t bitmask_values[BITMASK_IMM_ENCODINGS] ;
+/// @brief Open addressing hash of the valid values, holding 1 + their encoding; 0 is empty.
+static uint16_t bitmask_index[1 << BITMASK_IMM_INDEX_BITS] ;
+static pthread_once_t bitmask_tables_once = PTHREAD_ONCE_INIT ;
+
+static inline
+size_t bitmask_hash(uint64_t value) {
+    return (value * 0x9e3779b97f4a7c15) >> (64 - BITMASK_IMM_INDEX_BITS) ;
+}
+
+/**
+ * @brief The 64-bit value of N:immr:imms, as the architecture's
+ * DecodeBitMasks: imms gives the element size and the length of its run of
+ * ones, which is rotated right by immr.
+ * @return 0 when the encoding is reserved.
+ */
+static
+uint64_t expand_bitmask(word32_t n_immr_imms) {
+    unsigned n = (n_immr_imms >> 12) & 1 ;
+    unsigned immr = (n_immr_imms >> 6) & 0x3f ;
+    unsigned imms = n_immr_imms & 0x3f ;
+
+    unsigned len_bits = (n << 6) | (~imms & 0x3f) ;
+    if (len_bits == 0) return 0 ;
+    unsigned size = 1u << (31 - __builtin_clz(len_bits)) ;
+    unsigned ones = (imms & (size - 1)) + 1 ;
+    unsigned rotate = immr & (size - 1) ;
+    if (ones == size) return 0 ;
+
+    uint64_t elem_mask = size == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << size) - 1 ;
+    uint64_t elem = ((uint64_t) 1 << ones) - 1 ;
+    if (rotate) elem = ((elem >> rotate) | (elem << (size - rotate))) & elem_mask ;
+    for (unsigned s = size; s < 64; s *= 2) elem |= elem << s ;
+    return elem ;
+}
+
+static
+void build_bitmask_tables(void) {
+    for (word32_t e = 0; e < BITMASK_IMM_ENCODINGS; e++) {
+        uint64_t v = bitmask_values[e] = expand_bitmask(e) ;
+        if (!v) continue ;
+        // immr's bits above the element size are ignored, so values recur;
+        // the index keeps the first encoding of each, where they are clear
+        size_t mask = (1 << BITMASK_IMM_INDEX_BITS) - 1 ;
+        size_t s = bitmask_hash(v) ;
+        while (bitmask_index[s] && bitmask_values[bitmask_index[s] - 1] != v) s = (s + 1) & mask ;
+        if (!bitmask_index[s]) bitmask_index[s] = e + 1 ;
+    }
+}
+
+/**
+ * @brief The value of the bitmask immediate N:immr:imms, on 64 bits when
+ * `sf`, else 32.
+ * @return 0 when the encoding is reserved at that width.
+ */
+uint64_t bitmask_imm_decode(word32_t n_immr_imms, bool sf) {
+    pthread_once(&bitmask_tables_once, build_bitmask_tables) ;
+    if (!sf && (n_immr_imms >> 12)) return 0 ;
+    uint64_t v = bitmask_values[n_immr_imms & (BITMASK_IMM_ENCODINGS - 1)] ;
+    return sf ? v : v & 0xffffffff ;
+}
+
+/**
+ * @brief Finds the encoding of `value` as a bitmask immediate, on 64 bits
+ * when `sf`, else 32.
+ * @return false when `value` isn't one.
+ */
+bool bitmask_imm_encode(uint64_t value, bool sf, word32_t *n_immr_imms) {
+    pthread_once(&bitmask_tables_once, build_bitmask_tables) ;
+    if (!sf) {
+        // A 32-bit bitmask has elements of at most 32 bits, so is the 64-bit one repeating it
+        if (value >> 32) return false ;
+        value |= value << 32 ;
+    }
+    size_t mask = (1 << BITMASK_IMM_INDEX_BITS) - 1 ;
+    for (size_t s = bitmask_hash(value); bitmask_index[s]; s = (s + 1) & mask) {
+        word32_t e = bitmask_index[s] - 1 ;
+        if (bitmask_values[e] == value) {
+            *n_immr_imms = e ;
+            return true ;
+        }
+    }
+    return false ;
+}
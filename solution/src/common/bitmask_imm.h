@@ -0,0 +1,27 @@
+/**
+ * @file bitmask_imm.h
+ * @brief The bitmask immediates of the logical (immediate) instructions.
+ *
+ * A bitmask immediate is a run of ones, rotated within an element of 2, 4,
+ * ..., 64 bits, repeated to fill the register. It is encoded in 13 bits,
+ * N:immr:imms, which give 5334 distinct values on 64 bits, and 1302 on 32,
+ * those with elements of at most 32 bits. Both ways are looked up in tables
+ * built on first use: the value of each encoding, and a hash of the values
+ * back to their encodings.
+ */
+
+#ifndef __BITMASK_IMM_H
+#define __BITMASK_IMM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common/word.h"
+
+/// @brief The number of N:immr:imms encodings.
+#define BITMASK_IMM_ENCODINGS (1 << 13)
+
+uint64_t bitmask_imm_decode(word32_t n_immr_imms, bool sf) ;
+bool bitmask_imm_encode(uint64_t value, bool sf, word32_t *n_immr_imms) ;
+
+#endif
@@ -34,6 +34,12 @@ typedef struct {
     unsigned int shift :2 ;
 }   enc_mov ;
 
+typedef struct {
+    unsigned int opc :2 ;
+    unsigned int n_immr_imms :13 ;
+    unsigned int xn :5 ;
+}   enc_log_imm ;
+
 /*****************************************************************************/
 // Encoded Data Processing with shifted register operands
 
@@ -141,6 +147,7 @@ typedef struct {
     unsigned int xd :5 ;
     union {
         enc_add_imm add_imm ;
+        enc_log_imm log_imm ;
         enc_mov mov ;
     } ;
 }   enc_dp_imm ;
@@ -0,0 +1,530 @@
+#include <pthread.h>
+
+#include "common/bitmask_imm.h"
+#include "common/instr_table.h"
+#include "utils/log.h"
+
+/*********************************************************************************************************************/
+// Formats
+//
+// Each format `F` has
+//  INSTR_TP_F                          the case of `instr_t` it decodes to,
+//  dec_F(instr_t *, word32_t, pc, sem) filling an instr_t from its fields, false if they are reserved,
+//  is_F(const instr_t *, sem)          whether an instr_t is encoded by it,
+//  enc_F(const instr_t *)              its fields, to be or-ed with the entry's VALUE.
+
+/// @brief The register numbered `n`, where 31 means `r31`.
+static inline
+reg_t reg_of(word32_t n, reg_e r31, bool extended) {
+    return (reg_t) {.r = n == 31 ? r31 : (reg_e) n, .extended = extended} ;
+}
+
+static inline
+word32_t enc_reg(reg_t r) {
+    if (r.r == RZR || r.r == SP || r.r == PC) return 0x1f ;
+    return r.r ;
+}
+
+/// @brief The `bits`-bit two's complement `v`, sign extended.
+static inline
+int64_t sext(word32_t v, unsigned bits) {
+    return (int64_t) ((uint64_t) v << (64 - bits)) >> (64 - bits) ;
+}
+
+/// @brief The target of a pc-relative word offset `bits` wide.
+static inline
+address_t pc_rel(word32_t offset, unsigned bits, address_t pc) {
+    return pc + sext(offset, bits) * 4 ;
+}
+
+/// @brief The word offset from `from` to `to`, which must fit in `size` bits.
+static
+word32_t enc_offset(size_t size, address_t from, address_t to) {
+    int64_t offset = ((int64_t) (to - from)) / 4 ;
+    ASSERT_M(offset < (1 << size) && offset >= -(1 << size), "Offset too large: %ld", offset) ;
+    return (word32_t) offset & BIT_MASK(size) ;
+}
+
+// NOP
+
+#define INSTR_TP_NOP I_NOP
+
+static inline
+bool dec_NOP(instr_t *i, word32_t c, address_t pc, int sem) {
+    i->tp = I_NOP ;
+    return true ;
+}
+
+static inline
+bool is_NOP(const instr_t *i, int sem) {
+    return i->tp == I_NOP ;
+}
+
+static inline
+word32_t enc_NOP(const instr_t *i) {
+    return 0 ;
+}
+
+// ADD_IMM: add/sub (immediate)
+
+#define INSTR_TP_ADD_IMM I_DP
+
+static inline
+bool dec_ADD_IMM(instr_t *i, word32_t c, address_t pc, int sem) {
+    bool sf = FIELD_GET(c, sf) ;
+    i->tp = I_DP ;
+    i->dp.op_type = sem ;
+    i->dp.rd = reg_of(FIELD_GET(c, rd), RZR, sf) ;
+    i->dp.rn = reg_of(FIELD_GET(c, rn), RZR, sf) ;
+    i->dp.op2.type = OP2_IMM_SH ;
+    i->dp.op2.imm_sh.imm = FIELD_GET(c, imm12) ;
+    i->dp.op2.imm_sh.sh = (shift_arg) {.tp = LSL, .amount = FIELD_GET(c, sh) ? 12 : 0} ;
+    return true ;
+}
+
+static inline
+bool is_ADD_IMM(const instr_t *i, int sem) {
+    return i->tp == I_DP && i->dp.op2.type == OP2_IMM_SH && i->dp.op_type == sem ;
+}
+
+static inline
+word32_t enc_ADD_IMM(const instr_t *i) {
+    return FIELD_PUT(sf, i->dp.rd.extended)
+        | FIELD_PUT(sh, i->dp.op2.imm_sh.sh.amount != 0)
+        | FIELD_PUT(imm12, i->dp.op2.imm_sh.imm)
+        | FIELD_PUT(rn, enc_reg(i->dp.rn))
+        | FIELD_PUT(rd, enc_reg(i->dp.rd)) ;
+}
+
+// MOV: move wide (immediate)
+
+#define INSTR_TP_MOV I_DP
+
+static inline
+bool dec_MOV(instr_t *i, word32_t c, address_t pc, int sem) {
+    i->tp = I_DP ;
+    i->dp.op_type = sem ;
+    i->dp.rd = reg_of(FIELD_GET(c, rd), RZR, FIELD_GET(c, sf)) ;
+    i->dp.op2.type = OP2_IMM_SH ;
+    i->dp.op2.imm_sh.imm = FIELD_GET(c, imm16) ;
+    i->dp.op2.imm_sh.sh = (shift_arg) {.tp = LSL, .amount = FIELD_GET(c, hw) * 16} ;
+    return true ;
+}
+
+static inline
+bool is_MOV(const instr_t *i, int sem) {
+    return is_ADD_IMM(i, sem) ;
+}
+
+static inline
+word32_t enc_MOV(const instr_t *i) {
+    return FIELD_PUT(sf, i->dp.rd.extended)
+        | FIELD_PUT(hw, i->dp.op2.imm_sh.sh.amount / 16)
+        | FIELD_PUT(imm16, i->dp.op2.imm_sh.imm)
+        | FIELD_PUT(rd, enc_reg(i->dp.rd)) ;
+}
+
+// LOG_IMM: logical (immediate)
+
+#define INSTR_TP_LOG_IMM I_DP
+
+static inline
+bool dec_LOG_IMM(instr_t *i, word32_t c, address_t pc, int sem) {
+    bool sf = FIELD_GET(c, sf) ;
+    uint64_t imm = bitmask_imm_decode(FIELD_GET(c, n_immr_imms), sf) ;
+    if (!imm) return false ;
+    i->tp = I_DP ;
+    i->dp.op_type = sem ;
+    // Only ands, which sets the flags, writes to the zero register
+    i->dp.rd = reg_of(FIELD_GET(c, rd), sem == OP_ANDS ? RZR : SP, sf) ;
+    i->dp.rn = reg_of(FIELD_GET(c, rn), RZR, sf) ;
+    i->dp.op2.type = OP2_BITMASK ;
+    i->dp.op2.bitmask.imm = imm ;
+    return true ;
+}
+
+static inline
+bool is_LOG_IMM(const instr_t *i, int sem) {
+    return i->tp == I_DP && i->dp.op2.type == OP2_BITMASK && i->dp.op_type == sem ;
+}
+
+static inline
+word32_t enc_LOG_IMM(const instr_t *i) {
+    word32_t n_immr_imms ;
+    bool sf = i->dp.rd.extended ;
+    if (!bitmask_imm_encode(i->dp.op2.bitmask.imm, sf, &n_immr_imms))
+        log_exit_failure("Not a %d-bit bitmask immediate: %s", sf ? 64 : 32, show_instr(*i)) ;
+    return FIELD_PUT(sf, sf)
+        | FIELD_PUT(n_immr_imms, n_immr_imms)
+        | FIELD_PUT(rn, enc_reg(i->dp.rn))
+        | FIELD_PUT(rd, enc_reg(i->dp.rd)) ;
+}
+
+// DP_REG: add/sub and logical (shifted register)
+
+#define INSTR_TP_DP_REG I_DP
+
+static inline
+bool dec_DP_REG(instr_t *i, word32_t c, address_t pc, int sem) {
+    bool sf = FIELD_GET(c, sf) ;
+    i->tp = I_DP ;
+    i->dp.op_type = sem ;
+    i->dp.rd = reg_of(FIELD_GET(c, rd), RZR, sf) ;
+    i->dp.rn = reg_of(FIELD_GET(c, rn), RZR, sf) ;
+    i->dp.op2.type = OP2_REG_SH ;
+    i->dp.op2.reg_sh.rm = reg_of(FIELD_GET(c, rm), RZR, sf) ;
+    i->dp.op2.reg_sh.sh = (shift_arg) {.tp = FIELD_GET(c, shift), .amount = FIELD_GET(c, imm6)} ;
+    return true ;
+}
+
+static inline
+bool is_DP_REG(const instr_t *i, int sem) {
+    return i->tp == I_DP && i->dp.op2.type == OP2_REG_SH && i->dp.op_type == sem ;
+}
+
+static inline
+word32_t enc_DP_REG(const instr_t *i) {
+    return FIELD_PUT(sf, i->dp.rd.extended)
+        | FIELD_PUT(shift, i->dp.op2.reg_sh.sh.tp)
+        | FIELD_PUT(rm, enc_reg(i->dp.op2.reg_sh.rm))
+        | FIELD_PUT(imm6, i->dp.op2.reg_sh.sh.amount)
+        | FIELD_PUT(rn, enc_reg(i->dp.rn))
+        | FIELD_PUT(rd, enc_reg(i->dp.rd)) ;
+}
+
+// MUL: multiply-add/sub
+
+#define INSTR_TP_MUL I_DP
+
+static inline
+bool dec_MUL(instr_t *i, word32_t c, address_t pc, int sem) {
+    bool sf = FIELD_GET(c, sf) ;
+    i->tp = I_DP ;
+    i->dp.op_type = sem ;
+    i->dp.rd = reg_of(FIELD_GET(c, rd), RZR, sf) ;
+    i->dp.rn = reg_of(FIELD_GET(c, rn), RZR, sf) ;
+    i->dp.op2.type = OP2_MUL ;
+    i->dp.op2.mul.rm = reg_of(FIELD_GET(c, rm), RZR, sf) ;
+    i->dp.op2.mul.ra = reg_of(FIELD_GET(c, ra), RZR, sf) ;
+    return true ;
+}
+
+static inline
+bool is_MUL(const instr_t *i, int sem) {
+    return i->tp == I_DP && i->dp.op2.type == OP2_MUL && i->dp.op_type == sem ;
+}
+
+static inline
+word32_t enc_MUL(const instr_t *i) {
+    return FIELD_PUT(sf, i->dp.rd.extended)
+        | FIELD_PUT(rm, enc_reg(i->dp.op2.mul.rm))
+        | FIELD_PUT(ra, enc_reg(i->dp.op2.mul.ra))
+        | FIELD_PUT(rn, enc_reg(i->dp.rn))
+        | FIELD_PUT(rd, enc_reg(i->dp.rd)) ;
+}
+
+// B_COND, B, BR: branches
+
+#define INSTR_TP_B_COND I_B
+
+static inline
+bool dec_B_COND(instr_t *i, word32_t c, address_t pc, int sem) {
+    i->tp = I_B ;
+    i->b.tp = TP_BCond ;
+    i->b.cond = FIELD_GET(c, cond) ;
+    i->b.address = pc_rel(FIELD_GET(c, imm19), 19, pc) ;
+    i->b.label = INSTR_LABEL_B_COND ;
+    return true ;
+}
+
+static inline
+bool is_B_COND(const instr_t *i, int sem) {
+    return i->tp == I_B && i->b.tp == TP_BCond ;
+}
+
+static inline
+word32_t enc_B_COND(const instr_t *i) {
+    return FIELD_PUT(imm19, enc_offset(19, i->address, i->b.address))
+        | FIELD_PUT(cond, i->b.cond) ;
+}
+
+#define INSTR_TP_B I_B
+
+static inline
+bool dec_B(instr_t *i, word32_t c, address_t pc, int sem) {
+    i->tp = I_B ;
+    i->b.tp = TP_B ;
+    i->b.address = pc_rel(FIELD_GET(c, imm26), 26, pc) ;
+    i->b.label = INSTR_LABEL_DECODED ;
+    return true ;
+}
+
+static inline
+bool is_B(const instr_t *i, int sem) {
+    return i->tp == I_B && i->b.tp == TP_B ;
+}
+
+static inline
+word32_t enc_B(const instr_t *i) {
+    return FIELD_PUT(imm26, enc_offset(26, i->address, i->b.address)) ;
+}
+
+#define INSTR_TP_BR I_B
+
+static inline
+bool dec_BR(instr_t *i, word32_t c, address_t pc, int sem) {
+    i->tp = I_B ;
+    i->b.tp = TP_BR ;
+    i->b.rn = reg_of(FIELD_GET(c, rn), -1, true) ;
+    return true ;
+}
+
+static inline
+bool is_BR(const instr_t *i, int sem) {
+    return i->tp == I_B && i->b.tp == TP_BR ;
+}
+
+/// The decoder doesn't check bit 25 or op2 (20..16), so their ones aren't part of the entry's VALUE.
+static inline
+word32_t enc_BR(const instr_t *i) {
+    return 0x021f0000 | FIELD_PUT(rn, enc_reg(i->b.rn)) ;
+}
+
+// LS_LIT: load literal
+
+#define INSTR_TP_LS_LIT I_LS
+
+static inline
+bool dec_LS_LIT(instr_t *i, word32_t c, address_t pc, int sem) {
+    i->tp = I_LS ;
+    i->ls.op = sem ;
+    i->ls.arg_tp = LS_LIT ;
+    i->ls.rt = reg_of(FIELD_GET(c, rt), -1, FIELD_GET(c, ls_sf)) ;
+    i->ls.lit.lit = pc_rel(FIELD_GET(c, imm19), 19, pc) ;
+    i->ls.lit.label = INSTR_LABEL_DECODED ;
+    return true ;
+}
+
+static inline
+bool is_LS_LIT(const instr_t *i, int sem) {
+    return i->tp == I_LS && i->ls.arg_tp == LS_LIT && i->ls.op == sem ;
+}
+
+static inline
+word32_t enc_LS_LIT(const instr_t *i) {
+    return FIELD_PUT(ls_sf, i->ls.rt.extended)
+        | FIELD_PUT(imm19, enc_offset(19, i->address, i->ls.lit.lit))
+        | FIELD_PUT(rt, enc_reg(i->ls.rt)) ;
+}
+
+// LS_REG, LS_UOFF, LS_POST, LS_PRE: load/store register, of size 0b1x
+
+/// @brief Fills the fields common to the load/store formats other than LS_LIT.
+static inline
+void dec_ls(instr_t *i, word32_t c, int sem, e_ls_tp arg_tp) {
+    i->tp = I_LS ;
+    i->ls.op = sem ;
+    i->ls.arg_tp = arg_tp ;
+    i->ls.rt = reg_of(FIELD_GET(c, rt), -1, FIELD_GET(c, ls_sf)) ;
+}
+
+static inline
+word32_t enc_ls(const instr_t *i, reg_t rn) {
+    return FIELD_PUT(size, 0b10 | i->ls.rt.extended)
+        | FIELD_PUT(rn, enc_reg(rn))
+        | FIELD_PUT(rt, enc_reg(i->ls.rt)) ;
+}
+
+static inline
+bool is_ls_imm(const instr_t *i, int sem, e_ls_idx idx) {
+    return i->tp == I_LS && i->ls.arg_tp == LS_IMM && i->ls.imm.idx_tp == idx && i->ls.op == sem ;
+}
+
+#define INSTR_TP_LS_REG I_LS
+
+static inline
+bool dec_LS_REG(instr_t *i, word32_t c, address_t pc, int sem) {
+    dec_ls(i, c, sem, LS_REG) ;
+    i->ls.reg.rn = reg_of(FIELD_GET(c, rn), SP, true) ;
+    i->ls.reg.rm = reg_of(FIELD_GET(c, rm), RZR, true) ;
+    i->ls.reg.extend = (extend_t) {.tp = FIELD_GET(c, option), .amount = FIELD_GET(c, s) * 3} ;
+    return true ;
+}
+
+static inline
+bool is_LS_REG(const instr_t *i, int sem) {
+    return i->tp == I_LS && i->ls.arg_tp == LS_REG && i->ls.op == sem ;
+}
+
+static inline
+word32_t enc_LS_REG(const instr_t *i) {
+    return enc_ls(i, i->ls.reg.rn)
+        | FIELD_PUT(rm, enc_reg(i->ls.reg.rm))
+        | FIELD_PUT(option, i->ls.reg.extend.tp)
+        | FIELD_PUT(s, i->ls.reg.extend.amount != 0) ;
+}
+
+#define INSTR_TP_LS_UOFF I_LS
+
+static inline
+bool dec_LS_UOFF(instr_t *i, word32_t c, address_t pc, int sem) {
+    dec_ls(i, c, sem, LS_IMM) ;
+    i->ls.imm.idx_tp = IDX_U_OFFSET ;
+    i->ls.imm.rn = reg_of(FIELD_GET(c, rn), SP, true) ;
+    i->ls.imm.imm = FIELD_GET(c, imm12) * 8 ;
+    return true ;
+}
+
+static inline
+bool is_LS_UOFF(const instr_t *i, int sem) {
+    return is_ls_imm(i, sem, IDX_U_OFFSET) ;
+}
+
+static inline
+word32_t enc_LS_UOFF(const instr_t *i) {
+    return enc_ls(i, i->ls.imm.rn)
+        | FIELD_PUT(imm12, i->ls.imm.imm / (i->ls.rt.extended ? 8 : 4)) ;
+}
+
+/// @brief Fills a pre/post-indexed load/store, of index type `idx`.
+static inline
+void dec_ls_simm(instr_t *i, word32_t c, int sem, e_ls_idx idx) {
+    dec_ls(i, c, sem, LS_IMM) ;
+    i->ls.imm.idx_tp = idx ;
+    i->ls.imm.rn = reg_of(FIELD_GET(c, rn), SP, true) ;
+    i->ls.imm.imm = sext(FIELD_GET(c, imm9), 9) ;
+}
+
+static inline
+word32_t enc_ls_simm(const instr_t *i) {
+    return enc_ls(i, i->ls.imm.rn) | FIELD_PUT(imm9, i->ls.imm.imm) ;
+}
+
+#define INSTR_TP_LS_POST I_LS
+
+static inline
+bool dec_LS_POST(instr_t *i, word32_t c, address_t pc, int sem) {
+    dec_ls_simm(i, c, sem, IDX_POST) ;
+    return true ;
+}
+
+static inline
+bool is_LS_POST(const instr_t *i, int sem) {
+    return is_ls_imm(i, sem, IDX_POST) ;
+}
+
+static inline
+word32_t enc_LS_POST(const instr_t *i) {
+    return enc_ls_simm(i) ;
+}
+
+#define INSTR_TP_LS_PRE I_LS
+
+static inline
+bool dec_LS_PRE(instr_t *i, word32_t c, address_t pc, int sem) {
+    dec_ls_simm(i, c, sem, IDX_PRE) ;
+    return true ;
+}
+
+static inline
+bool is_LS_PRE(const instr_t *i, int sem) {
+    return is_ls_imm(i, sem, IDX_PRE) ;
+}
+
+static inline
+word32_t enc_LS_PRE(const instr_t *i) {
+    return enc_ls_simm(i) ;
+}
+
+/*********************************************************************************************************************/
+// Expansions of the table
+
+const instr_info_t instr_info[INSTR_COUNT] = {
+#define INSTR_INFO(name, mnem, m, v, fmt, op) \
+    [INSTR_ ## name] = {.mnemonic = mnem, .mask = m, .value = v, .tp = INSTR_TP_ ## fmt, .sem = op},
+    INSTR_TABLE(INSTR_INFO)
+#undef INSTR_INFO
+} ;
+
+/*
+ * The decoder first looks up the bits of `c` that the entries test, which
+ * are the op0 (28..25) and opcode fields of every family: bits 31..21, 15
+ * and 11..10. Indexed by those, `decode_table` holds the first entry that
+ * agrees with them, and decoding enters the chain of entries there. Every
+ * MASK bar NOP's lies within the key, so the first test almost always
+ * matches.
+ */
+#define DECODE_KEY_MASK 0xffe08c00
+#define DECODE_KEY_BITS 14
+
+_Static_assert(INSTR_COUNT < UINT8_MAX, "decode_table entries are bytes") ;
+
+static uint8_t decode_table[1 << DECODE_KEY_BITS] ;
+static pthread_once_t decode_table_once = PTHREAD_ONCE_INIT ;
+
+static inline
+uint32_t decode_key(word32_t c) {
+    return (c >> 21) << 3 | ((c >> 15) & 1) << 2 | ((c >> 10) & 3) ;
+}
+
+/// @brief The word with only the key bits `k` set, inverse to `decode_key`.
+static
+word32_t decode_key_word(uint32_t k) {
+    return (k >> 3) << 21 | ((k >> 2) & 1) << 15 | (k & 3) << 10 ;
+}
+
+static
+void build_decode_table(void) {
+    for (uint32_t k = 0 ; k < (1 << DECODE_KEY_BITS) ; k++) {
+        word32_t w = decode_key_word(k) ;
+        uint8_t id = INSTR_COUNT ;
+        for (size_t e = 0 ; e < INSTR_COUNT ; e++) {
+            if (((w ^ instr_info[e].value) & instr_info[e].mask & DECODE_KEY_MASK) == 0) {
+                id = e ;
+                break ;
+            }
+        }
+        decode_table[k] = id ;
+    }
+}
+
+/**
+ * @brief Decodes word `c` at `pc` into `i`, as the first entry of the
+ * instruction table it is an instance of.
+ * @return false when no entry matches, leaving `i` undefined.
+ */
+bool instr_decode(instr_t *i, word32_t c, address_t pc) {
+    pthread_once(&decode_table_once, build_decode_table) ;
+    i->address = pc ;
+    switch (decode_table[decode_key(c)]) {
+#define INSTR_DECODE(name, mnem, mask, value, fmt, sem) \
+    case INSTR_ ## name:                                            \
+        if ((c & (mask)) == (value) && dec_ ## fmt(i, c, pc, sem)) return true ; \
+        __attribute__((fallthrough)) ;
+    INSTR_TABLE(INSTR_DECODE)
+#undef INSTR_DECODE
+    default:
+        return false ;
+    }
+}
+
+/**
+ * @brief Encodes `i` as the first entry of the instruction table it is an
+ * instance of; @c .int directives are their own encoding.
+ */
+word32_t instr_encode(instr_t i) {
+    if (i.tp == I_DIRECTIVE) return i.int_directive ;
+#define INSTR_ENCODE(name, mnem, mask, value, fmt, sem) \
+    if (is_ ## fmt(&i, sem)) return (value) | enc_ ## fmt(&i) ;
+    INSTR_TABLE(INSTR_ENCODE)
+#undef INSTR_ENCODE
+    log_exit_failure("Cannot encode instruction: %s", show_instr(i)) ;
+}
+
+/// @brief The mnemonic of data processing operation `op`.
+const char *instr_dp_mnemonic(dp_op op) {
+    for (size_t k = 0 ; k < INSTR_COUNT ; k++) {
+        if (instr_info[k].tp == I_DP && instr_info[k].sem == op) return instr_info[k].mnemonic ;
+    }
+    log_exit_failure("Unknown dp_op %u", op) ;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file instr_table.h
+ * @brief The instruction table: every encoding the assembler and emulator know.
+ *
+ * Each entry of `INSTR_TABLE` is
+ *  X(NAME, "mnemonic", MASK, VALUE, FORMAT, SEM)
+ * A word `c` is an instance of the entry when `(c & MASK) == VALUE`, and
+ * entries are tried in order, so an encoding must come before any looser
+ * one it overlaps. FORMAT names the layout of the remaining fields (listed
+ * below, with their decoders and encoders in instr_table.c), and SEM is the
+ * AST operation the entry means: the `dp_op`, `e_ls_op` or branch type that
+ * the executors run. A format's decoder may still reject a word whose
+ * fields are reserved, e.g. a bitmask immediate of all ones, and the
+ * entries after it are then tried.
+ *
+ * The decoder, encoder and the printer's mnemonics are expanded from the
+ * table, one specialised case per entry, so adding an instruction is adding
+ * an entry here, and a format in instr_table.c if its layout is new.
+ */
+
+#ifndef __INSTR_TABLE_H
+#define __INSTR_TABLE_H
+
+#include <stdbool.h>
+
+#include "common/ast.h"
+#include "common/word.h"
+#include "utils/bits.h"
+
+#define INSTR_TABLE(X) \
+    X(NOP,       "nop",  0xffffffff, 0xd503201f, NOP,      0)         \
+    /* Data processing (immediate) */                                \
+    X(ADD_IMM,   "add",  0x7f800000, 0x11000000, ADD_IMM,  OP_ADD)    \
+    X(ADDS_IMM,  "adds", 0x7f800000, 0x31000000, ADD_IMM,  OP_ADDS)   \
+    X(SUB_IMM,   "sub",  0x7f800000, 0x51000000, ADD_IMM,  OP_SUB)    \
+    X(SUBS_IMM,  "subs", 0x7f800000, 0x71000000, ADD_IMM,  OP_SUBS)   \
+    X(MOVN,      "movn", 0x7f800000, 0x12800000, MOV,      OP_MOVN)   \
+    X(MOVZ,      "movz", 0x7f800000, 0x52800000, MOV,      OP_MOVZ)   \
+    X(MOVK,      "movk", 0x7f800000, 0x72800000, MOV,      OP_MOVK)   \
+    X(AND_IMM,   "and",  0x7f800000, 0x12000000, LOG_IMM,  OP_AND)    \
+    X(ORR_IMM,   "orr",  0x7f800000, 0x32000000, LOG_IMM,  OP_ORR)    \
+    X(EOR_IMM,   "eor",  0x7f800000, 0x52000000, LOG_IMM,  OP_EOR)    \
+    X(ANDS_IMM,  "ands", 0x7f800000, 0x72000000, LOG_IMM,  OP_ANDS)   \
+    /* Data processing (register) */                                 \
+    X(MADD,      "madd", 0x1f008000, 0x1b000000, MUL,      OP_MADD)   \
+    X(MSUB,      "msub", 0x1f008000, 0x1b008000, MUL,      OP_MSUB)   \
+    X(AND,       "and",  0x7f200000, 0x0a000000, DP_REG,   OP_AND)    \
+    X(BIC,       "bic",  0x7f200000, 0x0a200000, DP_REG,   OP_BIC)    \
+    X(ORR,       "orr",  0x7f200000, 0x2a000000, DP_REG,   OP_ORR)    \
+    X(ORN,       "orn",  0x7f200000, 0x2a200000, DP_REG,   OP_ORN)    \
+    X(EOR,       "eor",  0x7f200000, 0x4a000000, DP_REG,   OP_EOR)    \
+    X(EON,       "eon",  0x7f200000, 0x4a200000, DP_REG,   OP_EON)    \
+    X(ANDS,      "ands", 0x7f200000, 0x6a000000, DP_REG,   OP_ANDS)   \
+    X(BICS,      "bics", 0x7f200000, 0x6a200000, DP_REG,   OP_BICS)   \
+    X(ADD_REG,   "add",  0x7f200000, 0x0b000000, DP_REG,   OP_ADD)    \
+    X(ADDS_REG,  "adds", 0x7f200000, 0x2b000000, DP_REG,   OP_ADDS)   \
+    X(SUB_REG,   "sub",  0x7f200000, 0x4b000000, DP_REG,   OP_SUB)    \
+    X(SUBS_REG,  "subs", 0x7f200000, 0x6b000000, DP_REG,   OP_SUBS)   \
+    /* Branches */                                                   \
+    X(B_COND,    "b",    0xfc000000, 0x54000000, B_COND,   TP_BCond)  \
+    X(B,         "b",    0x7c000000, 0x14000000, B,        TP_B)      \
+    X(BR,        "br",   0xfc000000, 0xd4000000, BR,       TP_BR)     \
+    /* Loads and stores */                                           \
+    X(LDR_LIT,   "ldr",  0x3b000000, 0x18000000, LS_LIT,   OP_LDR)    \
+    X(STR_REG,   "str",  0x3b600c00, 0x38200800, LS_REG,   OP_STR)    \
+    X(LDR_REG,   "ldr",  0x3b600c00, 0x38600800, LS_REG,   OP_LDR)    \
+    X(STR_UOFF,  "str",  0x3b400000, 0x39000000, LS_UOFF,  OP_STR)    \
+    X(LDR_UOFF,  "ldr",  0x3b400000, 0x39400000, LS_UOFF,  OP_LDR)    \
+    X(STR_POST,  "str",  0x3b600c00, 0x38000400, LS_POST,  OP_STR)    \
+    X(STR_PRE,   "str",  0x3b600c00, 0x38000c00, LS_PRE,   OP_STR)    \
+    X(LDR_POST,  "ldr",  0x3b600c00, 0x38400400, LS_POST,  OP_LDR)    \
+    X(LDR_PRE,   "ldr",  0x3b600c00, 0x38400c00, LS_PRE,   OP_LDR)
+
+/*
+ * The field layouts of each format, as (name, high bit, low bit). Bits
+ * covered by the entry's MASK are fixed, and aren't listed.
+ *
+ *  NOP     -
+ *  ADD_IMM sf 31, sh 22, imm12 21..10, rn 9..5, rd 4..0
+ *  MOV     sf 31, hw 22..21, imm16 20..5, rd 4..0
+ *  LOG_IMM sf 31, N:immr:imms 22..10, rn 9..5, rd 4..0
+ *  DP_REG  sf 31, shift 23..22, rm 20..16, imm6 15..10, rn 9..5, rd 4..0
+ *  MUL     sf 31, rm 20..16, ra 14..10, rn 9..5, rd 4..0
+ *  B_COND  imm19 23..5, cond 3..0
+ *  B       imm26 25..0
+ *  BR      rn 9..5
+ *  LS_LIT  sf 30, imm19 23..5, rt 4..0
+ *  LS_REG  size 31..30, rm 20..16, option 15..13, s 12, rn 9..5, rt 4..0
+ *  LS_UOFF size 31..30, imm12 21..10, rn 9..5, rt 4..0
+ *  LS_POST size 31..30, imm9 20..12, rn 9..5, rt 4..0
+ *  LS_PRE  size 31..30, imm9 20..12, rn 9..5, rt 4..0
+ */
+#define FIELD_sf     31, 31
+#define FIELD_size   31, 30
+#define FIELD_ls_sf  30, 30
+#define FIELD_shift  23, 22
+#define FIELD_sh     22, 22
+#define FIELD_hw     22, 21
+#define FIELD_n_immr_imms 22, 10
+#define FIELD_imm12  21, 10
+#define FIELD_imm16  20, 5
+#define FIELD_imm9   20, 12
+#define FIELD_imm26  25, 0
+#define FIELD_imm19  23, 5
+#define FIELD_rm     20, 16
+#define FIELD_option 15, 13
+#define FIELD_s      12, 12
+#define FIELD_imm6   15, 10
+#define FIELD_ra     14, 10
+#define FIELD_rn     9, 5
+#define FIELD_rd     4, 0
+#define FIELD_rt     4, 0
+#define FIELD_cond   3, 0
+
+#define FIELD_APPLY(m, args) m args
+#define FIELD_GET_(c, hi, lo) (((c) >> (lo)) & BIT_MASK((hi) - (lo) + 1))
+#define FIELD_PUT_(v, hi, lo) (((word32_t) (v) & BIT_MASK((hi) - (lo) + 1)) << (lo))
+
+/// @brief Field `f` of word `c`, e.g. `FIELD_GET(c, rd)`.
+#define FIELD_GET(c, f) FIELD_APPLY(FIELD_GET_, (c, FIELD_ ## f))
+/// @brief `v` placed in field `f` of a word, truncated to its width.
+#define FIELD_PUT(f, v) FIELD_APPLY(FIELD_PUT_, (v, FIELD_ ## f))
+
+/// @brief The labels the decoder gives the targets of branches and literal loads.
+#define INSTR_LABEL_B_COND "decoded"
+#define INSTR_LABEL_DECODED "<decoded>"
+
+/// @brief An entry of the instruction table.
+typedef enum instr_id {
+#define INSTR_ID(name, mnem, mask, value, fmt, sem) INSTR_ ## name,
+    INSTR_TABLE(INSTR_ID)
+#undef INSTR_ID
+    INSTR_COUNT
+}   instr_id_e ;
+
+/// @brief An entry of the instruction table, as data.
+typedef struct instr_info {
+    const char *mnemonic ;
+    word32_t mask ;
+    word32_t value ;
+    /// @brief The case of `instr_t` the entry decodes to.
+    instr_type tp ;
+    /// @brief The operation within that case.
+    int sem ;
+}   instr_info_t ;
+
+extern const instr_info_t instr_info[INSTR_COUNT] ;
+
+bool instr_decode(instr_t *i, word32_t c, address_t pc) ;
+word32_t instr_encode(instr_t i) ;
+const char *instr_dp_mnemonic(dp_op op) ;
+
+#endif
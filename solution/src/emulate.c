@@ -1,9 +1,21 @@
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "emulator/emulator.h"
 #include "emulator/loader.h"
+#include "emulator/threaded.h"
+#include "emulator/block.h"
+#include "emulator/jit.h"
+#include "emulator/uop.h"
+#include "emulator/aot.h"
+#include "emulator/predecode.h"
+#include "emulator/decoder/decode_memo.h"
 #include "utils/log.h"
 #include "utils/file.h"
+#include "utils/outbuf.h"
+#include "utils/clock.h"
 
 
 void setup_emulate_log() {
@@ -11,15 +23,192 @@ void setup_emulate_log() {
     set_log_output(LOG_STDOUT);
 }
 
+typedef struct arg_config {
+    char *src ;
+    char *dst ;
+    engine_t engine ;
+    memory_config_t memory ;
+    state_format_e format ;
+    char *object ;
+    char *memo ;
+    bool help ;
+    bool stats ;
+    bool predecode ;
+    bool fingerprint ;
+}   arg_config ;
+
+static const char *options = "[-(h|s|p)] [-e <engine> | -a <object>] [-m <memo>] [--memory=<backend>] [--memory-size=<size>] [--huge-pages] [--format=<format> | --fingerprint] <binary> [<output>]";
+static const char *help =
+    "  -h: help (print this)\n"
+    "  -s: print the instructions run, and how fast, to stderr, and for\n"
+    "      the threaded and block engines, the uops fused, and for the\n"
+    "      block engine, its superinstructions\n"
+    "  -p: predecode: classify every word of <binary> (with AVX2 where the\n"
+    "      CPU has it) and decode all of its instructions before running it\n"
+    "  -e <engine>: how to run the binary, one of\n"
+    "      trace: interpret, logging each instruction (default)\n"
+    "      switch: interpret\n"
+    "      threaded: run as threaded code\n"
+    "      block: run as chained blocks of threaded code\n"
+    "      jit: compile blocks to native code (x86-64 hosts; block elsewhere)\n"
+    "  -a <object>: run the shared object recompiled from <binary> by\n"
+    "      `make recompile BIN=<binary>`, interpreting anything it doesn't cover\n"
+    "  -m <memo>: start with the decodings saved in the file <memo>, if it\n"
+    "      exists, and save them there, with this run's, at the end\n"
+    "  --memory=<backend>: where the guest memory lives, one of\n"
+    "      heap: allocated blocks, each access checked (default)\n"
+    "      mmu: a reserved host region, guest address a at base + a, out\n"
+    "      of bounds accesses caught as faults\n"
+    "  --memory-size=<size>: the bytes of main memory, from address 0, with\n"
+    "      an optional K, M or G suffix, a multiple of 4K (default 2M); only\n"
+    "      the pages written to are allocated\n"
+    "  --huge-pages: with --memory=mmu, back main memory with huge pages\n"
+    "  --format=<format>: how to write the final cpu state, one of\n"
+    "      text: registers, flags and non-zero memory, a line each (default)\n"
+    "      bin: a fixed layout binary record, see `state.h`, for `statecmp`\n"
+    "      json: the same as JSON\n"
+    "      the emulator logs to stdout, so give an <output> with bin or json\n"
+    "  --fingerprint: write the 128-bit fingerprint of the final cpu state,\n"
+    "      see `fingerprint.h`, in hex in place of the state\n"
+    "  <binary>: the file containing the binary to emulate\n"
+    "  <output>: the file to write the final cpu state to (default stdout)\n" ;
+
+static memory_backend_t parse_memory(const char *name) {
+    if (strcmp(name, "heap") == 0) return MEMORY_HEAP ;
+    if (strcmp(name, "mmu") == 0) return MEMORY_MMU ;
+    log_exit_failure("Unknown memory backend %s\n", name) ;
+}
+
+/**
+ * @brief Parses a size in bytes, with an optional K, M or G suffix. It must
+ * be a whole number of pages: the mmu backend commits whole pages, and
+ * would let accesses past the size into the last.
+ */
+static size_t parse_size(const char *s) {
+    char *end ;
+    errno = 0 ;
+    unsigned long long n = strtoull(s, &end, 0) ;
+    unsigned shift = 0 ;
+    switch (*end) {
+    case 'K': shift = 10 ; end++ ; break ;
+    case 'M': shift = 20 ; end++ ; break ;
+    case 'G': shift = 30 ; end++ ; break ;
+    }
+    if (end == s || *s == '-' || *end != '\0' || n == 0 || errno == ERANGE || n > (SIZE_MAX >> shift))
+        log_exit_failure("Invalid memory size %s\n", s) ;
+    n <<= shift ;
+    if (n % MEMORY_PAGE_BYTES != 0)
+        log_exit_failure("Memory size %s is not a multiple of the %d byte page\n", s, MEMORY_PAGE_BYTES) ;
+    return n ;
+}
+
+static state_format_e parse_format(const char *name) {
+    if (strcmp(name, "text") == 0) return STATE_FORMAT_TEXT ;
+    if (strcmp(name, "bin") == 0) return STATE_FORMAT_BIN ;
+    if (strcmp(name, "json") == 0) return STATE_FORMAT_JSON ;
+    log_exit_failure("Unknown output format %s\n", name) ;
+}
+
+static engine_t parse_engine(const char *name) {
+    if (strcmp(name, "trace") == 0) return ENGINE_TRACE ;
+    if (strcmp(name, "switch") == 0) return ENGINE_SWITCH ;
+    if (strcmp(name, "threaded") == 0) return ENGINE_THREADED ;
+    if (strcmp(name, "block") == 0) return ENGINE_BLOCK ;
+    if (strcmp(name, "jit") == 0) return ENGINE_JIT ;
+    log_exit_failure("Unknown engine %s\n", name) ;
+}
+
+void parse_arg(int argc, char **args, int *argi, arg_config *cfg) {
+    char *arg = args[*argi] ;
+    if (strncmp(arg, "--memory=", strlen("--memory=")) == 0) {
+        cfg->memory.backend = parse_memory(arg + strlen("--memory=")) ;
+    } else if (strncmp(arg, "--memory-size=", strlen("--memory-size=")) == 0) {
+        cfg->memory.size = parse_size(arg + strlen("--memory-size=")) ;
+    } else if (strcmp(arg, "--huge-pages") == 0) {
+        cfg->memory.huge_pages = true ;
+    } else if (strcmp(arg, "--fingerprint") == 0) {
+        cfg->fingerprint = true ;
+    } else if (strncmp(arg, "--format=", strlen("--format=")) == 0) {
+        cfg->format = parse_format(arg + strlen("--format=")) ;
+    } else if (arg[0] == '-') {
+        if (arg[1] == 'h') {
+            cfg->help = true ;
+        } else if (arg[1] == 's') {
+            cfg->stats = true ;
+        } else if (arg[1] == 'p') {
+            cfg->predecode = true ;
+        } else if (arg[1] == 'e') {
+            if (++*argi >= argc) log_exit_failure("Missing engine after %s\n", arg) ;
+            cfg->engine = parse_engine(args[*argi]) ;
+        } else if (arg[1] == 'a') {
+            if (++*argi >= argc) log_exit_failure("Missing object after %s\n", arg) ;
+            cfg->object = args[*argi] ;
+            cfg->engine = ENGINE_AOT ;
+        } else if (arg[1] == 'm') {
+            if (++*argi >= argc) log_exit_failure("Missing memo file after %s\n", arg) ;
+            cfg->memo = args[*argi] ;
+        } else {
+            log_exit_failure("Unknown argument %s\n", arg) ;
+        }
+    } else {
+        if (cfg->src == NULL) {
+            cfg->src = arg ;
+        } else if (cfg->dst == NULL) {
+            cfg->dst = arg ;
+        } else {
+            log_exit_failure("Too many arguments\n") ;
+        }
+    }
+}
+
+void parse_args(int argc, char **argv, arg_config *cfg) {
+    if (argc < 2)
+        log_exit_failure("Usage: %s %s\n", argv[0], options);
+
+    for (int i = 1; i < argc; i++) {
+        parse_arg(argc, argv, &i, cfg) ;
+    }
+}
+
+/// @brief Print what the block engine's profile found, see `block_profile`.
+static
+void print_super_stats(FILE *f) {
+    const block_super_stats_t *st = &block_super_stats ;
+    if (st->profiled_at == 0) {
+        fprintf(f, "superinstructions: never profiled\n") ;
+        return ;
+    }
+    fprintf(f, "profiled after %lu instructions, hottest runs (* made superinstructions):\n",
+            st->profiled_at) ;
+    for (size_t i = 0; i < st->n_hot; i++) {
+        const block_run_t *r = &st->hot[i] ;
+        fprintf(f, "  %12lu %c", r->count, r->used ? '*' : ' ') ;
+        for (size_t k = 0; k < r->len; k++) fprintf(f, " %s", show_uop_kind(r->kinds[k])) ;
+        fprintf(f, "\n") ;
+    }
+    fprintf(f, "superinstructions: %lu translated, %lu run\n", st->translated, st->runs) ;
+}
+
 int main(int argc, char **argv) {
     setup_emulate_log() ;
 
-    if (argc < 2) log_exit_failure("Usage: %s <binary> [output]\n", argv[0]);
+    arg_config cfg = { .engine = ENGINE_TRACE, .memory = {.size = MAXIMUM_MEMORY_SIZE_BYTES} } ;
+    parse_args(argc, argv, &cfg) ;
+
+    if (cfg.help) {
+        printf("Usage: %s %s\n", argv[0], options) ;
+        printf("%s", help) ;
+        exit(EXIT_SUCCESS) ;
+    }
+    if (cfg.src == NULL) log_exit_failure("Usage: %s %s\n", argv[0], options);
 
-    char *filename = argv[1];
+    char *filename = cfg.src;
     FILE *in = s_fopen(filename, "rb", "binary file") ;
 
-    cpu_t *cpu = init_cpu(MAXIMUM_MEMORY_SIZE_BYTES) ;
+    if (cfg.memo && !decode_memo_load(cfg.memo))
+        fprintf(stderr, "Ignoring the rest of decode memo %s: unreadable, or from another build\n", cfg.memo) ;
+
+    cpu_t *cpu = init_cpu_config(&cfg.memory) ;
 
     size_t count = 0 ;
     int load_result = load_bin(cpu->memory, in, &count);
@@ -27,22 +216,81 @@ int main(int argc, char **argv) {
 
     if (load_result == LOAD_FAIL)
         log_exit_failure("Error: failed to load binary data from '%s'.\n", filename);
-    
+
     FILE *out ;
-    if (argc >= 3) {
-        char *fileout = argv[2] ;
-        out = s_fopen(fileout, "wb", "output file");
+    if (cfg.dst != NULL) {
+        out = s_fopen(cfg.dst, "wb", "output file");
     } else {
         out = freopen(NULL, "wb", stdout) ;
         if (!stdout) log_exit_failure("Error: failed to reopen standard output in binary mode.\n") ;
     }
 
+    if (cfg.predecode) predecode_image(cpu, count) ;
+
+    aot_image_t *img = NULL ;
+    if (cfg.engine == ENGINE_AOT) img = aot_open(cfg.object, cpu, count) ;
+
     loglvl(LOG_1, "Emulating: %s\n", filename) ;
-    emulate(out, cpu, count);
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    switch (cfg.engine) {
+    case ENGINE_TRACE: emulate(out, cpu, count) ; break ;
+    case ENGINE_SWITCH: emulate_main(cpu) ; break ;
+    case ENGINE_THREADED: emulate_threaded(cpu) ; break ;
+    case ENGINE_BLOCK: emulate_blocks(cpu) ; break ;
+    case ENGINE_JIT: emulate_jit(cpu) ; break ;
+    case ENGINE_AOT: emulate_aot(cpu, img) ; break ;
+    }
+    double secs = seconds_since(&start) ;
     loglvl(LOG_1, "Emulation Done\n") ;
-    f_dump_cpu(out, cpu) ;
-    f_dump_mem(out, cpu, 0, count, PRINTM_MEMORY) ;
+    if (cfg.stats) {
+        fprintf(stderr, "%lu instructions in %.6fs: %.2f MIPS\n",
+                cpu->n_instrs, secs, secs > 0 ? cpu->n_instrs / secs / 1e6 : 0.0) ;
+        fprintf(stderr, "decode memo: %zu words, %lu hits, %lu misses\n",
+                decode_memo.n_used, decode_memo_counts.hits, decode_memo_counts.misses) ;
+        fprintf(stderr, "tlb: %lu misses, %lu fills\n",
+                cpu->memory->tlb.misses, cpu->memory->tlb.fills) ;
+        memory_block_t *m = cpu->memory->memory ;
+        if (m->pages) fprintf(stderr, "memory: %zu of %zu pages allocated\n", m->n_touched, m->n_pages) ;
+        if (cfg.predecode) {
+            predecode_stats_t *p = &predecode_stats ;
+            fprintf(stderr, "predecode: %zu words classified in %.6fs (%s), %zu decoded in %.6fs\n",
+                    p->words, p->classify_secs, predecode_impl() == PREDECODE_IMPL_AVX2 ? "avx2" : "scalar",
+                    p->decoded, p->decode_secs) ;
+        }
+        if (cfg.engine == ENGINE_THREADED || cfg.engine == ENGINE_BLOCK) {
+            uop_fuse_stats_t *f = &uop_fuse_stats ;
+            fprintf(stderr, "fused: %lu compare and branch (%lu without flags), "
+                    "%lu constants (%lu instructions)\n",
+                    f->cmp_branch, f->flags_dead, f->constants, f->const_instrs) ;
+        }
+        if (cfg.engine == ENGINE_BLOCK) print_super_stats(stderr) ;
+    }
+    // The whole state, written at once
+    outbuf_t dump ;
+    outbuf_init(&dump, out, OUTBUF_CAPACITY) ;
+    if (cfg.fingerprint) {
+        fingerprint_t fp = cpu_fingerprint(cpu) ;
+        char *p = outbuf_reserve(&dump, 40) ;
+        p = fmt_hex(p, fp.hi, 16) ;
+        p = fmt_hex(p, fp.lo, 16) ;
+        outbuf_commit(&dump, FMT_LIT(p, "\n")) ;
+    } else if (cfg.format == STATE_FORMAT_TEXT) {
+        buf_dump_cpu(&dump, cpu) ;
+        buf_dump_mem(&dump, cpu) ;
+    } else {
+        state_t state ;
+        cpu_state(cpu, &state) ;
+        if (cfg.format == STATE_FORMAT_BIN) state_write_bin(&dump, &state) ;
+        else state_write_json(&dump, &state) ;
+        state_free(&state) ;
+    }
+    outbuf_close(&dump) ;
+    if (img) aot_close(img) ;
     free_cpu(cpu);
+    if (cfg.memo && !decode_memo_save(cfg.memo))
+        fprintf(stderr, "Failed to save decode memo %s\n", cfg.memo) ;
+    free_decode_memo() ;
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,217 @@
+/**
+ * @file alu.h
+ * @brief The arithmetic of the emulated cpu, shared by every execution engine.
+ *
+ * These take operand values rather than instructions, so an engine that
+ * resolves its operands ahead of time (see `threaded.c`) computes exactly
+ * what the switch interpreter in `emulator.c` does.
+ */
+
+#ifndef __ALU_H
+#define __ALU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common/ast.h"
+#include "emulator/emulator.h"
+#include "utils/log.h"
+
+/// @brief Perform a right rotation on `x` by `shift_amount` bits.
+/// @param x - The value to shift.
+/// @param shift_amount - The amount to shift by.
+/// @return `x` rotated right by `shift_amount` bits.
+static inline
+uint64_t alu_ror(uint64_t x, uint64_t shift_amount, bool extended) {
+    if (extended) { return (x >> shift_amount) | (x << (64 - shift_amount)) ; }
+    else {
+        x = x & 0xffffffff ;
+        return (x >> shift_amount) | (x << (32 - shift_amount)) ;
+    }
+}
+
+static inline
+uint64_t alu_asr(uint64_t x, uint64_t shift_amount, bool extended) {
+    if (extended) {
+        return ((int64_t)x) >> ((uint64_t) shift_amount) ;
+    }
+    else {
+        uint32_t x32 = (uint32_t) (x & 0xffffffff) ;
+
+        return (uint64_t) ((int32_t) x32 >> ((uint32_t) shift_amount)) ;
+    }
+}
+
+/**
+ * @brief Shifts `val` by `amount` bits, with the shift type `tp`.
+ *
+ * @return uint64_t: `val` shifted.
+ */
+static inline
+uint64_t alu_shift(shift_tp tp, uint32_t amount, uint64_t val, bool extended) {
+    switch (tp) {
+    case ASR: return alu_asr(val, amount, extended) ;
+    case LSL: return val << amount ;
+    case LSR: return val >> amount ;
+    case ROR: return alu_ror(val, amount, extended) ;
+    }
+    return 0 ;
+}
+
+/*****************************************************************************/
+// Condition flags, see `pstate_t`
+
+/// @brief The N flag: the result is negative.
+static inline
+bool flag_n(const pstate_t *ps) {
+    if (ps->op == FLAGS_NZCV) return ps->nzcv & NZCV_N ;
+    return ps->res >> 63 ;
+}
+
+/// @brief The Z flag: the result is zero.
+static inline
+bool flag_z(const pstate_t *ps) {
+    if (ps->op == FLAGS_NZCV) return ps->nzcv & NZCV_Z ;
+    return ps->res == 0 ;
+}
+
+/**
+ * @brief The C flag: the 64-bit addition carried out, or the subtraction
+ * didn't borrow. 32-bit operations carry out of 64 bits too, as their
+ * operands are zero-extended.
+ */
+static inline
+bool flag_c(const pstate_t *ps) {
+    switch (ps->op) {
+    case FLAGS_NZCV: return ps->nzcv & NZCV_C ;
+    case FLAGS_ADD: return ps->res < ps->a ;
+    case FLAGS_SUB: return ps->a >= ps->b ;
+    default: return false ;
+    }
+}
+
+/**
+ * @brief The V flag. Additions only detect overflow of the sign-extended
+ * low 32 bits of their operands into 64 bits, which can't happen, so V
+ * is only ever set by `set_nzcv`.
+ */
+static inline
+bool flag_v(const pstate_t *ps) {
+    return ps->op == FLAGS_NZCV && (ps->nzcv & NZCV_V) ;
+}
+
+/// @brief Set the flags of `ps` to exactly `n`, `z`, `c` and `v`.
+static inline
+void set_nzcv(pstate_t *ps, bool n, bool z, bool c, bool v) {
+    ps->op = FLAGS_NZCV ;
+    ps->nzcv = (n ? NZCV_N : 0) | (z ? NZCV_Z : 0) | (c ? NZCV_C : 0) | (v ? NZCV_V : 0) ;
+}
+
+/*****************************************************************************/
+// Operations
+
+/**
+ * @brief The result of the addition `op_type` of `op1` and `op2`,
+ * recording it in `ps` if it sets the condition flags.
+ */
+static inline
+uint64_t alu_add(pstate_t *ps, dp_op op_type, uint64_t op1, uint64_t op2) {
+    uint64_t carry = 0 ;
+    //  Decide whether to add/subtract and if flags should be set
+    bool set_flags = false ;
+    switch (op_type) {
+        case OP_ADD: break ;
+        case OP_ADDS: set_flags = true ; break ;
+        case OP_SUBS: set_flags = true ; op2 = ~op2 ; carry = 1 ; break ;
+        case OP_SUB: op2 = ~op2 ; carry = 1 ; break ;
+        default: log_error("emulate_add bad opc: %d", op_type) ;
+    }
+
+    uint64_t result = op1 + op2 + carry ;
+    if (set_flags) {
+        ps->op = carry ? FLAGS_SUB : FLAGS_ADD ;
+        ps->res = result ;
+        ps->a = op1 ;
+        ps->b = carry ? ~op2 : op2 ;
+    }
+    return result ;
+}
+
+/**
+ * @brief The result of the bitwise operation `op_type` on `op1` and `op2`,
+ * recording it in `ps` if it sets the condition flags.
+ */
+static inline
+uint64_t alu_log(pstate_t *ps, dp_op op_type, uint64_t op1, uint64_t op2) {
+    uint64_t res = 0 ;
+    bool update_pstate = false ;
+    switch (op_type) {
+        case OP_AND: res = op1 & op2 ; break ;
+        case OP_BIC: res = op1 & ~op2 ; break ;
+        case OP_ORR: res = op1 | op2 ; break ;
+        case OP_ORN: res = op1 | ~op2 ; break ;
+        case OP_EOR: res = op1 ^ op2 ; break ;
+        case OP_EON: res = op1 ^ ~op2 ; break ;
+        case OP_ANDS: res = op1 & op2 ; update_pstate = true ; break ;
+        case OP_BICS: res = op1 & ~op2 ; update_pstate = true ; break ;
+        default: log_error("emulate_log bad opc: %d", op_type) ;
+    }
+    if (update_pstate) {
+        ps->op = FLAGS_LOG ;
+        ps->res = res ;
+    }
+    return res ;
+}
+
+/// @brief The result of an addition or bitwise operation `op_type`.
+static inline
+uint64_t alu_dp(pstate_t *ps, dp_op op_type, uint64_t op1, uint64_t op2) {
+    switch (op_type) {
+    case ADD_CASES: return alu_add(ps, op_type, op1, op2) ;
+    case LOG_CASES: return alu_log(ps, op_type, op1, op2) ;
+    default: log_error("alu_dp bad opc: %d", op_type) ;
+    }
+    return 0 ;
+}
+
+/**
+ * @brief The result of the move `op_type` of the (already shifted) `imm_val`
+ * into a register holding `old`, where `amount` is the shift of the immediate.
+ */
+static inline
+uint64_t alu_mov(dp_op op_type, uint64_t old, uint64_t imm_val, uint32_t amount) {
+    uint64_t mask = ((uint64_t) 0xffff) << amount ;
+    switch (op_type) {
+        case OP_MOVN: return ~imm_val ;
+        case OP_MOVZ: return imm_val ;
+        case OP_MOVK: return (old & ~mask) | (imm_val & mask) ;
+        default:
+            log_error("emulate_mov bad opc: %d", op_type) ;
+    }
+    return 0 ;
+}
+
+/// @brief The result of the multiplication `op_type`: `a (+|-) n * m`.
+static inline
+uint64_t alu_mul(dp_op op_type, uint64_t n, uint64_t m, uint64_t a) {
+    uint64_t mult = n * m ;
+    if (op_type == OP_MADD) return a + mult ;
+    else return a - mult ;
+}
+
+/// @brief Evaluates the condition `cond` based on the pstate `ps`.
+static inline
+bool alu_cond(const pstate_t *ps, cond_e cond) {
+    switch (cond) {
+    case EQ: return flag_z(ps) ;
+    case NE: return !flag_z(ps) ;
+    case GE: return flag_n(ps) == flag_v(ps) ;
+    case LT: return flag_n(ps) != flag_v(ps) ;
+    case GT: return !flag_z(ps) && flag_n(ps) == flag_v(ps) ;
+    case LE: return flag_z(ps) || flag_n(ps) != flag_v(ps) ;
+    case AL: return true ;
+    }
+    log_exit_failure("check_cond: Unrecognised condition: %u", cond) ;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "emulator/aot.h"
+#include "emulator/loader.h"
+#include "utils/log.h"
+
+struct aot_image {
+    void *handle ;
+    /// @brief By word of the image: the recompiled block starting there, if any.
+    aot_fn_t *by_word ;
+    size_t words ;
+    /// @brief One bit a word, set when it was recompiled.
+    const uint8_t *code_map ;
+    /// @brief Set once recompiled code has been overwritten, by the object or by `aot_invalidate`.
+    bool *stale ;
+    cpu_t *cpu ;
+} ;
+
+/// @brief The FNV-1a hash of the `count` words loaded into `cpu`.
+uint64_t aot_image_hash(cpu_t *cpu, size_t count) {
+    uint64_t h = 0xcbf29ce484222325 ;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t w = get_le_word(cpu->memory, 4 * i) ;
+        for (int b = 0; b < 4; b++) {
+            h ^= (w >> (8 * b)) & 0xff ;
+            h *= 0x100000001b3 ;
+        }
+    }
+    return h ;
+}
+
+static
+void *aot_sym(void *handle, const char *path, const char *name) {
+    void *sym = dlsym(handle, name) ;
+    if (!sym) log_exit_failure("Error: '%s' has no symbol %s\n", path, name) ;
+    return sym ;
+}
+
+/// @brief Marks the image `aux` stale when the word at `addr`, invalidated in the icache, was recompiled.
+static
+void aot_invalidate(void *aux, address_t addr) {
+    aot_image_t *img = aux ;
+    size_t w = addr / 4 ;
+    if (w < img->words && (img->code_map[w / 8] >> (w % 8) & 1)) *img->stale = true ;
+}
+
+/**
+ * @brief Load the object recompiled (see `aot_emit`) from the `count` words
+ * loaded into `cpu`. Exits if it can't be loaded, or was recompiled from
+ * a different binary.
+ */
+aot_image_t *aot_open(const char *path, cpu_t *cpu, size_t count) {
+    // dlopen looks a bare file name up in the library path, not the current directory
+    char *local = NULL ;
+    if (!strchr(path, '/')) {
+        local = malloc(strlen(path) + 3) ;
+        if (!local) log_exit_failure("Failed to allocate recompiled image\n") ;
+        sprintf(local, "./%s", path) ;
+    }
+    void *handle = dlopen(local ? local : path, RTLD_NOW | RTLD_LOCAL) ;
+    free(local) ;
+    if (!handle) log_exit_failure("Error: failed to load '%s': %s\n", path, dlerror()) ;
+
+    const uint32_t *abi = aot_sym(handle, path, "aot_abi") ;
+    const uint64_t *hash = aot_sym(handle, path, "aot_hash") ;
+    const size_t *words = aot_sym(handle, path, "aot_words") ;
+    const aot_entry_t *blocks = aot_sym(handle, path, "aot_blocks") ;
+    const size_t *n_blocks = aot_sym(handle, path, "aot_n_blocks") ;
+    if (*abi != AOT_ABI_VERSION || *(const uint64_t *) aot_sym(handle, path, "aot_layout") != AOT_LAYOUT)
+        log_exit_failure("Error: '%s' was recompiled by another version\n", path) ;
+    if (*words != count || *hash != aot_image_hash(cpu, count))
+        log_exit_failure("Error: '%s' was recompiled from another binary\n", path) ;
+
+    aot_image_t *img = malloc(sizeof(aot_image_t)) ;
+    if (!img) log_exit_failure("Failed to allocate recompiled image\n") ;
+    img->handle = handle ;
+    img->words = count ;
+    img->stale = aot_sym(handle, path, "aot_stale") ;
+    img->code_map = aot_sym(handle, path, "aot_code_map") ;
+    img->cpu = cpu ;
+    img->by_word = calloc(count + 1, sizeof(aot_fn_t)) ;
+    if (!img->by_word) log_exit_failure("Failed to allocate recompiled image\n") ;
+    for (size_t i = 0; i < *n_blocks; i++)
+        if (blocks[i].pc / 4 < count) img->by_word[blocks[i].pc / 4] = blocks[i].fn ;
+    *img->stale = false ;
+
+    // The object only sees its own stores: the interpreter's reach it through
+    // the icache, which must hold every recompiled word for them to
+    icache_t *icache = cpu->memory->icache ;
+    if (icache) {
+        for (size_t w = 0; w < count; w++)
+            if (img->code_map[w / 8] >> (w % 8) & 1) fetch_cached(cpu, 4 * w) ;
+        icache_listen(icache, aot_invalidate, img) ;
+    }
+    return img ;
+}
+
+void aot_close(aot_image_t *img) {
+    if (img->cpu->memory->icache) icache_unlisten(img->cpu->memory->icache, img) ;
+    dlclose(img->handle) ;
+    free(img->by_word) ;
+    free(img) ;
+}
+
+/// @brief The recompiled block starting at `pc`, or null.
+static inline
+aot_fn_t aot_lookup(aot_image_t *img, address_t pc) {
+    if (*img->stale || pc % 4 || pc / 4 >= img->words) return NULL ;
+    return img->by_word[pc / 4] ;
+}
+
+/**
+ * @brief Runs the `cpu` until it either halts or fails, like `emulate_main`,
+ * running the blocks recompiled in `img` wherever they apply.
+ */
+void emulate_aot(cpu_t *cpu, aot_image_t *img) {
+    address_t pc = cpu->pc ;
+    aot_fn_t fn = aot_lookup(img, pc) ;
+    while (true) {
+        if (fn == NULL) {
+            // Anything not recompiled is run by the interpreter
+            cpu->pc = pc ;
+            if (!emulate_step(cpu)) break ;
+            pc = cpu->pc ;
+            fn = aot_lookup(img, pc) ;
+            continue ;
+        }
+        aot_next_t next = fn(cpu) ;
+        pc = next.pc ;
+        fn = next.fn && !*img->stale ? next.fn : aot_lookup(img, pc) ;
+    }
+    if (cpu->fail) log_error("CPU fail\n") ;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file aot.h
+ * @brief Ahead-of-time recompilation of a binary to C.
+ *
+ * `aot_emit` walks the control-flow graph of a loaded binary from its
+ * entry point and writes a C translation unit with one function per basic
+ * block, each running its instructions straight on a `cpu_t`. Built as a
+ * shared object (see `make recompile`), it is loaded back by `aot_open`,
+ * and `emulate_aot` runs its blocks, falling back to the interpreter for
+ * every pc they don't cover.
+ *
+ * The object is tied to the exact binary it was compiled from: it exports
+ * a hash of the image, checked on load. A store over recompiled code, by
+ * the object or the interpreter, marks the object stale, after which the
+ * rest of the program is interpreted.
+ */
+
+#ifndef __AOT_H
+#define __AOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "emulator/emulator.h"
+
+/**
+ * @brief Bumped whenever the interface between generated code and the
+ * emulator changes, including the code generated objects inline from
+ * `loader.h`, `tlb.h` and `alu.h`: an object compiled once is reused, and
+ * would otherwise run the old code on the new structures.
+ */
+#define AOT_ABI_VERSION 6
+
+#define AOT_FOLD(h, x) (((h) ^ (uint64_t) (x)) * 0x100000001b3)
+
+/**
+ * @brief The sizes and offsets of the structures that code inlined into
+ * generated objects reaches into, folded into one number. Objects export
+ * it as they were compiled, and are rejected on load unless it is the
+ * emulator's, so that a layout change made without a bump of
+ * `AOT_ABI_VERSION` is still caught.
+ */
+#define AOT_LAYOUT \
+    AOT_FOLD(AOT_FOLD(AOT_FOLD(AOT_FOLD(AOT_FOLD(AOT_FOLD(AOT_FOLD(AOT_FOLD(AOT_FOLD(AOT_FOLD(AOT_FOLD(AOT_FOLD( \
+        UINT64_C(0xcbf29ce484222325), \
+        sizeof(cpu_t)), offsetof(cpu_t, pstate)), offsetof(cpu_t, n_instrs)), offsetof(cpu_t, memory)), \
+        sizeof(cpu_mem_t)), offsetof(cpu_mem_t, icache)), offsetof(cpu_mem_t, tlb)), offsetof(cpu_mem_t, mmu_span)), \
+        sizeof(tlb_entry_t)), sizeof(memory_block_t)), offsetof(memory_block_t, stale)), sizeof(icache_t))
+
+typedef struct aot_next aot_next_t ;
+
+/// @brief A recompiled block: runs it on `cpu`, returning where to go next.
+typedef aot_next_t (*aot_fn_t)(cpu_t *cpu) ;
+
+struct aot_next {
+    /// @brief The pc after the block.
+    address_t pc ;
+    /// @brief The block starting at `pc`, when known at compile time.
+    aot_fn_t fn ;
+} ;
+
+/// @brief An entry of the table of blocks exported by the object.
+typedef struct aot_entry {
+    address_t pc ;
+    aot_fn_t fn ;
+}   aot_entry_t ;
+
+/*
+ * The symbols exported by generated objects, as
+ *  const uint32_t aot_abi ;
+ *  const uint64_t aot_layout ;
+ *  const uint64_t aot_hash ;
+ *  const size_t aot_words ;
+ *  const aot_entry_t aot_blocks[] ;
+ *  const size_t aot_n_blocks ;
+ *  const uint8_t aot_code_map[] ;   one bit a word, set when it was recompiled
+ *  bool aot_stale ;
+ */
+
+/// @brief A loaded recompiled object.
+typedef struct aot_image aot_image_t ;
+
+uint64_t aot_image_hash(cpu_t *cpu, size_t count) ;
+bool aot_emit(FILE *out, cpu_t *cpu, size_t count, const char *name) ;
+
+aot_image_t *aot_open(const char *path, cpu_t *cpu, size_t count) ;
+void aot_close(aot_image_t *img) ;
+void emulate_aot(cpu_t *cpu, aot_image_t *img) ;
+
+#endif
@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "emulator/aot.h"
+#include "emulator/uop.h"
+#include "emulator/loader.h"
+#include "utils/log.h"
+
+/// @brief The most instructions recompiled into a single block function.
+#define AOT_MAX_OPS 256
+
+/// @brief A block of the control-flow graph, while it is being walked.
+typedef struct aot_block {
+    address_t start ;
+    uop_t ops[AOT_MAX_OPS] ;
+    size_t n ;
+}   aot_block_t ;
+
+typedef struct aot_cfg {
+    size_t words ;
+    /// @brief By word: the block starting there, if any.
+    aot_block_t **blocks ;
+    /// @brief By word: whether it was recompiled into some block.
+    uint8_t *code_map ;
+    address_t lo, hi ;
+    /// @brief Block starts still to be walked.
+    address_t *todo ;
+    size_t n_todo ;
+}   aot_cfg_t ;
+
+/// @brief Queue a block at `pc`, unless it is already known or outside the image.
+static
+void cfg_push(aot_cfg_t *g, address_t pc) {
+    if (pc % 4 || pc / 4 >= g->words || g->blocks[pc / 4]) return ;
+    aot_block_t *b = calloc(1, sizeof(aot_block_t)) ;
+    if (!b) log_exit_failure("Failed to allocate block\n") ;
+    b->start = pc ;
+    g->blocks[pc / 4] = b ;
+    g->todo[g->n_todo++] = pc ;
+}
+
+/**
+ * @brief Translate the block at `b->start` to uops, and queue the blocks
+ * it goes to. A block stops before any instruction without a uop, which
+ * is left to the interpreter, and the block after it is queued in its place.
+ */
+static
+void cfg_walk(aot_cfg_t *g, cpu_t *cpu, aot_block_t *b) {
+    address_t pc = b->start ;
+    while (b->n < AOT_MAX_OPS && pc / 4 < g->words) {
+        icache_entry_t *e = fetch_cached(cpu, pc) ;
+        if (!e) break ;
+        uop_t *op = &b->ops[b->n] ;
+        uop_kind k = uop_translate(op, e->flags, &e->instr) ;
+        if (k == UOP_INTERP || k == UOP_HALT) {
+            if (k == UOP_INTERP) cfg_push(g, pc + 4) ;
+            return ;
+        }
+        op->kind = k ;
+        b->n++ ;
+        g->code_map[pc / 32] |= 1 << (pc / 4 % 8) ;
+        if (pc < g->lo) g->lo = pc ;
+        if (pc + 4 > g->hi) g->hi = pc + 4 ;
+        pc += 4 ;
+
+        switch (uop_info[k].family) {
+        case UOP_FAM_B: cfg_push(g, op->imm) ; return ;
+        case UOP_FAM_BCOND: cfg_push(g, op->imm) ; cfg_push(g, pc) ; return ;
+        case UOP_FAM_BR: return ;
+        default: break ;
+        }
+    }
+    cfg_push(g, pc) ;
+}
+
+/*****************************************************************************/
+// C emission
+
+/// @brief The C lvalue of slot `s`; the zero register reads as 0.
+static
+const char *slot_expr(uint8_t s) {
+    static char buf[4][32] ;
+    static int next = 0 ;
+    char *p = buf[next++ % 4] ;
+    if (s == UOP_ZR) return "UINT64_C(0)" ;
+    snprintf(p, sizeof(buf[0]), "cpu->regs[%u]", s) ;
+    return p ;
+}
+
+/// @brief Print the value of slot `s` as a 32-bit register unless `sf`.
+static
+void emit_read(FILE *out, uint8_t s, bool sf) {
+    if (sf || s == UOP_ZR) fprintf(out, "%s", slot_expr(s)) ;
+    else fprintf(out, "(%s & 0xffffffff)", slot_expr(s)) ;
+}
+
+/// @brief Begin the write of a value to slot `s`, to be closed by `emit_write_end`.
+static
+void emit_write_begin(FILE *out, uint8_t s) {
+    if (s == UOP_SINK || s == UOP_ZR) fprintf(out, "    (void) (") ;
+    else fprintf(out, "    %s = (", slot_expr(s)) ;
+}
+
+static
+void emit_write_end(FILE *out, uint8_t s, bool sf) {
+    if (sf || s == UOP_SINK || s == UOP_ZR) fprintf(out, ") ;\n") ;
+    else fprintf(out, ") & 0xffffffff ;\n") ;
+}
+
+/// @brief Print a return to `pc`, naming its block when there is one.
+static
+void emit_goto(FILE *out, aot_cfg_t *g, address_t pc, const char *indent) {
+    if (pc % 4 == 0 && pc / 4 < g->words && g->blocks[pc / 4] && g->blocks[pc / 4]->n)
+        fprintf(out, "%sreturn (aot_next_t) { UINT64_C(0x%" PRIx64 "), b_%08" PRIx64 " } ;\n",
+                indent, pc, pc) ;
+    else
+        fprintf(out, "%sreturn (aot_next_t) { UINT64_C(0x%" PRIx64 "), NULL } ;\n", indent, pc) ;
+}
+
+/// @brief Print the address computation of a load/store into `a`.
+static
+void emit_ls_addr(FILE *out, const uop_t *op, uop_addr_t mode) {
+    const char *rn = slot_expr(op->rn) ;
+    switch (mode) {
+    case UOP_ADDR_LIT:
+        fprintf(out, "    a = UINT64_C(0x%" PRIx64 ") ;\n", op->imm) ;
+        break ;
+    case UOP_ADDR_POST:
+        fprintf(out, "    a = %s ;\n    %s = a + UINT64_C(0x%" PRIx64 ") ;\n", rn, rn, op->imm) ;
+        break ;
+    case UOP_ADDR_PRE:
+        fprintf(out, "    a = %s + UINT64_C(0x%" PRIx64 ") ;\n    %s = a ;\n", rn, op->imm, rn) ;
+        break ;
+    case UOP_ADDR_UOFF:
+        fprintf(out, "    a = %s + UINT64_C(0x%" PRIx64 ") ;\n", rn, op->imm) ;
+        break ;
+    case UOP_ADDR_REG_LSL:
+        fprintf(out, "    a = %s + (%s << %u) ;\n", rn, slot_expr(op->rm), op->amount) ;
+        break ;
+    case UOP_ADDR_REG_SXTX:
+        fprintf(out, "    a = %s + %s ;\n", rn, slot_expr(op->rm)) ;
+        break ;
+    }
+}
+
+/**
+ * @brief Print the C of the uop `op` at `pc`, the `i`th of the block `b`.
+ * Mirrors the handlers of `uop_exec.h`, through the same `alu.h` functions.
+ */
+static
+void emit_op(FILE *out, aot_cfg_t *g, const aot_block_t *b, size_t i, address_t pc) {
+    const uop_t *op = &b->ops[i] ;
+    uop_info_t info = uop_info[op->kind] ;
+    bool sf = info.sf ;
+    fprintf(out, "    // %08" PRIx64 ": %s\n", pc, show_uop_kind(op->kind)) ;
+
+    switch (info.family) {
+    case UOP_FAM_DP_IMM:
+        emit_write_begin(out, op->rd) ;
+        fprintf(out, "alu_dp(ps, %u, ", info.a) ;
+        emit_read(out, op->rn, sf) ;
+        fprintf(out, ", UINT64_C(0x%" PRIx64 "))", op->imm) ;
+        emit_write_end(out, op->rd, sf) ;
+        break ;
+    case UOP_FAM_DP_REG:
+        emit_write_begin(out, op->rd) ;
+        fprintf(out, "alu_dp(ps, %u, ", info.a) ;
+        emit_read(out, op->rn, sf) ;
+        fprintf(out, ", alu_shift(%u, %u, ", info.b, op->amount) ;
+        emit_read(out, op->rm, sf) ;
+        fprintf(out, ", %d))", sf) ;
+        emit_write_end(out, op->rd, sf) ;
+        break ;
+    case UOP_FAM_MOV:
+        emit_write_begin(out, op->rd) ;
+        fprintf(out, "alu_mov(%u, ", info.a) ;
+        emit_read(out, op->rn, sf) ;
+        fprintf(out, ", UINT64_C(0x%" PRIx64 "), %u)", op->imm, op->amount) ;
+        emit_write_end(out, op->rd, sf) ;
+        break ;
+    case UOP_FAM_MUL:
+        emit_write_begin(out, op->rd) ;
+        fprintf(out, "alu_mul(%u, ", info.a) ;
+        emit_read(out, op->rn, sf) ;
+        fprintf(out, ", ") ;
+        emit_read(out, op->rm, sf) ;
+        fprintf(out, ", ") ;
+        emit_read(out, op->ra, sf) ;
+        fprintf(out, ")") ;
+        emit_write_end(out, op->rd, sf) ;
+        break ;
+    case UOP_FAM_B:
+        emit_goto(out, g, op->imm, "    ") ;
+        break ;
+    case UOP_FAM_BCOND:
+        fprintf(out, "    if (alu_cond(ps, %u))\n", info.a) ;
+        emit_goto(out, g, op->imm, "        ") ;
+        emit_goto(out, g, pc + 4, "    ") ;
+        break ;
+    case UOP_FAM_BR:
+        fprintf(out, "    return (aot_next_t) { %s, NULL } ;\n", slot_expr(op->rn)) ;
+        break ;
+    case UOP_FAM_LDR:
+        emit_ls_addr(out, op, info.a) ;
+        emit_write_begin(out, op->rd) ;
+        fprintf(out, "get_dword(cpu, a)") ;
+        emit_write_end(out, op->rd, sf) ;
+        break ;
+    case UOP_FAM_STR:
+        emit_ls_addr(out, op, info.a) ;
+        fprintf(out, "    set_dword(cpu, a, ") ;
+        emit_read(out, op->rd, sf) ;
+        fprintf(out, ") ;\n") ;
+        // A store over recompiled code hands the rest of the run to the interpreter
+        fprintf(out, "    if (overwrites_code(a)) {\n") ;
+        fprintf(out, "        aot_stale = true ;\n") ;
+        fprintf(out, "        cpu->n_instrs -= %zu ;\n", b->n - i - 1) ;
+        fprintf(out, "        return (aot_next_t) { UINT64_C(0x%" PRIx64 "), NULL } ;\n", pc + 4) ;
+        fprintf(out, "    }\n") ;
+        break ;
+    default:
+        break ;
+    }
+}
+
+static
+void emit_block(FILE *out, aot_cfg_t *g, const aot_block_t *b) {
+    fprintf(out, "\nstatic aot_next_t b_%08" PRIx64 "(cpu_t *cpu) {\n", b->start) ;
+    fprintf(out, "    pstate_t *ps = &cpu->pstate ;\n") ;
+    fprintf(out, "    address_t a ;\n") ;
+    fprintf(out, "    (void) ps ; (void) a ;\n") ;
+    fprintf(out, "    cpu->n_instrs += %zu ;\n", b->n) ;
+    for (size_t i = 0; i < b->n; i++) emit_op(out, g, b, i, b->start + 4 * i) ;
+    if (!uop_is_branch(b->ops[b->n - 1].kind)) emit_goto(out, g, b->start + 4 * b->n, "    ") ;
+    fprintf(out, "}\n") ;
+}
+
+static
+void emit_unit(FILE *out, aot_cfg_t *g, uint64_t hash, const char *name) {
+    fprintf(out, "// Recompiled from %s by recompile: do not edit.\n\n", name) ;
+    fprintf(out, "#include \"emulator/aot.h\"\n") ;
+    fprintf(out, "#include \"emulator/alu.h\"\n") ;
+    fprintf(out, "#include \"emulator/loader.h\"\n\n") ;
+    fprintf(out, "const uint32_t aot_abi = %d ;\n", AOT_ABI_VERSION) ;
+    fprintf(out, "const uint64_t aot_layout = AOT_LAYOUT ;\n") ;
+    fprintf(out, "const uint64_t aot_hash = UINT64_C(0x%016" PRIx64 ") ;\n", hash) ;
+    fprintf(out, "const size_t aot_words = %zu ;\n", g->words) ;
+    fprintf(out, "bool aot_stale = false ;\n\n") ;
+
+    fprintf(out, "/// @brief By word: whether it was recompiled.\n") ;
+    fprintf(out, "const uint8_t aot_code_map[] = {") ;
+    for (size_t i = 0; i < (g->words + 7) / 8; i++)
+        fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n    ", g->code_map[i]) ;
+    fprintf(out, "\n} ;\n\n") ;
+    fprintf(out,
+        "/// @brief Whether the doubleword store to `a` overwrote recompiled code.\n"
+        "static inline bool overwrites_code(address_t a) {\n"
+        "    if (a >= UINT64_C(0x%" PRIx64 ") || a + 8 <= UINT64_C(0x%" PRIx64 ")) return false ;\n"
+        "    for (address_t w = a / 4; w <= (a + 7) / 4 && w < aot_words; w++)\n"
+        "        if (aot_code_map[w / 8] >> (w %% 8) & 1) return true ;\n"
+        "    return false ;\n"
+        "}\n", g->hi, g->lo) ;
+
+    for (size_t w = 0; w < g->words; w++) {
+        aot_block_t *b = g->blocks[w] ;
+        if (b && b->n) fprintf(out, "static aot_next_t b_%08" PRIx64 "(cpu_t *cpu) ;\n", b->start) ;
+    }
+    size_t n_blocks = 0 ;
+    for (size_t w = 0; w < g->words; w++) {
+        aot_block_t *b = g->blocks[w] ;
+        if (b && b->n) {
+            emit_block(out, g, b) ;
+            n_blocks++ ;
+        }
+    }
+
+    fprintf(out, "\nconst aot_entry_t aot_blocks[] = {\n") ;
+    for (size_t w = 0; w < g->words; w++) {
+        aot_block_t *b = g->blocks[w] ;
+        if (b && b->n)
+            fprintf(out, "    { UINT64_C(0x%" PRIx64 "), b_%08" PRIx64 " },\n", b->start, b->start) ;
+    }
+    // Keep the array non-empty for a binary with no blocks
+    fprintf(out, "    { 0, NULL },\n} ;\n") ;
+    fprintf(out, "const size_t aot_n_blocks = %zu ;\n", n_blocks) ;
+}
+
+/**
+ * @brief Write the C recompilation of the `count` words loaded into `cpu`,
+ * recompiled from the file `name`, to `out`.
+ *
+ * @return false if the binary has no block to recompile.
+ */
+bool aot_emit(FILE *out, cpu_t *cpu, size_t count, const char *name) {
+    aot_cfg_t g = { .words = count, .lo = UINT64_MAX, .hi = 0, .n_todo = 0 } ;
+    g.blocks = calloc(count + 1, sizeof(aot_block_t *)) ;
+    g.code_map = calloc(count / 8 + 1, 1) ;
+    g.todo = malloc((count + 1) * sizeof(address_t)) ;
+    if (!g.blocks || !g.code_map || !g.todo) log_exit_failure("Failed to allocate the CFG\n") ;
+
+    cfg_push(&g, cpu->pc) ;
+    while (g.n_todo > 0) {
+        address_t pc = g.todo[--g.n_todo] ;
+        cfg_walk(&g, cpu, g.blocks[pc / 4]) ;
+    }
+
+    bool any = g.hi > 0 ;
+    if (any) emit_unit(out, &g, aot_image_hash(cpu, count), name) ;
+
+    for (size_t w = 0; w < count; w++) free(g.blocks[w]) ;
+    free(g.blocks) ;
+    free(g.code_map) ;
+    free(g.todo) ;
+    return any ;
+}
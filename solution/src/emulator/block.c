@@ -0,0 +1,413 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "emulator/block.h"
+#include "emulator/uop_exec.h"
+#include "utils/log.h"
+
+#ifdef __GNUC__
+#define BLOCK_COMPUTED_GOTO 1
+#endif
+
+typedef struct code_block {
+    address_t start ;
+    /// @brief The next block in the same bucket of the block table.
+    struct code_block *next ;
+    /// @brief The blocks run after this one when its final branch is
+    /// taken (0) or not (1); null until first followed.
+    struct code_block *succ[2] ;
+    /// @brief The number of instructions in the block, and of superinstructions.
+    uint32_t n_instrs, n_super ;
+    /// @brief How often the block was entered.
+    uint64_t runs ;
+    /// @brief The uops of the instructions, and a final `UOP_END` if the
+    /// block doesn't end in a branch.
+    uop_t ops[] ;
+}   code_block_t ;
+
+typedef struct block_cache {
+    code_block_t *buckets[BLOCK_BUCKETS] ;
+    /// @brief The memory blocks are allocated from, `used` bytes at a time.
+    uint8_t *code ;
+    size_t used ;
+    /// @brief Incremented by every flush, which drops every block.
+    uint64_t generation ;
+    /// @brief The range of addresses translated since the last flush.
+    address_t lo, hi ;
+    /// @brief Set when translated code is overwritten: the cache must be
+    /// flushed before another block runs.
+    bool stale ;
+    icache_t *icache ;
+    /// @brief Whether the blocks were profiled, and the superinstructions
+    /// picked by the profile, by kind from `UOP_SUPER_FIRST`.
+    bool profiled ;
+    bool super_on[UOP_SUPER_COUNT] ;
+}   block_cache_t ;
+
+block_super_stats_t block_super_stats ;
+
+static
+void block_flush(block_cache_t *bc) {
+    for (size_t k = 0; k < BLOCK_BUCKETS; k++)
+        for (code_block_t *b = bc->buckets[k]; b; b = b->next)
+            block_super_stats.runs += b->runs * b->n_super ;
+    memset(bc->buckets, 0, sizeof(bc->buckets)) ;
+    bc->used = 0 ;
+    bc->generation++ ;
+    bc->lo = UINT64_MAX ;
+    bc->hi = 0 ;
+    bc->stale = false ;
+}
+
+/// @brief Mark the cache stale if the overwritten word at `addr` may have
+/// been translated.
+static
+void block_invalidate(void *aux, address_t addr) {
+    block_cache_t *bc = aux ;
+    if (bc->lo <= addr && addr < bc->hi) bc->stale = true ;
+}
+
+static
+block_cache_t *init_block_cache(icache_t *icache) {
+    block_cache_t *bc = calloc(1, sizeof(block_cache_t)) ;
+    if (!bc) log_exit_failure("Failed to allocate block cache") ;
+    bc->code = malloc(BLOCK_CACHE_BYTES) ;
+    if (!bc->code) log_exit_failure("Failed to allocate block cache") ;
+    bc->icache = icache ;
+    bc->generation = 0 ;
+    bc->profiled = false ;
+    memset(bc->super_on, 0, sizeof(bc->super_on)) ;
+    block_flush(bc) ;
+    icache_listen(icache, block_invalidate, bc) ;
+    return bc ;
+}
+
+static
+void free_block_cache(block_cache_t *bc) {
+    block_flush(bc) ;
+    icache_unlisten(bc->icache, bc) ;
+    free(bc->code) ;
+    free(bc) ;
+}
+
+static inline
+size_t bucket_of(address_t pc) {
+    return (pc >> 2) & (BLOCK_BUCKETS - 1) ;
+}
+
+/// @brief How far past a block its flags are followed, see `flags_dead_at`.
+#define BLOCK_FLAGS_LOOKAHEAD 8
+
+/**
+ * @brief Whether the code from `pc` overwrites the flags before anything
+ * may read them, following it through unconditional branches. Anything
+ * that isn't an arithmetic instruction counts as a read, and so do stores,
+ * which may overwrite the code looked at. The words looked at are added to
+ * the translated range, so that a flush also drops blocks relying on them.
+ */
+static
+bool flags_dead_at(block_cache_t *bc, cpu_t *cpu, address_t pc) {
+    for (int i = 0; i < BLOCK_FLAGS_LOOKAHEAD; i++) {
+        icache_entry_t *e = fetch_cached(cpu, pc) ;
+        if (!e) return false ;
+        if (pc < bc->lo) bc->lo = pc ;
+        if (pc + 4 > bc->hi) bc->hi = pc + 4 ;
+
+        uop_t op ;
+        uop_info_t info = uop_info[uop_translate(&op, e->flags, &e->instr)] ;
+        switch (info.family) {
+        case UOP_FAM_DP_IMM:
+        case UOP_FAM_DP_REG:
+            if (info.a == OP_ADDS || info.a == OP_SUBS || info.a == OP_ANDS || info.a == OP_BICS) return true ;
+            break ;
+        case UOP_FAM_MOV:
+        case UOP_FAM_MUL:
+        case UOP_FAM_NOP:
+        case UOP_FAM_LDR:
+            break ;
+        case UOP_FAM_B:
+            pc = op.imm ;
+            continue ;
+        default:
+            return false ;
+        }
+        pc += 4 ;
+    }
+    return false ;
+}
+
+/**
+ * @brief Make superinstructions of the runs of `ops` picked by the profile,
+ * longest first, returning how many were made.
+ */
+static
+uint32_t block_super(block_cache_t *bc, uop_t *ops, size_t n, const void *const *handlers) {
+    uint32_t made = 0 ;
+    for (size_t i = 0; i < n; i += uop_len(&ops[i])) {
+        for (size_t len = 3; len >= 2; len--) {
+            if (i + len > n) continue ;
+            uint16_t kinds[3] ;
+            for (size_t j = 0; j < len; j++) kinds[j] = ops[i + j].kind ;
+            uop_kind k = uop_super_kind(kinds, len) ;
+            if (k == UOP_INTERP || !bc->super_on[k - UOP_SUPER_FIRST]) continue ;
+            ops[i].kind = k ;
+            ops[i].handler = handlers[k] ;
+            made++ ;
+            break ;
+        }
+    }
+    block_super_stats.translated += made ;
+    return made ;
+}
+
+/**
+ * @brief Translate the block starting at `pc`, flushing the cache first
+ * if it is full. Uops jump to `handlers[kind]`.
+ *
+ * @return code_block_t* The block, or null if the instruction at `pc` has no uop.
+ */
+static
+code_block_t *block_translate(block_cache_t *bc, cpu_t *cpu, address_t pc,
+                              const void *const *handlers) {
+    uop_t ops[BLOCK_MAX_OPS + 1] ;
+    size_t n = 0 ;
+    for (address_t a = pc; n < BLOCK_MAX_OPS; a += 4) {
+        icache_entry_t *e = fetch_cached(cpu, a) ;
+        if (!e) break ;
+        uop_kind k = uop_translate(&ops[n], e->flags, &e->instr) ;
+        // Halts and uncommon instructions are left to the interpreter
+        if (k == UOP_INTERP || k == UOP_HALT) break ;
+        ops[n].kind = k ;
+        ops[n++].handler = handlers[k] ;
+        if (uop_is_branch(k)) break ;
+    }
+    if (n == 0) return NULL ;
+
+    size_t n_ops = n ;
+    if (!uop_is_branch(ops[n - 1].kind)) {
+        ops[n_ops].kind = UOP_END ;
+        ops[n_ops++].handler = handlers[UOP_END] ;
+    }
+
+    // Flushing now keeps the range looked at by `flags_dead_at`
+    size_t bytes = sizeof(code_block_t) + n_ops * sizeof(uop_t) ;
+    if (bc->used + bytes > BLOCK_CACHE_BYTES) block_flush(bc) ;
+
+    // A final b.cond's flags are dead if both of its paths overwrite them
+    bool flags_dead = false ;
+    uop_kind last = ops[n - 1].kind ;
+    if (n >= 2 && UOP_B_EQ <= last && last <= UOP_B_LE) {
+        address_t branch = pc + 4 * (n - 1) ;
+        flags_dead = flags_dead_at(bc, cpu, ops[n - 1].imm) && flags_dead_at(bc, cpu, branch + 4) ;
+    }
+    for (size_t i = 0; i < n; ) {
+        size_t len = uop_fuse(&ops[i], n - i, flags_dead) ;
+        if (len > 1) ops[i].handler = handlers[ops[i].kind] ;
+        i += len ;
+    }
+    uint32_t n_super = bc->profiled ? block_super(bc, ops, n, handlers) : 0 ;
+
+    code_block_t *b = (code_block_t *) (bc->code + bc->used) ;
+    bc->used += bytes ;
+
+    b->start = pc ;
+    b->succ[0] = b->succ[1] = NULL ;
+    b->n_instrs = n ;
+    b->n_super = n_super ;
+    b->runs = 0 ;
+    memcpy(b->ops, ops, n_ops * sizeof(uop_t)) ;
+
+    size_t k = bucket_of(pc) ;
+    b->next = bc->buckets[k] ;
+    bc->buckets[k] = b ;
+
+    if (pc < bc->lo) bc->lo = pc ;
+    if (pc + 4 * n > bc->hi) bc->hi = pc + 4 * n ;
+    return b ;
+}
+
+/// @brief Get the block starting at `pc`, translating it if needed.
+static inline
+code_block_t *block_get(block_cache_t *bc, cpu_t *cpu, address_t pc,
+                        const void *const *handlers) {
+    for (code_block_t *b = bc->buckets[bucket_of(pc)]; b; b = b->next)
+        if (b->start == pc) return b ;
+    return block_translate(bc, cpu, pc, handlers) ;
+}
+
+/// @brief The size of the hash table of runs counted by `block_profile`.
+#define BLOCK_PROFILE_SLOTS 4096
+
+/// @brief Add `count` to the run of the `len` uop kinds `kinds` in `table`.
+static
+void count_run(block_run_t *table, const uint16_t *kinds, uint8_t len, uint64_t count) {
+    size_t h = len ;
+    for (size_t i = 0; i < len; i++) h = h * 1021 + kinds[i] ;
+    for (size_t probe = 0; probe < BLOCK_PROFILE_SLOTS; probe++) {
+        block_run_t *r = &table[(h + probe) % BLOCK_PROFILE_SLOTS] ;
+        if (r->len == 0) {
+            memcpy(r->kinds, kinds, len * sizeof(uint16_t)) ;
+            r->len = len ;
+        } else if (r->len != len || memcmp(r->kinds, kinds, len * sizeof(uint16_t))) {
+            continue ;
+        }
+        r->count += count ;
+        return ;
+    }
+}
+
+static
+int hotter_run(const void *a, const void *b) {
+    uint64_t ca = ((const block_run_t *) a)->count, cb = ((const block_run_t *) b)->count ;
+    return (ca < cb) - (ca > cb) ;
+}
+
+/**
+ * @brief Count the runs of uops in the cached blocks, weighted by how often
+ * their blocks ran, and pick the hottest that have superinstructions. The
+ * cache is flushed, to be retranslated with them. `instrs` is the number
+ * of instructions run so far, for `block_super_stats`.
+ */
+static
+void block_profile(block_cache_t *bc, uint64_t instrs) {
+    block_run_t *table = calloc(BLOCK_PROFILE_SLOTS, sizeof(block_run_t)) ;
+    if (!table) log_exit_failure("Failed to allocate block profile") ;
+    for (size_t k = 0; k < BLOCK_BUCKETS; k++) {
+        for (code_block_t *b = bc->buckets[k]; b; b = b->next) {
+            // The kinds of the block's uops, skipping those fused into others
+            uint16_t kinds[BLOCK_MAX_OPS] ;
+            size_t m = 0 ;
+            for (size_t i = 0; i < b->n_instrs; i += uop_len(&b->ops[i])) kinds[m++] = b->ops[i].kind ;
+            for (size_t i = 0; i + 1 < m; i++) {
+                count_run(table, &kinds[i], 2, b->runs) ;
+                if (i + 2 < m) count_run(table, &kinds[i], 3, b->runs) ;
+            }
+        }
+    }
+    qsort(table, BLOCK_PROFILE_SLOTS, sizeof(block_run_t), hotter_run) ;
+
+    block_super_stats_t *st = &block_super_stats ;
+    size_t used = 0 ;
+    for (size_t i = 0; i < BLOCK_PROFILE_SLOTS && table[i].count > 0; i++) {
+        uop_kind k = uop_super_kind(table[i].kinds, table[i].len) ;
+        if (k != UOP_INTERP && used < BLOCK_SUPER_MAX) {
+            bc->super_on[k - UOP_SUPER_FIRST] = true ;
+            table[i].used = true ;
+            used++ ;
+        }
+        if (st->n_hot < BLOCK_PROFILE_TOP) st->hot[st->n_hot++] = table[i] ;
+    }
+    free(table) ;
+    st->profiled_at = instrs ;
+    bc->profiled = true ;
+    block_flush(bc) ;
+}
+
+/*****************************************************************************/
+// Control flow between handlers, see `uop_exec.h`
+
+#ifdef BLOCK_COMPUTED_GOTO
+#define JUMP goto *op->handler
+#else
+#define JUMP goto switch_dispatch
+#endif
+
+// Instructions are counted a block at a time
+#define RETIRE_N(k)
+#define SKIP(k) do { pc += 4 * (k) ; op += (k) ; JUMP ; } while (0)
+#define TAKEN(target) do { pc = (target) ; succ = 0 ; goto chain ; } while (0)
+#define NOT_TAKEN do { pc += 4 ; succ = 1 ; goto chain ; } while (0)
+#define JUMP_TO(target) do { pc = (target) ; goto dispatch ; } while (0)
+#define END_BLOCK do { succ = 1 ; goto chain ; } while (0)
+// A store into translated code ends the block after it
+#define AFTER_STORE \
+    if (bc->stale) { \
+        n -= b->n_instrs - (op - b->ops + 1) ; \
+        pc += 4 ; \
+        goto dispatch ; \
+    }
+
+/**
+ * @brief Runs the `cpu` until it either halts or fails, like `emulate_main`,
+ * a translated block at a time.
+ */
+void emulate_blocks(cpu_t *cpu) {
+#ifdef BLOCK_COMPUTED_GOTO
+    static const void *const handlers[UOP_SUPER_END] = {
+        UOP_KINDS(UOP_LABEL)
+        UOP_SUPERS(UOP_SUPER2_LABEL, UOP_SUPER3_LABEL)
+    } ;
+#else
+    static const void *const handlers[UOP_SUPER_END] = { NULL } ;
+#endif
+    block_cache_t *bc = init_block_cache(cpu->memory->icache) ;
+
+    pstate_t *ps = &cpu->pstate ;
+    uint64_t *x = cpu->regs ;
+    address_t pc = cpu->pc ;
+    code_block_t *b, *next ;
+    uop_t *op ;
+    int succ ;
+    uint64_t gen ;
+    // Instructions retired by blocks, not yet added to the cpu's count
+    uint64_t n = 0 ;
+
+dispatch:
+    if (bc->stale) block_flush(bc) ;
+    b = block_get(bc, cpu, pc, handlers) ;
+    if (b == NULL) goto step ;
+
+enter:
+    if (++b->runs == BLOCK_SUPER_WARMUP && !bc->profiled) goto profile ;
+    n += b->n_instrs ;
+    op = b->ops ;
+    JUMP ;
+
+chain:
+    if (b->succ[succ]) {
+        b = b->succ[succ] ;
+        goto enter ;
+    }
+    gen = bc->generation ;
+    next = block_get(bc, cpu, pc, handlers) ;
+    if (next == NULL) goto step ;
+    // Translating may have flushed the cache, and `b` with it
+    if (bc->generation == gen) b->succ[succ] = next ;
+    b = next ;
+    goto enter ;
+
+#ifndef BLOCK_COMPUTED_GOTO
+switch_dispatch:
+    switch (op->kind) {
+        UOP_KINDS(UOP_CASE)
+        UOP_SUPERS(UOP_SUPER2_CASE, UOP_SUPER3_CASE)
+    }
+#endif
+
+    UOP_KINDS(UOP_HANDLER)
+    UOP_SUPERS(UOP_SUPER2_HANDLER, UOP_SUPER3_HANDLER)
+
+profile:
+    // Blocks are translated again, with the superinstructions picked
+    block_profile(bc, cpu->n_instrs + n) ;
+    goto dispatch ;
+
+step:
+    // Anything without a uop is run by the interpreter
+    cpu->pc = pc ;
+    cpu->n_instrs += n ;
+    n = 0 ;
+    if (!emulate_step(cpu)) goto done ;
+    pc = cpu->pc ;
+    goto dispatch ;
+
+halt:
+    // Blocks never contain a halt, see `block_translate`
+    cpu->pc = pc ;
+    cpu->n_instrs += n ;
+    cpu->halt = true ;
+
+done:
+    free_block_cache(bc) ;
+    if (cpu->fail) log_error("CPU fail\n") ;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file block.h
+ * @brief A basic-block execution engine.
+ *
+ * Straight-line runs of instructions, up to and including a branch, are
+ * translated into blocks of uops (see `uop.h`) held in a bounded code cache.
+ * Each block is linked to the blocks its branch was seen to go to, so a
+ * running program mostly moves from block to block without any lookup.
+ */
+
+#ifndef __BLOCK_H
+#define __BLOCK_H
+
+#include "emulator/emulator.h"
+
+/// @brief The most instructions translated into a single block.
+#define BLOCK_MAX_OPS 64
+/// @brief The size of the code cache; it is flushed whenever it fills up.
+#define BLOCK_CACHE_BYTES (1024 * 1024)
+/// @brief The number of buckets of the table of blocks by start address.
+#define BLOCK_BUCKETS 4096
+
+/*
+ * Once any block has run `BLOCK_SUPER_WARMUP` times, the runs of two and
+ * three uops in the cached blocks are counted, weighted by how often their
+ * blocks ran, and the hottest `BLOCK_SUPER_MAX` of those with a
+ * superinstruction (see `uop.h`) are used from then on.
+ */
+#ifndef BLOCK_SUPER_WARMUP
+#define BLOCK_SUPER_WARMUP 4096
+#endif
+#define BLOCK_SUPER_MAX 16
+/// @brief The number of hottest runs kept in `block_super_stats`.
+#define BLOCK_PROFILE_TOP 8
+
+/// @brief A run of uops, and how often it ran by the profile.
+typedef struct block_run {
+    uint16_t kinds[3] ;
+    uint8_t len ;
+    /// @brief Whether it was made a superinstruction.
+    bool used ;
+    uint64_t count ;
+}   block_run_t ;
+
+typedef struct block_super_stats {
+    /// @brief The instructions run when the blocks were profiled; 0 if they weren't.
+    uint64_t profiled_at ;
+    /// @brief The hottest runs of uops, hottest first.
+    block_run_t hot[BLOCK_PROFILE_TOP] ;
+    size_t n_hot ;
+    /// @brief Superinstructions translated, and how often they ran.
+    uint64_t translated, runs ;
+}   block_super_stats_t ;
+
+extern block_super_stats_t block_super_stats ;
+
+void emulate_blocks(cpu_t *cpu) ;
+
+#endif
@@ -1,17 +1,43 @@
 #include "common/encoded_instrs.h"
+#include "common/instr_table.h"
 #include "emulator/decoder/decode.h"
+#include "emulator/decoder/decode_memo.h"
 #include "emulator/decoder/enc_decoder.h"
 #include "emulator/decoder/word_decoder.h"
 
 bool decode_word(instr_t *i, word32_t c, address_t pc) {
+    return decode_memo_word(i, c, pc) ;
+}
+
+bool decode_word_enc(instr_t *i, word32_t c, address_t pc) {
     enc_instr e ;
-    bool dece_status = false ;
-    bool decw_status = dec_word(&e, c) ;
-    if (decw_status){
-        dece_status = decode_enc_instr(i, e, pc) ;
-        i->address = pc ;
-    }
-    
-    return decw_status && dece_status ;
+    if (dec_word(&e, c) != DECODE_OK) return false ;
+    if (decode_enc_instr(i, e, pc) != DECODE_OK) return false ;
+    i->address = pc ;
+    return true ;
+}
+
+decode_status_e decode_word_status(word32_t c, address_t pc) {
+    enc_instr e ;
+    instr_t i ;
+    decode_status_e s = dec_word(&e, c) ;
+    return s != DECODE_OK ? s : decode_enc_instr(&i, e, pc) ;
+}
+
+decode_status_e decode_fail(decode_status_e s) {
+    return s ;
 }
 
+const char *decode_status_str(decode_status_e s) {
+    switch (s) {
+    case DECODE_OK:           return "ok" ;
+    case DECODE_UNALLOCATED:  return "unallocated encoding" ;
+    case DECODE_BAD_DP_IMM:   return "not a valid data processing (immediate) instruction" ;
+    case DECODE_BAD_DP_REG:   return "not a valid data processing (register) instruction" ;
+    case DECODE_BAD_BRANCH:   return "not a valid branch instruction" ;
+    case DECODE_BAD_LS:       return "not a valid load/store instruction" ;
+    case DECODE_RESERVED_IMM: return "reserved immediate" ;
+    case DECODE_BAD_ENC:      return "unrecognised encoded instruction type" ;
+    }
+    return "unknown decode status" ;
+}
@@ -3,9 +3,11 @@
 
 #include "common/ast.h"
 #include "common/word.h"
+#include "emulator/decoder/decode_status.h"
 
 /**
- * @brief Decodes 32-bit word `c` into an `instr_t`
+ * @brief Decodes 32-bit word `c` into an `instr_t`, through the
+ * decode memo (see decode_memo.h).
  * 
  * @param instr_t: The decoded word.
  * @param c: The word to be decoded. 
@@ -13,4 +15,16 @@
  */
 bool decode_word(instr_t *, word32_t, address_t) ;
 
+/**
+ * @brief Decodes `c` the old way, through its structured encoding
+ * `enc_instr`; kept as a reference for the table decoder of `decode_word`.
+ */
+bool decode_word_enc(instr_t *, word32_t, address_t) ;
+
+/**
+ * @brief Why `c` fails to decode, through its structured encoding as
+ * `decode_word_enc` decodes it, or `DECODE_OK` if it doesn't.
+ */
+decode_status_e decode_word_status(word32_t c, address_t pc) ;
+
 #endif
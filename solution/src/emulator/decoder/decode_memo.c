@@ -0,0 +1,266 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/instr_table.h"
+#include "emulator/decoder/decode_memo.h"
+#include "utils/log.h"
+
+decode_memo_t decode_memo = { .lock = PTHREAD_MUTEX_INITIALIZER } ;
+_Thread_local decode_memo_counts_t decode_memo_counts = {0} ;
+
+/// @brief The header of a saved memo, followed by `count` entries.
+typedef struct decode_memo_header {
+    char magic[8] ;
+    uint32_t version ;
+    /// @brief `sizeof(instr_t)` of the process that saved the memo.
+    uint32_t instr_size ;
+    /// @brief `table_hash()` of the process that saved the memo.
+    uint64_t table ;
+    uint64_t count ;
+}   decode_memo_header_t ;
+
+static const char DECODE_MEMO_MAGIC[8] = "DECMEMO" ;
+
+static inline
+size_t memo_hash(word32_t c) {
+    return (c * (uint64_t) 0x9e3779b97f4a7c15) >> 32 ;
+}
+
+/**
+ * @brief The slot holding `c`, or the empty slot it would go in, for the
+ * thread holding the memo's lock.
+ */
+static inline
+decode_memo_entry_t *memo_slot(decode_memo_table_t *t, word32_t c) {
+    size_t mask = t->n_slots - 1 ;
+    for (size_t s = memo_hash(c) & mask ;; s = (s + 1) & mask) {
+        decode_memo_entry_t *e = &t->slots[s] ;
+        if (!(e->flags & DECODE_MEMO_USED) || e->word == c) return e ;
+    }
+}
+
+/// @brief The slot holding `c`, or NULL, for any thread, without the lock.
+static inline
+const decode_memo_entry_t *memo_find(const decode_memo_table_t *t, word32_t c) {
+    size_t mask = t->n_slots - 1 ;
+    for (size_t s = memo_hash(c) & mask ;; s = (s + 1) & mask) {
+        const decode_memo_entry_t *e = &t->slots[s] ;
+        if (!(__atomic_load_n(&e->flags, __ATOMIC_ACQUIRE) & DECODE_MEMO_USED)) return NULL ;
+        if (e->word == c) return e ;
+    }
+}
+
+/// @brief A copy of `old`, which may be NULL, rehashed into `n_slots` slots.
+static
+decode_memo_table_t *memo_grow(decode_memo_table_t *old, size_t n_slots) {
+    decode_memo_table_t *t = calloc(1, sizeof(*t) + n_slots * sizeof(decode_memo_entry_t)) ;
+    if (!t) log_exit_failure("Failed to allocate the decode memo") ;
+    t->n_slots = n_slots ;
+    t->prev = old ;
+    for (size_t s = 0; old && s < old->n_slots; s++) {
+        if (old->slots[s].flags & DECODE_MEMO_USED) *memo_slot(t, old->slots[s].word) = old->slots[s] ;
+    }
+    return t ;
+}
+
+/**
+ * @brief The slot for `c`, making room for it if it is new.
+ * @pre The caller holds the memo's lock.
+ */
+static
+decode_memo_entry_t *memo_insert_slot(decode_memo_t *m, word32_t c) {
+    decode_memo_table_t *t = atomic_load_explicit(&m->table, memory_order_relaxed) ;
+    if (!t || 2 * (atomic_load_explicit(&m->n_used, memory_order_relaxed) + 1) > t->n_slots) {
+        t = memo_grow(t, t ? 2 * t->n_slots : DECODE_MEMO_MIN_SLOTS) ;
+        atomic_store_explicit(&m->table, t, memory_order_release) ;
+    }
+    return memo_slot(t, c) ;
+}
+
+/**
+ * @brief Fills the empty slot `e` and only then marks it used, for the
+ * threads looking it up without the lock.
+ * @pre The caller holds the memo's lock.
+ */
+static
+void memo_publish(decode_memo_t *m, decode_memo_entry_t *e, word32_t c, const instr_t *i, uint8_t flags) {
+    e->word = c ;
+    e->instr = *i ;
+    __atomic_store_n(&e->flags, flags | DECODE_MEMO_USED, __ATOMIC_RELEASE) ;
+    atomic_fetch_add_explicit(&m->n_used, 1, memory_order_relaxed) ;
+}
+
+/**
+ * @brief The slot of `c`, decoding it into a new one unless another thread
+ * got there first.
+ * @return NULL when the memo is full.
+ */
+static
+const decode_memo_entry_t *memo_add(decode_memo_t *m, word32_t c) {
+    pthread_mutex_lock(&m->lock) ;
+    decode_memo_table_t *t = atomic_load_explicit(&m->table, memory_order_relaxed) ;
+    decode_memo_entry_t *e = t ? memo_slot(t, c) : NULL ;
+    if (!e || !(e->flags & DECODE_MEMO_USED)) {
+        e = NULL ;
+        if (atomic_load_explicit(&m->n_used, memory_order_relaxed) < DECODE_MEMO_MAX_WORDS) {
+            instr_t i ;
+            uint8_t flags = instr_decode(&i, c, 0) ? DECODE_MEMO_OK : 0 ;
+            e = memo_insert_slot(m, c) ;
+            memo_publish(m, e, c, &i, flags) ;
+        }
+    }
+    pthread_mutex_unlock(&m->lock) ;
+    return e ;
+}
+
+/// @brief Moves the template `i`, decoded at pc 0, to `pc`.
+static inline
+void relocate(instr_t *i, address_t pc) {
+    i->address = pc ;
+    if (i->tp == I_B && i->b.tp != TP_BR) i->b.address += pc ;
+    else if (i->tp == I_LS && i->ls.arg_tp == LS_LIT) i->ls.lit.lit += pc ;
+}
+
+/**
+ * @brief Decodes word `c` at `pc` into `i`, from its template in the memo,
+ * which is made on the first decode of `c` while the memo has room.
+ * @return false when `c` doesn't decode, leaving `i` undefined.
+ */
+bool decode_memo_word(instr_t *i, word32_t c, address_t pc) {
+    decode_memo_t *m = &decode_memo ;
+    const decode_memo_table_t *t = atomic_load_explicit(&m->table, memory_order_acquire) ;
+    const decode_memo_entry_t *e = t ? memo_find(t, c) : NULL ;
+    if (e) {
+        decode_memo_counts.hits++ ;
+    } else {
+        decode_memo_counts.misses++ ;
+        bool full = atomic_load_explicit(&m->n_used, memory_order_relaxed) >= DECODE_MEMO_MAX_WORDS ;
+        if (full || !(e = memo_add(m, c))) return instr_decode(i, c, pc) ;
+    }
+    if (!(e->flags & DECODE_MEMO_OK)) return false ;
+    *i = e->instr ;
+    relocate(i, pc) ;
+    return true ;
+}
+
+/**
+ * @brief A hash of the instruction table, so that a memo saved by a
+ * build with different encodings isn't loaded.
+ */
+static
+uint64_t table_hash(void) {
+    uint64_t h = 0xcbf29ce484222325 ;
+    for (size_t k = 0; k < INSTR_COUNT; k++) {
+        uint64_t fields[] = {instr_info[k].mask, instr_info[k].value, instr_info[k].tp, instr_info[k].sem} ;
+        for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+            h = (h ^ fields[f]) * 0x100000001b3 ;
+        }
+    }
+    return h ;
+}
+
+static
+decode_memo_header_t memo_header(uint64_t count) {
+    decode_memo_header_t h = {
+        .version = DECODE_MEMO_VERSION,
+        .instr_size = sizeof(instr_t),
+        .table = table_hash(),
+        .count = count,
+    } ;
+    memcpy(h.magic, DECODE_MEMO_MAGIC, sizeof(h.magic)) ;
+    return h ;
+}
+
+/// @brief Labels are pointers, so are saved as null and restored on load.
+static
+void set_labels(instr_t *i, bool saving) {
+    if (i->tp == I_B && i->b.tp == TP_BCond) i->b.label = saving ? NULL : INSTR_LABEL_B_COND ;
+    else if (i->tp == I_B && i->b.tp == TP_B) i->b.label = saving ? NULL : INSTR_LABEL_DECODED ;
+    else if (i->tp == I_LS && i->ls.arg_tp == LS_LIT) i->ls.lit.label = saving ? NULL : INSTR_LABEL_DECODED ;
+}
+
+/**
+ * @brief Adds the words saved at `path`, if it exists, to the memo.
+ * @return false when `path` can't be read, or was saved by a build with a
+ * different instruction table or `instr_t`, in which case the rest of it
+ * is ignored.
+ */
+bool decode_memo_load(const char *path) {
+    FILE *f = fopen(path, "rb") ;
+    if (!f) return errno == ENOENT ;
+
+    decode_memo_header_t h, want = memo_header(0) ;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1
+        && memcmp(h.magic, want.magic, sizeof(h.magic)) == 0
+        && h.version == want.version
+        && h.instr_size == want.instr_size
+        && h.table == want.table ;
+
+    decode_memo_t *m = &decode_memo ;
+    pthread_mutex_lock(&m->lock) ;
+    for (uint64_t n = 0; ok && n < h.count && m->n_used < DECODE_MEMO_MAX_WORDS; n++) {
+        decode_memo_entry_t e ;
+        if (fread(&e, sizeof(e), 1, f) != 1) {
+            ok = false ;
+            break ;
+        }
+        decode_memo_entry_t *slot = memo_insert_slot(m, e.word) ;
+        if (slot->flags & DECODE_MEMO_USED) continue ;
+        set_labels(&e.instr, false) ;
+        memo_publish(m, slot, e.word, &e.instr, e.flags & DECODE_MEMO_OK) ;
+    }
+    pthread_mutex_unlock(&m->lock) ;
+    fclose(f) ;
+    return ok ;
+}
+
+/**
+ * @brief Writes every word of the memo to `path`, through a temporary
+ * file, so that a run failing midway, or runs saving at once, leave a
+ * whole memo in place.
+ */
+bool decode_memo_save(const char *path) {
+    size_t len = strlen(path) + 32 ;
+    char *tmp = malloc(len) ;
+    if (!tmp) return false ;
+    snprintf(tmp, len, "%s.%ld.tmp", path, (long) getpid()) ;
+
+    FILE *f = fopen(tmp, "wb") ;
+    if (!f) {
+        free(tmp) ;
+        return false ;
+    }
+    decode_memo_t *m = &decode_memo ;
+    pthread_mutex_lock(&m->lock) ;
+    decode_memo_table_t *t = m->table ;
+    decode_memo_header_t h = memo_header(m->n_used) ;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 ;
+    for (size_t s = 0; ok && t && s < t->n_slots; s++) {
+        if (!(t->slots[s].flags & DECODE_MEMO_USED)) continue ;
+        decode_memo_entry_t e = t->slots[s] ;
+        set_labels(&e.instr, true) ;
+        ok = fwrite(&e, sizeof(e), 1, f) == 1 ;
+    }
+    pthread_mutex_unlock(&m->lock) ;
+    ok = fclose(f) == 0 && ok ;
+    ok = ok && rename(tmp, path) == 0 ;
+    if (!ok) remove(tmp) ;
+    free(tmp) ;
+    return ok ;
+}
+
+/// @brief Empties the memo, once no other thread is decoding through it.
+void free_decode_memo(void) {
+    decode_memo_t *m = &decode_memo ;
+    for (decode_memo_table_t *t = m->table, *prev; t; t = prev) {
+        prev = t->prev ;
+        free(t) ;
+    }
+    m->table = NULL ;
+    m->n_used = 0 ;
+    decode_memo_counts = (decode_memo_counts_t) {0} ;
+}
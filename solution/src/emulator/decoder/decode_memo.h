@@ -0,0 +1,92 @@
+/**
+ * @file decode_memo.h
+ * @brief A memo of decodings, keyed by the raw 32-bit word.
+ *
+ * The same words recur all over a binary, and across binaries: `nop`s,
+ * common adds and moves, the halting `and x0, x0, x0`. The memo keeps one
+ * decoding of each word it has seen, made at pc 0, as a template any pc can
+ * use by adding itself to the template's pc-relative targets.
+ *
+ * It sits under the per-pc instruction cache (see icache.h), which still
+ * decodes each address once: the memo turns that decode into a lookup for
+ * every word already seen, at any address, in this run or, through
+ * `decode_memo_save` and `decode_memo_load`, in an earlier one.
+ *
+ * It holds at most `DECODE_MEMO_MAX_WORDS` words, the first ones seen:
+ * after that a new word is decoded as it would be without the memo, so a
+ * large image, most of it data, neither bloats the process nor the file.
+ *
+ * Any number of threads may decode through the memo at once: a lookup
+ * takes no lock, and a new word is added under the memo's lock, its slot
+ * published only once it is whole. A full table is replaced by a larger
+ * copy, the old one kept until `free_decode_memo` for the threads still
+ * probing it.
+ */
+
+#ifndef __DECODE_MEMO_H
+#define __DECODE_MEMO_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common/ast.h"
+#include "common/word.h"
+
+/// @brief The initial number of slots, a power of two.
+#define DECODE_MEMO_MIN_SLOTS 1024
+
+/// @brief The most words kept, in at most twice as many slots.
+#define DECODE_MEMO_MAX_WORDS (1 << 15)
+
+/// @brief Bumped whenever the file format, or `instr_t`, changes.
+#define DECODE_MEMO_VERSION 2
+
+typedef enum {
+    /// @brief The slot holds a word.
+    DECODE_MEMO_USED = 1 << 0,
+    /// @brief The word decodes, to the slot's `instr`.
+    DECODE_MEMO_OK   = 1 << 1,
+}   decode_memo_flags_t ;
+
+typedef struct decode_memo_entry {
+    word32_t word ;
+    uint8_t flags ;
+    /// @brief The decoding of `word` at pc 0.
+    instr_t instr ;
+}   decode_memo_entry_t ;
+
+typedef struct decode_memo_table {
+    /// @brief The number of slots, a power of two; at most half are used.
+    size_t n_slots ;
+    /// @brief The table this one replaced.
+    struct decode_memo_table *prev ;
+    decode_memo_entry_t slots[] ;
+}   decode_memo_table_t ;
+
+typedef struct decode_memo {
+    /// @brief Read without the lock, replaced under it.
+    decode_memo_table_t *_Atomic table ;
+    /// @brief Held to add words.
+    pthread_mutex_t lock ;
+    _Atomic size_t n_used ;
+}   decode_memo_t ;
+
+typedef struct decode_memo_counts {
+    uint64_t hits ;
+    uint64_t misses ;
+}   decode_memo_counts_t ;
+
+/// @brief The memo shared by every decode of the process, on any thread.
+extern decode_memo_t decode_memo ;
+
+/// @brief The lookups of the calling thread, kept apart from the other
+/// threads' so that counting a hit doesn't contend for a cache line.
+extern _Thread_local decode_memo_counts_t decode_memo_counts ;
+
+bool decode_memo_word(instr_t *i, word32_t c, address_t pc) ;
+bool decode_memo_load(const char *path) ;
+bool decode_memo_save(const char *path) ;
+void free_decode_memo(void) ;
+
+#endif
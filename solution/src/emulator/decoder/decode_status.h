@@ -0,0 +1,36 @@
+/**
+ * @file decode_status.h
+ * @brief Why a word failed to decode.
+ *
+ * The structured decoders, `dec_word` and `decode_enc_instr`, return one of
+ * these up their call chain rather than jumping out of it, so they keep no
+ * state between calls and can run on any number of threads at once.
+ */
+
+#ifndef __DECODE_STATUS_H
+#define __DECODE_STATUS_H
+
+typedef enum {
+    DECODE_OK = 0,
+    /// @brief The word is in no instruction group we know of.
+    DECODE_UNALLOCATED,
+    DECODE_BAD_DP_IMM,
+    DECODE_BAD_DP_REG,
+    DECODE_BAD_BRANCH,
+    DECODE_BAD_LS,
+    /// @brief A reserved immediate, e.g. a bitmask of all ones.
+    DECODE_RESERVED_IMM,
+    /// @brief An `enc_instr` of no known type.
+    DECODE_BAD_ENC,
+}   decode_status_e ;
+
+/**
+ * @brief Returns `s`. Failures go through here so that the compiler lays
+ * them out of line, away from the decoding of valid words.
+ */
+__attribute__((cold, noinline))
+decode_status_e decode_fail(decode_status_e s) ;
+
+const char *decode_status_str(decode_status_e s) ;
+
+#endif
@@ -1,7 +1,5 @@
-#include <setjmp.h>
-
+#include "common/bitmask_imm.h"
 #include "emulator/decoder/enc_decoder.h"
-#include "utils/log.h"
 #include "utils/bits.h"
 
 #define DEC_CASE(cond, enum_tp, sub_tp) \
@@ -9,10 +7,6 @@
 
 #define TO_ADD_ENUM(i) (DP_ADD + ((i.is_subtract << 1) + i.set_cond_flags))
 
-static jmp_buf dece_error ;
-
-#define dece_error_handler(args...) log_error_handler(dece_error, 1, args)
-
 
 static reg_t dec_reg(uint64_t rn, reg_e r31, bool is_extended) {
     if (rn == 31) return (reg_t) {.r = r31, .extended = is_extended} ;
@@ -41,8 +35,18 @@ void dec_mov(instr_dp *dest, enc_mov i, bool is_extended) {
     }
 }
 
+/// @brief Decodes an encoded logical instruction with a bitmask immediate.
+decode_status_e dec_log_imm(instr_dp *dest, enc_log_imm i, bool is_extended) {
+    dest->op_type = (i.opc << 1) + OP_AND ;
+    dest->rn = dec_reg(i.xn, RZR, is_extended) ;
+    dest->op2.type = OP2_BITMASK ;
+    dest->op2.bitmask.imm = bitmask_imm_decode(i.n_immr_imms, is_extended) ;
+    if (!dest->op2.bitmask.imm) return decode_fail(DECODE_RESERVED_IMM) ;
+    return DECODE_OK ;
+}
+
 /// @brief Decodes an encoded data processing instruction with immediate operands.
-void dec_dp_imm(instr_dp *dest, enc_dp_imm i) {
+decode_status_e dec_dp_imm(instr_dp *dest, enc_dp_imm i) {
     bool is_extended = i.sf ;
     dest->rd = dec_reg(i.xd, RZR, is_extended) ; // TODO: check if sets flags or not, because then is SP for DP_ADD
     dest->op2.type = OP2_IMM_SH ;
@@ -51,12 +55,20 @@ void dec_dp_imm(instr_dp *dest, enc_dp_imm i) {
     case DP_ADD:
         dec_add_imm(dest, i.add_imm, is_extended) ;
         break ;
+    case DP_LOG: {
+        decode_status_e s = dec_log_imm(dest, i.log_imm, is_extended) ;
+        if (s != DECODE_OK) return s ;
+        // Only ands, which sets the flags, writes to the zero register
+        if (dest->op_type != OP_ANDS) dest->rd = dec_reg(i.xd, SP, is_extended) ;
+        break ;
+    }
     case DP_MOV:
         dec_mov(dest, i.mov, is_extended) ;
         break ;
     default:
-        dece_error_handler("Not valid dp_imm tp: %d", i.tp) ;
+        return decode_fail(DECODE_BAD_DP_IMM) ;
     }
+    return DECODE_OK ;
 }
 
 /// @brief Decodes an encoded add instruction with register operands. 
@@ -82,7 +94,7 @@ void dec_mul(instr_dp *dest, enc_dp_reg i, bool is_extended) {
 }
 
 /// @brief Decodes an encoded data processing instruction with register operands. 
-void dec_dp_reg(instr_dp *dest, enc_dp_reg i) {
+decode_status_e dec_dp_reg(instr_dp *dest, enc_dp_reg i) {
     bool is_extended = i.sf ;
     dest->rd = dec_reg(i.xd, RZR, is_extended) ;
     dest->rn = dec_reg(i.xn, RZR, is_extended) ;
@@ -94,8 +106,9 @@ void dec_dp_reg(instr_dp *dest, enc_dp_reg i) {
     case DP_LOG: dec_log_reg(dest, i.log_reg) ; break ;
     case DP_MUL: dec_mul(dest, i, is_extended) ; break ;
     default:
-        dece_error_handler("dec_dp_reg") ;
+        return decode_fail(DECODE_BAD_DP_REG) ;
     }
+    return DECODE_OK ;
 }
 
 /// @brief Calculates the address given by an offset and the current PC.
@@ -187,23 +200,15 @@ void dec_ls(instr_ls *dest, enc_ls i, address_t curr_pc) {
 /// @param dest Where to store the decoded instruction.
 /// @param i The encoded instruction.
 /// @param curr_pc Current program counter value.
-/// @return Boolean indicating whether the decoding was successful.
-bool decode_enc_instr(instr_t *dest, enc_instr i, address_t curr_pc) {
-    int ret = setjmp(dece_error) ;
-    if (ret != 0) {
-        logln("^ in decode_enc_instr") ;
-        return false ;
-    }
-
+/// @return `DECODE_OK`, or why the instruction doesn't decode.
+decode_status_e decode_enc_instr(instr_t *dest, enc_instr i, address_t curr_pc) {
     switch (i.tp) {
     case E_DP_IMM: 
         dest->tp = I_DP ; 
-        dec_dp_imm (&dest->dp, i.dp_imm) ; 
-        break ;
+        return dec_dp_imm (&dest->dp, i.dp_imm) ; 
     case E_DP_REG: 
         dest->tp = I_DP ; 
-        dec_dp_reg (&dest->dp, i.dp_reg) ; 
-        break ;
+        return dec_dp_reg (&dest->dp, i.dp_reg) ; 
     case E_INT_DIRECTIVE: 
         dest->tp = I_DIRECTIVE ;
         dest->int_directive = i.int_directive ; 
@@ -220,7 +225,7 @@ bool decode_enc_instr(instr_t *dest, enc_instr i, address_t curr_pc) {
         dest->tp = I_NOP ;
         break ;
     default: 
-        dece_error_handler("Unrecognized instruction type: %d\n", i.tp) ;
+        return decode_fail(DECODE_BAD_ENC) ;
     }
-    return true ;
+    return DECODE_OK ;
 }
\ No newline at end of file
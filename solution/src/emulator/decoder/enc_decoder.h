@@ -3,10 +3,10 @@
 
 #include <stdlib.h>
 
-#include "utils/log.h"
 #include "common/encoded_instrs.h"
 #include "common/ast.h"
+#include "emulator/decoder/decode_status.h"
 
-bool decode_enc_instr(instr_t *, enc_instr i, address_t);
+decode_status_e decode_enc_instr(instr_t *, enc_instr i, address_t);
 
 #endif
\ No newline at end of file
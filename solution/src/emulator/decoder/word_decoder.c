@@ -1,12 +1,5 @@
-#include <setjmp.h>
-
 #include "emulator/decoder/word_decoder.h"
 #include "utils/bits.h"
-#include "utils/log.h"
-
-jmp_buf decw_error ;
-
-#define decw_error_handler(format, ...) log_error_handler(decw_error, 1, format, __VA_ARGS__)
 
 /************************* decwode *************************/
 
@@ -27,8 +20,15 @@ void decw_mov(enc_mov *dest, word32_t c) {
     dest->shift = bits_at(c, 22, 21) ;
 }
 
+/// @brief Decode word to a logical instruction with a bitmask immediate
+void decw_log_imm(enc_log_imm *dest, word32_t c) {
+    dest->opc = bits_at(c, 30, 29) ;
+    dest->n_immr_imms = bits_at(c, 22, 10) ;
+    dest->xn = bits_at(c, 9, 5) ;
+}
+
 /// @brief Decode word to a data processing (immediate) instruction
-void decw_dp_imm(enc_dp_imm *dest, word32_t c) {
+decode_status_e decw_dp_imm(enc_dp_imm *dest, word32_t c) {
     dest->sf = bit_at(c, 31) ;
     dest->xd = bits_at(c, 4, 0) ;
 
@@ -36,10 +36,11 @@ void decw_dp_imm(enc_dp_imm *dest, word32_t c) {
     switch (op0) 
     {
     case 0b010: dest->tp = DP_ADD ; decw_add_imm(&dest->add_imm, c) ; break;
-    case 0b100: not_implemented_error("decw_log_imm") ; break ;
+    case 0b100: dest->tp = DP_LOG ; decw_log_imm(&dest->log_imm, c) ; break ;
     case 0b101: dest->tp = DP_MOV ; decw_mov(&dest->mov, c) ; break ;
-    default: decw_error_handler("Not valid dp_imm op0: %d", op0) ;
+    default: return decode_fail(DECODE_BAD_DP_IMM) ;
     }
+    return DECODE_OK ;
 }
 
 /// @brief Decode add w/ register instruction 
@@ -67,7 +68,7 @@ void decw_mul(enc_mul *dest, word32_t c) {
 }
 
 /// @brief Decode word to a data processing (register) instruction 
-void decw_dp_reg(enc_dp_reg *dest, word32_t c) {
+decode_status_e decw_dp_reg(enc_dp_reg *dest, word32_t c) {
     dest->sf = bit_at(c, 31) ;
     dest->xm = bits_at(c, 20, 16) ;
     dest->xn = bits_at(c, 9, 5) ;
@@ -83,16 +84,13 @@ void decw_dp_reg(enc_dp_reg *dest, word32_t c) {
     else if (!op1 && bit_at_is(op2, 3, 0)) {
         dest->tp = DP_LOG ;
         decw_log_reg(&dest->log_reg, c) ;
-        return ;
     } else if ( bit_at_is(op2, 0, 0) && bit_at_is(op2, 3, 1)) {
         dest->tp = DP_ADD ;
         decw_add_reg(&dest->add_reg, c) ;
-        return ;
-    } else if (op2 == 0b1000) {
-        not_implemented_error("decw_multiply") ;
     } else {
-        decw_error_handler("Not valid dp_reg op2: %d", op2) ;
+        return decode_fail(DECODE_BAD_DP_REG) ;
     }
+    return DECODE_OK ;
 }
 
 /// @brief Decode word to conditional branch instruction.
@@ -112,7 +110,7 @@ void decw_b_reg(enc_b_reg *dest, word32_t c) {
 }
 
 /// @brief Decode word to a branch instruction. 
-void decw_branch(enc_branch *dest, word32_t c) {
+decode_status_e decw_branch(enc_branch *dest, word32_t c) {
     uint32_t op0 = bits_at(c, 31, 29) ;
 
     if (op0 == 0b010) {
@@ -125,8 +123,9 @@ void decw_branch(enc_branch *dest, word32_t c) {
         dest->tp = E_B_REG ;
         decw_b_reg(&dest->reg, c) ;
     } else {
-        decw_error_handler("Not valid branch op0: %d", op0) ;
+        return decode_fail(DECODE_BAD_BRANCH) ;
     }
+    return DECODE_OK ;
 }
 
 void decw_ld_lit(enc_ld_lit *dest, word32_t c) {
@@ -157,7 +156,7 @@ void decw_ls_uimm(enc_ls_imm *dest, word32_t c) {
 }
 
 /// @brief Decode word to structured load/store encoding. 
-void decw_ls(enc_ls *dest, word32_t c) {
+decode_status_e decw_ls(enc_ls *dest, word32_t c) {
     dest->sf = bit_at(c, 30) ;
     uint64_t op0 = bits_at(c, 29, 28) ;
     uint64_t op2 = bits_at(c, 24, 23) ;
@@ -179,44 +178,36 @@ void decw_ls(enc_ls *dest, word32_t c) {
         dest->tp = E_LS_IMM ;
         decw_ls_simm(&dest->imm, c) ;
     } else {
-        decw_error_handler("Not valid ls op0: %d", op0) ;
+        return decode_fail(DECODE_BAD_LS) ;
     }
-
+    return DECODE_OK ;
 }
 
 
 /// @brief Decode word to structured instruction encoding.
 /// @param dest Where to store the decoded instruction.
 /// @param c The word to decode.
-/// @return Boolean indicating success or failure of decoding.
-bool dec_word(enc_instr *dest, word32_t c) {
-    int ret = setjmp(decw_error) ;
-    if (ret != 0) {
-        return false ;
-    }
-
+/// @return `DECODE_OK`, or why the word doesn't decode.
+decode_status_e dec_word(enc_instr *dest, word32_t c) {
     if (c == NOP_CODE) {
         dest->tp = E_NOP ;
-        return true ;
+        return DECODE_OK ;
     }
 
     uint32_t op0 = ((0xF << 25) & c) >> 25;
 
     if (bits_at(op0, 4, 1) == 0b100) {
         dest->tp = E_DP_IMM ;
-        decw_dp_imm(&dest->dp_imm, c) ;
+        return decw_dp_imm(&dest->dp_imm, c) ;
     } else if ((op0 & 0b0111) == 0b101) {
         dest->tp = E_DP_REG ;
-        decw_dp_reg(&dest->dp_reg, c) ;
+        return decw_dp_reg(&dest->dp_reg, c) ;
     } else if (bits_at(op0, 4, 1) == 0b101) {
         dest->tp = E_BRANCH ;
-        decw_branch(&dest->branch, c) ;
+        return decw_branch(&dest->branch, c) ;
     } else if (!bit_at(op0, 0) && bit_at(op0, 2)) {
         dest->tp = E_LS ;
-        decw_ls(&dest->ls, c) ;
-    } else {
-        decw_error_handler("instr not decodable: %x", c) ;
+        return decw_ls(&dest->ls, c) ;
     }
-
-    return true ;
+    return decode_fail(DECODE_UNALLOCATED) ;
 }
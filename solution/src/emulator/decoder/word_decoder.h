@@ -3,10 +3,10 @@
 
 #include <stdlib.h>
 
-#include "utils/log.h"
 #include "common/encoded_instrs.h"
 #include "common/word.h"
+#include "emulator/decoder/decode_status.h"
 
-bool dec_word(enc_instr *, word32_t c);
+decode_status_e dec_word(enc_instr *, word32_t c);
 
 #endif
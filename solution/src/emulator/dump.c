@@ -0,0 +1,106 @@
+#include "emulator/dump.h"
+#include "emulator/loader.h"
+#include "utils/dispatch.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define DUMP_HAVE_AVX2
+#endif
+
+static
+size_t nonzero_scalar(const uint8_t *bytes, size_t n_words, uint16_t *idx) {
+    size_t n = 0 ;
+    size_t k = 0 ;
+    // Two words a step, skipping the pairs that are both zero
+    for (; k + 2 <= n_words; k += 2) {
+        uint64_t pair ;
+        memcpy(&pair, bytes + 4 * k, sizeof(pair)) ;
+        if (!pair) continue ;
+        if (dump_le_word(bytes + 4 * k)) idx[n++] = k ;
+        if (dump_le_word(bytes + 4 * k + 4)) idx[n++] = k + 1 ;
+    }
+    if (k < n_words && dump_le_word(bytes + 4 * k)) idx[n++] = k ;
+    return n ;
+}
+
+#ifdef DUMP_HAVE_AVX2
+/// @brief Tests 32 words a step, then finds the non-zero ones among them 8 at a time.
+__attribute__((target("avx2")))
+static
+size_t nonzero_avx2(const uint8_t *bytes, size_t n_words, uint16_t *idx) {
+    const __m256i zero = _mm256_setzero_si256() ;
+    size_t n = 0 ;
+    size_t k = 0 ;
+    for (; k + 32 <= n_words; k += 32) {
+        const __m256i *src = (const __m256i *) (bytes + 4 * k) ;
+        __m256i v[4] = {
+            _mm256_loadu_si256(src + 0), _mm256_loadu_si256(src + 1),
+            _mm256_loadu_si256(src + 2), _mm256_loadu_si256(src + 3),
+        } ;
+        __m256i any = _mm256_or_si256(_mm256_or_si256(v[0], v[1]), _mm256_or_si256(v[2], v[3])) ;
+        if (_mm256_testz_si256(any, any)) continue ;
+        for (size_t c = 0; c < 4; c++) {
+            __m256i is_zero = _mm256_cmpeq_epi32(v[c], zero) ;
+            unsigned mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(is_zero)) & 0xff ;
+            for (; mask; mask &= mask - 1) idx[n++] = k + 8 * c + __builtin_ctz(mask) ;
+        }
+    }
+    size_t tail = nonzero_scalar(bytes + 4 * k, n_words - k, idx + n) ;
+    for (size_t t = n; t < n + tail; t++) idx[t] += k ;
+    return n + tail ;
+}
+#endif
+
+typedef size_t (*nonzero_fn)(const uint8_t *bytes, size_t n_words, uint16_t *idx) ;
+
+#ifdef DUMP_HAVE_AVX2
+static dispatch_t nonzero = DISPATCH_INIT(nonzero_scalar, nonzero_avx2, cpu_has_avx2) ;
+#else
+static dispatch_t nonzero = DISPATCH_INIT(nonzero_scalar, NULL, NULL) ;
+#endif
+
+static inline
+nonzero_fn nonzero_impl(void) {
+    return (nonzero_fn) dispatch_get(&nonzero) ;
+}
+
+dump_impl_e dump_impl(void) {
+    return dispatch_impl(&nonzero) ;
+}
+
+bool dump_use_impl(dump_impl_e impl) {
+    return dispatch_use(&nonzero, impl) ;
+}
+
+/**
+ * @brief Writes the indices of the non-zero words among the `n_words`
+ * little endian words of `bytes` to `idx`, in order.
+ * @return The number of indices written; `n_words` is at most 65536.
+ */
+size_t dump_nonzero_words(const uint8_t *bytes, size_t n_words, uint16_t *idx) {
+    return nonzero_impl()(bytes, n_words, idx) ;
+}
+
+/**
+ * @brief Calls `f` with each non-zero word of `block`, in address order.
+ * Only its dirty pages are visited, the others being all zero, and they
+ * are scanned by `dump_nonzero_words`.
+ */
+void dump_block_words(memory_block_t *block, dump_word_fn f, void *ctx) {
+    uint16_t idx[MEMORY_PAGE_BYTES / 4] ;
+    address_t end = block->start + block->size ;
+    for (size_t w = 0; w < (block->n_pages + 63) / 64; w++) {
+        for (uint64_t bits = block->dirty[w]; bits; bits &= bits - 1) {
+            address_t page = block->start + (w * 64 + __builtin_ctzll(bits)) * MEMORY_PAGE_BYTES ;
+            const uint8_t *bytes = block_page(block, page) ;
+            if (!bytes) continue ;
+            address_t page_end = page + MEMORY_PAGE_BYTES < end ? page + MEMORY_PAGE_BYTES : end ;
+            size_t n = dump_nonzero_words(bytes, (page_end - page) / 4, idx) ;
+            for (size_t k = 0; k < n; k++) f(ctx, page + 4 * idx[k], dump_le_word(bytes + 4 * idx[k])) ;
+            // A last word the block ends within
+            address_t i = page + (page_end - page) / 4 * 4 ;
+            word32_t data ;
+            if (i < page_end && (data = get_le_word_from_block(block, i))) f(ctx, i, data) ;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+/**
+ * @file dump.h
+ * @brief Finding the words the final memory dump prints.
+ *
+ * The dump prints every non-zero word of memory. It only visits the pages
+ * its blocks mark dirty (see `memory_block_t`), the others being all zero,
+ * and finds the non-zero words of each eight at a time, with AVX2 where
+ * the CPU has it.
+ */
+
+#ifndef __DUMP_H
+#define __DUMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common/word.h"
+#include "emulator/emulator.h"
+
+typedef enum dump_impl {
+    DUMP_IMPL_SCALAR,
+    DUMP_IMPL_AVX2,
+}   dump_impl_e ;
+
+dump_impl_e dump_impl(void) ;
+bool dump_use_impl(dump_impl_e impl) ;
+
+size_t dump_nonzero_words(const uint8_t *bytes, size_t n_words, uint16_t *idx) ;
+
+/// @brief Called with each non-zero word `w`, at `i`, that `dump_block_words` finds.
+typedef void (*dump_word_fn)(void *ctx, address_t i, word32_t w) ;
+
+void dump_block_words(memory_block_t *block, dump_word_fn f, void *ctx) ;
+
+/// @brief The little endian word at `p`, which need not be aligned.
+static inline
+word32_t dump_le_word(const uint8_t *p) {
+    word32_t w ;
+    memcpy(&w, p, sizeof(w)) ;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap32(w) ;
+#endif
+    return w ;
+}
+
+#endif
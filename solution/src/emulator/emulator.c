@@ -1,6 +1,9 @@
 #include "common/ast.h"
 #include "emulator/emulator.h"
+#include "emulator/alu.h"
 #include "emulator/loader.h"
+#include "emulator/dump.h"
+#include "utils/outbuf.h"
 #include "utils/log.h"
 #include "utils/bits.h"
 #include "emulator/decoder/decode.h"
@@ -17,69 +20,29 @@ void inc_pc(cpu_t *cpu) {
 
 
 
-// void get_cpu_reg(cpu_t *cpu, reg_t rn) {
-//     if (R0 <= rn && R30 <= rn) return cpu->g_regs[rn] ;
-//     switch (rn) {
-//         SP: return cpu->sp ;
-        
-//     }
-// }
-
-
-
-
-/// @brief True exactly when @c rn is a general purpose register, 
-/// i.e. when @c rn is one of R0-R30. 
+/**
+ * @brief The bits of the register `r` that an access uses: all 64,
+ * or the low 32 of a W register.
+ */
 static inline
-bool is_g_reg(reg_t rn) {
-    return R0 <= rn.r && rn.r <= R30 ;
+uint64_t reg_mask(reg_t r) {
+    return UINT64_MAX >> ((!r.extended) << 5) ;
 }
 
+/// @brief The slot of the register file that a write to `r` goes to:
+/// writes to the zero register are sunk into `CPU_SINK`.
 static inline
-void set_pstate(cpu_t *cpu, bool N, bool Z, bool C, bool V) {
-    cpu->pstate->N = N ;
-    cpu->pstate->Z = Z ;
-    cpu->pstate->C = C ;
-    cpu->pstate->V = V ;
+size_t write_slot(reg_t r) {
+    return r.r + (r.r == RZR) * (CPU_SINK - CPU_ZR) ;
 }
 
-
 /**
  * @brief Set the value stored in register `rd` to `val`.
  * If `rd` is the zero register, this write is ignored.
  */
+static inline
 void set_cpu_reg(cpu_t *cpu, reg_t rd, uint64_t val) {
-    if (rd.r == RZR) return ;
-    g_reg_t *dest;
-    if (is_g_reg(rd)) dest = &cpu->g_regs[rd.r] ;
-    else switch (rd.r) {
-        case SP: dest = &cpu->sp ; break ;
-        case PC: dest = &cpu->pc ; break ;
-        default: log_error("Bad register: %u", rd.r) ;
-    }
-
-    *dest = val ;
-    if (!rd.extended) { *dest &= 0xffffffff ; }
-}
-
-
-static
-g_reg_t zero_g_reg = 0 ;
-
-/**
- * @brief Get the register `rn`, that is, a pointer to its value.
- * Returns `zero_g_reg` when `rn` is the zero register.
- * ! TODO: Should not be returning null, as that's annoying.
- * ! Maybe should abstract the setting of an individual register?
- */
-g_reg_t *get_cpu_reg(cpu_t *cpu, reg_t rn) {
-    if (rn.r == RZR) return &zero_g_reg ;
-    if (is_g_reg(rn)) return &cpu->g_regs[rn.r] ;
-    else switch (rn.r) {
-        case SP: return &cpu->sp ;
-        case PC: return &cpu->pc ;
-        default: FAIL_M("Bad register") ;
-    }
+    cpu->regs[write_slot(rd)] = val & reg_mask(rd) ;
 }
 
 /**
@@ -87,43 +50,10 @@ g_reg_t *get_cpu_reg(cpu_t *cpu, reg_t rn) {
  */
 static inline
 uint64_t get_reg_val(cpu_t *cpu, reg_t rn) {
-    uint64_t val = rn.r == RZR ? 0 : *get_cpu_reg(cpu, rn) ;
-    if (!rn.extended) val &= 0xffffffff ;
-    return val ;
+    return cpu->regs[rn.r] & reg_mask(rn) ;
 }
 
-#define ulsl(x, n) ((unsigned) x << n)
-#define ulsr(x, n) ((unsigned)x >> n)
-
 #define lsl(x, n) (x << n)
-#define lsr(x, n) (x >> n)
-
-/// @brief Perform a right rotation on `x` by `shift_amount` bits.
-/// @param x - The value to shift.
-/// @param shift_amount - The amount to shift by.
-/// @return `x` rotated right by `shift_amount` bits.
-static inline
-uint64_t ror(uint64_t x, uint64_t shift_amount, bool extended) {
-    if (extended) { return (x >> shift_amount) | (x << (64 - shift_amount)) ; }
-    else {
-        x = x & 0xffffffff ; 
-        return (x >> shift_amount) | (x << (32 - shift_amount)) ; 
-    }
-}
-
-// asr(x, n) ((signed)x >> n)
-
-static inline
-uint64_t asr(uint64_t x, uint64_t shift_amount, bool extended) {
-    if (extended) { 
-        return ((int64_t)x) >> ((uint64_t) shift_amount) ; // ! TODO WHY??
-    }
-    else {
-        uint32_t x32 = (uint32_t) (x & 0xffffffff) ; 
-
-        return (uint64_t) ((int32_t) x32 >> ((uint32_t) shift_amount)) ; 
-    }
-}
 
 /**
  * @brief Shifts `val` according to `sh`, which containing the shift type 
@@ -133,25 +63,9 @@ uint64_t asr(uint64_t x, uint64_t shift_amount, bool extended) {
  * @param val: The value to shift.
  * @return uint64_t: `val` shifted by `sh`.
  */
+static inline
 uint64_t apply_shift(shift_arg sh, uint64_t val, bool extended) {
-    uint64_t res = 0;
-    switch (sh.tp) {
-    case ASR: 
-        res = asr(val, sh.amount, extended) ;
-        // ((int64_t)val) >> ((uint64_t) sh.amount) ; 
-        // ! TODO: Understand why this is wrong:
-        // res = ((signed)val) >> ((uint64_t) sh.amount) ; 
-        // setup: val = 8278016, sh.amount = 54
-        // Expected: 0, Actual: 1
-        // changing signed to int64_t fixes this
-        break ;
-    case LSL: res = lsl(val, sh.amount) ; break ;
-    case LSR: res = lsr(val, sh.amount) ; break ;
-    case ROR: res = ror(val, sh.amount, extended) ; break ;
-    // default:
-        // log_exit_failure("%s - bad shift: %u", __func__, sh.tp) ;
-    }
-    return res ;
+    return alu_shift(sh.tp, sh.amount, val, extended) ;
 }
 
 
@@ -193,6 +107,7 @@ uint64_t get_op2_val(cpu_t *cpu, op2_t op2) {
     switch (op2.type) {
         case OP2_IMM_SH: return get_imm_sh_val(cpu, op2.imm_sh) ;
         case OP2_REG_SH: return get_reg_sh_val(cpu, op2.reg_sh) ;
+        case OP2_BITMASK: return op2.bitmask.imm ;
         case OP2_MUL: log_exit_failure("Internal error: emulation, get_op2_val: OP2_MUL") ;
     }
     log_exit_failure("get_op2_val: %d", op2) ;
@@ -206,40 +121,9 @@ uint64_t get_op2_val(cpu_t *cpu, op2_t op2) {
  * condition flags.
  */
 void emulate_add(cpu_t *cpu, instr_dp i) {
-#ifndef __SIZEOF_INT128__
-    log_error("emulate_add: 128 bit ints not supported") ;
-#endif
     uint64_t op2 = get_op2_val(cpu, i.op2) ;
-    uint64_t carry = 0 ;
-    //  Decide whether to add/subtract and if flags should be set
-    bool set_flags = false ;
-    switch (i.op_type) {
-        case OP_ADD: break ;
-        case OP_ADDS: set_flags = true ; break ;
-        case OP_SUBS: set_flags = true ; op2 = ~op2 ; carry = 1 ; break ;
-        case OP_SUB: op2 = ~op2 ; carry = 1 ; break ;
-        default: log_error("emulate_add bad opc: %d", i.op_type) ;
-    }
-
     uint64_t op1 = get_reg_val(cpu, i.rn) ;
-
-    // Calculate the condition flags based on the calculation.
-    uint64_t result = op1 + op2 + carry ;
-    if (set_flags) {
-        __uint128_t usum = (__uint128_t) op1 + (__uint128_t) op2 + ((__uint128_t)carry) ;
-        __int128_t sum = (__int128_t) ((signed) op1) + (__int128_t) ((signed) op2) + (__int128_t) ((signed) carry);
-        cpu->pstate->N = result >> 63;
-        cpu->pstate->Z = result == 0;
-
-        __uint128_t carryCheck = ((__uint128_t) 1 << 64) ;
-        cpu->pstate->C = usum >= carryCheck;
-
-        __int128_t overflow = ((__int128_t) 1 << 63) ;
-        __int128_t underflow = -((__int128_t) 1 << 63) ;
-        cpu->pstate->V = sum >= overflow || sum < underflow;
-    }
-
-    set_cpu_reg(cpu, i.rd, result) ;
+    set_cpu_reg(cpu, i.rd, alu_add(&cpu->pstate, i.op_type, op1, op2)) ;
 }
 
 
@@ -247,39 +131,14 @@ void emulate_add(cpu_t *cpu, instr_dp i) {
 void emulate_log(cpu_t *cpu, instr_dp i) {
     uint64_t op2 = get_op2_val(cpu, i.op2) ;
     uint64_t op1 = get_reg_val(cpu, i.rn) ;
-    uint64_t res = 0 ;
-    bool update_pstate = false ;
-    switch (i.op_type) {
-        case OP_AND: res = op1 & op2 ; break ;
-        case OP_BIC: res = op1 & ~op2 ; break ;
-        case OP_ORR: res = op1 | op2 ; break ;
-        case OP_ORN: res = op1 | ~op2 ; break ;
-        case OP_EOR: res = op1 ^ op2 ; break ;
-        case OP_EON: res = op1 ^ ~op2 ; break ;
-        case OP_ANDS: res = op1 & op2 ; update_pstate = true ; break ;
-        case OP_BICS: res = op1 & ~op2 ; update_pstate = true ; break ;
-        default: log_error("emulate_log bad opc: %d", i.op_type) ;
-    }
-    if (update_pstate) set_pstate(cpu, res >> 63, res == 0, 0, 0) ;
-    set_cpu_reg(cpu, i.rd, res) ;
+    set_cpu_reg(cpu, i.rd, alu_log(&cpu->pstate, i.op_type, op1, op2)) ;
 }
 
 /// @brief Emulate move operation
 void emulate_mov(cpu_t *cpu, instr_dp i) {
     uint64_t imm_val = get_imm_sh_val(cpu, i.op2.imm_sh) ;
-    uint64_t res ;
-    uint64_t mask = ((uint64_t) 0xffff) << (i.op2.imm_sh.sh.amount);
-    switch (i.op_type) {
-        case OP_MOVN: res = ~imm_val ; break ;
-        case OP_MOVZ: res = imm_val ; break ;
-        case OP_MOVK: 
-            res = get_reg_val(cpu, i.rd) ; 
-            res = (res & ~mask) | (imm_val & mask) ;
-            break ;
-        default:
-            log_error("emulate_mov bad opc: %d", i.op_type) ;
-    }
-    set_cpu_reg(cpu, i.rd, res) ;
+    uint64_t old = i.op_type == OP_MOVK ? get_reg_val(cpu, i.rd) : 0 ;
+    set_cpu_reg(cpu, i.rd, alu_mov(i.op_type, old, imm_val, i.op2.imm_sh.sh.amount)) ;
 }
 
 /// @brief Emulate multiplication operation
@@ -288,10 +147,7 @@ void emulate_mul(cpu_t *cpu, instr_dp i) {
     uint64_t op_m = get_reg_val(cpu, i.op2.mul.rm) ;
     uint64_t op_a = get_reg_val(cpu, i.op2.mul.ra) ;
 
-    uint64_t mult = op_n * op_m ;
-    uint64_t res ;
-    if (i.op_type == OP_MADD) res = op_a + mult ;
-    else res = op_a - mult ;
+    uint64_t res = alu_mul(i.op_type, op_n, op_m, op_a) ;
 
     set_cpu_reg(cpu, i.rd, res) ;
 }
@@ -334,16 +190,7 @@ void emulate_nop(cpu_t *cpu) {
 
 /// @brief Evaluates the condition `cond` based on the on the CPU's pstate.
 bool check_cond(cpu_t *cpu, cond_e cond) {
-    switch (cond) {
-    case EQ: return cpu->pstate->Z ;
-    case NE: return !(cpu->pstate->Z) ;
-    case GE: return cpu->pstate->N == cpu->pstate->V ;
-    case LT: return cpu->pstate->N != cpu->pstate->V ;
-    case GT: return !(cpu->pstate->Z) && (cpu->pstate->N == cpu->pstate->V) ;
-    case LE: return cpu->pstate->Z || (cpu->pstate->N != cpu->pstate->V) ;
-    case AL: return true ;
-    }
-    log_exit_failure("check_cond: Unrecognised condition: %u", cond) ;
+    return alu_cond(&cpu->pstate, cond) ;
 }
 
 /// @brief Emulate a branch instruction, setting the PC to the target address (`i.address`).
@@ -399,6 +246,8 @@ void emulate_ls(cpu_t *cpu, instr_ls i) {
     case LS_REG: target = eval_ls_reg_op(cpu, i.reg) ; break ;
     }
 
+    // The decoder leaves a transfer register of 31 unresolved
+    if (i.rt.r > SP) log_error("Bad register: %u", i.rt.r) ;
     switch (i.op) {
     case OP_STR: set_dword(cpu, target, get_reg_val(cpu, i.rt)) ; break ;
     case OP_LDR: set_cpu_reg(cpu, i.rt, get_dword(cpu, target)) ; break ;
@@ -418,6 +267,7 @@ void emulate_ls(cpu_t *cpu, instr_ls i) {
  * @param i: The instruction to be run.
  */
 void emulate_instr(cpu_t *cpu, instr_t i) {
+    cpu->n_instrs++ ;
     switch (i.tp) {
     case I_DP: emulate_dp(cpu, i.dp) ; break ;
     case I_B: emulate_b(cpu, i.b) ; break ;
@@ -463,8 +313,6 @@ word32_t get_next_word(cpu_t *cpu) {
     return get_word_at(cpu, cpu->pc) ;
 }
 
-#define HALT_CODE 0x8a000000
-
 static inline
 bool is_halt_code(word32_t w) {
     return w == HALT_CODE ;
@@ -481,41 +329,98 @@ bool is_halt_instr(instr_t i) {
     && i.dp.op2.reg_sh.rm.extended ;
 }
 
+/**
+ * @brief Decodes the word at `pc` into `i`, classifying it with
+ * `icache_flags_t`: whether it halts the cpu or fails to decode.
+ */
+static
+uint8_t decode_at(cpu_t *cpu, address_t pc, instr_t *i) {
+    word32_t w = get_word_at(cpu, pc) ;
+    if (is_halt_code(w)) return ICACHE_VALID | ICACHE_HALT ;
+
+    uint8_t flags = ICACHE_VALID ;
+    if (!decode_word(i, w, pc)) flags |= ICACHE_FAIL ;
+    if (is_halt_instr(*i)) flags |= ICACHE_HALT ;
+    return flags ;
+}
+
+/**
+ * @brief The cache entry holding the decoding of the word at `pc`,
+ * decoding it first if it isn't cached yet.
+ * Returns null when `pc` can't be cached.
+ */
+icache_entry_t *fetch_cached(cpu_t *cpu, address_t pc) {
+    icache_entry_t *e = icache_entry(cpu->memory->icache, pc) ;
+    if (e && !(e->flags & ICACHE_VALID)) e->flags = decode_at(cpu, pc, &e->instr) ;
+    return e ;
+}
+
 /**
  * @brief Retrieves and decodes the instruction at the current program counter.
+ * Decodings are looked up in the cpu's instruction cache first, so each
+ * word is only decoded once until it is overwritten.
  */
 static inline
 instr_t fetch_next_instr(cpu_t *cpu) {
     instr_t i ;
-    word32_t w = get_word_at(cpu, cpu->pc) ;
-    if (is_halt_code(w)) {
-        cpu->halt = true ;
-        return i ;
+    uint8_t flags ;
+    icache_entry_t *e = fetch_cached(cpu, cpu->pc) ;
+    if (e) {
+        flags = e->flags ;
+        i = e->instr ;
+    } else {
+        flags = decode_at(cpu, cpu->pc, &i) ;
     }
-    bool decode_status = decode_word(&i, w, cpu->pc) ;
-    cpu->fail = !decode_status ;
 
-    if (is_halt_instr(i)) cpu->halt = true ;
-    // i.address = cpu->pc ;
+    cpu->fail = flags & ICACHE_FAIL ;
+    if (flags & ICACHE_HALT) cpu->halt = true ;
     return i ;
 }
 
+/**
+ * @brief Fetches and executes the single instruction the PC points to.
+ * 
+ * @return false exactly when the cpu halted on, or failed to decode, 
+ * that instruction. A halting instruction is not executed.
+ */
+bool emulate_step(cpu_t *cpu) {
+    instr_t i = fetch_next_instr(cpu) ;
+    if (cpu->halt) return false ;
+    emulate_instr(cpu, i) ;
+    return !cpu->fail ;
+}
+
 /**
  * @brief Runs the `cpu` until it either halts or fails. 
  * Execution begins at whatever instruction the PC points to.
  */
 void emulate_main(cpu_t *cpu) {
-    while (!(cpu->halt || cpu->fail)) {
-        instr_t i = fetch_next_instr(cpu) ;
-        emulate_instr(cpu, i) ;
-    }
+    while (emulate_step(cpu)) ;
+    if (cpu->fail) log_error("CPU fail\n") ;
 }
 
 #define IS_ZERO_INSTR(instr) (instr == 0)
 
+/**
+ * @brief Log `instr`, about to run at the PC. The lines go through stdout's
+ * own buffer, not flushed each, so they keep their place among the rest
+ * of the output.
+ */
+static
+void trace_instr(cpu_t *cpu, instr_t instr) {
+    char line[32] ;
+    char *p = FMT_LIT(line, "(PC: ") ;
+    p = fmt_hex(p, (uint32_t) cpu->pc, 1) ;
+    p = FMT_LIT(p, ") Decoded: ") ;
+    fwrite(line, 1, p - line, stdout) ;
+    char *s = show_instr(instr) ;
+    fputs(s, stdout) ;
+    fputc('\n', stdout) ;
+    free(s) ;
+}
+
 void emulate(FILE *out, cpu_t *cpu, size_t count) {
     // size_t n_instr = count;
-    char *s ;
     while (true) {
         if (cpu->fail) {
             log_error("CPU fail\n") ;
@@ -523,9 +428,14 @@ void emulate(FILE *out, cpu_t *cpu, size_t count) {
         }
         instr_t instr = fetch_next_instr(cpu);
         if (cpu->halt) { logln("CPU halt") ; break ; }
-        s = show_instr(instr) ;
-        loglvl(LOG_1, "(PC: %x) Decoded: %s\n", cpu->pc, s);
-        free(s) ;
+        if (cpu->fail) {
+            // Neither traced nor run: what was decoded is left over from some other word
+            word32_t w = get_word_at(cpu, cpu->pc) ;
+            log_error("Instruction 0x%08x at PC %lx not decodable: %s\n", w, cpu->pc,
+                      decode_status_str(decode_word_status(w, cpu->pc))) ;
+            break ;
+        }
+        if (log_level_enabled(LOG_1)) trace_instr(cpu, instr) ;
         emulate_instr(cpu, instr);
         // f_dump_cpu(stdout, cpu) ;
     }
@@ -533,35 +443,112 @@ void emulate(FILE *out, cpu_t *cpu, size_t count) {
 
 /*** Dumps *************************************************************/
 
-void f_dump_cpu(FILE *out, cpu_t *cpu) {
-
-    fprintf(out, "Registers:\n") ;
+/// @brief Add the registers, PC and flags of `cpu` to `b`, as `f_dump_cpu` prints them.
+void buf_dump_cpu(outbuf_t *b, cpu_t *cpu) {
+    outbuf_str(b, "Registers:\n", 11) ;
     for (reg_e rn = R0; rn <= R30; rn++) {
-        fprintf(out, "X%02d    = %016lx\n", rn, get_reg_val(cpu, (reg_t) {.r= rn , .extended = true}));
+        char *p = outbuf_reserve(b, 32) ;
+        p = FMT_LIT(p, "X") ;
+        p = fmt_dec2(p, rn) ;
+        p = FMT_LIT(p, "    = ") ;
+        p = fmt_hex(p, get_reg_val(cpu, (reg_t) {.r= rn , .extended = true}), 16) ;
+        p = FMT_LIT(p, "\n") ;
+        outbuf_commit(b, p) ;
     }
-    fprintf(out, "PC     = %016lx\n", cpu->pc);
-    
-    fprintf(out, "PSTATE : %s%s%s%s\n", 
-            cpu->pstate->N ? "N" : "-",
-            cpu->pstate->Z ? "Z" : "-",
-            cpu->pstate->C ? "C" : "-",
-            cpu->pstate->V ? "V" : "-") ;
+    char *p = outbuf_reserve(b, 64) ;
+    p = FMT_LIT(p, "PC     = ") ;
+    p = fmt_hex(p, cpu->pc, 16) ;
+    p = FMT_LIT(p, "\nPSTATE : ") ;
+    *p++ = flag_n(&cpu->pstate) ? 'N' : '-' ;
+    *p++ = flag_z(&cpu->pstate) ? 'Z' : '-' ;
+    *p++ = flag_c(&cpu->pstate) ? 'C' : '-' ;
+    *p++ = flag_v(&cpu->pstate) ? 'V' : '-' ;
+    p = FMT_LIT(p, "\n") ;
+    outbuf_commit(b, p) ;
+}
+
+void f_dump_cpu(FILE *out, cpu_t *cpu) {
+    outbuf_t b ;
+    outbuf_init(&b, out, OUTBUF_CAPACITY) ;
+    buf_dump_cpu(&b, cpu) ;
+    outbuf_close(&b) ;
+}
+
+/// @brief Add the line of the non-zero word `w` at `i` to the `outbuf_t` `ctx`.
+static
+void buf_dump_word(void *ctx, address_t i, word32_t w) {
+    outbuf_t *b = ctx ;
+    char *p = outbuf_reserve(b, 32) ;
+    p = FMT_LIT(p, "0x") ;
+    p = fmt_hex(p, i, 8) ;
+    p = FMT_LIT(p, " : 0x") ;
+    p = fmt_hex(p, w, 8) ;
+    p = FMT_LIT(p, "\n") ;
+    outbuf_commit(b, p) ;
+}
 
+/// @brief Add the non-zero memory of `cpu` to `b`, as `f_dump_mem` prints it.
+void buf_dump_mem(outbuf_t *b, cpu_t *cpu) {
+    outbuf_str(b, "Non-zero memory:\n", 17) ;
+    dump_block_words(cpu->memory->memory, buf_dump_word, b) ;
+    dump_block_words(cpu->memory->IO, buf_dump_word, b) ;
 }
 
-void f_dump_block(FILE *out, memory_block_t *block) {
-    uint32_t data ;
-    for (address_t i = block->start; i < block->start + block->size; i += 4) {
-        data = get_le_word_from_block(block, i);
-        if (data) fprintf(out, "0x%08lx : 0x%08x\n", i, data);
+/// @brief The flags of `cpu`, as `state_t` holds them.
+static
+uint32_t cpu_nzcv(cpu_t *cpu) {
+    return (flag_n(&cpu->pstate) ? STATE_N : 0) | (flag_z(&cpu->pstate) ? STATE_Z : 0)
+         | (flag_c(&cpu->pstate) ? STATE_C : 0) | (flag_v(&cpu->pstate) ? STATE_V : 0) ;
+}
+
+static
+void state_word(void *ctx, address_t i, word32_t w) {
+    state_add_word(ctx, i, w) ;
+}
+
+/// @brief Record the registers, PC, flags and non-zero memory of `cpu` in `s`, which is initialised first.
+void cpu_state(cpu_t *cpu, state_t *s) {
+    state_init(s) ;
+    for (reg_e rn = R0; rn <= R30; rn++)
+        s->regs[rn] = get_reg_val(cpu, (reg_t) {.r= rn , .extended = true}) ;
+    s->pc = cpu->pc ;
+    s->nzcv = cpu_nzcv(cpu) ;
+    dump_block_words(cpu->memory->memory, state_word, s) ;
+    dump_block_words(cpu->memory->IO, state_word, s) ;
+}
+
+/**
+ * @brief The fingerprint of the registers, PC, flags and non-zero memory
+ * of `cpu`, see `fingerprint.h`: equal states have equal fingerprints,
+ * whatever the engine and memory backend.
+ *
+ * Only the pages stale since the last call are rehashed. Stores through
+ * the TLB don't mark their pages stale, so the pages it maps are taken
+ * to be, and it is flushed for the pages stored to next to be mapped, and
+ * marked, again.
+ */
+fingerprint_t cpu_fingerprint(cpu_t *cpu) {
+    uint64_t values[STATE_N_REGS + 2] ;
+    for (reg_e rn = R0; rn <= R30; rn++)
+        values[rn] = get_reg_val(cpu, (reg_t) {.r= rn , .extended = true}) ;
+    values[STATE_N_REGS] = cpu->pc ;
+    values[STATE_N_REGS + 1] = cpu_nzcv(cpu) ;
+
+    memory_block_t *blocks[] = {cpu->memory->memory, cpu->memory->IO} ;
+    uint64_t mem_hash[2] = {0, 0} ;
+    for (size_t k = 0; k < 2; k++) {
+        fingerprint_block(blocks[k]) ;
+        mem_hash[0] += blocks[k]->hash_sum[0] ;
+        mem_hash[1] += blocks[k]->hash_sum[1] ;
     }
+    tlb_flush(&cpu->memory->tlb) ;
+    return fingerprint_combine(values, STATE_N_REGS + 2, mem_hash) ;
 }
 
 void f_dump_mem(FILE *out, cpu_t *cpu, uint32_t start, size_t count,
                 unsigned char flags) {
-    
-    fprintf(out, "Non-zero memory:\n");
-    f_dump_block(out, cpu->memory->memory);
-    f_dump_block(out, cpu->memory->IO);
-
+    outbuf_t b ;
+    outbuf_init(&b, out, OUTBUF_CAPACITY) ;
+    buf_dump_mem(&b, cpu) ;
+    outbuf_close(&b) ;
 }
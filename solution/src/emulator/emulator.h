@@ -9,6 +9,11 @@
 #include <stdbool.h>
 
 #include "common/ast.h"
+#include "emulator/icache.h"
+#include "emulator/tlb.h"
+#include "utils/outbuf.h"
+#include "emulator/state.h"
+#include "emulator/fingerprint.h"
 
 #define REG_COUNT 31 // 0 - 30
 
@@ -17,11 +22,17 @@ typedef enum {
     PRINTM_DECODE = 1
 } printm_flags_t;
 
+/// @brief The default size of the main memory block.
 #define MAXIMUM_MEMORY_SIZE_BYTES (2 * 1024 * 1024)
 
+/// @brief The word of `and x0, x0, x0`, which halts the cpu.
+#define HALT_CODE 0x8a000000
+
 #define MAILBOX_ADDR 0x3f00b880
 #define _4_KB (4 * 1024)
 #define MAILBOX_PAGE (MAILBOX_ADDR - (MAILBOX_ADDR % _4_KB))
+/// @brief The pages memory blocks are allocated by, see `memory_block_t`.
+#define MEMORY_PAGE_BYTES _4_KB
 
 /***********************************************************
 * Processor 
@@ -32,39 +43,132 @@ typedef uint64_t g_reg_t;
 // typedef uint64_t reg_val ;
 typedef uint8_t *memory_t;
 
+/// @brief The kinds of flag-setting operation a `pstate_t` can record.
+typedef enum {
+    /// @brief The flags are held as they are, in `nzcv`.
+    FLAGS_NZCV,
+    FLAGS_ADD,
+    FLAGS_SUB,
+    FLAGS_LOG,
+} flags_op ;
+
+/// @brief The bit of each flag in `pstate_t.nzcv`.
+#define NZCV_N (1 << 3)
+#define NZCV_Z (1 << 2)
+#define NZCV_C (1 << 1)
+#define NZCV_V (1 << 0)
+
+/**
+ * @brief The condition flags, evaluated lazily: a flag-setting instruction
+ * only records its operation, operands and result, from which N, Z, C and
+ * V are worked out when something reads them (see `alu.h`).
+ */
 typedef struct pstate_t {
-    bool N :1 ;
-    bool Z :1 ;
-    bool C :1 ;
-    bool V :1 ;
+    /// @brief The `flags_op` that last set the flags.
+    uint8_t op ;
+    /// @brief For `FLAGS_NZCV`, the flags N, Z, C and V in bits 3 to 0.
+    uint8_t nzcv ;
+    /// @brief The result of the operation.
+    uint64_t res ;
+    /// @brief The operands of an addition or subtraction, for its carry.
+    uint64_t a, b ;
 } pstate_t ;
 
+/**
+ * @brief A block of guest memory from `start`, a multiple of
+ * `MEMORY_PAGE_BYTES`, to `start + size`. Either its bytes lie in `memory`,
+ * or, with `pages`, each page is allocated the first time it is written
+ * to, reading as zero before, so a block costs what is touched of it.
+ * Either way, `dirty` has a bit set for every page that may have been
+ * written, so the pages without one are known to be all zero.
+ */
 typedef struct memory_block {
     size_t size ;
     address_t start ;
+    /// @brief The block's bytes, when contiguous; else null.
     memory_t memory ;
+    /// @brief The block's pages, null until written to, when it isn't contiguous; else null.
+    uint8_t **pages ;
+    size_t n_pages ;
+    /// @brief The number of `pages` allocated.
+    size_t n_touched ;
+    /// @brief The binary mapped by `load_bin` as the first `image_pages` pages, if any; not theirs to free.
+    uint8_t *image ;
+    size_t image_pages ;
+    /// @brief One bit a page, set when the page is first written to, by `block_mark_dirty`.
+    uint64_t *dirty ;
+    /// @brief One bit a page, set when the page may have changed since `cpu_fingerprint`
+    /// last hashed it: when written to, or mapped by the TLB, through which it may be.
+    uint64_t *stale ;
+    /// @brief The two lanes of each page's hash, as `cpu_fingerprint` last found them;
+    /// null until it first runs. The hashes of all-zero pages are zero.
+    uint64_t (*page_hashes)[2] ;
+    /// @brief The sum of `page_hashes`, lane by lane.
+    uint64_t hash_sum[2] ;
 }   memory_block_t;
 
 typedef struct cpu_mem_t {
     memory_block_t *memory;
     memory_block_t *IO;
+    /// @brief Predecoded instructions of the main memory block,
+    /// invalidated by every write to it.
+    icache_t *icache ;
+    /// @brief Maps the pages of the main memory block, for loads and stores.
+    tlb_t tlb ;
+    /**
+     * @brief With `MEMORY_MMU`, the host region the blocks lie in, at their
+     * guest address, and the `MMU_SPAN` addresses it covers; else null and 0.
+     */
+    uint8_t *mmu_base ;
+    address_t mmu_span ;
 } cpu_mem_t;
 
+/// @brief Where the guest memory blocks are allocated.
+typedef enum {
+    /// @brief On the heap a page at a time, each access checked against the blocks, see `tlb.h`.
+    MEMORY_HEAP,
+    /// @brief In a region of host memory where guest addresses map one to one, see `mmu.h`.
+    MEMORY_MMU,
+}   memory_backend_t ;
+
+/// @brief How to allocate the guest memory.
+typedef struct memory_config {
+    /// @brief The size of the main memory block, from address 0.
+    size_t size ;
+    memory_backend_t backend ;
+    /// @brief With `MEMORY_MMU`, back the main memory by huge pages where the host has them.
+    bool huge_pages ;
+}   memory_config_t ;
+
+/*
+ * The slots of the register file: R0-R30, the zero register, which always
+ * reads 0, and SP are indexed by their `reg_e`.
+ */
+#define CPU_ZR RZR
+#define CPU_SP SP
+/// @brief Writes to the zero register go here, and are never read back.
+#define CPU_SINK (SP + 1)
+#define CPU_SLOTS (SP + 2)
+
+/// @brief The alignment of a `cpu_t`, so its hot state starts a cache line.
+#define CPU_ALIGN 64
+
 typedef struct cpu_t {
-    /// @brief The values of general registers R0-R30.
-    g_reg_t g_regs[31] ;
     /// @brief The value of the program counter.
     g_reg_t pc;
-    /// @brief The value of the stack pointer.
-    g_reg_t sp;
     /// @brief The cpu's PSTATE.
-    pstate_t *pstate;
+    pstate_t pstate;
     /// @brief True exactly when the cpu failed executing the 
     /// previous instruction.
     bool fail ;
     /// @brief True exactly when the cpu has received a signal to halt
     /// on the previous instruction.
     bool halt ;
+    /// @brief The number of instructions executed so far.
+    uint64_t n_instrs ;
+    /// @brief The register file, see `CPU_SLOTS`; the uop register file
+    /// (see `uop.h`) has the same layout, so uops run on it directly.
+    uint64_t regs[CPU_SLOTS] ;
 
     /// @brief The cpu's memory.
     cpu_mem_t *memory ;
@@ -81,10 +185,34 @@ typedef struct cpu_t {
 } cpu_t ;
 
 
+/// @brief The ways `emulate` can run a program.
+typedef enum {
+    /// @brief The switch interpreter, logging each instruction it runs.
+    ENGINE_TRACE,
+    /// @brief The switch interpreter.
+    ENGINE_SWITCH,
+    /// @brief Threaded code, see `threaded.h`.
+    ENGINE_THREADED,
+    /// @brief Chained blocks of threaded code, see `block.h`.
+    ENGINE_BLOCK,
+    /// @brief Blocks compiled to native code, see `jit.h`.
+    ENGINE_JIT,
+    /// @brief Blocks recompiled ahead of time to a shared object, see `aot.h`.
+    ENGINE_AOT,
+}   engine_t ;
+
 void emulate(FILE *out , cpu_t *cpu , size_t count) ;
+void emulate_main(cpu_t *cpu) ;
+bool emulate_step(cpu_t *cpu) ;
+void emulate_instr(cpu_t *cpu, instr_t i) ;
+icache_entry_t *fetch_cached(cpu_t *cpu, address_t pc) ;
 void f_dump_mem(FILE *out, cpu_t *cpu, uint32_t start, size_t count,
                 unsigned char flags) ;
 void f_dump_cpu(FILE *out, cpu_t *cpu) ;
+void buf_dump_cpu(outbuf_t *b, cpu_t *cpu) ;
+void buf_dump_mem(outbuf_t *b, cpu_t *cpu) ;
+void cpu_state(cpu_t *cpu, state_t *s) ;
+fingerprint_t cpu_fingerprint(cpu_t *cpu) ;
 
 #endif
 
@@ -0,0 +1,169 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "emulator/fingerprint.h"
+#include "emulator/dump.h"
+#include "emulator/loader.h"
+#include "utils/log.h"
+#include "utils/dispatch.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define FINGERPRINT_HAVE_AVX2
+#endif
+
+#define PAGE_WORDS (MEMORY_PAGE_BYTES / 4)
+
+/// @brief The NH keys of each lane, a word each of the page's words.
+static uint32_t keys[2][PAGE_WORDS] __attribute__((aligned(32))) ;
+static pthread_once_t keys_once = PTHREAD_ONCE_INIT ;
+
+static const uint64_t lane_seeds[2] = {0x243f6a8885a308d3, 0x13198a2e03707344} ;
+
+/// @brief The finaliser of MurmurHash3: every bit of the result depends on every bit of `x`.
+static inline
+uint64_t fmix64(uint64_t x) {
+    x ^= x >> 33 ;
+    x *= 0xff51afd7ed558ccd ;
+    x ^= x >> 33 ;
+    x *= 0xc4ceb9fe1a85ec53 ;
+    x ^= x >> 33 ;
+    return x ;
+}
+
+static
+void init_keys(void) {
+    // SplitMix64, from a fixed seed, so fingerprints are the same in every process
+    uint64_t x = 0x452821e638d01377 ;
+    for (size_t l = 0; l < 2; l++) {
+        for (size_t k = 0; k < PAGE_WORDS; k++) {
+            x += 0x9e3779b97f4a7c15 ;
+            keys[l][k] = fmix64(x) ;
+        }
+    }
+}
+
+/// @brief Adds the NH of the words `from` to `n_words` of `bytes` to `nh`, and ORs them into `any`.
+static
+void nh_scalar_from(const uint8_t *bytes, size_t from, size_t n_words, uint64_t nh[2], uint32_t *any) {
+    for (size_t k = from; k < n_words; k += 2) {
+        word32_t x = dump_le_word(bytes + 4 * k) ;
+        // An odd last word is paired with zero
+        word32_t y = k + 1 < n_words ? dump_le_word(bytes + 4 * k + 4) : 0 ;
+        *any |= x | y ;
+        for (size_t l = 0; l < 2; l++)
+            nh[l] += (uint64_t) (word32_t) (x + keys[l][k]) * (word32_t) (y + keys[l][k + 1]) ;
+    }
+}
+
+static
+void nh_scalar(const uint8_t *bytes, size_t n_words, uint64_t nh[2], uint32_t *any) {
+    nh_scalar_from(bytes, 0, n_words, nh, any) ;
+}
+
+#ifdef FINGERPRINT_HAVE_AVX2
+/**
+ * @brief Eight words a step: each 64-bit lane holds a pair of them, plus
+ * their keys, which `_mm256_mul_epu32` multiplies together.
+ */
+__attribute__((target("avx2")))
+static
+void nh_avx2(const uint8_t *bytes, size_t n_words, uint64_t nh[2], uint32_t *any) {
+    __m256i acc[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()} ;
+    __m256i ors = _mm256_setzero_si256() ;
+    size_t k = 0 ;
+    for (; k + 8 <= n_words; k += 8) {
+        __m256i w = _mm256_loadu_si256((const __m256i *) (bytes + 4 * k)) ;
+        ors = _mm256_or_si256(ors, w) ;
+        for (size_t l = 0; l < 2; l++) {
+            __m256i a = _mm256_add_epi32(w, _mm256_load_si256((const __m256i *) &keys[l][k])) ;
+            acc[l] = _mm256_add_epi64(acc[l], _mm256_mul_epu32(a, _mm256_srli_epi64(a, 32))) ;
+        }
+    }
+    for (size_t l = 0; l < 2; l++) {
+        uint64_t sums[4] ;
+        _mm256_storeu_si256((__m256i *) sums, acc[l]) ;
+        nh[l] += sums[0] + sums[1] + sums[2] + sums[3] ;
+    }
+    if (!_mm256_testz_si256(ors, ors)) *any = 1 ;
+    nh_scalar_from(bytes, k, n_words, nh, any) ;
+}
+#endif
+
+typedef void (*nh_fn)(const uint8_t *bytes, size_t n_words, uint64_t nh[2], uint32_t *any) ;
+
+#ifdef FINGERPRINT_HAVE_AVX2
+static dispatch_t nh = DISPATCH_INIT(nh_scalar, nh_avx2, cpu_has_avx2) ;
+#else
+static dispatch_t nh = DISPATCH_INIT(nh_scalar, NULL, NULL) ;
+#endif
+
+/// @brief The hash in use, with the keys it needs.
+static inline
+nh_fn nh_impl(void) {
+    pthread_once(&keys_once, init_keys) ;
+    return (nh_fn) dispatch_get(&nh) ;
+}
+
+fingerprint_impl_e fingerprint_impl(void) {
+    return dispatch_impl(&nh) ;
+}
+
+bool fingerprint_use_impl(fingerprint_impl_e impl) {
+    return dispatch_use(&nh, impl) ;
+}
+
+/**
+ * @brief Hashes the `n_words` little endian words of `bytes`, at most a
+ * page's, at (absolute) index `page`, to `hash`: zero if they all are.
+ */
+void fingerprint_page(const uint8_t *bytes, size_t n_words, address_t page, uint64_t hash[2]) {
+    uint64_t acc[2] = {0, 0} ;
+    uint32_t any = 0 ;
+    nh_impl()(bytes, n_words, acc, &any) ;
+    for (size_t l = 0; l < 2; l++) hash[l] = any ? fmix64(acc[l] + fmix64(page ^ lane_seeds[l])) : 0 ;
+}
+
+/**
+ * @brief Brings the page hashes of `block` and their sum up to date,
+ * rehashing only its stale pages, of which none are left. Of a page the
+ * block ends within, only the words wholly in it are hashed.
+ */
+void fingerprint_block(memory_block_t *block) {
+    if (!block->page_hashes) {
+        // Every page that may be non-zero is stale, since it was written to
+        block->page_hashes = calloc(block->n_pages, sizeof(*block->page_hashes)) ;
+        if (!block->page_hashes) log_exit_failure("Failed to allocate the page hashes") ;
+    }
+    address_t end = block->start + block->size ;
+    for (size_t w = 0; w < (block->n_pages + 63) / 64; w++) {
+        for (uint64_t bits = block->stale[w]; bits; bits &= bits - 1) {
+            size_t p = w * 64 + __builtin_ctzll(bits) ;
+            address_t page = block->start + p * MEMORY_PAGE_BYTES ;
+            const uint8_t *bytes = block_page(block, page) ;
+            uint64_t hash[2] = {0, 0} ;
+            size_t n_words = ((end - page < MEMORY_PAGE_BYTES) ? end - page : MEMORY_PAGE_BYTES) / 4 ;
+            if (bytes) fingerprint_page(bytes, n_words, page, hash) ;
+            for (size_t l = 0; l < 2; l++) {
+                block->hash_sum[l] += hash[l] - block->page_hashes[p][l] ;
+                block->page_hashes[p][l] = hash[l] ;
+            }
+        }
+        block->stale[w] = 0 ;
+    }
+}
+
+/**
+ * @brief The fingerprint of the `n` values, the registers and the like,
+ * and the memory hashed to `mem_hash`.
+ */
+fingerprint_t fingerprint_combine(const uint64_t *values, size_t n, const uint64_t mem_hash[2]) {
+    uint64_t h[2] = {lane_seeds[0] ^ n, lane_seeds[1] ^ n} ;
+    for (size_t k = 0; k < n; k++) {
+        h[0] = fmix64(h[0] ^ values[k]) ;
+        h[1] = fmix64(h[1] + values[k] * 0x9e3779b97f4a7c15) ;
+    }
+    uint64_t hi = fmix64(h[0] ^ mem_hash[0]) ;
+    uint64_t lo = fmix64(h[1] ^ mem_hash[1] ^ hi) ;
+    return (fingerprint_t) {.hi = hi, .lo = lo} ;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file fingerprint.h
+ * @brief A 128-bit hash of the architectural state: registers, PC, flags and memory.
+ *
+ * Memory is hashed a page at a time, each page by NH (sums of products of
+ * pairs of words, each plus a key) in two lanes with different keys, mixed
+ * with the page's address; with AVX2 where the CPU has it. An all-zero page
+ * hashes to zero, and the memory's hash is the sum of its pages', so it
+ * depends only on the non-zero words, as the dump does, and pages can be
+ * rehashed on their own. `cpu_fingerprint` keeps the hashes of each block's
+ * pages and rehashes only the stale ones.
+ */
+
+#ifndef __FINGERPRINT_H
+#define __FINGERPRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common/ast.h"
+#include "common/word.h"
+
+typedef struct fingerprint {
+    uint64_t hi ;
+    uint64_t lo ;
+}   fingerprint_t ;
+
+typedef enum fingerprint_impl {
+    FINGERPRINT_IMPL_SCALAR,
+    FINGERPRINT_IMPL_AVX2,
+}   fingerprint_impl_e ;
+
+fingerprint_impl_e fingerprint_impl(void) ;
+bool fingerprint_use_impl(fingerprint_impl_e impl) ;
+
+struct memory_block ;
+
+void fingerprint_page(const uint8_t *bytes, size_t n_words, address_t page, uint64_t hash[2]) ;
+void fingerprint_block(struct memory_block *block) ;
+fingerprint_t fingerprint_combine(const uint64_t *values, size_t n, const uint64_t mem_hash[2]) ;
+
+static inline
+bool fingerprint_equal(fingerprint_t a, fingerprint_t b) {
+    return a.hi == b.hi && a.lo == b.lo ;
+}
+
+#endif
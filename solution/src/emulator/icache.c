@@ -0,0 +1,92 @@
+#include <stdlib.h>
+
+#include "emulator/icache.h"
+#include "utils/log.h"
+
+/**
+ * @brief Initialise an empty instruction cache covering the `size` bytes
+ * from address `start`.
+ *
+ * @return icache_t* The cache, or null if allocation failed.
+ */
+icache_t *init_icache(address_t start, size_t size) {
+    icache_t *cache = malloc(sizeof(icache_t)) ;
+    if (!cache) return NULL ;
+
+    cache->start = start ;
+    cache->size = size ;
+    cache->n_listeners = 0 ;
+    cache->n_pages = (size + ICACHE_PAGE_BYTES - 1) / ICACHE_PAGE_BYTES ;
+    cache->pages = calloc(cache->n_pages, sizeof(icache_page_t *)) ;
+    if (!cache->pages) {
+        free(cache) ;
+        return NULL ;
+    }
+    return cache ;
+}
+
+/// @brief Free the given instruction cache, and all of its pages.
+void free_icache(icache_t *cache) {
+    if (cache == NULL) return ;
+    for (size_t p = 0; p < cache->n_pages; p++) free(cache->pages[p]) ;
+    free(cache->pages) ;
+    free(cache) ;
+}
+
+/**
+ * @brief Register `f` to be called with `aux` whenever a cached word
+ * is invalidated.
+ */
+void icache_listen(icache_t *cache, icache_listener_t f, void *aux) {
+    if (cache->n_listeners == ICACHE_MAX_LISTENERS)
+        log_exit_failure("Too many instruction cache listeners") ;
+    cache->listeners[cache->n_listeners] = f ;
+    cache->listener_aux[cache->n_listeners] = aux ;
+    cache->n_listeners++ ;
+}
+
+/// @brief Remove every listener registered with `aux`.
+void icache_unlisten(icache_t *cache, void *aux) {
+    size_t n = 0 ;
+    for (size_t l = 0; l < cache->n_listeners; l++) {
+        if (cache->listener_aux[l] == aux) continue ;
+        cache->listeners[n] = cache->listeners[l] ;
+        cache->listener_aux[n] = cache->listener_aux[l] ;
+        n++ ;
+    }
+    cache->n_listeners = n ;
+}
+
+/**
+ * @brief Allocate the (empty) page of entries holding `pc`.
+ *
+ * @return icache_entry_t* The entry for `pc` on the new page.
+ */
+icache_entry_t *icache_fill_page(icache_t *cache, address_t pc) {
+    size_t p = icache_page_idx(cache, pc) ;
+    icache_page_t *page = calloc(1, sizeof(icache_page_t)) ;
+    if (!page) log_exit_failure("Failed to allocate instruction cache page") ;
+    cache->pages[p] = page ;
+    return &page->entries[icache_word_idx(cache, pc)] ;
+}
+
+/**
+ * @brief Invalidate every cached word overlapping the `len` bytes at `addr`.
+ * Only the words actually written are dropped, so data stored next to
+ * code doesn't cost the code its decoding.
+ * Listeners are told about each word that held a decoding.
+ */
+void __icache_invalidate(icache_t *cache, address_t addr, size_t len) {
+    address_t end = addr + len ;
+    if (end - cache->start > cache->size) end = cache->start + cache->size ;
+
+    for (address_t w = addr & ~(address_t) 3; w < end; w += 4) {
+        icache_page_t *page = cache->pages[icache_page_idx(cache, w)] ;
+        if (!page) continue ;
+        icache_entry_t *e = &page->entries[icache_word_idx(cache, w)] ;
+        if (!(e->flags & ICACHE_VALID)) continue ;
+        e->flags = 0 ;
+        for (size_t l = 0; l < cache->n_listeners; l++)
+            cache->listeners[l](cache->listener_aux[l], w) ;
+    }
+}
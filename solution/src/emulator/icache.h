@@ -0,0 +1,117 @@
+/**
+ * @file icache.h
+ * @brief A predecoded instruction cache, indexed by `pc / 4`.
+ *
+ * Each word of the main memory block can hold its decoded `instr_t`,
+ * along with whether fetching it halts or fails the cpu. Entries are
+ * allocated a page at a time, the first time an instruction on that
+ * page is fetched, so memory that is never executed costs nothing.
+ */
+
+#ifndef __ICACHE_H
+#define __ICACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common/ast.h"
+
+#define ICACHE_PAGE_BYTES (4 * 1024)
+#define ICACHE_PAGE_WORDS (ICACHE_PAGE_BYTES / 4)
+
+/// @brief Flags describing the state of a cache entry.
+typedef enum {
+    /// @brief The entry holds the decoding of the word at its address.
+    ICACHE_VALID = 1 << 0,
+    /// @brief Fetching the word halts the cpu.
+    ICACHE_HALT  = 1 << 1,
+    /// @brief The word could not be decoded.
+    ICACHE_FAIL  = 1 << 2,
+}   icache_flags_t ;
+
+typedef struct icache_entry {
+    uint8_t flags ;
+    instr_t instr ;
+}   icache_entry_t ;
+
+typedef struct icache_page {
+    icache_entry_t entries[ICACHE_PAGE_WORDS] ;
+}   icache_page_t ;
+
+/**
+ * @brief Notified of the address of every cached word that is invalidated,
+ * so that anything derived from its decoding can be dropped as well.
+ */
+typedef void (*icache_listener_t)(void *aux, address_t addr) ;
+
+#define ICACHE_MAX_LISTENERS 4
+
+typedef struct icache {
+    /// @brief The first address covered by the cache.
+    address_t start ;
+    /// @brief The number of bytes covered by the cache.
+    size_t size ;
+    size_t n_pages ;
+    /// @brief Pages of entries; null until a word on the page is fetched.
+    icache_page_t **pages ;
+    size_t n_listeners ;
+    icache_listener_t listeners[ICACHE_MAX_LISTENERS] ;
+    void *listener_aux[ICACHE_MAX_LISTENERS] ;
+}   icache_t ;
+
+icache_t *init_icache(address_t start, size_t size) ;
+void free_icache(icache_t *cache) ;
+void icache_listen(icache_t *cache, icache_listener_t f, void *aux) ;
+void icache_unlisten(icache_t *cache, void *aux) ;
+
+icache_entry_t *icache_fill_page(icache_t *cache, address_t pc) ;
+void __icache_invalidate(icache_t *cache, address_t addr, size_t len) ;
+
+/// @brief The index of the page holding `addr`, relative to the cache start.
+static inline
+size_t icache_page_idx(icache_t *cache, address_t addr) {
+    return (addr - cache->start) / ICACHE_PAGE_BYTES ;
+}
+
+/// @brief The index of the word at `addr` within its page.
+static inline
+size_t icache_word_idx(icache_t *cache, address_t addr) {
+    return ((addr - cache->start) % ICACHE_PAGE_BYTES) / 4 ;
+}
+
+/// @brief True exactly when `pc` is a word-aligned address covered by `cache`.
+static inline
+bool icache_covers(icache_t *cache, address_t pc) {
+    return cache != NULL && (pc & 3) == 0
+        && cache->start <= pc && pc - cache->start < cache->size ;
+}
+
+/**
+ * @brief Get the entry for the instruction at `pc`, allocating its page
+ * if needed. Returns null when `pc` can't be cached.
+ * The entry is only meaningful when its `ICACHE_VALID` flag is set.
+ */
+static inline
+icache_entry_t *icache_entry(icache_t *cache, address_t pc) {
+    if (!icache_covers(cache, pc)) return NULL ;
+    icache_page_t *page = cache->pages[icache_page_idx(cache, pc)] ;
+    if (!page) return icache_fill_page(cache, pc) ;
+    return &page->entries[icache_word_idx(cache, pc)] ;
+}
+
+/**
+ * @brief Drop any cached decoding of the words overlapping
+ * the `len` bytes written at `addr`.
+ * Writes to pages that were never fetched from cost a single check.
+ */
+static inline
+void icache_invalidate(icache_t *cache, address_t addr, size_t len) {
+    if (cache == NULL || addr < cache->start || addr - cache->start >= cache->size) return ;
+    address_t last = addr + len - 1 ;
+    if (last - cache->start >= cache->size) last = cache->start + cache->size - 1 ;
+    if (!cache->pages[icache_page_idx(cache, addr)]
+    &&  !cache->pages[icache_page_idx(cache, last)]) return ;
+    __icache_invalidate(cache, addr, len) ;
+}
+
+#endif
@@ -0,0 +1,788 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emulator/jit.h"
+#include "emulator/block.h"
+
+#ifndef JIT_SUPPORTED
+
+/// @brief Without a native backend, run chained blocks of uops instead.
+void emulate_jit(cpu_t *cpu) {
+    emulate_blocks(cpu) ;
+}
+
+#else
+
+#include <sys/mman.h>
+
+#include "emulator/uop_exec.h"
+#include "utils/log.h"
+
+/*****************************************************************************/
+// Translator state
+
+typedef struct jit_block {
+    /// @brief Where the two direct exits of the block (taken, not taken) jump
+    /// to: the exit stub, until linked to the code of the block they go to.
+    void *succ[2] ;
+    address_t start ;
+    /// @brief The next block in the same bucket of the block table.
+    struct jit_block *next ;
+    uint8_t code[] ;
+}   jit_block_t ;
+
+struct jit ;
+
+/// @brief Where native code left off: the next pc, and the successor slot
+/// of the exit taken, if it can be linked.
+typedef struct jit_exit {
+    uint64_t pc ;
+    void **slot ;
+}   jit_exit_t ;
+
+typedef struct jit {
+    /// @brief The uop register file. `rbx` points here while native code runs.
+    uint64_t x[UOP_SLOTS] ;
+    /// @brief The condition flags, a byte each.
+    uint8_t N, Z, C, V ;
+    /// @brief Instructions retired by native code, not yet added to the cpu's count.
+    uint64_t n_instrs ;
+    cpu_t *cpu ;
+
+    /// @brief The executable code buffer, `used` bytes of which are taken.
+    uint8_t *code ;
+    size_t used ;
+    /// @brief The bytes at the start of `code` taken by the trampolines.
+    size_t stubs ;
+    jit_block_t *buckets[BLOCK_BUCKETS] ;
+    /// @brief Incremented by every flush, which drops every block.
+    uint64_t generation ;
+    /// @brief The range of addresses translated since the last flush.
+    address_t lo, hi ;
+    /// @brief Set when translated code is overwritten.
+    bool stale ;
+
+    /// @brief Saves the host's callee-saved registers and jumps to `code`.
+    jit_exit_t (*enter)(struct jit *j, void *code) ;
+    /// @brief Restores the host's registers and returns from `enter`.
+    uint8_t *exit_stub ;
+}   jit_t ;
+
+#define X_DISP(slot) ((int32_t) (offsetof(jit_t, x) + 8 * (slot)))
+#define FIELD_DISP(f) ((int32_t) offsetof(jit_t, f))
+
+/*****************************************************************************/
+// x86-64 encoding
+
+typedef enum {
+    H_RAX, H_RCX, H_RDX, H_RBX, H_RSP, H_RBP, H_RSI, H_RDI,
+    H_R8, H_R9, H_R10, H_R11, H_R12, H_R13, H_R14, H_R15
+}   host_reg ;
+
+/// @brief x86 condition codes; `cc ^ 1` is the negation of `cc`.
+typedef enum {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_S = 0x8, CC_NS = 0x9
+}   host_cc ;
+
+/// @brief Extensions of the ModRM reg field, selecting the operation.
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6 } ;
+enum { SH_ROR = 1, SH_SHL = 4, SH_SHR = 5, SH_SAR = 7 } ;
+/// @brief Opcodes of `op r/m64, r64`.
+enum { OPC_ADD = 0x01, OPC_OR = 0x09, OPC_AND = 0x21, OPC_SUB = 0x29, OPC_XOR = 0x31, OPC_MOV = 0x89 } ;
+
+typedef struct emit {
+    uint8_t *p ;
+}   emit_t ;
+
+static inline void b1(emit_t *e, uint8_t b) { *e->p++ = b ; }
+static inline void b4(emit_t *e, uint32_t v) { memcpy(e->p, &v, 4) ; e->p += 4 ; }
+static inline void b8(emit_t *e, uint64_t v) { memcpy(e->p, &v, 8) ; e->p += 8 ; }
+
+/// @brief A REX prefix, if needed: `w` for 64-bit operands, and the high
+/// bits of the ModRM `reg` and `rm` registers.
+static void rex(emit_t *e, bool w, int reg, int rm) {
+    uint8_t r = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3) ;
+    if (r != 0x40) b1(e, r) ;
+}
+
+static void modrm_rr(emit_t *e, int reg, int rm) {
+    b1(e, 0xc0 | ((reg & 7) << 3) | (rm & 7)) ;
+}
+
+/// @brief A ModRM operand of memory at `[rbx + disp]`.
+static void modrm_mem(emit_t *e, int reg, int32_t disp) {
+    b1(e, 0x80 | ((reg & 7) << 3) | H_RBX) ;
+    b4(e, disp) ;
+}
+
+/// @brief A rip-relative displacement to `target`, ending the instruction.
+static void rip_disp(emit_t *e, const void *target) {
+    b4(e, (int32_t) ((const uint8_t *) target - (e->p + 4))) ;
+}
+
+static void alu_rr(emit_t *e, uint8_t opc, int dst, int src) {
+    rex(e, true, src, dst) ;
+    b1(e, opc) ;
+    modrm_rr(e, src, dst) ;
+}
+
+static void mov_rr(emit_t *e, int dst, int src) { alu_rr(e, OPC_MOV, dst, src) ; }
+
+/// @brief `mov dst32, dst32`: clears the top 32 bits of `dst`.
+static void zext32(emit_t *e, int dst) {
+    rex(e, false, dst, dst) ;
+    b1(e, OPC_MOV) ;
+    modrm_rr(e, dst, dst) ;
+}
+
+static void alu_ri(emit_t *e, int ext, int dst, int32_t imm) {
+    rex(e, true, 0, dst) ;
+    b1(e, 0x81) ;
+    modrm_rr(e, ext, dst) ;
+    b4(e, imm) ;
+}
+
+static void alu_mem_imm(emit_t *e, int ext, int32_t disp, int32_t imm) {
+    rex(e, true, 0, H_RBX) ;
+    b1(e, 0x81) ;
+    modrm_mem(e, ext, disp) ;
+    b4(e, imm) ;
+}
+
+static void shift_ri(emit_t *e, bool w, int ext, int dst, uint8_t n) {
+    rex(e, w, 0, dst) ;
+    b1(e, 0xc1) ;
+    modrm_rr(e, ext, dst) ;
+    b1(e, n) ;
+}
+
+static void not_r(emit_t *e, int dst) {
+    rex(e, true, 0, dst) ;
+    b1(e, 0xf7) ;
+    modrm_rr(e, 2, dst) ;
+}
+
+static void imul_rr(emit_t *e, int dst, int src) {
+    rex(e, true, dst, src) ;
+    b1(e, 0x0f) ; b1(e, 0xaf) ;
+    modrm_rr(e, dst, src) ;
+}
+
+static void movsxd_rr(emit_t *e, int dst, int src) {
+    rex(e, true, dst, src) ;
+    b1(e, 0x63) ;
+    modrm_rr(e, dst, src) ;
+}
+
+/// @brief Load `dst` with `imm`, without touching the host flags.
+static void mov_ri(emit_t *e, int dst, uint64_t imm) {
+    if (imm <= UINT32_MAX) {
+        rex(e, false, 0, dst) ;
+        b1(e, 0xb8 + (dst & 7)) ;
+        b4(e, imm) ;
+    } else {
+        rex(e, true, 0, dst) ;
+        b1(e, 0xb8 + (dst & 7)) ;
+        b8(e, imm) ;
+    }
+}
+
+static void load_mem(emit_t *e, int dst, int32_t disp) {
+    rex(e, true, dst, H_RBX) ;
+    b1(e, 0x8b) ;
+    modrm_mem(e, dst, disp) ;
+}
+
+static void store_mem(emit_t *e, int32_t disp, int src) {
+    rex(e, true, src, H_RBX) ;
+    b1(e, OPC_MOV) ;
+    modrm_mem(e, src, disp) ;
+}
+
+static void setcc_mem(emit_t *e, host_cc cc, int32_t disp) {
+    b1(e, 0x0f) ; b1(e, 0x90 + cc) ;
+    modrm_mem(e, 0, disp) ;
+}
+
+static void mov_mem8_imm(emit_t *e, int32_t disp, uint8_t v) {
+    b1(e, 0xc6) ;
+    modrm_mem(e, 0, disp) ;
+    b1(e, v) ;
+}
+
+/// @brief `movzx eax, byte [rbx + disp]`
+static void load8_eax(emit_t *e, int32_t disp) {
+    b1(e, 0x0f) ; b1(e, 0xb6) ;
+    modrm_mem(e, H_RAX, disp) ;
+}
+
+/// @brief `op al, byte [rbx + disp]`, with `opc` 0x32 for xor or 0x0a for or.
+static void alu8_al_mem(emit_t *e, uint8_t opc, int32_t disp) {
+    b1(e, opc) ;
+    modrm_mem(e, H_RAX, disp) ;
+}
+
+static void test_al(emit_t *e) { b1(e, 0x84) ; b1(e, 0xc0) ; }
+
+/// @brief A conditional jump, to be pointed at its target by `patch_to_here`.
+static uint8_t *jcc(emit_t *e, host_cc cc) {
+    b1(e, 0x0f) ; b1(e, 0x80 + cc) ;
+    b4(e, 0) ;
+    return e->p - 4 ;
+}
+
+static void patch_to_here(emit_t *e, uint8_t *rel) {
+    int32_t d = (int32_t) (e->p - (rel + 4)) ;
+    memcpy(rel, &d, 4) ;
+}
+
+static void jmp_to(emit_t *e, const uint8_t *target) {
+    b1(e, 0xe9) ;
+    rip_disp(e, target) ;
+}
+
+/// @brief `jmp [rip + disp]`, i.e. to the address held at `slot`.
+static void jmp_slot(emit_t *e, void **slot) {
+    b1(e, 0xff) ; b1(e, 0x25) ;
+    rip_disp(e, slot) ;
+}
+
+static void lea_rip(emit_t *e, int dst, const void *target) {
+    rex(e, true, dst, 0) ;
+    b1(e, 0x8d) ;
+    b1(e, 0x05 | ((dst & 7) << 3)) ;
+    rip_disp(e, target) ;
+}
+
+static void call_abs(emit_t *e, const void *f) {
+    mov_ri(e, H_RAX, (uint64_t) f) ;
+    b1(e, 0xff) ; b1(e, 0xd0) ;
+}
+
+static void push_r(emit_t *e, int r) { rex(e, false, 0, r) ; b1(e, 0x50 + (r & 7)) ; }
+static void pop_r(emit_t *e, int r) { rex(e, false, 0, r) ; b1(e, 0x58 + (r & 7)) ; }
+
+/*****************************************************************************/
+// Runtime helpers, called from native code
+
+static uint64_t jit_load(jit_t *j, address_t a) {
+    return get_dword(j->cpu, a) ;
+}
+
+/// @return true if the store overwrote translated code.
+static bool jit_store(jit_t *j, address_t a, uint64_t w) {
+    set_dword(j->cpu, a, w) ;
+    return j->stale ;
+}
+
+/*****************************************************************************/
+// Code generation
+
+/// @brief Callee-saved host registers that hold guest registers in a block.
+static const host_reg cache_regs[] = { H_RBP, H_R12, H_R13, H_R14, H_R15 } ;
+#define N_CACHE_REGS (sizeof(cache_regs) / sizeof(cache_regs[0]))
+
+/// @brief Upper bounds on the code of a uop, and of a block's entry and exit.
+#define JIT_MAX_OP_BYTES 256
+#define JIT_MAX_FRAME_BYTES 256
+
+typedef struct jit_gen {
+    emit_t e ;
+    jit_t *j ;
+    jit_block_t *b ;
+    /// @brief The host register caching each slot, or -1.
+    int8_t host[UOP_SLOTS] ;
+    uint8_t cached[N_CACHE_REGS] ;
+    size_t n_cached ;
+    /// @brief True when the host flags still hold the guest flags, as
+    /// left by the last flag-setting uop.
+    bool flags_live ;
+}   jit_gen_t ;
+
+/// @brief Load `dst` with the value of `slot`, as a 32-bit register unless `sf`.
+static void get_slot(jit_gen_t *g, int dst, uint8_t slot, bool sf) {
+    if (slot == UOP_ZR) {
+        mov_ri(&g->e, dst, 0) ;
+        return ;
+    }
+    if (g->host[slot] >= 0) mov_rr(&g->e, dst, g->host[slot]) ;
+    else load_mem(&g->e, dst, X_DISP(slot)) ;
+    if (!sf) zext32(&g->e, dst) ;
+}
+
+/// @brief Write `src` to `slot`, which is already masked to its width.
+static void put_slot(jit_gen_t *g, uint8_t slot, int src) {
+    if (slot == UOP_SINK || slot == UOP_ZR) return ;
+    if (g->host[slot] >= 0) mov_rr(&g->e, g->host[slot], src) ;
+    else store_mem(&g->e, X_DISP(slot), src) ;
+}
+
+static void spill_cached(jit_gen_t *g) {
+    for (size_t c = 0; c < g->n_cached; c++)
+        store_mem(&g->e, X_DISP(g->cached[c]), cache_regs[c]) ;
+}
+
+/// @brief Leave the block for `target` through its successor slot `k`.
+static void exit_direct(jit_gen_t *g, int k, address_t target) {
+    spill_cached(g) ;
+    mov_ri(&g->e, H_RAX, target) ;
+    lea_rip(&g->e, H_RDX, &g->b->succ[k]) ;
+    jmp_slot(&g->e, &g->b->succ[k]) ;
+}
+
+/// @brief Leave the block for the pc in `rax`, without linking.
+static void exit_indirect(jit_gen_t *g) {
+    spill_cached(g) ;
+    alu_rr(&g->e, OPC_XOR, H_RDX, H_RDX) ;
+    jmp_to(&g->e, g->j->exit_stub) ;
+}
+
+/// @brief Store the guest flags, as set by the host flags of a `kind` operation.
+static void spill_flags(jit_gen_t *g, flags_op kind) {
+    emit_t *e = &g->e ;
+    setcc_mem(e, CC_S, FIELD_DISP(N)) ;
+    setcc_mem(e, CC_E, FIELD_DISP(Z)) ;
+    switch (kind) {
+    case FLAGS_NZCV: break ;
+    case FLAGS_ADD: setcc_mem(e, CC_B, FIELD_DISP(C)) ; break ;
+    // x86 borrows where AArch64 carries
+    case FLAGS_SUB: setcc_mem(e, CC_AE, FIELD_DISP(C)) ; break ;
+    case FLAGS_LOG: mov_mem8_imm(e, FIELD_DISP(C), 0) ; break ;
+    }
+    // The interpreter never sets V, see `alu_add`
+    mov_mem8_imm(e, FIELD_DISP(V), 0) ;
+    g->flags_live = true ;
+}
+
+/// @brief Shift `rcx` as `alu_shift` does, with `rdx` as scratch.
+static void gen_shift(jit_gen_t *g, shift_tp sh, uint8_t amount, bool sf) {
+    emit_t *e = &g->e ;
+    switch (sh) {
+    case LSL: shift_ri(e, true, SH_SHL, H_RCX, amount) ; break ;
+    case LSR: shift_ri(e, true, SH_SHR, H_RCX, amount) ; break ;
+    case ASR:
+        if (sf) shift_ri(e, true, SH_SAR, H_RCX, amount) ;
+        else {
+            shift_ri(e, false, SH_SAR, H_RCX, amount) ;
+            movsxd_rr(e, H_RCX, H_RCX) ;
+        }
+        break ;
+    case ROR:
+        if (sf) shift_ri(e, true, SH_ROR, H_RCX, amount) ;
+        else {
+            // A 32-bit rotate is done on 64 bits, see `alu_ror`
+            mov_rr(e, H_RDX, H_RCX) ;
+            shift_ri(e, true, SH_SHR, H_RCX, amount & 63) ;
+            shift_ri(e, true, SH_SHL, H_RDX, (32 - amount) & 63) ;
+            alu_rr(e, OPC_OR, H_RCX, H_RDX) ;
+        }
+        break ;
+    }
+}
+
+static void gen_dp(jit_gen_t *g, const uop_t *op, uop_info_t info) {
+    emit_t *e = &g->e ;
+    dp_op opc = info.a ;
+    get_slot(g, H_RAX, op->rn, info.sf) ;
+    if (info.family == UOP_FAM_DP_IMM) {
+        mov_ri(e, H_RCX, op->imm) ;
+    } else {
+        get_slot(g, H_RCX, op->rm, info.sf) ;
+        gen_shift(g, info.b, op->amount, info.sf) ;
+    }
+
+    switch (opc) {
+    case OP_BIC: case OP_ORN: case OP_EON: case OP_BICS:
+        not_r(e, H_RCX) ;
+        break ;
+    default: break ;
+    }
+    switch (opc) {
+    case OP_ADD: case OP_ADDS: alu_rr(e, OPC_ADD, H_RAX, H_RCX) ; break ;
+    case OP_SUB: case OP_SUBS: alu_rr(e, OPC_SUB, H_RAX, H_RCX) ; break ;
+    case OP_AND: case OP_BIC: case OP_ANDS: case OP_BICS: alu_rr(e, OPC_AND, H_RAX, H_RCX) ; break ;
+    case OP_ORR: case OP_ORN: alu_rr(e, OPC_OR, H_RAX, H_RCX) ; break ;
+    case OP_EOR: case OP_EON: alu_rr(e, OPC_XOR, H_RAX, H_RCX) ; break ;
+    default: break ;
+    }
+    switch (opc) {
+    case OP_ADDS: spill_flags(g, FLAGS_ADD) ; break ;
+    case OP_SUBS: spill_flags(g, FLAGS_SUB) ; break ;
+    case OP_ANDS: case OP_BICS: spill_flags(g, FLAGS_LOG) ; break ;
+    default: break ;
+    }
+
+    if (!info.sf) zext32(e, H_RAX) ;
+    put_slot(g, op->rd, H_RAX) ;
+}
+
+static void gen_mov(jit_gen_t *g, const uop_t *op, uop_info_t info) {
+    emit_t *e = &g->e ;
+    uint64_t width = info.sf ? UINT64_MAX : 0xffffffff ;
+    switch ((dp_op) info.a) {
+    case OP_MOVZ: mov_ri(e, H_RAX, op->imm & width) ; break ;
+    case OP_MOVN: mov_ri(e, H_RAX, ~op->imm & width) ; break ;
+    default: {
+        uint64_t mask = ((uint64_t) 0xffff) << op->amount ;
+        get_slot(g, H_RAX, op->rn, info.sf) ;
+        mov_ri(e, H_RCX, ~mask) ;
+        alu_rr(e, OPC_AND, H_RAX, H_RCX) ;
+        mov_ri(e, H_RCX, op->imm & mask) ;
+        alu_rr(e, OPC_OR, H_RAX, H_RCX) ;
+        if (!info.sf) zext32(e, H_RAX) ;
+        break ;
+    }
+    }
+    put_slot(g, op->rd, H_RAX) ;
+}
+
+static void gen_mul(jit_gen_t *g, const uop_t *op, uop_info_t info) {
+    emit_t *e = &g->e ;
+    get_slot(g, H_RAX, op->rn, info.sf) ;
+    get_slot(g, H_RCX, op->rm, info.sf) ;
+    imul_rr(e, H_RAX, H_RCX) ;
+    get_slot(g, H_RDX, op->ra, info.sf) ;
+    if (info.a == OP_MADD) alu_rr(e, OPC_ADD, H_RAX, H_RDX) ;
+    else {
+        alu_rr(e, OPC_SUB, H_RDX, H_RAX) ;
+        mov_rr(e, H_RAX, H_RDX) ;
+    }
+    if (!info.sf) zext32(e, H_RAX) ;
+    put_slot(g, op->rd, H_RAX) ;
+}
+
+static void gen_bcond(jit_gen_t *g, const uop_t *op, uop_info_t info, address_t pc) {
+    emit_t *e = &g->e ;
+    cond_e cond = info.a ;
+    host_cc taken ;
+    if (g->flags_live && cond == EQ) taken = CC_E ;
+    else if (g->flags_live && cond == NE) taken = CC_NE ;
+    // V is never set, so GE and LT only depend on N
+    else if (g->flags_live && cond == GE) taken = CC_NS ;
+    else if (g->flags_live && cond == LT) taken = CC_S ;
+    else {
+        switch (cond) {
+        case EQ: case NE:
+            load8_eax(e, FIELD_DISP(Z)) ;
+            test_al(e) ;
+            taken = cond == EQ ? CC_NE : CC_E ;
+            break ;
+        case GE: case LT:
+            load8_eax(e, FIELD_DISP(N)) ;
+            alu8_al_mem(e, 0x32, FIELD_DISP(V)) ;
+            taken = cond == GE ? CC_E : CC_NE ;
+            break ;
+        default:
+            load8_eax(e, FIELD_DISP(N)) ;
+            alu8_al_mem(e, 0x32, FIELD_DISP(V)) ;
+            alu8_al_mem(e, 0x0a, FIELD_DISP(Z)) ;
+            taken = cond == GT ? CC_E : CC_NE ;
+            break ;
+        }
+    }
+    uint8_t *not_taken = jcc(e, taken ^ 1) ;
+    exit_direct(g, 0, op->imm) ;
+    patch_to_here(e, not_taken) ;
+    exit_direct(g, 1, pc + 4) ;
+}
+
+/// @brief Compute the address of the load/store `op` into `rsi`,
+/// writing back its base register.
+static void gen_ls_addr(jit_gen_t *g, const uop_t *op, uop_addr_t mode) {
+    emit_t *e = &g->e ;
+    switch (mode) {
+    case UOP_ADDR_LIT:
+        mov_ri(e, H_RSI, op->imm) ;
+        break ;
+    case UOP_ADDR_UOFF:
+        get_slot(g, H_RSI, op->rn, true) ;
+        alu_ri(e, ALU_ADD, H_RSI, (int32_t) op->imm) ;
+        break ;
+    case UOP_ADDR_PRE:
+        get_slot(g, H_RSI, op->rn, true) ;
+        alu_ri(e, ALU_ADD, H_RSI, (int32_t) op->imm) ;
+        put_slot(g, op->rn, H_RSI) ;
+        break ;
+    case UOP_ADDR_POST:
+        get_slot(g, H_RSI, op->rn, true) ;
+        mov_rr(e, H_RAX, H_RSI) ;
+        alu_ri(e, ALU_ADD, H_RAX, (int32_t) op->imm) ;
+        put_slot(g, op->rn, H_RAX) ;
+        break ;
+    case UOP_ADDR_REG_LSL:
+    case UOP_ADDR_REG_SXTX:
+        get_slot(g, H_RSI, op->rn, true) ;
+        get_slot(g, H_RCX, op->rm, true) ;
+        if (mode == UOP_ADDR_REG_LSL) shift_ri(e, true, SH_SHL, H_RCX, op->amount) ;
+        alu_rr(e, OPC_ADD, H_RSI, H_RCX) ;
+        break ;
+    }
+}
+
+static void gen_ls(jit_gen_t *g, const uop_t *op, uop_info_t info,
+                   address_t pc, uint32_t remaining) {
+    emit_t *e = &g->e ;
+    gen_ls_addr(g, op, info.a) ;
+    if (info.family == UOP_FAM_LDR) {
+        mov_rr(e, H_RDI, H_RBX) ;
+        call_abs(e, jit_load) ;
+        if (!info.sf) zext32(e, H_RAX) ;
+        put_slot(g, op->rd, H_RAX) ;
+        return ;
+    }
+
+    get_slot(g, H_RDX, op->rd, info.sf) ;
+    mov_rr(e, H_RDI, H_RBX) ;
+    call_abs(e, jit_store) ;
+    // A store into translated code ends the block after it
+    test_al(e) ;
+    uint8_t *fresh = jcc(e, CC_E) ;
+    if (remaining) alu_mem_imm(e, ALU_SUB, FIELD_DISP(n_instrs), remaining) ;
+    mov_ri(e, H_RAX, pc + 4) ;
+    exit_indirect(g) ;
+    patch_to_here(e, fresh) ;
+}
+
+/// @brief Count a use of `slot`, if it can be cached in a host register.
+static void count_use(uint32_t *uses, uint8_t slot) {
+    if (slot < UOP_ZR || slot == UOP_SP) uses[slot]++ ;
+}
+
+/// @brief Give the most used registers of the block's uops a host register.
+static void alloc_regs(jit_gen_t *g, const uop_t *ops, size_t n) {
+    uint32_t uses[UOP_SLOTS] = {0} ;
+    for (size_t i = 0; i < n; i++) {
+        const uop_t *op = &ops[i] ;
+        uop_info_t info = uop_info[op->kind] ;
+        switch (info.family) {
+        case UOP_FAM_MUL: count_use(uses, op->ra) ; // fallthrough
+        case UOP_FAM_DP_REG: count_use(uses, op->rm) ; // fallthrough
+        case UOP_FAM_DP_IMM: count_use(uses, op->rn) ; count_use(uses, op->rd) ; break ;
+        case UOP_FAM_MOV: count_use(uses, op->rd) ; break ;
+        case UOP_FAM_BR: count_use(uses, op->rn) ; break ;
+        case UOP_FAM_LDR:
+        case UOP_FAM_STR:
+            count_use(uses, op->rd) ;
+            if (info.a != UOP_ADDR_LIT) count_use(uses, op->rn) ;
+            if (info.a == UOP_ADDR_REG_LSL || info.a == UOP_ADDR_REG_SXTX) count_use(uses, op->rm) ;
+            break ;
+        default: break ;
+        }
+    }
+
+    memset(g->host, -1, sizeof(g->host)) ;
+    g->n_cached = 0 ;
+    while (g->n_cached < N_CACHE_REGS) {
+        uint8_t best = 0 ;
+        for (uint8_t s = 1; s < UOP_SLOTS; s++) if (uses[s] > uses[best]) best = s ;
+        // A register used once is cheaper left in memory
+        if (uses[best] < 2) break ;
+        uses[best] = 0 ;
+        g->host[best] = cache_regs[g->n_cached] ;
+        g->cached[g->n_cached++] = best ;
+    }
+}
+
+static void gen_op(jit_gen_t *g, const uop_t *op, address_t pc, uint32_t remaining) {
+    uop_info_t info = uop_info[op->kind] ;
+    if (info.family != UOP_FAM_BCOND && info.family != UOP_FAM_NOP) g->flags_live = false ;
+
+    switch (info.family) {
+    case UOP_FAM_DP_IMM:
+    case UOP_FAM_DP_REG: gen_dp(g, op, info) ; break ;
+    case UOP_FAM_MOV: gen_mov(g, op, info) ; break ;
+    case UOP_FAM_MUL: gen_mul(g, op, info) ; break ;
+    case UOP_FAM_B: exit_direct(g, 0, op->imm) ; break ;
+    case UOP_FAM_BCOND: gen_bcond(g, op, info, pc) ; break ;
+    case UOP_FAM_BR:
+        get_slot(g, H_RAX, op->rn, true) ;
+        exit_indirect(g) ;
+        break ;
+    case UOP_FAM_LDR:
+    case UOP_FAM_STR: gen_ls(g, op, info, pc, remaining) ; break ;
+    default: break ;
+    }
+}
+
+/*****************************************************************************/
+// Code cache
+
+static void jit_flush(jit_t *j) {
+    memset(j->buckets, 0, sizeof(j->buckets)) ;
+    j->used = j->stubs ;
+    j->generation++ ;
+    j->lo = UINT64_MAX ;
+    j->hi = 0 ;
+    j->stale = false ;
+}
+
+static void jit_invalidate(void *aux, address_t addr) {
+    jit_t *j = aux ;
+    if (j->lo <= addr && addr < j->hi) j->stale = true ;
+}
+
+/// @brief Emit the trampolines in and out of native code.
+static void gen_stubs(jit_t *j) {
+    emit_t e = { .p = j->code } ;
+    j->enter = (jit_exit_t (*)(jit_t *, void *)) e.p ;
+    push_r(&e, H_RBX) ; push_r(&e, H_RBP) ;
+    push_r(&e, H_R12) ; push_r(&e, H_R13) ; push_r(&e, H_R14) ; push_r(&e, H_R15) ;
+    // Keep the stack 16-byte aligned for helper calls
+    alu_ri(&e, ALU_SUB, H_RSP, 8) ;
+    mov_rr(&e, H_RBX, H_RDI) ;
+    b1(&e, 0xff) ; modrm_rr(&e, 4, H_RSI) ;
+
+    j->exit_stub = e.p ;
+    alu_ri(&e, ALU_ADD, H_RSP, 8) ;
+    pop_r(&e, H_R15) ; pop_r(&e, H_R14) ; pop_r(&e, H_R13) ; pop_r(&e, H_R12) ;
+    pop_r(&e, H_RBP) ; pop_r(&e, H_RBX) ;
+    b1(&e, 0xc3) ;
+
+    j->stubs = (e.p - j->code + 15) & ~(size_t) 15 ;
+}
+
+static inline size_t bucket_of(address_t pc) {
+    return (pc >> 2) & (BLOCK_BUCKETS - 1) ;
+}
+
+/**
+ * @brief Compile the block starting at `pc`, flushing the cache first
+ * if it is full.
+ *
+ * @return jit_block_t* The block, or null if the instruction at `pc` has no uop.
+ */
+static jit_block_t *jit_translate(jit_t *j, address_t pc) {
+    uop_t ops[BLOCK_MAX_OPS] ;
+    size_t n = 0 ;
+    for (address_t a = pc; n < BLOCK_MAX_OPS; a += 4) {
+        icache_entry_t *e = fetch_cached(j->cpu, a) ;
+        if (!e) break ;
+        uop_kind k = uop_translate(&ops[n], e->flags, &e->instr) ;
+        if (k == UOP_INTERP || k == UOP_HALT) break ;
+        ops[n++].kind = k ;
+        if (uop_is_branch(k)) break ;
+    }
+    if (n == 0) return NULL ;
+
+    size_t bound = sizeof(jit_block_t) + n * JIT_MAX_OP_BYTES + JIT_MAX_FRAME_BYTES ;
+    if (j->used + bound > JIT_CODE_BYTES) jit_flush(j) ;
+
+    jit_block_t *b = (jit_block_t *) (j->code + j->used) ;
+    b->succ[0] = b->succ[1] = j->exit_stub ;
+    b->start = pc ;
+
+    jit_gen_t g = { .e = { .p = b->code }, .j = j, .b = b, .flags_live = false } ;
+    alloc_regs(&g, ops, n) ;
+    alu_mem_imm(&g.e, ALU_ADD, FIELD_DISP(n_instrs), n) ;
+    for (size_t c = 0; c < g.n_cached; c++)
+        load_mem(&g.e, cache_regs[c], X_DISP(g.cached[c])) ;
+
+    for (size_t i = 0; i < n; i++) gen_op(&g, &ops[i], pc + 4 * i, n - i - 1) ;
+    if (!uop_is_branch(ops[n - 1].kind)) exit_direct(&g, 1, pc + 4 * n) ;
+
+    j->used = (g.e.p - j->code + 15) & ~(size_t) 15 ;
+
+    size_t k = bucket_of(pc) ;
+    b->next = j->buckets[k] ;
+    j->buckets[k] = b ;
+    if (pc < j->lo) j->lo = pc ;
+    if (pc + 4 * n > j->hi) j->hi = pc + 4 * n ;
+    return b ;
+}
+
+static inline jit_block_t *jit_get(jit_t *j, address_t pc) {
+    for (jit_block_t *b = j->buckets[bucket_of(pc)]; b; b = b->next)
+        if (b->start == pc) return b ;
+    return jit_translate(j, pc) ;
+}
+
+/*****************************************************************************/
+// Running
+
+static void jit_load_state(jit_t *j) {
+    cpu_t *cpu = j->cpu ;
+    memcpy(j->x, cpu->regs, sizeof(j->x)) ;
+    j->N = flag_n(&cpu->pstate) ;
+    j->Z = flag_z(&cpu->pstate) ;
+    j->C = flag_c(&cpu->pstate) ;
+    j->V = flag_v(&cpu->pstate) ;
+}
+
+static void jit_store_state(jit_t *j) {
+    cpu_t *cpu = j->cpu ;
+    memcpy(cpu->regs, j->x, sizeof(j->x)) ;
+    set_nzcv(&cpu->pstate, j->N, j->Z, j->C, j->V) ;
+    cpu->n_instrs += j->n_instrs ;
+    j->n_instrs = 0 ;
+}
+
+static jit_t *init_jit(cpu_t *cpu) {
+    jit_t *j = malloc(sizeof(jit_t)) ;
+    if (!j) log_exit_failure("Failed to allocate the JIT") ;
+    j->code = mmap(NULL, JIT_CODE_BYTES, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) ;
+    if (j->code == MAP_FAILED) {
+        free(j) ;
+        return NULL ;
+    }
+    j->cpu = cpu ;
+    j->n_instrs = 0 ;
+    j->generation = 0 ;
+    gen_stubs(j) ;
+    jit_flush(j) ;
+    icache_listen(cpu->memory->icache, jit_invalidate, j) ;
+    return j ;
+}
+
+static void free_jit(jit_t *j) {
+    icache_unlisten(j->cpu->memory->icache, j) ;
+    munmap(j->code, JIT_CODE_BYTES) ;
+    free(j) ;
+}
+
+/**
+ * @brief Runs the `cpu` until it either halts or fails, like `emulate_main`,
+ * compiling each block to native code the first time it runs.
+ * Falls back to `emulate_blocks` if no executable memory can be mapped.
+ */
+void emulate_jit(cpu_t *cpu) {
+    jit_t *j = init_jit(cpu) ;
+    if (!j) {
+        emulate_blocks(cpu) ;
+        return ;
+    }
+
+    jit_load_state(j) ;
+    address_t pc = cpu->pc ;
+    // The successor slot of the last exit, to link to the next block
+    void **link = NULL ;
+    uint64_t link_gen = 0 ;
+
+    while (true) {
+        if (j->stale) jit_flush(j) ;
+        jit_block_t *b = jit_get(j, pc) ;
+        if (b == NULL) {
+            // Anything without a uop is run by the interpreter
+            jit_store_state(j) ;
+            cpu->pc = pc ;
+            if (!emulate_step(cpu)) break ;
+            jit_load_state(j) ;
+            pc = cpu->pc ;
+            link = NULL ;
+            continue ;
+        }
+        // Blocks linked before a flush are gone
+        if (link && link_gen == j->generation) *link = b->code ;
+
+        jit_exit_t exit = j->enter(j, b->code) ;
+        pc = exit.pc ;
+        link = exit.slot ;
+        link_gen = j->generation ;
+    }
+
+    free_jit(j) ;
+    if (cpu->fail) log_error("CPU fail\n") ;
+}
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ * @file jit.h
+ * @brief An x86-64 dynamic binary translator.
+ *
+ * Blocks of instructions, found and translated to uops as in `block.h`,
+ * are compiled to native code in executable mmap'd pages. The most used
+ * registers of a block live in host registers while it runs, loads and
+ * stores go through `get_dword`/`set_dword`, and compiled blocks jump
+ * straight to each other once linked.
+ *
+ * On other hosts, `emulate_jit` runs the block engine instead.
+ */
+
+#ifndef __JIT_H
+#define __JIT_H
+
+#include "emulator/emulator.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define JIT_SUPPORTED 1
+#endif
+
+/// @brief The size of the native code cache; it is flushed whenever it fills up.
+#define JIT_CODE_BYTES (4 * 1024 * 1024)
+
+void emulate_jit(cpu_t *cpu) ;
+
+#endif
@@ -1,13 +1,25 @@
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "emulator/loader.h"
+#include "emulator/mmu.h"
 #include "utils/log.h"
 
 
-cpu_t *__init_cpu(size_t memory_size) ;
+cpu_t *__init_cpu(const memory_config_t *config) ;
 
-/// @brief Free the given memory block
+/// @brief Free the given memory block, and its pages; contiguous memory is the backend's to free
 void free_memory_block(memory_block_t *block) {
     if (block != NULL) {
-        log_free(block->memory) ;
+        if (block->pages) {
+            for (size_t p = block->image_pages; p < block->n_pages; p++) free(block->pages[p]) ;
+            free(block->pages) ;
+        }
+        if (block->image) munmap(block->image, block->image_pages * MEMORY_PAGE_BYTES) ;
+        free(block->dirty) ;
+        free(block->stale) ;
+        free(block->page_hashes) ;
         log_free(block) ;
     }
 }
@@ -17,6 +29,8 @@ void free_mem(cpu_mem_t *mem) {
     if (mem != NULL) {
         free_memory_block(mem->memory) ;
         free_memory_block(mem->IO) ;
+        if (mem->mmu_base) mmu_release(mem->mmu_base) ;
+        free_icache(mem->icache) ;
         free(mem) ;
     }
 }
@@ -24,7 +38,6 @@ void free_mem(cpu_mem_t *mem) {
 /// @brief Free the given cpu
 void free_cpu(cpu_t *cpu) {
     if (cpu != NULL) {
-        free(cpu->pstate);
         free_mem(cpu->memory);
         free(cpu) ;
     }
@@ -61,13 +74,62 @@ bool valid_mem_address(cpu_mem_t *mem, address_t idx) {
  * @return cpu_t* CPU pointer with allocated memory
  */
 cpu_t *init_cpu(size_t memory_size) {
-    cpu_t *res = __init_cpu(memory_size) ;
+    return init_cpu_config(&(memory_config_t) {.size = memory_size, .backend = MEMORY_HEAP}) ;
+}
+
+/**
+ * @brief Allocate memory for a new cpu, with its memory as `config` says
+ * 
+ * @param config The size of the main memory, and where to allocate it and the IO memory
+ * @return cpu_t* CPU pointer with allocated memory
+ */
+cpu_t *init_cpu_config(const memory_config_t *config) {
+    cpu_t *res = __init_cpu(config) ;
     if (!res) log_exit_failure("Failed to allocate memory for CPU") ;
     return res ;
 }
 
-/// @brief Get the memory at (absolute) index `i`.
-#define MEM(mem, i)  (mem->memory[i - mem->start])
+/**
+ * @brief Get the page of `block` at (absolute) index `page`, a multiple of `MEMORY_PAGE_BYTES`
+ * 
+ * @param block The memory block holding the page
+ * @param page The index of the page's first byte
+ * @return uint8_t* The page's bytes, or null when it was never written to, and reads as zero
+ */
+uint8_t *block_page(memory_block_t *block, address_t page) {
+    if (block->memory) return &block->memory[page - block->start] ;
+    size_t p = (page - block->start) / MEMORY_PAGE_BYTES ;
+    return p < block->n_pages ? block->pages[p] : NULL ;
+}
+
+/// @brief Get the page of `block` at (absolute) index `page`, allocating it if it was never written to,
+/// and mark it dirty.
+static
+uint8_t *block_page_for_write(memory_block_t *block, address_t page) {
+    block_mark_dirty(block, page, 1) ;
+    uint8_t *bytes = block_page(block, page) ;
+    if (bytes) return bytes ;
+    bytes = calloc(MEMORY_PAGE_BYTES, 1) ;
+    if (!bytes) log_exit_failure("Failed to allocate the memory page at 0x%lx", page) ;
+    block->pages[(page - block->start) / MEMORY_PAGE_BYTES] = bytes ;
+    block->n_touched++ ;
+    return bytes ;
+}
+
+/// @brief Get the memory at (absolute) index `i`, which reads as zero past the end of the block.
+static inline
+uint8_t mem_get(memory_block_t *block, address_t i) {
+    if (i - block->start >= block->size) return 0 ;
+    const uint8_t *page = block_page(block, i & ~(address_t) (MEMORY_PAGE_BYTES - 1)) ;
+    return page ? page[i % MEMORY_PAGE_BYTES] : 0 ;
+}
+
+/// @brief Set the memory at (absolute) index `i`, unless past the end of the block.
+static inline
+void mem_set(memory_block_t *block, address_t i, uint8_t v) {
+    if (i - block->start >= block->size) return ;
+    block_page_for_write(block, i & ~(address_t) (MEMORY_PAGE_BYTES - 1))[i % MEMORY_PAGE_BYTES] = v ;
+}
 
 /**
  * @brief Get the block of memory that contains the given index `idx`
@@ -92,10 +154,10 @@ memory_block_t *get_block(cpu_mem_t *mem, address_t idx) {
  */
 bool store_le_word_in_block(memory_block_t *mem, uint64_t idx, uint32_t w) {
     if (!in_mem(mem, idx)) log_exit_failure("Out of bounds memory write at 0x%lx", idx) ;
-    MEM(mem, idx+3) = (uint8_t) ((w & 0xFF000000) >> 24);
-    MEM(mem, idx+2) = (uint8_t)((w & 0x00FF0000) >> 16);
-    MEM(mem, idx+1) = (uint8_t)((w & 0x0000FF00) >> 8);
-    MEM(mem, idx) =   (uint8_t) (w & 0x000000FF);
+    mem_set(mem, idx+3, (uint8_t) ((w & 0xFF000000) >> 24));
+    mem_set(mem, idx+2, (uint8_t)((w & 0x00FF0000) >> 16));
+    mem_set(mem, idx+1, (uint8_t)((w & 0x0000FF00) >> 8));
+    mem_set(mem, idx,   (uint8_t) (w & 0x000000FF));
     return true ;
 }
 
@@ -110,7 +172,12 @@ bool store_le_word_in_block(memory_block_t *mem, uint64_t idx, uint32_t w) {
 bool store_le_word(cpu_mem_t *mem, uint64_t idx, uint32_t w) {
     if (!valid_mem_address(mem, idx)) log_exit_failure("Out of bounds memory write at 0x%lx", idx) ;
 
-    return store_le_word_in_block(get_block(mem, idx), idx, w) ;
+    bool res = store_le_word_in_block(get_block(mem, idx), idx, w) ;
+    icache_invalidate(mem->icache, idx, sizeof(uint32_t)) ;
+    // The page may have been allocated by this store, and no longer reads as the zero page
+    tlb_drop_read_only(&mem->tlb, idx) ;
+    tlb_drop_read_only(&mem->tlb, idx + 3) ;
+    return res ;
 }
 
 /**
@@ -127,28 +194,120 @@ bool store_le_dword(cpu_mem_t *mem, uint64_t idx, uint64_t w) {
         &&  store_le_word(mem, idx, w) ;
 }
 
+/**
+ * @brief Fail as storing the words of a binary of `bytes` bytes would, if it doesn't fit in the
+ * main memory block `block`: at the first word past its end.
+ */
+static
+void check_bin_fits(memory_block_t *block, size_t bytes) {
+    address_t end = (block->size + 3) / 4 * 4 ;
+    if (bytes / 4 * 4 > end) log_exit_failure("Out of bounds memory write at 0x%lx", end) ;
+}
+
+/**
+ * @brief Load the binary `image` of `bytes` bytes into the the cpu main memory, a page at a time.
+ * Any bytes after the last whole word are left out.
+ * 
+ * @param mem The cpu memory to load the binary into.
+ * @param image The binary's bytes, as in its file.
+ * @param bytes The size of the binary.
+ * @param count To report the number of words loaded.
+ * @return int load status
+ */
+int load_image(cpu_mem_t *mem, const uint8_t *image, size_t bytes, size_t *count) {
+    memory_block_t *block = mem->memory ;
+    check_bin_fits(block, bytes) ;
+    bytes = bytes / 4 * 4 ;
+    for (size_t off = 0; off < bytes; off += MEMORY_PAGE_BYTES) {
+        size_t n = bytes - off < MEMORY_PAGE_BYTES ? bytes - off : MEMORY_PAGE_BYTES ;
+        memcpy(block_page_for_write(block, block->start + off), image + off, n) ;
+    }
+    icache_invalidate(mem->icache, block->start, bytes) ;
+    *count += bytes / 4 ;
+    return LOAD_SUCCESS ;
+}
+
+/**
+ * @brief Map the `bytes` bytes of the binary file `fd` as the first pages of the cpu main memory,
+ * privately, so stores to them copy the page rather than write to the file.
+ * 
+ * @return int load status; LOAD_FAIL, having changed nothing, if the file can't be mapped.
+ */
+static
+int map_bin(cpu_mem_t *mem, int fd, size_t bytes, size_t *count) {
+    memory_block_t *block = mem->memory ;
+    check_bin_fits(block, bytes) ;
+    // Only the pages of whole words: bytes past the last may be past the end of memory
+    size_t words = bytes / 4 ;
+    size_t n_pages = (words * 4 + MEMORY_PAGE_BYTES - 1) / MEMORY_PAGE_BYTES ;
+    size_t len = n_pages * MEMORY_PAGE_BYTES ;
+
+    uint8_t *image ;
+    if (block->memory) {
+        // Contiguous memory is replaced, in place, by the file's pages
+        image = mmap(block->memory, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) ;
+        if (image == MAP_FAILED) return LOAD_FAIL ;
+    } else {
+        for (size_t p = 0; p < n_pages; p++) if (block->pages[p]) return LOAD_FAIL ;
+        image = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) ;
+        if (image == MAP_FAILED) return LOAD_FAIL ;
+        for (size_t p = 0; p < n_pages; p++) block->pages[p] = image + p * MEMORY_PAGE_BYTES ;
+        block->n_touched += n_pages ;
+        block->image = image ;
+        block->image_pages = n_pages ;
+    }
+    block_mark_dirty(block, block->start, len) ;
+    // What follows the last whole word isn't part of the binary; it is mapped unless a page starts there
+    if (words * 4 != bytes && words * 4 < len) memset(image + words * 4, 0, bytes - words * 4) ;
+    *count += words ;
+    return LOAD_SUCCESS ;
+}
+
 /**
  * @brief Load a binary file into the the cpu main memory.
  * 
+ * A regular file is mapped rather than read, so loading it costs the same
+ * whatever its size, and its pages are only read in as they are used.
+ * Anything else is read whole, then loaded by `load_image`.
+ * 
  * @param mem The cpu memory to load the binary into.
  * @param in The file to load the binary from.
  * @param count To report the number of words loaded.
  * @return int load status
  */
 int load_bin(cpu_mem_t *mem, FILE *in, size_t *count) {
-    size_t read;
-    uint32_t w;
-    int i = 0;
-    while (!feof(in)) {
-        read = fread(&w, sizeof(uint32_t), 1, in) ;
-        if (read != 1) return LOAD_SUCCESS ;
-
-        store_le_word(mem, i, w);
-        i += 4;
-        (*count)++;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Words are stored little endian, so memory holds the file's bytes as they are
+    struct stat st ;
+    if (fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && ftell(in) == 0
+    &&  map_bin(mem, fileno(in), st.st_size, count) == LOAD_SUCCESS) return LOAD_SUCCESS ;
+#endif
+
+    size_t cap = MEMORY_PAGE_BYTES, bytes = 0 ;
+    uint8_t *image = malloc(cap) ;
+    if (!image) return LOAD_FAIL ;
+    size_t read ;
+    while ((read = fread(image + bytes, 1, cap - bytes, in)) > 0) {
+        bytes += read ;
+        if (bytes < cap) continue ;
+        uint8_t *grown = realloc(image, cap *= 2) ;
+        if (!grown) {
+            free(image) ;
+            return LOAD_FAIL ;
+        }
+        image = grown ;
     }
-
-    return LOAD_SUCCESS ;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; i + 4 <= bytes; i += 4) {
+        uint32_t w ;
+        memcpy(&w, image + i, 4) ;
+        w = __builtin_bswap32(w) ;
+        memcpy(image + i, &w, 4) ;
+    }
+#endif
+    int res = ferror(in) ? LOAD_FAIL : load_image(mem, image, bytes, count) ;
+    free(image) ;
+    return res ;
 }
 
 /**
@@ -159,10 +318,10 @@ int load_bin(cpu_mem_t *mem, FILE *in, size_t *count) {
  * @return uint32_t The big endian word at the given index
  */
 uint32_t get_be_word_from_block(memory_block_t *mem, uint64_t i) {
-    uint32_t w = (MEM(mem, i) << 24)
-        | (MEM(mem, i+1) << 16)
-        | (MEM(mem, i+2) << 8)
-        | MEM(mem, i+3) ;
+    uint32_t w = (mem_get(mem, i) << 24)
+        | (mem_get(mem, i+1) << 16)
+        | (mem_get(mem, i+2) << 8)
+        | mem_get(mem, i+3) ;
     return w ;
 }
 
@@ -223,10 +382,10 @@ bool set_le_word_mem(cpu_t *cpu, uint64_t i, uint32_t w) {
  */
 uint32_t get_le_word_from_block(memory_block_t *mem, uint64_t i) {
     if (!in_mem(mem, i)) log_exit_failure("Out of bounds memory read at 0x%lx", i) ;
-    uint32_t w = (MEM(mem, i+3) << 24)
-        | (MEM(mem, i+2) << 16)
-        | (MEM(mem, i+1) << 8)
-        | MEM(mem, i) ;
+    uint32_t w = (mem_get(mem, i+3) << 24)
+        | (mem_get(mem, i+2) << 16)
+        | (mem_get(mem, i+1) << 8)
+        | mem_get(mem, i) ;
     return w ;
 }
 
@@ -255,27 +414,62 @@ uint64_t get_le_dword(cpu_mem_t *mem, uint64_t i) {
     return (u << 32) | l ; 
 }
 
+_Static_assert(TLB_PAGE_BYTES == MEMORY_PAGE_BYTES, "the TLB maps the pages of memory blocks") ;
+
+/// @brief What the pages never written to read as, mapped by the TLB for loads only.
+static uint8_t zero_page[TLB_PAGE_BYTES] __attribute__((aligned(TLB_PAGE_BYTES))) ;
+
 /**
- * @brief Get the little endian double word from the memory in cpu `cpu` at absolute index `i`.
+ * @brief Map the page holding `i` in the TLB of `mem`, if it lies wholly in the main memory block.
+ * A page never written to is mapped to `zero_page`, for loads only. The IO page is never mapped,
+ * so that its accesses always come here.
+ */
+static
+void tlb_map(cpu_mem_t *mem, address_t i) {
+    memory_block_t *block = mem->memory ;
+    address_t page = i & ~(address_t) (TLB_PAGE_BYTES - 1) ;
+    if (block->size < TLB_PAGE_BYTES
+    ||  page < block->start || page - block->start > block->size - TLB_PAGE_BYTES) return ;
+    uint8_t *bytes = block_page(block, page) ;
+    if (!bytes) {
+        tlb_fill(&mem->tlb, page, zero_page, false) ;
+        return ;
+    }
+    tlb_fill(&mem->tlb, page, bytes, true) ;
+    // Stores through the TLB don't mark the page themselves
+    size_t p = (page - block->start) / MEMORY_PAGE_BYTES ;
+    block->stale[p / 64] |= (uint64_t) 1 << (p % 64) ;
+}
+
+/**
+ * @brief Get the little endian double word from the memory in cpu `cpu` at absolute index `i`,
+ * when the TLB doesn't map it: the slow path of `get_dword`.
  * 
  * @param cpu The cpu to get the double word from.
  * @param i The absolute index to get the double word from.
  * @return uint64_t The little endian double word at the given index.
  */
-uint64_t get_dword(cpu_t *cpu, address_t i) {
-    return get_le_dword(cpu->memory, i) ;
+uint64_t __get_dword(cpu_t *cpu, address_t i) {
+    cpu->memory->tlb.misses++ ;
+    uint64_t w = get_le_dword(cpu->memory, i) ;
+    tlb_map(cpu->memory, i) ;
+    return w ;
 }
 
 /**
- * @brief Set 8 bytes of memory of `cpu` from absolute index `i` (to `i+8`) to the little endian double word `w`.
+ * @brief Set 8 bytes of memory of `cpu` from absolute index `i` (to `i+8`) to the little endian double word `w`,
+ * when the TLB doesn't map them: the slow path of `set_dword`.
  * 
  * @param cpu The cpu to set the memory of.
  * @param i The absolute index to set the memory at.
  * @param w The little endian double word to set the memory to.
  * @return true if the memory was set successfully.
  */
-bool set_dword(cpu_t *cpu, address_t i, uint64_t w) {
-    return store_le_dword(cpu->memory, i, w) ;
+bool __set_dword(cpu_t *cpu, address_t i, uint64_t w) {
+    cpu->memory->tlb.misses++ ;
+    bool res = store_le_dword(cpu->memory, i, w) ;
+    tlb_map(cpu->memory, i) ;
+    return res ;
 }
 
 /**
@@ -320,10 +514,11 @@ int store_bin(cpu_mem_t *mem, size_t word_count, FILE *out) {
 }
 
 /**
- * @brief Initialize a memory block of size `size` with starting address `start`.
+ * @brief Initialize a memory block of size `size` with starting address `start`,
+ * its pages allocated as they are written to.
  * 
  * @param size The size of the memory block.
- * @param start The starting address of the memory block.
+ * @param start The starting address of the memory block, a multiple of `MEMORY_PAGE_BYTES`.
  * @return memory_block_t* The initialized memory block.
  */
 memory_block_t *__init_memory_block(size_t size, address_t start) {
@@ -332,54 +527,124 @@ memory_block_t *__init_memory_block(size_t size, address_t start) {
 
     block->size = size ;
     block->start = start ;
-    block->memory = calloc(size, sizeof(memory_t));
+    block->memory = NULL ;
+    block->n_pages = (size + MEMORY_PAGE_BYTES - 1) / MEMORY_PAGE_BYTES ;
+    block->n_touched = 0 ;
+    block->image = NULL ;
+    block->image_pages = 0 ;
+    block->pages = calloc(block->n_pages, sizeof(uint8_t *));
+    block->dirty = calloc((block->n_pages + 63) / 64, sizeof(uint64_t)) ;
+    block->stale = calloc((block->n_pages + 63) / 64, sizeof(uint64_t)) ;
+    block->page_hashes = NULL ;
+    block->hash_sum[0] = block->hash_sum[1] = 0 ;
+    if (!block->pages || !block->dirty || !block->stale) {
+        free(block->pages) ;
+        free(block->dirty) ;
+        free(block->stale) ;
+        free(block) ;
+        return NULL ;
+    }
 
     return block ;
 }
 
 /**
- * @brief Initialize a cpu memory of size `size`, and its IO page.
+ * @brief Initialize a memory block of size `size` with starting address `start`,
+ * committed in the region `base` of `MEMORY_MMU` at that address.
  * 
- * @param size The size of the cpu main memory.
+ * @param base The region to commit the block in.
+ * @param size The size of the memory block.
+ * @param start The starting address of the memory block.
+ * @return memory_block_t* The initialized memory block.
+ */
+memory_block_t *__map_memory_block(uint8_t *base, size_t size, address_t start) {
+    size_t n_pages = (size + MEMORY_PAGE_BYTES - 1) / MEMORY_PAGE_BYTES ;
+    if (!mmu_commit(base, start, n_pages * MEMORY_PAGE_BYTES)) return NULL ;
+    memory_block_t *block = malloc(sizeof(memory_block_t));
+    if (!block) return NULL;
+
+    block->size = size ;
+    block->start = start ;
+    block->memory = base + start ;
+    block->pages = NULL ;
+    block->n_pages = n_pages ;
+    block->n_touched = 0 ;
+    block->image = NULL ;
+    block->image_pages = 0 ;
+    block->dirty = calloc((n_pages + 63) / 64, sizeof(uint64_t)) ;
+    block->stale = calloc((n_pages + 63) / 64, sizeof(uint64_t)) ;
+    block->page_hashes = NULL ;
+    block->hash_sum[0] = block->hash_sum[1] = 0 ;
+    if (!block->dirty || !block->stale) {
+        free(block->dirty) ;
+        free(block->stale) ;
+        free(block) ;
+        return NULL ;
+    }
+
+    return block ;
+}
+
+/**
+ * @brief Initialize a cpu memory, and its IO page, as `config` says.
+ * 
+ * @param config The size of the cpu main memory, and where to allocate it and the IO page.
  * @return cpu_mem_t* The initialized cpu memory.
  */
-cpu_mem_t *__init_cpu_mem(size_t size) {
+cpu_mem_t *__init_cpu_mem(const memory_config_t *config) {
+    size_t size = config->size ;
     cpu_mem_t *mem = malloc(sizeof(cpu_mem_t));
     if (!mem) return NULL;
 
-    mem->IO = __init_memory_block(_4_KB, MAILBOX_PAGE);
-    mem->memory = __init_memory_block(size, 0);
+    mem->mmu_base = NULL ;
+    mem->mmu_span = 0 ;
+    if (config->backend == MEMORY_MMU) {
+        mem->mmu_base = mmu_reserve() ;
+        if (!mem->mmu_base) {
+            free(mem) ;
+            return NULL ;
+        }
+        mem->mmu_span = MMU_SPAN ;
+        mem->IO = __map_memory_block(mem->mmu_base, _4_KB, MAILBOX_PAGE);
+        mem->memory = __map_memory_block(mem->mmu_base, size, 0);
+        if (mem->memory && config->huge_pages) mmu_huge_pages(mem->mmu_base, 0, size) ;
+    } else {
+        mem->IO = __init_memory_block(_4_KB, MAILBOX_PAGE);
+        mem->memory = __init_memory_block(size, 0);
+    }
+    mem->icache = init_icache(0, size);
+    tlb_flush(&mem->tlb) ;
 
     return mem ;
 }
 
 /**
- * @brief Initialize a cpu with main memory of size `memory_size`.
+ * @brief Initialize a cpu with its memory as `config` says.
  * 
- * @param memory_size The size of the cpu main memory.
+ * @param config The size of the cpu main memory, and where to allocate it and the IO page.
  * @return cpu_t* The initialized cpu.
  */
-cpu_t *__init_cpu(size_t memory_size) {
-    cpu_t *cpu = malloc(sizeof(cpu_t));
+cpu_t *__init_cpu(const memory_config_t *config) {
+    size_t bytes = (sizeof(cpu_t) + CPU_ALIGN - 1) / CPU_ALIGN * CPU_ALIGN ;
+    cpu_t *cpu = aligned_alloc(CPU_ALIGN, bytes);
     if (cpu == NULL) return NULL;
 
-    // cpu->g_regs = calloc(REG_COUNT, sizeof(reg_t));
-
-    cpu->pstate = calloc(1, sizeof(pstate_t));
-    cpu->pstate->Z = true ;
+    memset(cpu->regs, 0, sizeof(cpu->regs)) ;
+    cpu->pstate.op = FLAGS_NZCV ;
+    cpu->pstate.nzcv = NZCV_Z ;
 
     cpu->pc = 0;
-    cpu->sp = 0;
     cpu->fail = false ;
     cpu->halt = false ;
+    cpu->n_instrs = 0 ;
     cpu->get_word_at = *get_le_word_mem ;
     cpu->set_word_at = *set_le_word_mem ;
 
-    cpu->memory = __init_cpu_mem(memory_size);
+    cpu->memory = __init_cpu_mem(config);
     if (cpu->memory == NULL) return NULL ;
 
-    if (cpu->g_regs == NULL || cpu->pstate == NULL 
-    ||  cpu->memory->memory == NULL || cpu->memory->IO == NULL) {
+    if (cpu->memory->memory == NULL 
+    ||  cpu->memory->IO == NULL || cpu->memory->icache == NULL) {
         free_cpu(cpu);
         return NULL;
     }
@@ -14,6 +14,8 @@
 void free_cpu(cpu_t *cpu) ;
 
 cpu_t *init_cpu(size_t memory_size) ;
+cpu_t *init_cpu_config(const memory_config_t *config) ;
+uint8_t *block_page(memory_block_t *block, address_t page) ;
 
 uint32_t get_le_word_from_block(memory_block_t *mem, uint64_t i) ;
 uint32_t get_le_word(cpu_mem_t *mem, uint64_t i) ;
@@ -24,10 +26,75 @@ uint64_t get_be_dword(cpu_mem_t *mem, uint64_t i) ;
 bool store_le_word(cpu_mem_t *mem, uint64_t i, uint32_t w) ;
 bool store_le_dword(cpu_mem_t *mem, uint64_t i, uint64_t w) ;
 
-uint64_t get_dword(cpu_t *, address_t) ;
-bool set_dword(cpu_t *cpu, address_t, uint64_t w) ;
+uint64_t __get_dword(cpu_t *, address_t) ;
+bool __set_dword(cpu_t *cpu, address_t, uint64_t w) ;
+
+/**
+ * @brief Marks the pages of `block` holding the `len` bytes at (absolute) index `i` as written to:
+ * dirty, and stale for `cpu_fingerprint`.
+ */
+static inline
+void block_mark_dirty(memory_block_t *block, address_t i, size_t len) {
+    size_t first = (i - block->start) / MEMORY_PAGE_BYTES ;
+    size_t last = (i + len - 1 - block->start) / MEMORY_PAGE_BYTES ;
+    if (last >= block->n_pages) last = block->n_pages - 1 ;
+    for (size_t p = first; p <= last; p++) {
+        block->dirty[p / 64] |= (uint64_t) 1 << (p % 64) ;
+        block->stale[p / 64] |= (uint64_t) 1 << (p % 64) ;
+    }
+}
+
+/// @brief Whether the page of `block` at (absolute) index `page` may have been written to.
+static inline
+bool block_page_dirty(const memory_block_t *block, address_t page) {
+    size_t p = (page - block->start) / MEMORY_PAGE_BYTES ;
+    return block->dirty[p / 64] >> (p % 64) & 1 ;
+}
+
+/**
+ * @brief The host address of the `len` bytes at `i`, to load or, when `store`, to store,
+ * or null when they must take the slow path.
+ * In the region of `MEMORY_MMU`, any address is taken as is, and faults if it is out of bounds.
+ */
+static inline
+uint8_t *mem_host(cpu_mem_t *mem, address_t i, size_t len, bool store) {
+    if (i < mem->mmu_span) return mem->mmu_base + i ;
+    return tlb_lookup(&mem->tlb, i, len, store) ;
+}
+
+/**
+ * @brief Get the little endian double word from the memory in cpu `cpu` at absolute index `i`,
+ * directly when `mem_host` finds it.
+ */
+static inline
+uint64_t get_dword(cpu_t *cpu, address_t i) {
+    const uint8_t *host = mem_host(cpu->memory, i, sizeof(uint64_t), false) ;
+    if (host) return tlb_load_dword(host) ;
+    return __get_dword(cpu, i) ;
+}
+
+/**
+ * @brief Set the 8 bytes of memory of `cpu` from absolute index `i` to the little endian
+ * double word `w`, directly when `mem_host` finds them.
+ * The pages the TLB maps for stores are already dirty, having been allocated by a write;
+ * those of `MEMORY_MMU` are marked here.
+ */
+static inline
+bool set_dword(cpu_t *cpu, address_t i, uint64_t w) {
+    cpu_mem_t *mem = cpu->memory ;
+    uint8_t *host = mem_host(mem, i, sizeof(uint64_t), true) ;
+    if (!host) return __set_dword(cpu, i, w) ;
+    tlb_store_dword(host, w) ;
+    if (i < mem->mmu_span) {
+        memory_block_t *block = i - mem->memory->start < mem->memory->size ? mem->memory : mem->IO ;
+        block_mark_dirty(block, i, sizeof(uint64_t)) ;
+    }
+    icache_invalidate(mem->icache, i, sizeof(uint64_t)) ;
+    return true ;
+}
 
 int load_bin(cpu_mem_t *mem, FILE *in, size_t *count) ;
+int load_image(cpu_mem_t *mem, const uint8_t *image, size_t bytes, size_t *count) ;
 int store_bin(cpu_mem_t *mem, size_t word_count, FILE *out) ;
 
 #endif
\ No newline at end of file
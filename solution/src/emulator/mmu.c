@@ -0,0 +1,105 @@
+#define _GNU_SOURCE
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#include "emulator/mmu.h"
+#include "utils/log.h"
+
+/// @brief The base of every region reserved, null in free slots, for the SIGSEGV handler.
+static uint8_t *volatile mmu_regions[MMU_MAX_REGIONS] ;
+static bool mmu_handler_installed = false ;
+
+/// @brief Whether the fault described by `ctx` was a write, where the host says.
+static
+bool fault_is_write(void *ctx) {
+#if defined(__x86_64__) && defined(__linux__)
+    // Bit 1 of the page fault error code is set on writes
+    return ((ucontext_t *) ctx)->uc_mcontext.gregs[REG_ERR] & 2 ;
+#else
+    return false ;
+#endif
+}
+
+/**
+ * @brief Fails the emulation on a fault in a reserved region, as a bounds
+ * check would have; any other fault gets the default action back and is
+ * raised again on return.
+ *
+ * Guest accesses fault synchronously, in the emulator's own loads and
+ * stores and never within stdio, so the handler can log and exit.
+ */
+static
+void mmu_fault(int sig, siginfo_t *info, void *ctx) {
+    uint8_t *addr = info->si_addr ;
+    for (size_t r = 0; r < MMU_MAX_REGIONS; r++) {
+        uint8_t *base = mmu_regions[r] ;
+        if (base && base <= addr && addr < base + MMU_SPAN + MMU_GUARD)
+            log_exit_failure("Out of bounds memory %s at 0x%lx",
+                             fault_is_write(ctx) ? "write" : "access", (address_t) (addr - base)) ;
+    }
+    signal(sig, SIG_DFL) ;
+}
+
+static
+bool install_handler(void) {
+    if (mmu_handler_installed) return true ;
+    struct sigaction sa ;
+    memset(&sa, 0, sizeof(sa)) ;
+    sa.sa_sigaction = mmu_fault ;
+    sa.sa_flags = SA_SIGINFO ;
+    sigemptyset(&sa.sa_mask) ;
+    if (sigaction(SIGSEGV, &sa, NULL) != 0) return false ;
+    mmu_handler_installed = true ;
+    return true ;
+}
+
+/**
+ * @brief Reserve an inaccessible region for the guest addresses below
+ * `MMU_SPAN`, and catch the faults in it.
+ * @return The base of the region, or null if it couldn't be reserved.
+ */
+uint8_t *mmu_reserve(void) {
+    size_t r = 0 ;
+    while (r < MMU_MAX_REGIONS && mmu_regions[r]) r++ ;
+    if (r == MMU_MAX_REGIONS || !install_handler()) return NULL ;
+
+    void *base = mmap(NULL, MMU_SPAN + MMU_GUARD, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0) ;
+    if (base == MAP_FAILED) return NULL ;
+    mmu_regions[r] = base ;
+    return base ;
+}
+
+/**
+ * @brief Make the `size` bytes of guest memory at `start` readable and
+ * writable; they read as zero until written.
+ * @return false if they aren't page aligned, or don't lie below `MMU_SPAN`.
+ */
+bool mmu_commit(uint8_t *base, address_t start, size_t size) {
+    if (start % MMU_PAGE_BYTES || size % MMU_PAGE_BYTES) return false ;
+    if (start > MMU_SPAN || size > MMU_SPAN - start) return false ;
+    return mprotect(base + start, size, PROT_READ | PROT_WRITE) == 0 ;
+}
+
+/**
+ * @brief Ask for the `size` bytes of guest memory at `start` to be backed by
+ * transparent huge pages, so that large memories take fewer TLB entries.
+ * @return false where the host has no such pages; the memory is then as it was.
+ */
+bool mmu_huge_pages(uint8_t *base, address_t start, size_t size) {
+#ifdef MADV_HUGEPAGE
+    return madvise(base + start, size, MADV_HUGEPAGE) == 0 ;
+#else
+    return false ;
+#endif
+}
+
+/// @brief Unmap the region at `base`, as reserved by `mmu_reserve`.
+void mmu_release(uint8_t *base) {
+    for (size_t r = 0; r < MMU_MAX_REGIONS; r++) {
+        if (mmu_regions[r] == base) mmu_regions[r] = NULL ;
+    }
+    munmap(base, MMU_SPAN + MMU_GUARD) ;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file mmu.h
+ * @brief Guest memory backed by the host MMU.
+ *
+ * The guest's addresses below `MMU_SPAN` are reserved as one inaccessible
+ * host region, of which only the pages of the memory blocks are committed,
+ * so the guest address `a` is the host address `base + a`. Loads and
+ * stores below `MMU_SPAN` then make no bounds checks of their own: one
+ * outside the blocks faults, and a SIGSEGV handler turns the fault into
+ * the out of bounds failure the checks would have given.
+ */
+
+#ifndef __MMU_H
+#define __MMU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "common/ast.h"
+
+/// @brief The guest addresses reserved, those of the main memory and the mailbox.
+#define MMU_SPAN ((address_t) 1 << 32)
+/// @brief Reserved past `MMU_SPAN`, so accesses that start below it but run over fault too.
+#define MMU_GUARD (64 * 1024)
+/// @brief The host page size, to which committed memory is aligned.
+#define MMU_PAGE_BYTES (4 * 1024)
+/// @brief The number of regions that can be reserved at once.
+#define MMU_MAX_REGIONS 8
+
+uint8_t *mmu_reserve(void) ;
+bool mmu_commit(uint8_t *base, address_t start, size_t size) ;
+bool mmu_huge_pages(uint8_t *base, address_t start, size_t size) ;
+void mmu_release(uint8_t *base) ;
+
+#endif
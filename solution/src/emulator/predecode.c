@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "emulator/predecode.h"
+#include "emulator/loader.h"
+#include "utils/log.h"
+#include "utils/clock.h"
+#include "utils/dispatch.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PREDECODE_HAVE_AVX2
+#endif
+
+predecode_stats_t predecode_stats = {0} ;
+
+/*
+ * The class of each op0, bits 28..25 of a word:
+ *  100x data processing (immediate)    x101 data processing (register)
+ *  101x branches and system            x1x0 loads and stores
+ * and the rest are reserved, unallocated, SVE or SIMD.
+ */
+#define D PREDECODE_DATA
+#define I PREDECODE_DP_IMM
+#define R PREDECODE_DP_REG
+#define B PREDECODE_BRANCH
+#define L PREDECODE_LS
+static const uint8_t op0_class[16] = {
+    D, D, D, D, L, R, L, D,
+    I, I, B, B, L, R, L, D,
+} ;
+#undef D
+#undef I
+#undef R
+#undef B
+#undef L
+
+static inline
+uint8_t classify_word(word32_t w) {
+    return w == HALT_CODE ? PREDECODE_HALT : op0_class[(w >> 25) & 0xf] ;
+}
+
+/// @brief The little endian word at `p`.
+static inline
+word32_t le_word(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (word32_t) p[3] << 24 ;
+}
+
+static
+void classify_scalar(const uint8_t *image, size_t n_words, uint8_t *classes) {
+    for (size_t k = 0; k < n_words; k++) classes[k] = classify_word(le_word(image + 4 * k)) ;
+}
+
+#ifdef PREDECODE_HAVE_AVX2
+/// @brief The classes of the 8 words of `w`, one per 32-bit lane.
+__attribute__((target("avx2")))
+static inline
+__m256i classify_8(__m256i w, __m256i lo, __m256i hi) {
+    __m256i op0 = _mm256_and_si256(_mm256_srli_epi32(w, 25), _mm256_set1_epi32(0xf)) ;
+    // permutevar looks up the low 3 bits of op0; bit 3 picks the half of the table
+    __m256i upper = _mm256_cmpgt_epi32(op0, _mm256_set1_epi32(7)) ;
+    __m256i cls = _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(lo, op0),
+                                     _mm256_permutevar8x32_epi32(hi, op0), upper) ;
+    __m256i halt = _mm256_cmpeq_epi32(w, _mm256_set1_epi32((int) HALT_CODE)) ;
+    return _mm256_blendv_epi8(cls, _mm256_set1_epi32(PREDECODE_HALT), halt) ;
+}
+
+/// @brief Classifies 32 words a step, x86 being little endian like the image.
+__attribute__((target("avx2")))
+static
+void classify_avx2(const uint8_t *image, size_t n_words, uint8_t *classes) {
+    const __m256i lo = _mm256_setr_epi32(op0_class[0], op0_class[1], op0_class[2], op0_class[3],
+                                         op0_class[4], op0_class[5], op0_class[6], op0_class[7]) ;
+    const __m256i hi = _mm256_setr_epi32(op0_class[8], op0_class[9], op0_class[10], op0_class[11],
+                                         op0_class[12], op0_class[13], op0_class[14], op0_class[15]) ;
+    // Packing interleaves the 128-bit lanes: this puts the words back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7) ;
+
+    size_t k = 0 ;
+    for (; k + 32 <= n_words; k += 32) {
+        const __m256i *src = (const __m256i *) (image + 4 * k) ;
+        __m256i c0 = classify_8(_mm256_loadu_si256(src + 0), lo, hi) ;
+        __m256i c1 = classify_8(_mm256_loadu_si256(src + 1), lo, hi) ;
+        __m256i c2 = classify_8(_mm256_loadu_si256(src + 2), lo, hi) ;
+        __m256i c3 = classify_8(_mm256_loadu_si256(src + 3), lo, hi) ;
+        __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(c0, c1), _mm256_packs_epi32(c2, c3)) ;
+        _mm256_storeu_si256((__m256i *) (classes + k), _mm256_permutevar8x32_epi32(bytes, order)) ;
+    }
+    classify_scalar(image + 4 * k, n_words - k, classes + k) ;
+}
+#endif
+
+typedef void (*classify_fn)(const uint8_t *image, size_t n_words, uint8_t *classes) ;
+
+#ifdef PREDECODE_HAVE_AVX2
+static dispatch_t classify = DISPATCH_INIT(classify_scalar, classify_avx2, cpu_has_avx2) ;
+#else
+static dispatch_t classify = DISPATCH_INIT(classify_scalar, NULL, NULL) ;
+#endif
+
+static inline
+classify_fn classify_impl(void) {
+    return (classify_fn) dispatch_get(&classify) ;
+}
+
+predecode_impl_e predecode_impl(void) {
+    return dispatch_impl(&classify) ;
+}
+
+bool predecode_use_impl(predecode_impl_e impl) {
+    return dispatch_use(&classify, impl) ;
+}
+
+/**
+ * @brief Writes the `predecode_class_e` of each of the `n_words` little
+ * endian words of `image` to `classes`.
+ */
+void predecode_classify(const uint8_t *image, size_t n_words, uint8_t *classes) {
+    classify_impl()(image, n_words, classes) ;
+}
+
+/**
+ * @brief Decodes every instruction among the first `n_words` words of
+ * main memory, where `load_bin` put the image, into the instruction cache.
+ */
+void predecode_image(cpu_t *cpu, size_t n_words) {
+    memory_block_t *block = cpu->memory->memory ;
+    if (n_words > block->size / 4) n_words = block->size / 4 ;
+    uint8_t *classes = malloc(n_words + 1) ;
+    if (!classes) log_exit_failure("Failed to allocate the predecode classes") ;
+
+    predecode_stats = (predecode_stats_t) {.words = n_words} ;
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    // A page at a time, as they needn't be contiguous; those never written to are all data
+    const size_t page_words = MEMORY_PAGE_BYTES / 4 ;
+    for (size_t k = 0; k < n_words; k += page_words) {
+        size_t n = n_words - k < page_words ? n_words - k : page_words ;
+        const uint8_t *page = block_page(block, block->start + 4 * k) ;
+        if (page) predecode_classify(page, n, classes + k) ;
+        else memset(classes + k, PREDECODE_DATA, n) ;
+    }
+    predecode_stats.classify_secs = seconds_since(&start) ;
+
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    for (size_t k = 0; k < n_words; k++) {
+        if (classes[k] == PREDECODE_DATA) continue ;
+        fetch_cached(cpu, block->start + 4 * k) ;
+        predecode_stats.decoded++ ;
+    }
+    predecode_stats.decode_secs = seconds_since(&start) ;
+    free(classes) ;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file predecode.h
+ * @brief Eager decoding of a whole loaded image, before it runs.
+ *
+ * Every word of the image is first classified by its op0 bits (28..25),
+ * eight at a time with AVX2 where the CPU has it, and the words of the
+ * classes the emulator runs are then decoded in one pass into the
+ * instruction cache (see icache.h). The engines then find every
+ * instruction already decoded, and words that can only be data, e.g. the
+ * `.int`s after the code, are never decoded at all.
+ */
+
+#ifndef __PREDECODE_H
+#define __PREDECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common/word.h"
+#include "emulator/emulator.h"
+
+/// @brief The class of a word, from its op0 bits.
+typedef enum predecode_class {
+    /// @brief Reserved, unallocated or SIMD: data, such as a directive.
+    PREDECODE_DATA,
+    PREDECODE_DP_IMM,
+    PREDECODE_DP_REG,
+    PREDECODE_BRANCH,
+    PREDECODE_LS,
+    /// @brief The halting `and x0, x0, x0`.
+    PREDECODE_HALT,
+}   predecode_class_e ;
+
+typedef enum predecode_impl {
+    PREDECODE_IMPL_SCALAR,
+    PREDECODE_IMPL_AVX2,
+}   predecode_impl_e ;
+
+/// @brief What the last `predecode_image` did.
+typedef struct predecode_stats {
+    size_t words ;
+    /// @brief Of `words`, those decoded into the instruction cache.
+    size_t decoded ;
+    double classify_secs ;
+    double decode_secs ;
+}   predecode_stats_t ;
+
+extern predecode_stats_t predecode_stats ;
+
+predecode_impl_e predecode_impl(void) ;
+bool predecode_use_impl(predecode_impl_e impl) ;
+
+void predecode_classify(const uint8_t *image, size_t n_words, uint8_t *classes) ;
+void predecode_image(cpu_t *cpu, size_t n_words) ;
+
+#endif
@@ -0,0 +1,421 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "emulator/state.h"
+#include "utils/log.h"
+#include "utils/dispatch.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define STATE_HAVE_AVX2
+#endif
+
+/// @brief Empty `s`, holding no words.
+void state_init(state_t *s) {
+    memset(s, 0, sizeof(*s)) ;
+}
+
+void state_free(state_t *s) {
+    free(s->addresses) ;
+    free(s->words) ;
+    state_init(s) ;
+}
+
+/// @brief Make room for `n` words in `s`.
+static
+void reserve_words(state_t *s, size_t n) {
+    if (n <= s->cap_words) return ;
+    size_t cap = s->cap_words ? s->cap_words : 256 ;
+    while (cap < n) cap *= 2 ;
+    address_t *addresses = realloc(s->addresses, cap * sizeof(address_t)) ;
+    if (addresses) s->addresses = addresses ;
+    word32_t *words = realloc(s->words, cap * sizeof(word32_t)) ;
+    if (words) s->words = words ;
+    if (!addresses || !words) log_exit_failure("Failed to allocate the state of %zu words", n) ;
+    s->cap_words = cap ;
+}
+
+/// @brief Add the non-zero word `w` at `address`, above those already added.
+void state_add_word(state_t *s, address_t address, word32_t w) {
+    if (s->n_words == s->cap_words) reserve_words(s, s->n_words + 1) ;
+    s->addresses[s->n_words] = address ;
+    s->words[s->n_words] = w ;
+    s->n_words++ ;
+}
+
+static inline
+uint8_t *put_le(uint8_t *p, uint64_t v, size_t bytes) {
+    for (size_t k = 0; k < bytes; k++) p[k] = v >> (8 * k) ;
+    return p + bytes ;
+}
+
+static inline
+uint64_t get_le(const uint8_t *p, size_t bytes) {
+    uint64_t v = 0 ;
+    for (size_t k = 0; k < bytes; k++) v |= (uint64_t) p[k] << (8 * k) ;
+    return v ;
+}
+
+/// @brief Add `s` to `b` as a binary record, see `state.h`.
+void state_write_bin(outbuf_t *b, const state_t *s) {
+    uint8_t *p = (uint8_t *) outbuf_reserve(b, STATE_HEADER_BYTES) ;
+    memcpy(p, STATE_MAGIC, 8) ;
+    p = put_le(p + 8, STATE_VERSION, 4) ;
+    p = put_le(p, s->nzcv, 4) ;
+    for (size_t r = 0; r < STATE_N_REGS; r++) p = put_le(p, s->regs[r], 8) ;
+    p = put_le(p, s->pc, 8) ;
+    p = put_le(p, s->n_words, 8) ;
+    outbuf_commit(b, (char *) p) ;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    outbuf_str(b, (const char *) s->addresses, s->n_words * sizeof(address_t)) ;
+    outbuf_str(b, (const char *) s->words, s->n_words * sizeof(word32_t)) ;
+#else
+    for (size_t k = 0; k < s->n_words; k++) {
+        p = (uint8_t *) outbuf_reserve(b, 8) ;
+        outbuf_commit(b, (char *) put_le(p, s->addresses[k], 8)) ;
+    }
+    for (size_t k = 0; k < s->n_words; k++) {
+        p = (uint8_t *) outbuf_reserve(b, 4) ;
+        outbuf_commit(b, (char *) put_le(p, s->words[k], 4)) ;
+    }
+#endif
+}
+
+/**
+ * @brief Read the binary record of `len` bytes at `data` into `s`, which
+ * is initialised first.
+ * @return false, leaving `s` empty, unless it is a whole record of this
+ * version, its words non-zero and at ascending addresses.
+ */
+bool state_read_bin(const uint8_t *data, size_t len, state_t *s) {
+    state_init(s) ;
+    if (len < STATE_HEADER_BYTES || memcmp(data, STATE_MAGIC, 8) != 0) return false ;
+    if (get_le(data + 8, 4) != STATE_VERSION) return false ;
+    const uint8_t *p = data + 16 ;
+    for (size_t r = 0; r < STATE_N_REGS; r++, p += 8) s->regs[r] = get_le(p, 8) ;
+    s->pc = get_le(p, 8) ;
+    s->nzcv = get_le(data + 12, 4) ;
+    uint64_t n = get_le(p + 8, 8) ;
+    if (n > (len - STATE_HEADER_BYTES) / 12 || len != STATE_HEADER_BYTES + 12 * n) return false ;
+
+    reserve_words(s, n) ;
+    const uint8_t *addresses = data + STATE_HEADER_BYTES ;
+    const uint8_t *words = addresses + 8 * n ;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(s->addresses, addresses, n * sizeof(address_t)) ;
+    memcpy(s->words, words, n * sizeof(word32_t)) ;
+#else
+    for (size_t k = 0; k < n; k++) {
+        s->addresses[k] = get_le(addresses + 8 * k, 8) ;
+        s->words[k] = get_le(words + 4 * k, 4) ;
+    }
+#endif
+    // As `cpu_state` takes them: non-zero words at ascending addresses
+    for (size_t k = 0; k < n; k++) {
+        if (!s->words[k] || (k && s->addresses[k] <= s->addresses[k - 1])) {
+            state_free(s) ;
+            return false ;
+        }
+    }
+    s->n_words = n ;
+    return true ;
+}
+
+/// @brief One more than the value of each hex digit, and zero for the other characters.
+static const uint8_t hex_values[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+} ;
+
+/// @brief The value of the hex digit `c`, or -1 if it isn't one; a table lookup, as the digits are random.
+static inline
+int hex_digit(char c) {
+    return hex_values[(uint8_t) c] - 1 ;
+}
+
+/// @brief Parse the 1 to 16 hex digits at `p` into `v`.
+/// @return The end of the digits, or NULL if there aren't any or too many.
+static
+const char *parse_hex(const char *p, uint64_t *v) {
+    const char *start = p ;
+    uint64_t x = 0 ;
+    for (int d; (d = hex_digit(*p)) >= 0; p++) x = x << 4 | d ;
+    if (p == start || p - start > 16) return NULL ;
+    *v = x ;
+    return p ;
+}
+
+/// @brief Parse the 8 hex digits at `p` into `v`.
+static inline
+bool parse_hex8(const char *p, uint64_t *v) {
+    uint64_t x = 0 ;
+    bool valid = true ;
+    for (size_t k = 0; k < 8; k++) {
+        int d = hex_digit(p[k]) ;
+        valid &= d >= 0 ;
+        x = x << 4 | (d & 0xf) ;
+    }
+    *v = x ;
+    return valid ;
+}
+
+/// @brief Add the word `w` of a text dump at `at` to `s`, if it isn't zero; the words must be at ascending addresses.
+static inline
+bool add_dump_word(state_t *s, address_t at, uint64_t w) {
+    if (w > UINT32_MAX || (s->n_words && at <= s->addresses[s->n_words - 1])) return false ;
+    if (w) state_add_word(s, at, w) ;
+    return true ;
+}
+
+/// @brief Parse the line `l` of a text dump after its "Registers:", without its spaces, into `s`.
+static
+bool parse_dump_line(const char *l, state_t *s) {
+    uint64_t v ;
+    if (l[0] == '\0' || strcmp(l, "Non-zeromemory:") == 0) return true ;
+    if (l[0] == 'X') {
+        if (l[1] < '0' || l[1] > '9' || l[2] < '0' || l[2] > '9' || l[3] != '=') return false ;
+        size_t r = (l[1] - '0') * 10 + (l[2] - '0') ;
+        if (r >= STATE_N_REGS || !(l = parse_hex(l + 4, &v)) || *l) return false ;
+        s->regs[r] = v ;
+        return true ;
+    }
+    if (strncmp(l, "PC=", 3) == 0) {
+        if (!(l = parse_hex(l + 3, &v)) || *l) return false ;
+        s->pc = v ;
+        return true ;
+    }
+    if (strncmp(l, "PSTATE:", 7) == 0) {
+        const char flags[] = "NZCV" ;
+        s->nzcv = 0 ;
+        for (size_t k = 0; k < 4; k++) {
+            if (l[7 + k] == flags[k]) s->nzcv |= STATE_N >> k ;
+            else if (l[7 + k] != '-') return false ;
+        }
+        return l[11] == '\0' ;
+    }
+    uint64_t w ;
+    if (strncmp(l, "0x", 2) != 0 || !(l = parse_hex(l + 2, &v)) || strncmp(l, ":0x", 3) != 0
+        || !(l = parse_hex(l + 3, &w)) || *l)
+        return false ;
+    return add_dump_word(s, v, w) ;
+}
+
+/**
+ * @brief Read the text dump of `len` bytes at `data`, as `f_dump_cpu` and
+ * `f_dump_mem` print it, into `s`, which is initialised first. Spaces are
+ * ignored, as are the lines before "Registers:"; the words must be at
+ * ascending addresses.
+ * @return false, leaving `s` empty, unless it is such a dump.
+ */
+bool state_read_text(const char *data, size_t len, state_t *s) {
+    state_init(s) ;
+    // About a word a line
+    reserve_words(s, len / 24) ;
+    bool started = false ;
+    const char *end = data + len ;
+    for (const char *p = data; p < end; ) {
+        // Most of a large dump is lines of memory as `f_dump_mem` prints them, taken as they are
+        uint64_t at, w ;
+        if (started && end - p >= 24 && p[23] == '\n' && memcmp(p, "0x", 2) == 0 && memcmp(p + 10, " : 0x", 5) == 0
+            && parse_hex8(p + 2, &at) && parse_hex8(p + 15, &w)) {
+            if (!add_dump_word(s, at, w)) {
+                state_free(s) ;
+                return false ;
+            }
+            p += 24 ;
+            continue ;
+        }
+        const char *eol = memchr(p, '\n', end - p) ;
+        if (!eol) eol = end ;
+        char line[64] ;
+        size_t n = 0 ;
+        bool fits = true ;
+        for (; p < eol; p++) {
+            if (*p == ' ' || *p == '\t' || *p == '\r') continue ;
+            if (n < sizeof(line) - 1) line[n++] = *p ;
+            else fits = false ;
+        }
+        line[n] = '\0' ;
+        p = eol < end ? eol + 1 : end ;
+        if (!started) {
+            started = fits && strcmp(line, "Registers:") == 0 ;
+        } else if (!fits || !parse_dump_line(line, s)) {
+            state_free(s) ;
+            return false ;
+        }
+    }
+    if (!started) state_free(s) ;
+    return started ;
+}
+
+/// @brief Read `s` from the `len` bytes at `data`: a binary record if it starts as one, else a text dump.
+bool state_read(const uint8_t *data, size_t len, state_t *s) {
+    if (len >= 8 && memcmp(data, STATE_MAGIC, 8) == 0) return state_read_bin(data, len, s) ;
+    return state_read_text((const char *) data, len, s) ;
+}
+
+/**
+ * @brief Read `s` from the file `fname`, see `state_read`.
+ * @return false, leaving `s` empty, if it can't be read or isn't a state.
+ */
+bool state_read_file(const char *fname, state_t *s) {
+    state_init(s) ;
+    FILE *f = fopen(fname, "rb") ;
+    uint8_t *data = NULL ;
+    long len = -1 ;
+    if (f && fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+        data = malloc(len ? len : 1) ;
+        if (data && fread(data, 1, len, f) != (size_t) len) len = -1 ;
+    }
+    if (f) fclose(f) ;
+    bool ok = data && len >= 0 && state_read(data, len, s) ;
+    free(data) ;
+    return ok ;
+}
+
+/// @brief Add `v` as a JSON string of at least `digits` hex digits.
+static inline
+char *json_hex(char *p, uint64_t v, size_t digits) {
+    p = FMT_LIT(p, "\"0x") ;
+    p = fmt_hex(p, v, digits) ;
+    return FMT_LIT(p, "\"") ;
+}
+
+/**
+ * @brief Add `s` to `b` as JSON: the numbers are strings of hex digits, as
+ * in the text dump, since JSON's numbers don't hold 64 bits.
+ *
+ *     {"registers": ["0x...", ...], "pc": "0x...", "pstate": "NZCV",
+ *      "memory": {"0x00000000": "0x...", ...}}
+ */
+void state_write_json(outbuf_t *b, const state_t *s) {
+    outbuf_str(b, "{\n  \"registers\": [", 18) ;
+    for (size_t r = 0; r < STATE_N_REGS; r++) {
+        char *p = outbuf_reserve(b, 32) ;
+        if (r) p = FMT_LIT(p, ", ") ;
+        outbuf_commit(b, json_hex(p, s->regs[r], 16)) ;
+    }
+    char *p = outbuf_reserve(b, 64) ;
+    p = FMT_LIT(p, "],\n  \"pc\": ") ;
+    p = json_hex(p, s->pc, 16) ;
+    p = FMT_LIT(p, ",\n  \"pstate\": \"") ;
+    *p++ = s->nzcv & STATE_N ? 'N' : '-' ;
+    *p++ = s->nzcv & STATE_Z ? 'Z' : '-' ;
+    *p++ = s->nzcv & STATE_C ? 'C' : '-' ;
+    *p++ = s->nzcv & STATE_V ? 'V' : '-' ;
+    p = FMT_LIT(p, "\",\n  \"memory\": {") ;
+    outbuf_commit(b, p) ;
+    for (size_t k = 0; k < s->n_words; k++) {
+        p = outbuf_reserve(b, 48) ;
+        if (k) p = FMT_LIT(p, ",") ;
+        p = FMT_LIT(p, "\n    ") ;
+        p = json_hex(p, s->addresses[k], 8) ;
+        p = FMT_LIT(p, ": ") ;
+        outbuf_commit(b, json_hex(p, s->words[k], 8)) ;
+    }
+    outbuf_str(b, s->n_words ? "\n  }\n}\n" : "}\n}\n", s->n_words ? 7 : 4) ;
+}
+
+/// @brief The number of leading entries, of `n`, at which `aa`, `aw` and `ba`, `bw` hold the same address and word.
+static
+size_t match_scalar(const address_t *aa, const word32_t *aw, const address_t *ba, const word32_t *bw, size_t n) {
+    size_t k = 0 ;
+    while (k < n && aa[k] == ba[k] && aw[k] == bw[k]) k++ ;
+    return k ;
+}
+
+#ifdef STATE_HAVE_AVX2
+/// @brief Eight entries a step: their addresses compared four at a time, their words eight.
+__attribute__((target("avx2")))
+static
+size_t match_avx2(const address_t *aa, const word32_t *aw, const address_t *ba, const word32_t *bw, size_t n) {
+    size_t k = 0 ;
+    for (; k + 8 <= n; k += 8) {
+        __m256i lo = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (aa + k)),
+                                        _mm256_loadu_si256((const __m256i *) (ba + k))) ;
+        __m256i hi = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (aa + k + 4)),
+                                        _mm256_loadu_si256((const __m256i *) (ba + k + 4))) ;
+        __m256i words = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *) (aw + k)),
+                                           _mm256_loadu_si256((const __m256i *) (bw + k))) ;
+        unsigned same = _mm256_movemask_ps(_mm256_castsi256_ps(words))
+                      & (_mm256_movemask_pd(_mm256_castsi256_pd(lo))
+                         | _mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4) ;
+        if (same != 0xff) return k + __builtin_ctz(~same) ;
+    }
+    return k + match_scalar(aa + k, aw + k, ba + k, bw + k, n - k) ;
+}
+#endif
+
+typedef size_t (*match_fn)(const address_t *aa, const word32_t *aw, const address_t *ba, const word32_t *bw, size_t n) ;
+
+#ifdef STATE_HAVE_AVX2
+static dispatch_t match = DISPATCH_INIT(match_scalar, match_avx2, cpu_has_avx2) ;
+#else
+static dispatch_t match = DISPATCH_INIT(match_scalar, NULL, NULL) ;
+#endif
+
+static inline
+match_fn match_impl(void) {
+    return (match_fn) dispatch_get(&match) ;
+}
+
+state_impl_e state_impl(void) {
+    return dispatch_impl(&match) ;
+}
+
+bool state_use_impl(state_impl_e impl) {
+    return dispatch_use(&match, impl) ;
+}
+
+/**
+ * @brief Calls `f` with each address at which `a` and `b` hold different
+ * words, a word missing from one being zero, in order. The runs of
+ * entries with the same address and word in both are skipped a vector at
+ * a time, so the time goes to the differences.
+ */
+void state_diff_words(const state_t *a, const state_t *b, state_diff_fn f, void *ctx) {
+    match_fn same = match_impl() ;
+    size_t i = 0, j = 0 ;
+    for (;;) {
+        size_t n = a->n_words - i < b->n_words - j ? a->n_words - i : b->n_words - j ;
+        size_t k = same(a->addresses + i, a->words + i, b->addresses + j, b->words + j, n) ;
+        i += k ;
+        j += k ;
+        if (i == a->n_words && j == b->n_words) return ;
+        if (j == b->n_words || (i < a->n_words && a->addresses[i] < b->addresses[j])) {
+            f(ctx, a->addresses[i], a->words[i], 0) ;
+            i++ ;
+        } else if (i == a->n_words || b->addresses[j] < a->addresses[i]) {
+            f(ctx, b->addresses[j], 0, b->words[j]) ;
+            j++ ;
+        } else {
+            f(ctx, a->addresses[i], a->words[i], b->words[j]) ;
+            i++ ;
+            j++ ;
+        }
+    }
+}
+
+/// @brief Note in the `state_cmp_t` `ctx` that the words at `at` differ.
+static
+void cmp_word(void *ctx, address_t at, word32_t a, word32_t b) {
+    state_cmp_t *cmp = ctx ;
+    if (cmp->n_words++ == 0) cmp->first_address = at ;
+}
+
+/**
+ * @brief Compare the states `a` and `b`, finding where they differ, see
+ * `state_diff_words`.
+ * @return true exactly when they are equal.
+ */
+bool state_compare(const state_t *a, const state_t *b, state_cmp_t *cmp) {
+    *cmp = (state_cmp_t) {0} ;
+    for (size_t r = 0; r < STATE_N_REGS; r++)
+        if (a->regs[r] != b->regs[r]) cmp->regs |= (uint32_t) 1 << r ;
+    cmp->pc = a->pc != b->pc ;
+    cmp->nzcv = a->nzcv != b->nzcv ;
+    state_diff_words(a, b, cmp_word, cmp) ;
+    return !cmp->regs && !cmp->pc && !cmp->nzcv && cmp->n_words == 0 ;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file state.h
+ * @brief The architectural state at the end of a run, as a record to write and compare.
+ *
+ * The text dump of `f_dump_cpu` and `f_dump_mem` is for people; a
+ * `state_t` holds the same registers, PC, flags and non-zero words, and is
+ * written either as a fixed layout binary record or as JSON, for programs
+ * that check results. The binary record, all little endian, is
+ *
+ *     magic "A64STATE", u32 version, u32 nzcv,
+ *     u64 registers[31], u64 pc, u64 n_words,
+ *     u64 addresses[n_words], u32 words[n_words]
+ *
+ * with the addresses ascending and every word non-zero, so two records of
+ * equal states are equal byte for byte. A state is read back from either
+ * a binary record or a text dump.
+ *
+ * Two states are compared by walking their words together, skipping the
+ * runs of entries the same in both eight at a time, with AVX2 where the
+ * CPU has it.
+ */
+
+#ifndef __STATE_H
+#define __STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common/ast.h"
+#include "common/word.h"
+#include "utils/outbuf.h"
+
+#define STATE_MAGIC "A64STATE"
+#define STATE_VERSION 1
+#define STATE_N_REGS 31
+/// @brief The bytes of a binary record before its words.
+#define STATE_HEADER_BYTES (8 + 4 + 4 + 8 * STATE_N_REGS + 8 + 8)
+
+/// @brief The flags in `nzcv`, as in the PSTATE line of the text dump.
+#define STATE_N 8
+#define STATE_Z 4
+#define STATE_C 2
+#define STATE_V 1
+
+typedef struct state {
+    uint64_t regs[STATE_N_REGS] ;
+    uint64_t pc ;
+    uint32_t nzcv ;
+    /// @brief The non-zero words of memory, at ascending `addresses`.
+    size_t n_words ;
+    size_t cap_words ;
+    address_t *addresses ;
+    word32_t *words ;
+}   state_t ;
+
+typedef enum state_format {
+    STATE_FORMAT_TEXT,
+    STATE_FORMAT_BIN,
+    STATE_FORMAT_JSON,
+}   state_format_e ;
+
+/// @brief Where two states first differ, as `state_compare` finds it.
+typedef struct state_cmp {
+    /// @brief The registers that differ, bit `n` for Xn.
+    uint32_t regs ;
+    bool pc ;
+    bool nzcv ;
+    /// @brief The addresses whose words differ, a word missing from one state being zero.
+    size_t n_words ;
+    /// @brief The first of them, when there are any.
+    address_t first_address ;
+}   state_cmp_t ;
+
+typedef enum state_impl {
+    STATE_IMPL_SCALAR,
+    STATE_IMPL_AVX2,
+}   state_impl_e ;
+
+state_impl_e state_impl(void) ;
+bool state_use_impl(state_impl_e impl) ;
+
+/// @brief Called with each address `at` at which `state_diff_words` finds the words `a` and `b` differ.
+typedef void (*state_diff_fn)(void *ctx, address_t at, word32_t a, word32_t b) ;
+
+void state_init(state_t *s) ;
+void state_free(state_t *s) ;
+void state_add_word(state_t *s, address_t address, word32_t w) ;
+
+void state_write_bin(outbuf_t *b, const state_t *s) ;
+void state_write_json(outbuf_t *b, const state_t *s) ;
+bool state_read_bin(const uint8_t *data, size_t len, state_t *s) ;
+bool state_read_text(const char *data, size_t len, state_t *s) ;
+bool state_read(const uint8_t *data, size_t len, state_t *s) ;
+bool state_read_file(const char *fname, state_t *s) ;
+
+void state_diff_words(const state_t *a, const state_t *b, state_diff_fn f, void *ctx) ;
+bool state_compare(const state_t *a, const state_t *b, state_cmp_t *cmp) ;
+
+#endif
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+
+#include "emulator/threaded.h"
+#include "emulator/uop_exec.h"
+#include "utils/log.h"
+
+/*
+ * Handlers are labels inside `emulate_threaded`, and each uop holds the
+ * address of its handler, so dispatch is a single `goto *`. Compilers
+ * without labels as values fall back to a switch on the uop kind.
+ */
+#ifdef __GNUC__
+#define THREADED_COMPUTED_GOTO 1
+#endif
+
+/// @brief The uops of one icache page, and a final uop that always
+/// dispatches, for when execution runs off the end of the page.
+typedef struct uop_page {
+    uop_t ops[ICACHE_PAGE_WORDS + 1] ;
+}   uop_page_t ;
+
+typedef struct threaded {
+    icache_t *icache ;
+    /// @brief Pages of uops, null until an instruction on the page runs.
+    uop_page_t **pages ;
+    /// @brief The handler of `UOP_DISPATCH`, which (re)translates its uop.
+    const void *dispatch ;
+}   threaded_t ;
+
+static inline
+void reset_op(threaded_t *t, uop_t *op) {
+    op->kind = UOP_DISPATCH ;
+    op->handler = t->dispatch ;
+}
+
+/// @brief Drop the uop of the overwritten instruction at `addr`, and those
+/// of the instructions before it that may have been fused with it.
+static
+void threaded_invalidate(void *aux, address_t addr) {
+    threaded_t *t = aux ;
+    uop_page_t *page = t->pages[icache_page_idx(t->icache, addr)] ;
+    if (!page) return ;
+    size_t w = icache_word_idx(t->icache, addr) ;
+    for (size_t i = 0; i < UOP_FUSE_MAX && i <= w; i++) reset_op(t, &page->ops[w - i]) ;
+}
+
+/**
+ * @brief Get the uop of the instruction at `pc`, allocating its page if
+ * needed. Returns null when `pc` can't be cached.
+ */
+static
+uop_t *threaded_op(threaded_t *t, address_t pc) {
+    if (!icache_covers(t->icache, pc)) return NULL ;
+    size_t p = icache_page_idx(t->icache, pc) ;
+    uop_page_t *page = t->pages[p] ;
+    if (!page) {
+        page = malloc(sizeof(uop_page_t)) ;
+        if (!page) log_exit_failure("Failed to allocate uop page") ;
+        for (size_t w = 0; w <= ICACHE_PAGE_WORDS; w++) reset_op(t, &page->ops[w]) ;
+        t->pages[p] = page ;
+    }
+    return &page->ops[icache_word_idx(t->icache, pc)] ;
+}
+
+/**
+ * @brief Translate the uop `op` of the instruction at `pc`, fusing it with
+ * the instructions after it on the same page, whose own uops are left to
+ * be translated (and fused) when they first run. Flags are never known to
+ * be dead here: that depends on code `threaded_invalidate` doesn't watch.
+ */
+static
+void threaded_translate(threaded_t *t, cpu_t *cpu, uop_t *op, address_t pc,
+                        const void *const *handlers) {
+    uop_t ops[UOP_FUSE_MAX] ;
+    size_t w = icache_word_idx(t->icache, pc) ;
+    size_t n = ICACHE_PAGE_WORDS - w < UOP_FUSE_MAX ? ICACHE_PAGE_WORDS - w : UOP_FUSE_MAX ;
+    for (size_t i = 0; i < n; i++) {
+        icache_entry_t *e = fetch_cached(cpu, pc + 4 * i) ;
+        ops[i].kind = uop_translate(&ops[i], e->flags, &e->instr) ;
+    }
+    // A compare and branch reads its target from the uop of the branch
+    if (uop_fuse(ops, n, false) == 2 && uop_info[ops[0].kind].family == UOP_FAM_CMPB)
+        op[1].imm = ops[1].imm ;
+    *op = ops[0] ;
+    op->handler = handlers[op->kind] ;
+}
+
+/*****************************************************************************/
+// Control flow between handlers, see `uop_exec.h`
+
+#ifdef THREADED_COMPUTED_GOTO
+#define JUMP goto *op->handler
+#else
+#define JUMP goto switch_dispatch
+#endif
+
+#define RETIRE_N(k) n += (k)
+#define SKIP(k) do { pc += 4 * (k) ; op += (k) ; JUMP ; } while (0)
+#define TAKEN(target) do { pc = (target) ; goto dispatch ; } while (0)
+#define NOT_TAKEN NEXT
+#define JUMP_TO(target) TAKEN(target)
+#define END_BLOCK goto dispatch
+#define AFTER_STORE
+
+/**
+ * @brief Runs the `cpu` until it either halts or fails, like `emulate_main`,
+ * by translating instructions to uops and threading through their handlers.
+ * Uops of overwritten instructions are retranslated when next run.
+ */
+void emulate_threaded(cpu_t *cpu) {
+#ifdef THREADED_COMPUTED_GOTO
+    static const void *const handlers[UOP_KIND_COUNT] = { UOP_KINDS(UOP_LABEL) } ;
+#else
+    static const void *const handlers[UOP_KIND_COUNT] = { NULL } ;
+#endif
+    threaded_t t = {
+        .icache = cpu->memory->icache,
+        .dispatch = handlers[UOP_DISPATCH],
+    } ;
+    t.pages = calloc(t.icache->n_pages, sizeof(uop_page_t *)) ;
+    if (!t.pages) log_exit_failure("Failed to allocate uop pages") ;
+    icache_listen(t.icache, threaded_invalidate, &t) ;
+
+    pstate_t *ps = &cpu->pstate ;
+    uint64_t *x = cpu->regs ;
+    address_t pc = cpu->pc ;
+    uop_t *op ;
+    // Instructions retired by uops, not yet added to the cpu's count
+    uint64_t n = 0 ;
+
+dispatch:
+    op = threaded_op(&t, pc) ;
+    if (op == NULL) goto step ;
+    if (op->kind == UOP_DISPATCH) threaded_translate(&t, cpu, op, pc, handlers) ;
+    JUMP ;
+
+#ifndef THREADED_COMPUTED_GOTO
+switch_dispatch:
+    switch (op->kind) {
+        UOP_KINDS(UOP_CASE)
+    }
+#endif
+
+    UOP_KINDS(UOP_HANDLER)
+
+step:
+    // Anything without a uop is run by the interpreter
+    cpu->pc = pc ;
+    cpu->n_instrs += n ;
+    n = 0 ;
+    if (!emulate_step(cpu)) goto done ;
+    pc = cpu->pc ;
+    goto dispatch ;
+
+halt:
+    cpu->pc = pc ;
+    cpu->n_instrs += n ;
+    cpu->halt = true ;
+
+done:
+    icache_unlisten(t.icache, &t) ;
+    for (size_t p = 0; p < t.icache->n_pages; p++) free(t.pages[p]) ;
+    free(t.pages) ;
+    if (cpu->fail) log_error("CPU fail\n") ;
+}
@@ -0,0 +1,18 @@
+/**
+ * @file threaded.h
+ * @brief A threaded-code execution engine.
+ *
+ * Instructions are translated to uops (see `uop.h`) the first time they
+ * run, and each uop jumps straight to the handler of the next one, so
+ * executing an instruction costs a single indirect jump instead of the
+ * nested switches of `emulate_instr`.
+ */
+
+#ifndef __THREADED_H
+#define __THREADED_H
+
+#include "emulator/emulator.h"
+
+void emulate_threaded(cpu_t *cpu) ;
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file tlb.h
+ * @brief A software TLB: host pointers to the guest's 4 KiB pages.
+ *
+ * Loads and stores look their page up in a direct-mapped table of
+ * `TLB_ENTRIES` entries, each the page number it holds and a host pointer
+ * to the page's first byte. A hit costs one tag compare and a native
+ * little-endian access. Misses, accesses crossing a page, the IO page and
+ * addresses outside memory take the slow path of `loader.c`, which fills
+ * the entry when the page lies wholly in the main memory block.
+ *
+ * A page never written to has no bytes of its own. Loads from it are
+ * mapped to a shared page of zeros, with the entry's `store_tag` left
+ * empty, so that the first store still misses and allocates the page.
+ */
+
+#ifndef __TLB_H
+#define __TLB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common/ast.h"
+
+#define TLB_PAGE_BITS 12
+#define TLB_PAGE_BYTES (1 << TLB_PAGE_BITS)
+/// @brief The number of entries, a power of two; enough to map 2 MiB.
+#define TLB_ENTRIES 512
+/// @brief The tag of an empty entry, which no page number has.
+#define TLB_NO_TAG (~(address_t) 0)
+
+typedef struct tlb_entry {
+    /// @brief The page number, `address >> TLB_PAGE_BITS`, of the page mapped.
+    address_t tag ;
+    /// @brief `tag` when stores may go through the entry too; `TLB_NO_TAG` when it maps the zero page.
+    address_t store_tag ;
+    /// @brief The host address of the page's first byte.
+    uint8_t *host ;
+}   tlb_entry_t ;
+
+typedef struct tlb {
+    tlb_entry_t entries[TLB_ENTRIES] ;
+    /// @brief The accesses that missed, and the entries filled.
+    uint64_t misses ;
+    uint64_t fills ;
+}   tlb_t ;
+
+/// @brief Empties every entry.
+static inline
+void tlb_flush(tlb_t *tlb) {
+    for (size_t e = 0; e < TLB_ENTRIES; e++)
+        tlb->entries[e] = (tlb_entry_t) {.tag = TLB_NO_TAG, .store_tag = TLB_NO_TAG} ;
+}
+
+/**
+ * @brief Maps the page holding `addr` to `page_host`, the host address of its first byte,
+ * for loads, and for stores too when `writable`.
+ */
+static inline
+void tlb_fill(tlb_t *tlb, address_t addr, uint8_t *page_host, bool writable) {
+    address_t page = addr >> TLB_PAGE_BITS ;
+    tlb->entries[page & (TLB_ENTRIES - 1)] = (tlb_entry_t) {
+        .tag = page, .store_tag = writable ? page : TLB_NO_TAG, .host = page_host} ;
+    tlb->fills++ ;
+}
+
+/// @brief Empties the entry of the page holding `addr` if it maps that page for loads only.
+static inline
+void tlb_drop_read_only(tlb_t *tlb, address_t addr) {
+    address_t page = addr >> TLB_PAGE_BITS ;
+    tlb_entry_t *e = &tlb->entries[page & (TLB_ENTRIES - 1)] ;
+    if (e->tag == page && e->store_tag != page) e->tag = TLB_NO_TAG ;
+}
+
+/**
+ * @brief The host address of the `len` bytes at `addr`, or null unless
+ * they all lie in a page mapped for loads, or for stores when `store`.
+ *
+ * The entry is that of the first byte's page, and its tag is compared with
+ * the last byte's page, which only matches when the access doesn't cross
+ * into the next one: that page has a different entry.
+ */
+static inline
+uint8_t *tlb_lookup(tlb_t *tlb, address_t addr, size_t len, bool store) {
+    const tlb_entry_t *e = &tlb->entries[(addr >> TLB_PAGE_BITS) & (TLB_ENTRIES - 1)] ;
+    address_t tag = store ? e->store_tag : e->tag ;
+    if (__builtin_expect(tag != (addr + len - 1) >> TLB_PAGE_BITS, 0)) return NULL ;
+    return e->host + (addr & (TLB_PAGE_BYTES - 1)) ;
+}
+
+/// @brief The little-endian double word at `host`, which need not be aligned.
+static inline
+uint64_t tlb_load_dword(const uint8_t *host) {
+    uint64_t w ;
+    memcpy(&w, host, sizeof(w)) ;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w) ;
+#endif
+    return w ;
+}
+
+/// @brief Stores `w` little-endian at `host`, which need not be aligned.
+static inline
+void tlb_store_dword(uint8_t *host, uint64_t w) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w) ;
+#endif
+    memcpy(host, &w, sizeof(w)) ;
+}
+
+#endif
@@ -0,0 +1,308 @@
+#include "emulator/uop.h"
+#include "emulator/icache.h"
+#include "emulator/alu.h"
+
+#define UOP_NAME(KIND, FAMILY, SF, A, B) [UOP_ ## KIND] = #KIND,
+
+static const char *uop_names[UOP_KIND_COUNT] = { UOP_KINDS(UOP_NAME) } ;
+
+#define UOP_LETTER(P, KIND) UOP_ ## KIND,
+
+static const uop_kind uop_letters[UOP_SUPER_LETTERS] = { UOP_SUPER_A(UOP_LETTER, ) } ;
+
+#define UOP_INFO(KIND, FAMILY, SF, A, B) [UOP_ ## KIND] = { UOP_FAM_ ## FAMILY, SF, A, B },
+
+const uop_info_t uop_info[UOP_KIND_COUNT] = { UOP_KINDS(UOP_INFO) } ;
+
+uop_fuse_stats_t uop_fuse_stats ;
+
+/// @brief The name of the uop kind `kind`, e.g. "ADDS_LSL_64"; "SUPER"
+/// for superinstructions, see `uop_super_parts`.
+const char *show_uop_kind(uop_kind kind) {
+    if (uop_is_super(kind)) return "SUPER" ;
+    return kind < UOP_KIND_COUNT ? uop_names[kind] : "?" ;
+}
+
+_Static_assert(UOP_ZR == CPU_ZR && UOP_SP == CPU_SP && UOP_SINK == CPU_SINK
+            && UOP_SLOTS == CPU_SLOTS,
+    "UOP_SLOTS: the uop register file must match the cpu's") ;
+_Static_assert(UOP_SUBS_IMM_64 == UOP_ADD_IMM_32 + (OP_SUBS - OP_ADD) * 2 + 1,
+    "UOP_KINDS: add immediate kinds out of order") ;
+_Static_assert(UOP_BICS_ROR_64 == UOP_ADD_LSL_32 + (OP_BICS - OP_ADD) * 8 + ROR * 2 + 1,
+    "UOP_KINDS: register operand kinds out of order") ;
+_Static_assert(UOP_MOVK_64 == UOP_MOVN_32 + (OP_MOVK - OP_MOVN) * 2 + 1,
+    "UOP_KINDS: move kinds out of order") ;
+_Static_assert(UOP_MSUB_64 == UOP_MADD_32 + (OP_MSUB - OP_MADD) * 2 + 1,
+    "UOP_KINDS: multiply kinds out of order") ;
+_Static_assert(UOP_TST_REG_NF_B_LE_64 == UOP_CMP_IMM_B_EQ_32 + 4 * 24 + 12 + 5 * 2 + 1
+            && UOP_B_LE == UOP_B_EQ + 5,
+    "UOP_KINDS: compare-and-branch kinds out of order") ;
+_Static_assert(UOP_SUPER_END == UOP_SUPER_FIRST + UOP_SUPER_LETTERS * UOP_SUPER_LETTERS
+                                * (1 + UOP_SUPER_LETTERS),
+    "UOP_SUPER_LETTERS: not the size of UOP_SUPER_A") ;
+_Static_assert(UOP_LDR_REG_SXTX_64 == UOP_LDR_LIT_32 + UOP_ADDR_REG_SXTX * 2 + 1
+            && UOP_STR_REG_SXTX_64 == UOP_STR_LIT_32 + UOP_ADDR_REG_SXTX * 2 + 1,
+    "UOP_KINDS: load/store kinds out of order") ;
+
+/**
+ * @brief Resolve the register `r` to its slot of the uop register file.
+ * The zero register reads from `UOP_ZR`, but is written to `UOP_SINK`.
+ *
+ * @return false if `r` has no slot, i.e. it is the PC or not a register.
+ */
+static
+bool reg_slot(reg_t r, bool is_dest, uint8_t *slot) {
+    if (R0 <= r.r && r.r <= R30) *slot = r.r ;
+    else if (r.r == RZR) *slot = is_dest ? UOP_SINK : UOP_ZR ;
+    else if (r.r == SP) *slot = UOP_SP ;
+    else return false ;
+    return true ;
+}
+
+static
+uop_kind translate_dp(uop_t *op, const instr_dp *i) {
+    bool sf = i->rd.extended ;
+    if (!reg_slot(i->rd, true, &op->rd)) return UOP_INTERP ;
+
+    switch (i->op_type) {
+    case MOV_CASES:
+        // movk keeps the bits of rd it doesn't move into
+        if (!reg_slot(i->rd, false, &op->rn)) return UOP_INTERP ;
+        op->amount = i->op2.imm_sh.sh.amount ;
+        op->imm = alu_shift(LSL, op->amount, i->op2.imm_sh.imm, true) ;
+        return UOP_MOVN_32 + (i->op_type - OP_MOVN) * 2 + sf ;
+    case MUL_CASES:
+        if (i->op2.type != OP2_MUL
+        || !reg_slot(i->rn, false, &op->rn)
+        || !reg_slot(i->op2.mul.rm, false, &op->rm)
+        || !reg_slot(i->op2.mul.ra, false, &op->ra)) return UOP_INTERP ;
+        return UOP_MADD_32 + (i->op_type - OP_MADD) * 2 + sf ;
+    case ADD_CASES:
+    case LOG_CASES:
+        if (i->rn.extended != sf || !reg_slot(i->rn, false, &op->rn)) return UOP_INTERP ;
+        break ;
+    default:
+        return UOP_INTERP ;
+    }
+
+    switch (i->op2.type) {
+    case OP2_IMM_SH:
+        if (i->op_type > OP_SUBS) return UOP_INTERP ;
+        op->imm = alu_shift(i->op2.imm_sh.sh.tp, i->op2.imm_sh.sh.amount, i->op2.imm_sh.imm, true) ;
+        return UOP_ADD_IMM_32 + (i->op_type - OP_ADD) * 2 + sf ;
+    case OP2_BITMASK:
+        switch (i->op_type) {
+        case OP_AND: case OP_ORR: case OP_EOR: case OP_ANDS:
+            op->imm = i->op2.bitmask.imm ;
+            return UOP_AND_IMM_32 + (i->op_type - OP_AND) + sf ;
+        default:
+            return UOP_INTERP ;
+        }
+    case OP2_REG_SH:
+        if (i->op2.reg_sh.rm.extended != sf
+        || !reg_slot(i->op2.reg_sh.rm, false, &op->rm)) return UOP_INTERP ;
+        op->amount = i->op2.reg_sh.sh.amount ;
+        return UOP_ADD_LSL_32 + (i->op_type - OP_ADD) * 8 + i->op2.reg_sh.sh.tp * 2 + sf ;
+    default:
+        return UOP_INTERP ;
+    }
+}
+
+static
+uop_kind translate_b(uop_t *op, const instr_b *i) {
+    switch (i->tp) {
+    case TP_B:
+        op->imm = i->address ;
+        return UOP_B ;
+    case TP_BR:
+        if (!reg_slot(i->rn, false, &op->rn)) return UOP_INTERP ;
+        return UOP_BR ;
+    case TP_BCond:
+        op->imm = i->address ;
+        switch (i->cond) {
+        case EQ: return UOP_B_EQ ;
+        case NE: return UOP_B_NE ;
+        case GE: return UOP_B_GE ;
+        case LT: return UOP_B_LT ;
+        case GT: return UOP_B_GT ;
+        case LE: return UOP_B_LE ;
+        case AL: return UOP_B ;
+        }
+    }
+    return UOP_INTERP ;
+}
+
+static
+uop_kind translate_ls(uop_t *op, const instr_ls *i) {
+    bool sf = i->rt.extended ;
+    if (!reg_slot(i->rt, i->op == OP_LDR, &op->rd)) return UOP_INTERP ;
+
+    uop_addr_t addr ;
+    switch (i->arg_tp) {
+    case LS_LIT:
+        addr = UOP_ADDR_LIT ;
+        op->imm = i->lit.lit ;
+        break ;
+    case LS_IMM:
+        if (!i->imm.rn.extended || !reg_slot(i->imm.rn, false, &op->rn)) return UOP_INTERP ;
+        op->imm = (int64_t) (signed) i->imm.imm ;
+        switch (i->imm.idx_tp) {
+        case IDX_POST: addr = UOP_ADDR_POST ; break ;
+        case IDX_PRE: addr = UOP_ADDR_PRE ; break ;
+        case IDX_U_OFFSET: addr = UOP_ADDR_UOFF ; break ;
+        default: return UOP_INTERP ;
+        }
+        // The written back base must be readable from the same slot
+        if (op->rn == UOP_ZR && addr != UOP_ADDR_UOFF) return UOP_INTERP ;
+        break ;
+    case LS_REG:
+        if (!i->reg.rn.extended || !i->reg.rm.extended
+        || !reg_slot(i->reg.rn, false, &op->rn)
+        || !reg_slot(i->reg.rm, false, &op->rm)) return UOP_INTERP ;
+        op->amount = i->reg.extend.amount ;
+        switch (i->reg.extend.tp) {
+        case E_LS_EXTEND_LSL: addr = UOP_ADDR_REG_LSL ; break ;
+        case E_LS_EXTEND_SXTX: addr = UOP_ADDR_REG_SXTX ; break ;
+        default: return UOP_INTERP ;
+        }
+        break ;
+    default:
+        return UOP_INTERP ;
+    }
+
+    switch (i->op) {
+    case OP_LDR: return UOP_LDR_LIT_32 + addr * 2 + sf ;
+    case OP_STR: return UOP_STR_LIT_32 + addr * 2 + sf ;
+    }
+    return UOP_INTERP ;
+}
+
+/**
+ * @brief Translate the instruction `i`, fetched with the `icache_flags_t`
+ * `flags`, into the operands of `op`.
+ *
+ * @return uop_kind The kind of `op`; `UOP_INTERP` when `i` has no
+ * specialised kind, and must be run by `emulate_instr`.
+ */
+uop_kind uop_translate(uop_t *op, uint8_t flags, const instr_t *i) {
+    if (!(flags & ICACHE_VALID) || (flags & ICACHE_FAIL)) return UOP_INTERP ;
+    if (flags & ICACHE_HALT) return UOP_HALT ;
+
+    switch (i->tp) {
+    case I_DP: return translate_dp(op, &i->dp) ;
+    case I_B: return translate_b(op, &i->b) ;
+    case I_LS: return translate_ls(op, &i->ls) ;
+    case I_NOP: return UOP_NOP ;
+    default: return UOP_INTERP ;
+    }
+}
+
+/**
+ * @brief The fused kind of the compare `cmp` (or the subs, adds or ands it
+ * aliases) and the uop after it, `b`, when that is a b.cond; `UOP_INTERP`
+ * if they don't fuse.
+ */
+static
+uop_kind cmpb_kind(const uop_t *cmp, const uop_t *b, bool flags_dead) {
+    if (uop_info[b->kind].family != UOP_FAM_BCOND) return UOP_INTERP ;
+
+    // In `UOP_KINDS` order: CMP_IMM, CMN_IMM, CMP_REG, CMN_REG, TST_REG
+    uop_info_t info = uop_info[cmp->kind] ;
+    int form ;
+    if (info.family == UOP_FAM_DP_IMM && info.a == OP_SUBS) form = 0 ;
+    else if (info.family == UOP_FAM_DP_IMM && info.a == OP_ADDS) form = 1 ;
+    else if (info.family == UOP_FAM_DP_REG && info.b == LSL && info.a == OP_SUBS) form = 2 ;
+    else if (info.family == UOP_FAM_DP_REG && info.b == LSL && info.a == OP_ADDS) form = 3 ;
+    else if (info.family == UOP_FAM_DP_REG && info.b == LSL && info.a == OP_ANDS) form = 4 ;
+    else return UOP_INTERP ;
+    return UOP_CMP_IMM_B_EQ_32 + form * 24 + flags_dead * 12 + (b->kind - UOP_B_EQ) * 2 + info.sf ;
+}
+
+/**
+ * @brief Fuse the uop `ops[0]` with the uops of the instructions after it,
+ * `ops[1]` to `ops[n - 1]`, if they form a pair (or chain) with a fused kind.
+ * Only `ops[0]` changes: the rest stay as they are, both for code branching
+ * into the middle of the pair, and for compare-and-branch uops, which read
+ * their target from the branch after them. The engine must set the
+ * handler of `ops[0]` again.
+ *
+ * @param flags_dead Whether the flags set by a compare and branch are
+ * overwritten on both of its paths before anything reads them.
+ * @return size_t The number of instructions `ops[0]` now covers, 1 if
+ * nothing was fused.
+ */
+size_t uop_fuse(uop_t *ops, size_t n, bool flags_dead) {
+    if (n < 2) return 1 ;
+
+    uop_kind k = cmpb_kind(&ops[0], &ops[1], flags_dead) ;
+    if (k != UOP_INTERP) {
+        ops[0].kind = k ;
+        uop_fuse_stats.cmp_branch++ ;
+        uop_fuse_stats.flags_dead += flags_dead ;
+        return 2 ;
+    }
+
+    uop_info_t info = uop_info[ops[0].kind] ;
+    if (info.family != UOP_FAM_MOV || info.a == OP_MOVK || ops[0].rd == UOP_SINK) return 1 ;
+    uint64_t mask = info.sf ? UINT64_MAX : 0xffffffff ;
+    uint64_t val = alu_mov(info.a, 0, ops[0].imm, ops[0].amount) & mask ;
+    uop_kind movk = info.sf ? UOP_MOVK_64 : UOP_MOVK_32 ;
+    size_t len = 1 ;
+    for (; len < n && len < UOP_FUSE_MAX; len++) {
+        if (ops[len].kind != movk || ops[len].rd != ops[0].rd) break ;
+        val = alu_mov(OP_MOVK, val, ops[len].imm, ops[len].amount) & mask ;
+    }
+    if (len == 1) return 1 ;
+
+    ops[0].kind = UOP_CONST ;
+    ops[0].imm = val ;
+    ops[0].amount = len - 1 ;
+    uop_fuse_stats.constants++ ;
+    uop_fuse_stats.const_instrs += len ;
+    return len ;
+}
+
+/// @brief The number of instructions the (possibly fused) uop `op` covers.
+size_t uop_len(const uop_t *op) {
+    if (op->kind == UOP_CONST) return op->amount + 1 ;
+    if (uop_is_super(op->kind)) return op->kind < UOP_SUPER_FIRST + UOP_SUPER_LETTERS * UOP_SUPER_LETTERS ? 2 : 3 ;
+    if (uop_info[op->kind].family == UOP_FAM_CMPB) return 2 ;
+    return 1 ;
+}
+
+/// @brief The index of `k` in `UOP_SUPER_A`, or -1 if it isn't there.
+int uop_super_letter(uop_kind k) {
+    for (int l = 0; l < UOP_SUPER_LETTERS; l++)
+        if (uop_letters[l] == k) return l ;
+    return -1 ;
+}
+
+/**
+ * @brief The superinstruction running uops of the `len` (2 or 3) kinds
+ * `kinds` in order, or `UOP_INTERP` if one isn't in `UOP_SUPER_A`.
+ */
+uop_kind uop_super_kind(const uint16_t *kinds, size_t len) {
+    size_t idx = 0 ;
+    for (size_t i = 0; i < len; i++) {
+        int l = uop_super_letter(kinds[i]) ;
+        if (l < 0) return UOP_INTERP ;
+        idx = idx * UOP_SUPER_LETTERS + l ;
+    }
+    if (len == 3) idx += UOP_SUPER_LETTERS * UOP_SUPER_LETTERS ;
+    return UOP_SUPER_FIRST + idx ;
+}
+
+/// @brief Write the kinds run by the superinstruction `k` to `kinds`,
+/// returning how many there are.
+size_t uop_super_parts(uop_kind k, uint16_t *kinds) {
+    size_t idx = k - UOP_SUPER_FIRST, len = 2 ;
+    if (idx >= UOP_SUPER_LETTERS * UOP_SUPER_LETTERS) {
+        idx -= UOP_SUPER_LETTERS * UOP_SUPER_LETTERS ;
+        len = 3 ;
+    }
+    for (size_t i = len; i > 0; i--) {
+        kinds[i - 1] = uop_letters[idx % UOP_SUPER_LETTERS] ;
+        idx /= UOP_SUPER_LETTERS ;
+    }
+    return len ;
+}
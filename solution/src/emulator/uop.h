@@ -0,0 +1,268 @@
+/**
+ * @file uop.h
+ * @brief Micro-operations: instructions with every case analysis that
+ * `emulate_instr` does on each execution resolved once, at translation.
+ *
+ * Each kind of uop is one specialisation of an instruction, e.g. a 32-bit
+ * `adds` with an `lsr`-shifted register operand, so its handler has no
+ * decisions left to make. Register operands are resolved to slots of a
+ * flat register file (see `UOP_SLOTS`), and immediates are pre-shifted
+ * or pre-extended.
+ */
+
+#ifndef __UOP_H
+#define __UOP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "common/ast.h"
+
+/// @brief Slots 0-30 hold R0-R30; the layout is that of `cpu_t.regs`.
+#define UOP_ZR   31
+#define UOP_SP   32
+/// @brief Writes to the zero register go here, and are never read back.
+#define UOP_SINK 33
+#define UOP_SLOTS 34
+
+/*
+ * Every uop kind, as X(KIND, FAMILY, SF, A, B): the handler of KIND is
+ * the FAMILY handler specialised on SF (64-bit), A and B.
+ * Order is important here: `uop_translate` computes kinds from offsets
+ * within a family, in the order of `dp_op`, `shift_tp` and 32 then 64-bit;
+ * the logical immediates are every other `dp_op`, as only the operations
+ * without a negation have an immediate form.
+ * `END` is not an instruction: it ends a block that doesn't end in a
+ * branch (see `block.h`). The kinds after `STR` are fused (see `uop_fuse`).
+ */
+#define UOP_SF(X, KIND, FAMILY, A, B) \
+    X(KIND ## _32, FAMILY, false, A, B) \
+    X(KIND ## _64, FAMILY, true, A, B)
+
+#define UOP_SHIFTS(X, KIND, FAMILY, A) \
+    UOP_SF(X, KIND ## _LSL, FAMILY, A, LSL) \
+    UOP_SF(X, KIND ## _LSR, FAMILY, A, LSR) \
+    UOP_SF(X, KIND ## _ASR, FAMILY, A, ASR) \
+    UOP_SF(X, KIND ## _ROR, FAMILY, A, ROR)
+
+/*
+ * Fused kinds: `CONST` is a movz or movn and the movks after it into the
+ * same register, as the constant they build. `<CMP>_B_<COND>` is a compare
+ * (a cmp, cmn or tst, or the subs, adds or ands they alias) and the b.cond
+ * after it, with B the compare's
+ * `UOP_CMPB_*` bits; the `_NF_` kinds don't write the flags, as they are
+ * overwritten before anything reads them.
+ */
+#define UOP_CMPB_CMN  1
+#define UOP_CMPB_TST  2
+#define UOP_CMPB_REG  4
+#define UOP_CMPB_DEAD 8
+
+#define UOP_CMPB_CONDS(X, KIND, B) \
+    UOP_SF(X, KIND ## _EQ, CMPB, EQ, B) \
+    UOP_SF(X, KIND ## _NE, CMPB, NE, B) \
+    UOP_SF(X, KIND ## _GE, CMPB, GE, B) \
+    UOP_SF(X, KIND ## _LT, CMPB, LT, B) \
+    UOP_SF(X, KIND ## _GT, CMPB, GT, B) \
+    UOP_SF(X, KIND ## _LE, CMPB, LE, B)
+
+#define UOP_CMPB_FLAGS(X, KIND, B) \
+    UOP_CMPB_CONDS(X, KIND ## _B, B) \
+    UOP_CMPB_CONDS(X, KIND ## _NF_B, (B) | UOP_CMPB_DEAD)
+
+#define UOP_KINDS(X)                                        \
+    X(DISPATCH, DISPATCH, true, 0, 0)                       \
+    X(INTERP, INTERP, true, 0, 0)                           \
+    X(HALT, HALT, true, 0, 0)                               \
+    X(NOP, NOP, true, 0, 0)                                 \
+    X(END, END, true, 0, 0)                                 \
+    UOP_SF(X, ADD_IMM, DP_IMM, OP_ADD, 0)                   \
+    UOP_SF(X, ADDS_IMM, DP_IMM, OP_ADDS, 0)                 \
+    UOP_SF(X, SUB_IMM, DP_IMM, OP_SUB, 0)                   \
+    UOP_SF(X, SUBS_IMM, DP_IMM, OP_SUBS, 0)                 \
+    UOP_SF(X, AND_IMM, DP_IMM, OP_AND, 0)                   \
+    UOP_SF(X, ORR_IMM, DP_IMM, OP_ORR, 0)                   \
+    UOP_SF(X, EOR_IMM, DP_IMM, OP_EOR, 0)                   \
+    UOP_SF(X, ANDS_IMM, DP_IMM, OP_ANDS, 0)                 \
+    UOP_SHIFTS(X, ADD, DP_REG, OP_ADD)                      \
+    UOP_SHIFTS(X, ADDS, DP_REG, OP_ADDS)                    \
+    UOP_SHIFTS(X, SUB, DP_REG, OP_SUB)                      \
+    UOP_SHIFTS(X, SUBS, DP_REG, OP_SUBS)                    \
+    UOP_SHIFTS(X, AND, DP_REG, OP_AND)                      \
+    UOP_SHIFTS(X, BIC, DP_REG, OP_BIC)                      \
+    UOP_SHIFTS(X, ORR, DP_REG, OP_ORR)                      \
+    UOP_SHIFTS(X, ORN, DP_REG, OP_ORN)                      \
+    UOP_SHIFTS(X, EOR, DP_REG, OP_EOR)                      \
+    UOP_SHIFTS(X, EON, DP_REG, OP_EON)                      \
+    UOP_SHIFTS(X, ANDS, DP_REG, OP_ANDS)                    \
+    UOP_SHIFTS(X, BICS, DP_REG, OP_BICS)                    \
+    UOP_SF(X, MOVN, MOV, OP_MOVN, 0)                        \
+    UOP_SF(X, MOVZ, MOV, OP_MOVZ, 0)                        \
+    UOP_SF(X, MOVK, MOV, OP_MOVK, 0)                        \
+    UOP_SF(X, MADD, MUL, OP_MADD, 0)                        \
+    UOP_SF(X, MSUB, MUL, OP_MSUB, 0)                        \
+    X(B, B, true, 0, 0)                                     \
+    X(BR, BR, true, 0, 0)                                   \
+    X(B_EQ, BCOND, true, EQ, 0)                             \
+    X(B_NE, BCOND, true, NE, 0)                             \
+    X(B_GE, BCOND, true, GE, 0)                             \
+    X(B_LT, BCOND, true, LT, 0)                             \
+    X(B_GT, BCOND, true, GT, 0)                             \
+    X(B_LE, BCOND, true, LE, 0)                             \
+    UOP_SF(X, LDR_LIT, LDR, UOP_ADDR_LIT, 0)                \
+    UOP_SF(X, LDR_POST, LDR, UOP_ADDR_POST, 0)              \
+    UOP_SF(X, LDR_PRE, LDR, UOP_ADDR_PRE, 0)                \
+    UOP_SF(X, LDR_UOFF, LDR, UOP_ADDR_UOFF, 0)              \
+    UOP_SF(X, LDR_REG_LSL, LDR, UOP_ADDR_REG_LSL, 0)        \
+    UOP_SF(X, LDR_REG_SXTX, LDR, UOP_ADDR_REG_SXTX, 0)      \
+    UOP_SF(X, STR_LIT, STR, UOP_ADDR_LIT, 0)                \
+    UOP_SF(X, STR_POST, STR, UOP_ADDR_POST, 0)              \
+    UOP_SF(X, STR_PRE, STR, UOP_ADDR_PRE, 0)                \
+    UOP_SF(X, STR_UOFF, STR, UOP_ADDR_UOFF, 0)              \
+    UOP_SF(X, STR_REG_LSL, STR, UOP_ADDR_REG_LSL, 0)        \
+    UOP_SF(X, STR_REG_SXTX, STR, UOP_ADDR_REG_SXTX, 0)      \
+    X(CONST, CONST, true, 0, 0)                             \
+    UOP_CMPB_FLAGS(X, CMP_IMM, 0)                           \
+    UOP_CMPB_FLAGS(X, CMN_IMM, UOP_CMPB_CMN)                \
+    UOP_CMPB_FLAGS(X, CMP_REG, UOP_CMPB_REG)                \
+    UOP_CMPB_FLAGS(X, CMN_REG, UOP_CMPB_CMN | UOP_CMPB_REG) \
+    UOP_CMPB_FLAGS(X, TST_REG, UOP_CMPB_TST | UOP_CMPB_REG)
+
+/*
+ * Superinstructions: runs of two or three uops whose kinds are all in
+ * `UOP_SUPER_A`, run by a single handler made of the fragments of their
+ * handlers (see `uop_exec.h`). Every such run has a kind, after
+ * `UOP_KIND_COUNT`: the pairs, then the triples, in alphabet order, e.g.
+ * `UOP_LDR_UOFF_64__ADD_IMM_64__STR_UOFF_64`. Engines pick which to use.
+ */
+#define UOP_SUPER_A(X, ...)         \
+    X(__VA_ARGS__, ADD_IMM_64)      \
+    X(__VA_ARGS__, SUB_IMM_64)      \
+    X(__VA_ARGS__, ADD_LSL_64)      \
+    X(__VA_ARGS__, MADD_64)         \
+    X(__VA_ARGS__, LDR_UOFF_64)     \
+    X(__VA_ARGS__, STR_UOFF_64)
+
+// Copies of `UOP_SUPER_A`, as a macro can't expand within itself
+#define UOP_SUPER_B(X, ...)         \
+    X(__VA_ARGS__, ADD_IMM_64)      \
+    X(__VA_ARGS__, SUB_IMM_64)      \
+    X(__VA_ARGS__, ADD_LSL_64)      \
+    X(__VA_ARGS__, MADD_64)         \
+    X(__VA_ARGS__, LDR_UOFF_64)     \
+    X(__VA_ARGS__, STR_UOFF_64)
+
+#define UOP_SUPER_C(X, ...)         \
+    X(__VA_ARGS__, ADD_IMM_64)      \
+    X(__VA_ARGS__, SUB_IMM_64)      \
+    X(__VA_ARGS__, ADD_LSL_64)      \
+    X(__VA_ARGS__, MADD_64)         \
+    X(__VA_ARGS__, LDR_UOFF_64)     \
+    X(__VA_ARGS__, STR_UOFF_64)
+
+#define UOP_SUPER_PAIRS(X2, K1) UOP_SUPER_B(X2, K1)
+#define UOP_SUPER_TRIPLES(X3, K1) UOP_SUPER_B(UOP_SUPER_TRIPLES_, X3, K1)
+#define UOP_SUPER_TRIPLES_(X3, K1, K2) UOP_SUPER_C(X3, K1, K2)
+
+/// @brief Every superinstruction, as X2(K1, K2) or X3(K1, K2, K3).
+#define UOP_SUPERS(X2, X3) \
+    UOP_SUPER_A(UOP_SUPER_PAIRS, X2) \
+    UOP_SUPER_A(UOP_SUPER_TRIPLES, X3)
+
+/// @brief How a load/store computes its address, in `UOP_KINDS` order.
+typedef enum {
+    UOP_ADDR_LIT,
+    UOP_ADDR_POST,
+    UOP_ADDR_PRE,
+    UOP_ADDR_UOFF,
+    UOP_ADDR_REG_LSL,
+    UOP_ADDR_REG_SXTX,
+}   uop_addr_t ;
+
+#define UOP_ENUM(KIND, FAMILY, SF, A, B) UOP_ ## KIND,
+#define UOP_SUPER2_ENUM(K1, K2) UOP_ ## K1 ## __ ## K2,
+#define UOP_SUPER3_ENUM(K1, K2, K3) UOP_ ## K1 ## __ ## K2 ## __ ## K3,
+
+typedef enum {
+    UOP_KINDS(UOP_ENUM)
+    UOP_KIND_COUNT,
+    UOP_SUPERS(UOP_SUPER2_ENUM, UOP_SUPER3_ENUM)
+    UOP_SUPER_END
+}   uop_kind ;
+
+#define UOP_SUPER_FIRST (UOP_KIND_COUNT + 1)
+#define UOP_SUPER_COUNT (UOP_SUPER_END - UOP_SUPER_FIRST)
+/// @brief The number of kinds in `UOP_SUPER_A`.
+#define UOP_SUPER_LETTERS 6
+
+/// @brief The handler families of `UOP_KINDS`.
+typedef enum {
+    UOP_FAM_DISPATCH, UOP_FAM_INTERP, UOP_FAM_HALT, UOP_FAM_NOP, UOP_FAM_END,
+    UOP_FAM_DP_IMM, UOP_FAM_DP_REG, UOP_FAM_MOV, UOP_FAM_MUL,
+    UOP_FAM_B, UOP_FAM_BR, UOP_FAM_BCOND, UOP_FAM_LDR, UOP_FAM_STR,
+    UOP_FAM_CONST, UOP_FAM_CMPB,
+}   uop_family ;
+
+/**
+ * @brief A kind's entry of `UOP_KINDS`: its handler is the `family` handler
+ * specialised on `sf`, `a` and `b`, e.g. a `dp_op` and a `shift_tp`.
+ */
+typedef struct uop_info {
+    uint8_t family ;
+    bool sf ;
+    uint8_t a, b ;
+}   uop_info_t ;
+
+extern const uop_info_t uop_info[UOP_KIND_COUNT] ;
+
+typedef struct uop {
+    /// @brief Where the engine running the uop jumps to execute it.
+    const void *handler ;
+    uint16_t kind ;
+    /// @brief Register slots; which are used depends on the kind.
+    uint8_t rd, rn, rm, ra ;
+    /// @brief The shift amount of a register operand, or of a `mov` immediate;
+    /// for `UOP_CONST`, the number of movks it covers.
+    uint8_t amount ;
+    /// @brief The shifted or bitmask immediate, signed offset or target address.
+    uint64_t imm ;
+}   uop_t ;
+
+/// @brief Whether uops of kind `k` are superinstructions.
+static inline
+bool uop_is_super(uop_kind k) {
+    return UOP_SUPER_FIRST <= k && k < UOP_SUPER_END ;
+}
+
+/// @brief True exactly when uops of kind `k` are branches.
+static inline
+bool uop_is_branch(uop_kind k) {
+    return k == UOP_B || k == UOP_BR || (UOP_B_EQ <= k && k <= UOP_B_LE)
+        || (UOP_CMP_IMM_B_EQ_32 <= k && k <= UOP_TST_REG_NF_B_LE_64) ;
+}
+
+/// @brief The most instructions a fused uop covers: a movz and three movks.
+#define UOP_FUSE_MAX 4
+
+/// @brief How often `uop_fuse` has fused each kind of pair.
+typedef struct uop_fuse_stats {
+    uint64_t cmp_branch ;
+    /// @brief Of `cmp_branch`, those fused without their flags.
+    uint64_t flags_dead ;
+    uint64_t constants ;
+    /// @brief Of `constants`, the instructions they cover.
+    uint64_t const_instrs ;
+}   uop_fuse_stats_t ;
+
+extern uop_fuse_stats_t uop_fuse_stats ;
+
+uop_kind uop_translate(uop_t *op, uint8_t flags, const instr_t *i) ;
+size_t uop_fuse(uop_t *ops, size_t n, bool flags_dead) ;
+size_t uop_len(const uop_t *op) ;
+int uop_super_letter(uop_kind k) ;
+uop_kind uop_super_kind(const uint16_t *kinds, size_t len) ;
+size_t uop_super_parts(uop_kind k, uint16_t *kinds) ;
+const char *show_uop_kind(uop_kind kind) ;
+
+#endif
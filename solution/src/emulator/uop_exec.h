@@ -0,0 +1,173 @@
+/**
+ * @file uop_exec.h
+ * @brief The handlers of every uop kind, shared by the engines that run uops.
+ *
+ * `UOP_KINDS(UOP_HANDLER)` expands to a labelled handler `h_<KIND>` for each
+ * kind, to be placed inside the engine's run function, which must have in
+ * scope `cpu`, its pstate `ps`, its register file `uint64_t *x`,
+ * `address_t pc` and the running `uop_t *op`, and labels `dispatch`,
+ * `step` (run the instruction at `pc` with `emulate_step`) and `halt`.
+ * Likewise `UOP_SUPERS(UOP_SUPER2_HANDLER, UOP_SUPER3_HANDLER)` for
+ * superinstructions, which run the uops after theirs as well.
+ *
+ * How control moves on is up to the engine, through the macros:
+ *  - RETIRE_N(k): `k` instructions are about to be executed.
+ *  - SKIP(k): continue with the uop of the instruction `k` on.
+ *  - TAKEN(target): a direct branch to `target` was taken.
+ *  - NOT_TAKEN: a conditional branch wasn't taken.
+ *  - JUMP_TO(target): an indirect branch to `target`.
+ *  - END_BLOCK: fall through from an `UOP_END`.
+ *  - AFTER_STORE: memory was just written, possibly over code.
+ */
+
+#ifndef __UOP_EXEC_H
+#define __UOP_EXEC_H
+
+#include "emulator/uop.h"
+#include "emulator/alu.h"
+#include "emulator/loader.h"
+
+/**
+ * @brief The target address of the load/store `op`, with addressing `mode`,
+ * writing back its base register for pre/post-indexing.
+ */
+static inline
+address_t ls_addr(uop_addr_t mode, const uop_t *op, uint64_t *x) {
+    address_t target ;
+    switch (mode) {
+    case UOP_ADDR_LIT: return op->imm ;
+    case UOP_ADDR_POST:
+        target = x[op->rn] ;
+        x[op->rn] = target + op->imm ;
+        return target ;
+    case UOP_ADDR_PRE:
+        target = x[op->rn] + op->imm ;
+        x[op->rn] = target ;
+        return target ;
+    case UOP_ADDR_UOFF: return x[op->rn] + op->imm ;
+    case UOP_ADDR_REG_LSL: return x[op->rn] + (x[op->rm] << op->amount) ;
+    case UOP_ADDR_REG_SXTX: return x[op->rn] + x[op->rm] ;
+    }
+    return 0 ;
+}
+
+#define RETIRE RETIRE_N(1)
+#define NEXT SKIP(1)
+
+/// @brief The value of slot `slot`, as a 32-bit register unless `SF`.
+#define READ(slot, SF) ((SF) ? x[slot] : x[slot] & 0xffffffff)
+/// @brief Write `val` to slot `slot`, as a 32-bit register unless `SF`.
+#define WRITE(slot, val, SF) do { \
+    uint64_t v_ = (val) ; \
+    x[slot] = (SF) ? v_ : v_ & 0xffffffff ; \
+} while (0)
+
+#define H_DISPATCH(SF, A, B) goto dispatch ;
+#define H_INTERP(SF, A, B) goto step ;
+#define H_HALT(SF, A, B) goto halt ;
+#define H_END(SF, A, B) END_BLOCK ;
+#define H_NOP(SF, A, B) RETIRE ; NEXT ;
+
+/*
+ * The fragments of the handlers: what a uop does, without retiring it or
+ * moving on, to be composed into superinstructions.
+ */
+#define F_DP_IMM(SF, OP, B) \
+    WRITE(op->rd, alu_dp(ps, OP, READ(op->rn, SF), op->imm), SF) ;
+
+#define F_DP_REG(SF, OP, SH) \
+    WRITE(op->rd, alu_dp(ps, OP, READ(op->rn, SF), \
+        alu_shift(SH, op->amount, READ(op->rm, SF), SF)), SF) ;
+
+#define F_MOV(SF, OP, B) \
+    WRITE(op->rd, alu_mov(OP, READ(op->rn, SF), op->imm, op->amount), SF) ;
+
+#define F_MUL(SF, OP, B) \
+    WRITE(op->rd, alu_mul(OP, READ(op->rn, SF), READ(op->rm, SF), READ(op->ra, SF)), SF) ;
+
+#define F_LDR(SF, MODE, B) { \
+    address_t a = ls_addr(MODE, op, x) ; \
+    WRITE(op->rd, get_dword(cpu, a), SF) ; \
+}
+
+#define F_STR(SF, MODE, B) { \
+    address_t a = ls_addr(MODE, op, x) ; \
+    set_dword(cpu, a, READ(op->rd, SF)) ; \
+    AFTER_STORE ; \
+}
+
+#define H_DP_IMM(SF, OP, B) RETIRE ; F_DP_IMM(SF, OP, B) NEXT ;
+#define H_DP_REG(SF, OP, SH) RETIRE ; F_DP_REG(SF, OP, SH) NEXT ;
+#define H_MOV(SF, OP, B) RETIRE ; F_MOV(SF, OP, B) NEXT ;
+#define H_MUL(SF, OP, B) RETIRE ; F_MUL(SF, OP, B) NEXT ;
+
+#define H_B(SF, A, B) RETIRE ; TAKEN(op->imm) ;
+#define H_BR(SF, A, B) RETIRE ; JUMP_TO(x[op->rn]) ;
+#define H_BCOND(SF, COND, B) \
+    RETIRE ; \
+    if (alu_cond(ps, COND)) TAKEN(op->imm) ; \
+    NOT_TAKEN ;
+
+#define H_CONST(SF, A, B) \
+    RETIRE_N(op->amount + 1) ; \
+    x[op->rd] = op->imm ; \
+    SKIP(op->amount + 1) ;
+
+/// The flags of a compare whose flags are dead are kept in a local
+#define H_CMPB(SF, COND, B) { \
+    RETIRE_N(2) ; \
+    pstate_t dead_ ; \
+    pstate_t *fp_ = (B) & UOP_CMPB_DEAD ? &dead_ : ps ; \
+    uint64_t b_ = (B) & UOP_CMPB_REG ? alu_shift(LSL, op->amount, READ(op->rm, SF), SF) : op->imm ; \
+    WRITE(op->rd, (B) & UOP_CMPB_TST ? alu_log(fp_, OP_ANDS, READ(op->rn, SF), b_) \
+        : alu_add(fp_, (B) & UOP_CMPB_CMN ? OP_ADDS : OP_SUBS, READ(op->rn, SF), b_), SF) ; \
+    pc += 4 ; \
+    op++ ; \
+    if (alu_cond(fp_, COND)) TAKEN(op->imm) ; \
+    NOT_TAKEN ; \
+}
+
+#define H_LDR(SF, MODE, B) RETIRE ; F_LDR(SF, MODE, B) NEXT ;
+#define H_STR(SF, MODE, B) RETIRE ; F_STR(SF, MODE, B) NEXT ;
+
+// The fragments of the kinds of `UOP_SUPER_A`
+#define F_ADD_IMM_64 F_DP_IMM(true, OP_ADD, 0)
+#define F_SUB_IMM_64 F_DP_IMM(true, OP_SUB, 0)
+#define F_ADD_LSL_64 F_DP_REG(true, OP_ADD, LSL)
+#define F_MADD_64 F_MUL(true, OP_MADD, 0)
+#define F_LDR_UOFF_64 F_LDR(true, UOP_ADDR_UOFF, 0)
+#define F_STR_UOFF_64 F_STR(true, UOP_ADDR_UOFF, 0)
+
+#define H_SUPER2(K1, K2) \
+    RETIRE_N(2) ; \
+    F_ ## K1 \
+    pc += 4 ; \
+    op++ ; \
+    F_ ## K2 \
+    NEXT ;
+
+#define H_SUPER3(K1, K2, K3) \
+    RETIRE_N(3) ; \
+    F_ ## K1 \
+    pc += 4 ; \
+    op++ ; \
+    F_ ## K2 \
+    pc += 4 ; \
+    op++ ; \
+    F_ ## K3 \
+    NEXT ;
+
+#define UOP_HANDLER(KIND, FAMILY, SF, A, B) h_ ## KIND: H_ ## FAMILY(SF, A, B)
+#define UOP_LABEL(KIND, FAMILY, SF, A, B) [UOP_ ## KIND] = &&h_ ## KIND,
+#define UOP_CASE(KIND, FAMILY, SF, A, B) case UOP_ ## KIND: goto h_ ## KIND ;
+
+#define UOP_SUPER2_HANDLER(K1, K2) h_ ## K1 ## __ ## K2: H_SUPER2(K1, K2)
+#define UOP_SUPER3_HANDLER(K1, K2, K3) h_ ## K1 ## __ ## K2 ## __ ## K3: H_SUPER3(K1, K2, K3)
+#define UOP_SUPER2_LABEL(K1, K2) [UOP_ ## K1 ## __ ## K2] = &&h_ ## K1 ## __ ## K2,
+#define UOP_SUPER3_LABEL(K1, K2, K3) \
+    [UOP_ ## K1 ## __ ## K2 ## __ ## K3] = &&h_ ## K1 ## __ ## K2 ## __ ## K3,
+#define UOP_SUPER2_CASE(K1, K2) case UOP_ ## K1 ## __ ## K2: goto h_ ## K1 ## __ ## K2 ;
+#define UOP_SUPER3_CASE(K1, K2, K3) \
+    case UOP_ ## K1 ## __ ## K2 ## __ ## K3: goto h_ ## K1 ## __ ## K2 ## __ ## K3 ;
+
+#endif
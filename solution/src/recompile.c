@@ -0,0 +1,79 @@
+#include <stdlib.h>
+
+#include "emulator/emulator.h"
+#include "emulator/loader.h"
+#include "emulator/aot.h"
+#include "utils/log.h"
+#include "utils/file.h"
+
+typedef struct arg_config {
+    char *src ;
+    char *dst ;
+    bool help ;
+}   arg_config ;
+
+static const char *options = "[-h] <binary> <output>";
+static const char *help =
+    "  -h: help (print this)\n"
+    "  <binary>: the file containing the binary to recompile\n"
+    "  <output>: the file to write the C recompilation to, to be built\n"
+    "      as a shared object and run with `emulate -a`\n" ;
+
+void parse_arg(int argc, char **args, int *argi, arg_config *cfg) {
+    char *arg = args[*argi] ;
+    if (arg[0] == '-') {
+        if (arg[1] == 'h') {
+            cfg->help = true ;
+        } else {
+            log_exit_failure("Unknown argument %s\n", arg) ;
+        }
+    } else {
+        if (cfg->src == NULL) {
+            cfg->src = arg ;
+        } else if (cfg->dst == NULL) {
+            cfg->dst = arg ;
+        } else {
+            log_exit_failure("Too many arguments\n") ;
+        }
+    }
+}
+
+void parse_args(int argc, char **argv, arg_config *cfg) {
+    if (argc < 2)
+        log_exit_failure("Usage: %s %s\n", argv[0], options);
+
+    for (int i = 1; i < argc; i++) {
+        parse_arg(argc, argv, &i, cfg) ;
+    }
+}
+
+int main(int argc, char **argv) {
+    set_log_level(LOG_1) ;
+    set_log_output(LOG_STDOUT) ;
+
+    arg_config cfg = {} ;
+    parse_args(argc, argv, &cfg) ;
+
+    if (cfg.help) {
+        printf("Usage: %s %s\n", argv[0], options) ;
+        printf("%s", help) ;
+        exit(EXIT_SUCCESS) ;
+    }
+    if (cfg.src == NULL || cfg.dst == NULL) log_exit_failure("Usage: %s %s\n", argv[0], options);
+
+    FILE *in = s_fopen(cfg.src, "rb", "binary file") ;
+    cpu_t *cpu = init_cpu(MAXIMUM_MEMORY_SIZE_BYTES) ;
+    size_t count = 0 ;
+    int load_result = load_bin(cpu->memory, in, &count) ;
+    fclose(in) ;
+    if (load_result == LOAD_FAIL)
+        log_exit_failure("Error: failed to load binary data from '%s'.\n", cfg.src) ;
+
+    FILE *out = s_fopen(cfg.dst, "w", "output file") ;
+    if (!aot_emit(out, cpu, count, cfg.src))
+        log_exit_failure("Error: '%s' has no code to recompile.\n", cfg.src) ;
+    fclose(out) ;
+    free_cpu(cpu) ;
+
+    return EXIT_SUCCESS ;
+}
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "emulator/state.h"
+#include "utils/log.h"
+
+typedef struct arg_config {
+    char *a ;
+    char *b ;
+    bool help ;
+    bool quiet ;
+    bool stats ;
+}   arg_config ;
+
+static const char *options = "[-(h|q|s)] <state> <state>";
+static const char *help =
+    "  -h: help (print this)\n"
+    "  -q: print nothing, only exit with the result\n"
+    "  -s: print how long the comparison took to stderr\n"
+    "  <state>: a final cpu state written by `emulate --format=bin`, or its\n"
+    "      text dump\n"
+    "Exits with 0 if the states are equal, 1 if they differ, and 2 if\n"
+    "either can't be read.\n" ;
+
+void parse_arg(int argc, char **args, int *argi, arg_config *cfg) {
+    char *arg = args[*argi] ;
+    if (arg[0] == '-') {
+        if (arg[1] == 'h') {
+            cfg->help = true ;
+        } else if (arg[1] == 'q') {
+            cfg->quiet = true ;
+        } else if (arg[1] == 's') {
+            cfg->stats = true ;
+        } else {
+            log_exit_failure("Unknown argument %s\n", arg) ;
+        }
+    } else {
+        if (cfg->a == NULL) {
+            cfg->a = arg ;
+        } else if (cfg->b == NULL) {
+            cfg->b = arg ;
+        } else {
+            log_exit_failure("Too many arguments\n") ;
+        }
+    }
+}
+
+void parse_args(int argc, char **argv, arg_config *cfg) {
+    if (argc < 2)
+        log_exit_failure("Usage: %s %s\n", argv[0], options);
+
+    for (int i = 1; i < argc; i++) {
+        parse_arg(argc, argv, &i, cfg) ;
+    }
+}
+
+/// @brief Read the state in the file `fname` into `s`, exiting with 2 if it can't be.
+static
+void read_state(char *fname, state_t *s) {
+    if (!state_read_file(fname, s)) {
+        fprintf(stderr, "Error: %s is not a final cpu state written by `emulate`.\n", fname) ;
+        exit(2) ;
+    }
+}
+
+static
+void print_pstate(uint32_t nzcv) {
+    printf("%c%c%c%c", nzcv & STATE_N ? 'N' : '-', nzcv & STATE_Z ? 'Z' : '-',
+           nzcv & STATE_C ? 'C' : '-', nzcv & STATE_V ? 'V' : '-') ;
+}
+
+/// @brief Print where `a` and `b` differ, as `state_compare` found.
+static
+void print_cmp(const state_t *a, const state_t *b, const state_cmp_t *cmp) {
+    for (size_t r = 0; r < STATE_N_REGS; r++) {
+        if (cmp->regs >> r & 1) printf("X%02zu    = %016lx != %016lx\n", r, a->regs[r], b->regs[r]) ;
+    }
+    if (cmp->pc) printf("PC     = %016lx != %016lx\n", a->pc, b->pc) ;
+    if (cmp->nzcv) {
+        printf("PSTATE : ") ;
+        print_pstate(a->nzcv) ;
+        printf(" != ") ;
+        print_pstate(b->nzcv) ;
+        printf("\n") ;
+    }
+    if (cmp->n_words)
+        printf("memory : differs in %zu words, the first at 0x%08lx\n", cmp->n_words, cmp->first_address) ;
+}
+
+int main(int argc, char **argv) {
+    set_log_level(LOG_1) ;
+    set_log_output(LOG_STDOUT) ;
+
+    arg_config cfg = {} ;
+    parse_args(argc, argv, &cfg) ;
+
+    if (cfg.help) {
+        printf("Usage: %s %s\n", argv[0], options) ;
+        printf("%s", help) ;
+        exit(EXIT_SUCCESS) ;
+    }
+    if (cfg.b == NULL) log_exit_failure("Usage: %s %s\n", argv[0], options);
+
+    state_t a, b ;
+    read_state(cfg.a, &a) ;
+    read_state(cfg.b, &b) ;
+
+    struct timespec start, end ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    state_cmp_t cmp ;
+    bool equal = state_compare(&a, &b, &cmp) ;
+    clock_gettime(CLOCK_MONOTONIC, &end) ;
+
+    if (cfg.stats) {
+        fprintf(stderr, "compared %zu and %zu words in %.1fus\n", a.n_words, b.n_words,
+                (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3) ;
+    }
+    if (!equal && !cfg.quiet) print_cmp(&a, &b, &cmp) ;
+    state_free(&a) ;
+    state_free(&b) ;
+    return equal ? EXIT_SUCCESS : EXIT_FAILURE ;
+}
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "emulator/state.h"
+#include "emulator/decoder/decode.h"
+#include "utils/log.h"
+#include "utils/outbuf.h"
+#include "utils/clock.h"
+
+typedef struct arg_config {
+    char *a ;
+    char *b ;
+    size_t max_words ;
+    bool help ;
+    bool stats ;
+}   arg_config ;
+
+static const char *options = "[-(h|s)] [-n <words>] <state> <state>";
+static const char *help =
+    "  -h: help (print this)\n"
+    "  -s: print how long reading, comparing and printing took to stderr\n"
+    "  -n <words>: print at most <words> of the words of each range of\n"
+    "      differing words (default 8)\n"
+    "  <state>: a final cpu state written by `emulate`, as text or with\n"
+    "      `--format=bin`\n"
+    "Prints the registers, PC and flags that differ, then each range of\n"
+    "addresses whose words differ, with the instructions the words decode\n"
+    "to. Exits with 0 if the states are equal, 1 if they differ, and 2 if\n"
+    "either can't be read.\n" ;
+
+void parse_arg(int argc, char **args, int *argi, arg_config *cfg) {
+    char *arg = args[*argi] ;
+    if (arg[0] == '-') {
+        if (arg[1] == 'h') {
+            cfg->help = true ;
+        } else if (arg[1] == 's') {
+            cfg->stats = true ;
+        } else if (arg[1] == 'n') {
+            if (++*argi >= argc) log_exit_failure("Missing number of words after %s\n", arg) ;
+            char *end ;
+            cfg->max_words = strtoull(args[*argi], &end, 0) ;
+            if (end == args[*argi] || *end != '\0') log_exit_failure("Invalid number of words %s\n", args[*argi]) ;
+        } else {
+            log_exit_failure("Unknown argument %s\n", arg) ;
+        }
+    } else {
+        if (cfg->a == NULL) {
+            cfg->a = arg ;
+        } else if (cfg->b == NULL) {
+            cfg->b = arg ;
+        } else {
+            log_exit_failure("Too many arguments\n") ;
+        }
+    }
+}
+
+void parse_args(int argc, char **argv, arg_config *cfg) {
+    if (argc < 2)
+        log_exit_failure("Usage: %s %s\n", argv[0], options);
+
+    for (int i = 1; i < argc; i++) {
+        parse_arg(argc, argv, &i, cfg) ;
+    }
+}
+
+/// @brief Read the state in the file `fname` into `s`, exiting with 2 if it can't be.
+static
+void read_state(char *fname, state_t *s) {
+    if (!state_read_file(fname, s)) {
+        fprintf(stderr, "Error: %s is not a final cpu state written by `emulate`.\n", fname) ;
+        exit(2) ;
+    }
+}
+
+static
+void print_pstate(uint32_t nzcv) {
+    printf("%c%c%c%c", nzcv & STATE_N ? 'N' : '-', nzcv & STATE_Z ? 'Z' : '-',
+           nzcv & STATE_C ? 'C' : '-', nzcv & STATE_V ? 'V' : '-') ;
+}
+
+/// @brief Print the registers, PC and flags where `a` and `b` differ, and how much memory, as `state_compare` found.
+static
+void print_cmp(const state_t *a, const state_t *b, const state_cmp_t *cmp) {
+    for (size_t r = 0; r < STATE_N_REGS; r++) {
+        if (cmp->regs >> r & 1) printf("X%02zu    = %016lx != %016lx\n", r, a->regs[r], b->regs[r]) ;
+    }
+    if (cmp->pc) printf("PC     = %016lx != %016lx\n", a->pc, b->pc) ;
+    if (cmp->nzcv) {
+        printf("PSTATE : ") ;
+        print_pstate(a->nzcv) ;
+        printf(" != ") ;
+        print_pstate(b->nzcv) ;
+        printf("\n") ;
+    }
+    if (cmp->n_words)
+        printf("memory : differs in %zu words, the first at 0x%08lx\n", cmp->n_words, cmp->first_address) ;
+}
+
+typedef struct diff_word {
+    address_t at ;
+    word32_t a ;
+    word32_t b ;
+}   diff_word_t ;
+
+/// @brief The range of consecutive differing words being found, and the first `max_words` of them.
+typedef struct diff_range {
+    outbuf_t *out ;
+    size_t max_words ;
+    diff_word_t *words ;
+    address_t start ;
+    /// @brief Past its last word.
+    address_t end ;
+    size_t n_words ;
+    size_t n_ranges ;
+}   diff_range_t ;
+
+/// @brief Add what `w` at `at` decodes to, or "-" if it isn't an instruction.
+static
+void put_instr(outbuf_t *b, word32_t w, address_t at) {
+    instr_t instr ;
+    if (!w || !decode_word(&instr, w, at)) {
+        outbuf_str(b, "-", 1) ;
+        return ;
+    }
+    char *s = show_instr(instr) ;
+    outbuf_str(b, s, strlen(s)) ;
+    free(s) ;
+}
+
+/**
+ * @brief Add the range of `d` and its words to its output, each with the
+ * instructions it decodes to in either state, when it does in one.
+ */
+static
+void put_range(diff_range_t *d) {
+    char *p = outbuf_reserve(d->out, 64) ;
+    p = FMT_LIT(p, "0x") ;
+    p = fmt_hex(p, d->start, 8) ;
+    p = FMT_LIT(p, "-0x") ;
+    p = fmt_hex(p, d->end - 1, 8) ;
+    p = FMT_LIT(p, " : ") ;
+    outbuf_commit(d->out, p) ;
+    char count[32] ;
+    int n = snprintf(count, sizeof(count), "%zu word%s\n", d->n_words, d->n_words == 1 ? "" : "s") ;
+    outbuf_str(d->out, count, n) ;
+
+    size_t shown = d->n_words < d->max_words ? d->n_words : d->max_words ;
+    for (size_t k = 0; k < shown; k++) {
+        diff_word_t *w = &d->words[k] ;
+        p = outbuf_reserve(d->out, 64) ;
+        p = FMT_LIT(p, "    0x") ;
+        p = fmt_hex(p, w->at, 8) ;
+        p = FMT_LIT(p, " : 0x") ;
+        p = fmt_hex(p, w->a, 8) ;
+        p = FMT_LIT(p, " != 0x") ;
+        p = fmt_hex(p, w->b, 8) ;
+        outbuf_commit(d->out, p) ;
+        instr_t instr ;
+        if ((w->a && decode_word(&instr, w->a, w->at)) || (w->b && decode_word(&instr, w->b, w->at))) {
+            outbuf_str(d->out, "    ", 4) ;
+            put_instr(d->out, w->a, w->at) ;
+            outbuf_str(d->out, " != ", 4) ;
+            put_instr(d->out, w->b, w->at) ;
+        }
+        outbuf_str(d->out, "\n", 1) ;
+    }
+    if (shown < d->n_words) {
+        n = snprintf(count, sizeof(count), "    ... %zu more\n", d->n_words - shown) ;
+        outbuf_str(d->out, count, n) ;
+    }
+    d->n_ranges++ ;
+    d->n_words = 0 ;
+}
+
+/// @brief Add the word at `at`, differing as `a` and `b`, to the range of the `diff_range_t` `ctx`, or start the next.
+static
+void diff_word(void *ctx, address_t at, word32_t a, word32_t b) {
+    diff_range_t *d = ctx ;
+    if (d->n_words && at != d->end) put_range(d) ;
+    if (!d->n_words) d->start = at ;
+    if (d->n_words < d->max_words) d->words[d->n_words] = (diff_word_t) {.at = at, .a = a, .b = b} ;
+    d->n_words++ ;
+    d->end = at + 4 ;
+}
+
+int main(int argc, char **argv) {
+    set_log_level(LOG_1) ;
+    set_log_output(LOG_STDOUT) ;
+
+    arg_config cfg = {.max_words = 8} ;
+    parse_args(argc, argv, &cfg) ;
+
+    if (cfg.help) {
+        printf("Usage: %s %s\n", argv[0], options) ;
+        printf("%s", help) ;
+        exit(EXIT_SUCCESS) ;
+    }
+    if (cfg.b == NULL) log_exit_failure("Usage: %s %s\n", argv[0], options);
+
+    struct timespec start ;
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    state_t a, b ;
+    read_state(cfg.a, &a) ;
+    read_state(cfg.b, &b) ;
+    double read_ms = seconds_since(&start) * 1e3 ;
+
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    state_cmp_t cmp ;
+    bool equal = state_compare(&a, &b, &cmp) ;
+    double compare_ms = seconds_since(&start) * 1e3 ;
+
+    clock_gettime(CLOCK_MONOTONIC, &start) ;
+    diff_range_t d = {.max_words = cfg.max_words} ;
+    if (!equal) {
+        print_cmp(&a, &b, &cmp) ;
+        outbuf_t out ;
+        outbuf_init(&out, stdout, OUTBUF_CAPACITY) ;
+        d.out = &out ;
+        d.words = malloc((cfg.max_words ? cfg.max_words : 1) * sizeof(diff_word_t)) ;
+        if (!d.words) log_exit_failure("Failed to allocate %zu words\n", cfg.max_words) ;
+        state_diff_words(&a, &b, diff_word, &d) ;
+        if (d.n_words) put_range(&d) ;
+        outbuf_close(&out) ;
+        free(d.words) ;
+    }
+    double print_ms = seconds_since(&start) * 1e3 ;
+
+    if (cfg.stats) {
+        fprintf(stderr, "read %zu and %zu words in %.2fms, compared them in %.3fms, printed %zu ranges in %.2fms\n",
+                a.n_words, b.n_words, read_ms, compare_ms, d.n_ranges, print_ms) ;
+    }
+    state_free(&a) ;
+    state_free(&b) ;
+    return equal ? EXIT_SUCCESS : EXIT_FAILURE ;
+}
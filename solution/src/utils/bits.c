@@ -1,16 +1,63 @@
 #include "utils/bits.h"
+#include "utils/dispatch.h"
 
-void set_bits_at(word32_t *dest, bit_index low_idx, uint32_t val) {
-    *dest |= (val << low_idx) ;
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BITS_HAVE_BMI2
+#endif
+
+typedef bits_t (*extract_fn)(word32_t c, word32_t mask) ;
+typedef word32_t (*deposit_fn)(bits_t v, word32_t mask) ;
+
+static bits_t portable_extract(word32_t c, word32_t mask) {
+    bits_t r = 0 ;
+    for (bits_t bit = 1; mask; bit <<= 1, mask &= mask - 1) {
+        if (c & mask & -mask) r |= bit ;
+    }
+    return r ;
+}
+
+static word32_t portable_deposit(bits_t v, word32_t mask) {
+    word32_t r = 0 ;
+    for (bits_t bit = 1; mask; bit <<= 1, mask &= mask - 1) {
+        if (v & bit) r |= mask & -mask ;
+    }
+    return r ;
+}
+
+#ifdef BITS_HAVE_BMI2
+__attribute__((target("bmi2")))
+static bits_t bmi2_extract(word32_t c, word32_t mask) {
+    return _pext_u32(c, mask) ;
+}
+
+__attribute__((target("bmi2")))
+static word32_t bmi2_deposit(bits_t v, word32_t mask) {
+    return _pdep_u32(v, mask) ;
+}
+
+static dispatch_t extract = DISPATCH_INIT(portable_extract, bmi2_extract, cpu_has_bmi2) ;
+static dispatch_t deposit = DISPATCH_INIT(portable_deposit, bmi2_deposit, cpu_has_bmi2) ;
+#else
+static dispatch_t extract = DISPATCH_INIT(portable_extract, NULL, NULL) ;
+static dispatch_t deposit = DISPATCH_INIT(portable_deposit, NULL, NULL) ;
+#endif
+
+bits_impl_e bits_impl(void) {
+    return dispatch_impl(&extract) ;
+}
+
+/// @brief Switches both `bits_extract` and `bits_deposit` to `impl`.
+bool bits_use_impl(bits_impl_e impl) {
+    return dispatch_use(&extract, impl) && dispatch_use(&deposit, impl) ;
 }
 
-void set_bit_at(word32_t *dest, bit_index idx, bool val) {
-    *dest ^= (-(bool_to_bit(val)) ^ *dest) & (1 << idx) ; 
-    // (bool_to_bit(val) << idx) ;
+bits_t bits_extract(word32_t c, word32_t mask) {
+    return ((extract_fn) dispatch_get(&extract))(c, mask) ;
 }
 
-bits_t bits_at(word32_t c, bit_index high, bit_index low) {
-    return (c >> low) & BIT_MASK(high - low + 1) ;
+word32_t bits_deposit(bits_t v, word32_t mask) {
+    return ((deposit_fn) dispatch_get(&deposit))(v, mask) ;
 }
 
 bit_t bit_at(word32_t c, bit_index idx) {
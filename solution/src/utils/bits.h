@@ -15,16 +15,50 @@ typedef uint32_t bits_t ;
 
 int64_t sign_extend(uint64_t val, size_t bit_size, size_t new_size) ;
 
-void set_bits_at(word32_t *, bit_index, bits_t) ;
-// bit_t bool_to_bit(bool) ;
-void set_bit_at(word32_t *, bit_index, bit_t) ;
+/**
+ * @brief The implementations of `bits_extract` and `bits_deposit`, picked
+ * once per process: BMI2's PEXT and PDEP where the CPU has them, a loop
+ * over the mask's bits otherwise.
+ */
+typedef enum bits_impl {
+    BITS_IMPL_PORTABLE,
+    BITS_IMPL_BMI2,
+}   bits_impl_e ;
 
-bits_t bits_at(word32_t c, bit_index high, bit_index low) ;
-bit_t bit_at(word32_t c, bit_index idx) ;
-bit_t ensure_bit(bit_t b) ;
+bits_impl_e bits_impl(void) ;
+bool bits_use_impl(bits_impl_e impl) ;
 
+/// @brief The bits of `c` under `mask`, packed down from bit 0 (PEXT).
+bits_t bits_extract(word32_t c, word32_t mask) ;
+/// @brief The low bits of `v` spread, in order, over the bits of `mask` (PDEP).
+word32_t bits_deposit(bits_t v, word32_t mask) ;
+
+// bit_t bool_to_bit(bool) ;
 #define bool_to_bit(b) (!!b)
 // ensure_bit(b)
 
+/*
+ * The field helpers are shifts and masks, inline: a field's bounds are
+ * usually constants, which PEXT and PDEP, behind a call, can't beat.
+ */
+
+static inline
+void set_bits_at(word32_t *dest, bit_index low_idx, bits_t val) {
+    *dest |= (val << low_idx) ;
+}
+
+static inline
+void set_bit_at(word32_t *dest, bit_index idx, bit_t val) {
+    *dest ^= (-(bool_to_bit(val)) ^ *dest) & (1 << idx) ;
+}
+
+static inline
+bits_t bits_at(word32_t c, bit_index high, bit_index low) {
+    return (c >> low) & BIT_MASK(high - low + 1) ;
+}
+
+bit_t bit_at(word32_t c, bit_index idx) ;
+bit_t ensure_bit(bit_t b) ;
+
 bool bit_at_is(word32_t c, bit_index idx, bit_t b) ;
 #endif
\ No newline at end of file
@@ -0,0 +1,19 @@
+/**
+ * @file clock.h
+ * @brief Timing a stretch of code, as the stats and the benchmarks do.
+ */
+
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+#include <time.h>
+
+/// @brief The seconds since `start`, both read from `CLOCK_MONOTONIC`.
+static inline
+double seconds_since(const struct timespec *start) {
+    struct timespec end ;
+    clock_gettime(CLOCK_MONOTONIC, &end) ;
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9 ;
+}
+
+#endif
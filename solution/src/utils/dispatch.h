@@ -0,0 +1,85 @@
+/**
+ * @file dispatch.h
+ * @brief Picking, once per process, between the portable implementation of
+ * a routine and one using a CPU extension, such as AVX2 or BMI2.
+ *
+ * A `dispatch_t` holds the implementation in use: the one a caller pinned
+ * with `dispatch_use`, or else the extension's, when the CPU has it, else
+ * the portable one, picked by the first `dispatch_get`. Threads may make
+ * that first call at once, so the pointer is atomic; its loads and stores
+ * are relaxed, as the implementations compute the same results and there
+ * is nothing else to publish with them.
+ */
+
+#ifndef __DISPATCH_H
+#define __DISPATCH_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define DISPATCH_HAVE_X86
+#endif
+
+/// @brief Any implementation, cast back to its own type to be called.
+typedef void (*dispatch_fn)(void) ;
+
+/// @brief The indices of the implementations, as the `*_impl_e` enums number them.
+#define DISPATCH_PORTABLE 0
+#define DISPATCH_NATIVE 1
+
+typedef struct dispatch {
+    /// @brief The implementation in use, NULL until one is picked.
+    _Atomic dispatch_fn fn ;
+    /// @brief The portable implementation, then the extension's, NULL where it isn't built.
+    dispatch_fn impls[2] ;
+    /// @brief Whether the CPU can run the extension's implementation.
+    bool (*supported)(void) ;
+}   dispatch_t ;
+
+/// @brief A `dispatch_t` between `portable` and `native`, which runs where `cpu_has()`.
+#define DISPATCH_INIT(portable, native, cpu_has) \
+    { .impls = {(dispatch_fn) (portable), (dispatch_fn) (native)}, .supported = (cpu_has) }
+
+/**
+ * @brief Switches `d` to its implementation `impl`.
+ * @return false, leaving `d` as it was, when the CPU can't run `impl`.
+ */
+static inline
+bool dispatch_use(dispatch_t *d, int impl) {
+    if (impl != DISPATCH_PORTABLE && (impl != DISPATCH_NATIVE || !d->impls[impl] || !d->supported())) return false ;
+    atomic_store_explicit(&d->fn, d->impls[impl], memory_order_relaxed) ;
+    return true ;
+}
+
+/// @brief The implementation of `d` in use, picking one on the first call.
+static inline
+dispatch_fn dispatch_get(dispatch_t *d) {
+    dispatch_fn fn = atomic_load_explicit(&d->fn, memory_order_relaxed) ;
+    if (fn) return fn ;
+    if (!dispatch_use(d, DISPATCH_NATIVE)) dispatch_use(d, DISPATCH_PORTABLE) ;
+    return atomic_load_explicit(&d->fn, memory_order_relaxed) ;
+}
+
+/// @brief The index of the implementation of `d` in use.
+static inline
+int dispatch_impl(dispatch_t *d) {
+    return dispatch_get(d) == d->impls[DISPATCH_PORTABLE] ? DISPATCH_PORTABLE : DISPATCH_NATIVE ;
+}
+
+#ifdef DISPATCH_HAVE_X86
+static inline
+bool cpu_has_avx2(void) {
+    __builtin_cpu_init() ;
+    return __builtin_cpu_supports("avx2") ;
+}
+
+static inline
+bool cpu_has_bmi2(void) {
+    __builtin_cpu_init() ;
+    return __builtin_cpu_supports("bmi2") ;
+}
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "utils/outbuf.h"
+#include "utils/log.h"
+
+#define P(n) {"0123456789abcdef"[(n) >> 4], "0123456789abcdef"[(n) & 0xf]}
+#define P4(n) P(n), P(n + 1), P(n + 2), P(n + 3)
+#define P16(n) P4(n), P4(n + 4), P4(n + 8), P4(n + 12)
+#define P64(n) P16(n), P16(n + 16), P16(n + 32), P16(n + 48)
+
+const char fmt_hex_pairs[256][2] = {P64(0), P64(64), P64(128), P64(192)} ;
+
+/// @brief Start an empty buffer of `cap` bytes for `out`.
+void outbuf_init(outbuf_t *b, FILE *out, size_t cap) {
+    b->data = malloc(cap) ;
+    if (!b->data) log_exit_failure("Failed to allocate an output buffer of %zu bytes", cap) ;
+    b->len = 0 ;
+    b->cap = cap ;
+    b->out = out ;
+}
+
+/**
+ * @brief Write the contents of `b` to its stream's file descriptor, after
+ * what the stream buffers itself, and empty it. Streams without a file
+ * descriptor are written through stdio.
+ * @return false if the write failed; the contents are dropped either way.
+ */
+bool outbuf_flush(outbuf_t *b) {
+    bool ok = true ;
+    if (b->len) {
+        fflush(b->out) ;
+        int fd = fileno(b->out) ;
+        if (fd < 0) {
+            ok = fwrite(b->data, 1, b->len, b->out) == b->len ;
+        } else {
+            const char *p = b->data ;
+            for (size_t left = b->len; left > 0; ) {
+                ssize_t n = write(fd, p, left) ;
+                if (n < 0 && errno == EINTR) continue ;
+                if (n < 0) {
+                    ok = false ;
+                    break ;
+                }
+                p += n ;
+                left -= n ;
+            }
+        }
+    }
+    b->len = 0 ;
+    return ok ;
+}
+
+/// @brief Flush `b` and free its buffer.
+bool outbuf_close(outbuf_t *b) {
+    bool ok = outbuf_flush(b) ;
+    free(b->data) ;
+    b->data = NULL ;
+    return ok ;
+}
+
+/// @brief Add the `n` bytes of `s`, which may be more than `b` holds.
+void outbuf_str(outbuf_t *b, const char *s, size_t n) {
+    while (n > 0) {
+        size_t room = b->cap - b->len ;
+        if (room == 0) {
+            outbuf_flush(b) ;
+            room = b->cap ;
+        }
+        size_t k = n < room ? n : room ;
+        memcpy(b->data + b->len, s, k) ;
+        b->len += k ;
+        s += k ;
+        n -= k ;
+    }
+}
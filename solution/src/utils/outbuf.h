@@ -0,0 +1,107 @@
+/**
+ * @file outbuf.h
+ * @brief Formatting text a field at a time, into one large buffer written out at once.
+ *
+ * The emulator's dumps are many short lines of a fixed shape, mostly hex.
+ * The `fmt_` helpers write such fields into any buffer, the hex two digits
+ * a table lookup, and return the end of what they wrote. An `outbuf_t`
+ * collects lines in a buffer of `OUTBUF_CAPACITY` bytes, written to its
+ * stream's file descriptor with one `write` when full or flushed, in place
+ * of a `fprintf` a line.
+ */
+
+#ifndef __OUTBUF_H
+#define __OUTBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "wrapper/io.h"
+
+#define OUTBUF_CAPACITY (1 << 20)
+
+typedef struct outbuf {
+    char *data ;
+    size_t len ;
+    size_t cap ;
+    /// @brief The stream written to; what it buffers itself is flushed first, to keep the order.
+    FILE *out ;
+}   outbuf_t ;
+
+void outbuf_init(outbuf_t *b, FILE *out, size_t cap) ;
+bool outbuf_flush(outbuf_t *b) ;
+bool outbuf_close(outbuf_t *b) ;
+
+/// @brief The two lowercase hex digits of each byte.
+extern const char fmt_hex_pairs[256][2] ;
+
+/// @brief The number of hex digits of `v`, at least one.
+static inline
+size_t fmt_hex_len(uint64_t v) {
+    return v ? (67 - __builtin_clzll(v)) / 4 : 1 ;
+}
+
+/// @brief Writes `v` in hex to `dst`, zero padded to at least `digits` digits, like `%0*lx`.
+static inline
+char *fmt_hex(char *dst, uint64_t v, size_t digits) {
+    size_t len = fmt_hex_len(v) ;
+    char *end = dst + (len > digits ? len : digits) ;
+    char *p = end ;
+    for (; p - dst >= 2; v >>= 8) {
+        p -= 2 ;
+        memcpy(p, fmt_hex_pairs[v & 0xff], 2) ;
+    }
+    if (p > dst) *--p = fmt_hex_pairs[v & 0xf][1] ;
+    return end ;
+}
+
+/// @brief Writes `v` in hex to `dst`, space padded to at least `width` characters, like `%*lx`.
+static inline
+char *fmt_hex_pad(char *dst, uint64_t v, size_t width) {
+    size_t len = fmt_hex_len(v) ;
+    if (width > len) {
+        memset(dst, ' ', width - len) ;
+        dst += width - len ;
+    }
+    return fmt_hex(dst, v, len) ;
+}
+
+/// @brief Writes the two decimal digits of `v`, below 100, like `%02d`.
+static inline
+char *fmt_dec2(char *dst, unsigned v) {
+    dst[0] = '0' + v / 10 ;
+    dst[1] = '0' + v % 10 ;
+    return dst + 2 ;
+}
+
+static inline
+char *fmt_str(char *dst, const char *s, size_t n) {
+    memcpy(dst, s, n) ;
+    return dst + n ;
+}
+
+/// @brief Writes the string literal `s`, which must be a literal: its length is its `sizeof`.
+#define FMT_LIT(dst, s) fmt_str(dst, s, sizeof(s) - 1)
+
+/**
+ * @brief Room for `n` more bytes at the end of `b`, flushing it first if
+ * there isn't; `n` is at most its capacity. What is written there is added
+ * by `outbuf_commit`.
+ */
+static inline
+char *outbuf_reserve(outbuf_t *b, size_t n) {
+    if (b->len + n > b->cap) outbuf_flush(b) ;
+    return b->data + b->len ;
+}
+
+/// @brief Adds what was written from `outbuf_reserve` up to `end`.
+static inline
+void outbuf_commit(outbuf_t *b, char *end) {
+    b->len = end - b->data ;
+}
+
+void outbuf_str(outbuf_t *b, const char *s, size_t n) ;
+
+#endif
@@ -174,7 +174,7 @@ def emulate_individual(fname):
         res = emulate(fname, path_emulate)
         #if no error
         if res[0] == False:
-            return render_template('emulate_individual.html', results = res[1], fname = fname, actual_output = res[3], expected_output = res[2], title = fname + ' Emulator Results')
+            return render_template('emulate_individual.html', results = res[1], fname = fname, actual_output = res[3], expected_output = res[2], diff = res[4], title = fname + ' Emulator Results')
         else:
             return render_template('emulate_individual.html', execution_error = res[0], result = res[1], fname=fname, title = fname + ' Emulator Execution Error')
 